@@ -4,3 +4,12 @@ struct hitPayload {
   vec4 hitValue;
 };
 
+
+// inverse of encode_normal in vertex_layout.cpp, e is in [-1, 1] square
+vec3 octahedral_decode(vec2 e) {
+  vec3  n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
@@ -33,6 +33,14 @@ START_BINDING(SharedBindings)
   total = 7
 END_BINDING();
 
+// scene_description::vertex_layout, same values as whim::vertex_layout_t
+START_BINDING(VertexLayouts)
+  VertexLayoutSeparate = 0,
+  VertexLayoutInterleaved = 1,
+  VertexLayoutCompressed = 2,
+  VertexLayoutQuantized = 3
+END_BINDING();
+
 // clang-format on
 
 struct vertex {
@@ -41,6 +49,21 @@ struct vertex {
   vec2 texture;
 };
 
+// normal is octahedral encoded as two snorm16, uv is two half floats
+struct compressed_vertex {
+  vec3 pos;
+  uint normal;
+  uint uv;
+};
+
+// position is four snorm16 (w is unused), dequantized with primitive_shader_info
+struct quantized_vertex {
+  uint pos_xy;
+  uint pos_zw;
+  uint normal;
+  uint uv;
+};
+
 struct sphere_t {
   vec3  center;
   float radius;
@@ -63,18 +86,28 @@ struct material {
 };
 
 struct scene_description {
+  // separate layout only
   uint64_t pos_address;
   uint64_t normal_address;
   uint64_t uv_address;
+  // array of vertex, compressed_vertex or quantized_vertex, other layouts only
+  uint64_t vertex_address;
   uint64_t index_address;
   uint64_t material_address;
   uint64_t prim_info_address;
+  // uint primitive index per blas geometry of every tlas instance, instance custom index points to its first geometry,
+  // so primitive of a hit is geometry_primitives[gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT]
+  uint64_t geometry_address;
+  uint     vertex_layout;
 };
 
 struct primitive_shader_info {
   uint index_offset;
   uint vertex_offset;
   int  material_index;
+  // quantized layout: object space position = snorm position * dequantize_scale + dequantize_offset
+  vec3 dequantize_scale;
+  vec3 dequantize_offset;
 };
 
 struct global_ubo {
@@ -87,6 +120,12 @@ struct global_ubo {
 struct push_constant_t {
   mat4 mvp;
   uint frame;
+  // relative standard error of pixel luminance above which pixel counts as noisy, 0 - noise is not estimated
+  float    noise_threshold;
+  // running mean of luminance and squared luminance per pixel, 0 - not tracked
+  uint64_t moments_address;
+  // single uint incremented for every noisy pixel
+  uint64_t noisy_pixels_address;
 };
 
 #ifdef __cplusplus
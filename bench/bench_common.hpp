@@ -0,0 +1,61 @@
+#pragma once
+
+#include <charconv>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+#include "gltf_loader.hpp"
+#include "obj_loader.hpp"
+#include "scene.hpp"
+#include "utility/log.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/types.hpp"
+
+namespace whim::bench {
+
+struct triangle_soup_t {
+  std::vector<glm::vec3> positions{};
+  std::vector<u32>       indices{};
+};
+
+/*
+  number argument of command line option, exits on garbage
+*/
+inline u32 parse_u32(std::string_view str) {
+  u32 value         = 0;
+  auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (error != std::errc{} || end != str.data() + str.size()) {
+    fmt::println(stderr, "invalid number '{}', see --help", str);
+    std::exit(EXIT_FAILURE);
+  }
+  return value;
+}
+
+/*
+  loads gltf or obj scene and flattens it: every node gets its own copy of primitive vertices in world space,
+  indices are rebased onto them
+*/
+inline triangle_soup_t load_scene(std::string_view path, ThreadPool &pool) {
+  scene_data_t scene{};
+  if (path.ends_with(".obj")) {
+    load_obj(path, scene, pool, { .use_scene_cache = true });
+  } else {
+    load_gltf(path, scene, pool, { .use_scene_cache = true });
+  }
+
+  triangle_soup_t soup{};
+  for (auto const &node : scene.nodes) {
+    auto const &info = scene.primitive_infos[node.primitive_mesh];
+    u32         base = (u32) soup.positions.size();
+    for (u32 i = 0; i < info.vertex_count; i += 1) {
+      soup.positions.push_back(glm::vec3(node.world_matrix * glm::vec4(scene.positions[info.vertex_offset + i], 1.f)));
+    }
+    for (u32 i = 0; i < info.index_count; i += 1) {
+      soup.indices.push_back(base + scene.indices[info.index_offset + i]);
+    }
+  }
+  return soup;
+}
+
+} // namespace whim::bench
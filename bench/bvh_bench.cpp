@@ -0,0 +1,137 @@
+/*
+  BVH builder benchmark
+
+  builds whim::bvh over a gltf scene (all nodes flattened to world space) or over random triangles,
+  once serially and once on all threads, and prints build speed and tree quality
+*/
+
+#include <chrono>
+#include <random>
+#include <string_view>
+#include <thread>
+
+#include "bench_common.hpp"
+#include "bvh/bvh.hpp"
+#include "utility/log.hpp"
+#include "utility/thread_pool.hpp"
+
+namespace {
+
+using namespace whim;
+using bench::parse_u32;
+using bench::triangle_soup_t;
+
+constexpr std::string_view usage = R"(usage: bvh_bench [options]
+  --scene <path>      gltf scene, its nodes are flattened into one triangle soup
+  --triangles <n>     random triangles when no scene is given (default 1000000)
+  --threads <n>       threads of parallel build (default all)
+  --bins <n>          SAH bins per axis, 2..32 (default 16)
+  --leaf <n>          max primitives per leaf (default 4)
+  --repeat <n>        builds per configuration, best time is reported (default 3))";
+
+struct bench_options_t {
+  std::string_view scene_path = {};
+  u32              triangles  = 1'000'000;
+  u32              threads    = 0;
+  u32              repeat     = 3;
+
+  bvh::build_options_t build = {};
+};
+
+bench_options_t parse_options(int argc, char** argv) {
+  bench_options_t options{};
+  for (int i = 1; i < argc; i += 1) {
+    std::string_view arg   = argv[i];
+    std::string_view value = i + 1 < argc ? argv[i + 1] : std::string_view{};
+
+    if (arg == "--help") {
+      fmt::println("{}", usage);
+      std::exit(EXIT_SUCCESS);
+    } else if (arg == "--scene") {
+      options.scene_path = value;
+    } else if (arg == "--triangles") {
+      options.triangles = parse_u32(value);
+    } else if (arg == "--threads") {
+      options.threads = parse_u32(value);
+    } else if (arg == "--bins") {
+      options.build.bin_count = parse_u32(value);
+    } else if (arg == "--leaf") {
+      options.build.max_leaf_size = parse_u32(value);
+    } else if (arg == "--repeat") {
+      options.repeat = std::max(1u, parse_u32(value));
+    } else {
+      fmt::println(stderr, "unknown option '{}'\n{}", arg, usage);
+      std::exit(EXIT_FAILURE);
+    }
+    i += 1;
+  }
+  return options;
+}
+
+/*
+  small triangles spread uniformly in unit cube
+*/
+triangle_soup_t random_triangles(u32 count) {
+  std::mt19937                        rng{ 42 };
+  std::uniform_real_distribution<f32> position{ 0.f, 1.f };
+  std::uniform_real_distribution<f32> offset{ -0.01f, 0.01f };
+
+  triangle_soup_t soup{};
+  soup.positions.reserve((usize) count * 3);
+  soup.indices.reserve((usize) count * 3);
+  for (u32 i = 0; i < count; i += 1) {
+    glm::vec3 center{ position(rng), position(rng), position(rng) };
+    for (u32 corner = 0; corner < 3; corner += 1) {
+      soup.indices.push_back((u32) soup.positions.size());
+      soup.positions.push_back(center + glm::vec3{ offset(rng), offset(rng), offset(rng) });
+    }
+  }
+  return soup;
+}
+
+f64 best_build_ms(triangle_soup_t const &soup, ThreadPool* pool, bench_options_t const &options, bvh::Bvh &result) {
+  f64 best_ms = std::numeric_limits<f64>::max();
+  for (u32 i = 0; i < options.repeat; i += 1) {
+    auto start = std::chrono::steady_clock::now();
+    result     = bvh::Bvh::build_triangles(soup.positions, soup.indices, pool, options.build);
+    best_ms    = std::min(best_ms, std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best_ms;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench_options_t options = parse_options(argc, argv);
+
+  u32        thread_count = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+  ThreadPool pool{ thread_count - 1 };
+
+  triangle_soup_t soup           = options.scene_path.empty() ? random_triangles(options.triangles) : bench::load_scene(options.scene_path, pool);
+  u32             triangle_count = (u32) (soup.indices.size() / 3);
+  if (triangle_count == 0) {
+    WERROR("nothing to build: {} has no triangles", options.scene_path);
+    return EXIT_FAILURE;
+  }
+
+  bvh::Bvh tree{};
+  f64      serial_ms   = best_build_ms(soup, nullptr, options, tree);
+  f64      parallel_ms = best_build_ms(soup, &pool, options, tree);
+
+  bvh::metrics_t metrics = tree.metrics(options.build);
+
+  fmt::println("triangles:        {}", triangle_count);
+  fmt::println("serial build:     {:.2f} ms ({:.2f} Mtris/s)", serial_ms, triangle_count / serial_ms / 1e3);
+  fmt::println(
+      "parallel build:   {:.2f} ms ({:.2f} Mtris/s) on {} threads, {:.2f}x", //
+      parallel_ms, triangle_count / parallel_ms / 1e3, thread_count, serial_ms / parallel_ms
+  );
+  fmt::println("SAH cost:         {:.2f}", metrics.sah_cost);
+  fmt::println("nodes:            {} ({} leaves, {:.2f} MB)", metrics.node_count, metrics.leaf_count, (f64) metrics.memory_bytes / (1024.0 * 1024.0));
+  fmt::println("depth:            max {}, average leaf {:.2f}", metrics.max_depth, metrics.average_leaf_depth);
+  fmt::println("leaf sizes:");
+  for (u32 size = 1; size < metrics.leaf_size_histogram.size(); size += 1) {
+    fmt::println("  {:>3}: {}", size, metrics.leaf_size_histogram[size]);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/*
+  OBJ import benchmark
+
+  parses an obj scene with plain serial tinyobjloader (reference) and with whim::load_obj on one and on all threads,
+  scene cache is not used. prints text throughput of parsing and of whole import without texture decoding
+*/
+
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <string_view>
+#include <thread>
+
+#include "tiny_obj_loader.h"
+
+#include "bench_common.hpp"
+#include "obj_loader.hpp"
+#include "utility/log.hpp"
+#include "utility/thread_pool.hpp"
+
+namespace {
+
+using namespace whim;
+using bench::parse_u32;
+
+constexpr std::string_view usage = R"(usage: obj_bench [options]
+  --scene <path>      obj scene (default ../assets/obj/Medieval_building.obj)
+  --threads <n>       threads of parallel import (default all)
+  --repeat <n>        imports per configuration, best time is reported (default 3))";
+
+struct bench_options_t {
+  std::string_view scene_path = "../assets/obj/Medieval_building.obj";
+  u32              threads    = 0;
+  u32              repeat     = 3;
+};
+
+bench_options_t parse_options(int argc, char** argv) {
+  bench_options_t options{};
+  for (int i = 1; i < argc; i += 1) {
+    std::string_view arg   = argv[i];
+    std::string_view value = i + 1 < argc ? argv[i + 1] : std::string_view{};
+
+    if (arg == "--help") {
+      fmt::println("{}", usage);
+      std::exit(EXIT_SUCCESS);
+    } else if (arg == "--scene") {
+      options.scene_path = value;
+    } else if (arg == "--threads") {
+      options.threads = parse_u32(value);
+    } else if (arg == "--repeat") {
+      options.repeat = std::max(1u, parse_u32(value));
+    } else {
+      fmt::println(stderr, "unknown option '{}'\n{}", arg, usage);
+      std::exit(EXIT_FAILURE);
+    }
+    i += 1;
+  }
+  return options;
+}
+
+f64 best_tinyobj_ms(bench_options_t const &options) {
+  f64 best_ms = std::numeric_limits<f64>::max();
+  for (u32 i = 0; i < options.repeat; i += 1) {
+    tinyobj::ObjReaderConfig config{};
+    config.mtl_search_path = std::filesystem::path(options.scene_path).parent_path().string();
+
+    tinyobj::ObjReader reader{};
+    auto               start = std::chrono::steady_clock::now();
+    if (not reader.ParseFromFile(std::string(options.scene_path), config)) {
+      WERROR("tinyobjloader failed to parse {}: {}", options.scene_path, reader.Error());
+      std::exit(EXIT_FAILURE);
+    }
+    best_ms = std::min(best_ms, std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best_ms;
+}
+
+/*
+  stats of the fastest import
+*/
+obj_load_stats_t best_import(ThreadPool &pool, bench_options_t const &options) {
+  obj_load_stats_t best{};
+  best.parse_ms = std::numeric_limits<f64>::max();
+  for (u32 i = 0; i < options.repeat; i += 1) {
+    scene_data_t     scene{};
+    obj_load_stats_t stats = load_obj(options.scene_path, scene, pool, { .use_scene_cache = false });
+    if (stats.parse_ms + stats.build_ms < best.parse_ms + best.build_ms) {
+      best = stats;
+    }
+  }
+  return best;
+}
+
+void print_import(std::string_view name, obj_load_stats_t const &stats) {
+  f64 file_mb = (f64) stats.file_bytes / (1024.0 * 1024.0);
+  f64 total   = stats.parse_ms + stats.build_ms;
+  fmt::println(
+      "{:<24} parse {:>8.2f} ms ({:>7.1f} MB/s), parse + build {:>8.2f} ms ({:>7.1f} MB/s), {} chunks", //
+      name, stats.parse_ms, file_mb / (stats.parse_ms / 1000.0), total, file_mb / (total / 1000.0), stats.chunk_count
+  );
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench_options_t options = parse_options(argc, argv);
+
+  u32        thread_count = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+  ThreadPool serial_pool{ 0 };
+  ThreadPool pool{ thread_count - 1 };
+
+  f64              tinyobj_ms = best_tinyobj_ms(options);
+  obj_load_stats_t serial     = best_import(serial_pool, options);
+  obj_load_stats_t parallel   = best_import(pool, options);
+
+  // results go after log messages of imports
+  log::flush();
+  f64 file_mb = (f64) serial.file_bytes / (1024.0 * 1024.0);
+  fmt::println("file:                    {} ({:.2f} MB)", options.scene_path, file_mb);
+  fmt::println("corners:                 {} welded into {} vertices", serial.corner_count, serial.vertex_count);
+  fmt::println("tinyobjloader LoadObj    {:>8.2f} ms ({:>7.1f} MB/s), serial reference", tinyobj_ms, file_mb / (tinyobj_ms / 1000.0));
+  print_import("load_obj, 1 thread", serial);
+  print_import(fmt::format("load_obj, {} threads", thread_count), parallel);
+  fmt::println(
+      "parallel speedup:        {:.2f}x parse, {:.2f}x vs tinyobjloader", serial.parse_ms / parallel.parse_ms, tinyobj_ms / (parallel.parse_ms + parallel.build_ms)
+  );
+  return EXIT_SUCCESS;
+}
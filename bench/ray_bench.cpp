@@ -0,0 +1,275 @@
+/*
+  ray traversal benchmark
+
+  for every scene builds binary Bvh and WideBvh for each isa supported by this cpu,
+  then traces primary and diffuse ray streams with closest hit and any hit queries and prints Mrays/s
+*/
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string_view>
+#include <thread>
+
+#include "bench_common.hpp"
+#include "bvh/bvh.hpp"
+#include "bvh/wide_bvh.hpp"
+#include "utility/log.hpp"
+#include "utility/thread_pool.hpp"
+
+namespace {
+
+using namespace whim;
+using bench::parse_u32;
+using bench::triangle_soup_t;
+
+constexpr std::string_view usage = R"(usage: ray_bench [options]
+  --scene <path>      gltf scene, can be repeated (default bundled Sponza, DamagedHelmet and FlightHelmet)
+  --rays <n>          rays per stream (default 1048576)
+  --threads <n>       tracing threads (default all)
+  --repeat <n>        runs per query, best time is reported (default 3))";
+
+// paths are relative to bin directory, same as scene path of main executable
+constexpr std::string_view default_scenes[] = {
+  "../assets/gltf/Sponza/Sponza.gltf",
+  "../assets/gltf/DamagedHelmet/DamagedHelmet.gltf",
+  "../assets/gltf/FlightHelmet/FlightHelmet.gltf",
+};
+
+// rays of one chunk are traced by one kernel call
+constexpr u32 chunk_size = 1024;
+
+struct bench_options_t {
+  std::vector<std::string_view> scene_paths{};
+  u32                           ray_count = 1 << 20;
+  u32                           threads   = 0;
+  u32                           repeat    = 3;
+};
+
+struct stream_t {
+  std::vector<bvh::ray_t> rays{};
+};
+
+bench_options_t parse_options(int argc, char** argv) {
+  bench_options_t options{};
+  for (int i = 1; i < argc; i += 1) {
+    std::string_view arg   = argv[i];
+    std::string_view value = i + 1 < argc ? argv[i + 1] : std::string_view{};
+
+    if (arg == "--help") {
+      fmt::println("{}", usage);
+      std::exit(EXIT_SUCCESS);
+    } else if (arg == "--scene") {
+      options.scene_paths.push_back(value);
+    } else if (arg == "--rays") {
+      options.ray_count = std::max(1u, parse_u32(value));
+    } else if (arg == "--threads") {
+      options.threads = parse_u32(value);
+    } else if (arg == "--repeat") {
+      options.repeat = std::max(1u, parse_u32(value));
+    } else {
+      fmt::println(stderr, "unknown option '{}'\n{}", arg, usage);
+      std::exit(EXIT_FAILURE);
+    }
+    i += 1;
+  }
+
+  if (options.scene_paths.empty()) {
+    options.scene_paths.assign(std::begin(default_scenes), std::end(default_scenes));
+  }
+  return options;
+}
+
+/*
+  coherent rays: pinhole camera in front of scene looking at its center
+*/
+stream_t primary_rays(bvh::bounds_t const &bounds, u32 count) {
+  glm::vec3 extent = bounds.max - bounds.min;
+  f32       radius = glm::length(extent) * 0.5f;
+  glm::vec3 eye    = bounds.center() + glm::vec3{ 0.f, 0.f, radius * 1.5f };
+
+  u32 side = std::max(1u, (u32) std::sqrt((f64) count));
+  f32 fov  = std::tan(glm::radians(30.f));
+
+  stream_t stream{};
+  stream.rays.resize(count);
+  for (u32 i = 0; i < count; i += 1) {
+    f32 x = ((f32) (i % side) + 0.5f) / (f32) side * 2.f - 1.f;
+    f32 y = ((f32) (i / side % side) + 0.5f) / (f32) side * 2.f - 1.f;
+
+    stream.rays[i] = bvh::ray_t{ eye, glm::normalize(glm::vec3{ x * fov, y * fov, -1.f }), 0.001f, 10000.f };
+  }
+  return stream;
+}
+
+/*
+  incoherent rays: random origins inside scene bounds, uniform directions
+*/
+stream_t diffuse_rays(bvh::bounds_t const &bounds, u32 count) {
+  std::mt19937                        rng{ 7 };
+  std::uniform_real_distribution<f32> unit{ 0.f, 1.f };
+
+  stream_t stream{};
+  stream.rays.resize(count);
+  for (u32 i = 0; i < count; i += 1) {
+    glm::vec3 origin = bounds.min + (bounds.max - bounds.min) * glm::vec3{ unit(rng), unit(rng), unit(rng) };
+
+    f32 z   = unit(rng) * 2.f - 1.f;
+    f32 phi = unit(rng) * glm::two_pi<f32>();
+    f32 r   = std::sqrt(std::max(0.f, 1.f - z * z));
+
+    stream.rays[i] = bvh::ray_t{ origin, glm::vec3{ r * std::cos(phi), r * std::sin(phi), z }, 0.001f, 10000.f };
+  }
+  return stream;
+}
+
+/*
+  best of repeat runs, every run gets fresh copy of rays because closest hit queries shorten them
+*/
+template<typename F>
+f64 measure_mrays(stream_t const &stream, ThreadPool &pool, u32 repeat, F &&trace_chunk) {
+  u32 ray_count   = (u32) stream.rays.size();
+  u32 chunk_count = (ray_count + chunk_size - 1) / chunk_size;
+
+  f64 best_s = std::numeric_limits<f64>::max();
+  for (u32 run = 0; run < repeat; run += 1) {
+    std::vector<bvh::ray_t> rays = stream.rays;
+
+    auto start = std::chrono::steady_clock::now();
+    pool.parallel_for(chunk_count, [&](usize chunk) {
+      u32 first = (u32) chunk * chunk_size;
+      u32 count = std::min(chunk_size, ray_count - first);
+      trace_chunk(std::span<bvh::ray_t>{ rays.data() + first, count }, first);
+    });
+    best_s = std::min(best_s, std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count());
+  }
+  return (f64) ray_count / best_s / 1e6;
+}
+
+/*
+  scalar Moller-Trumbore for binary Bvh, same tests as packet kernels
+*/
+bool intersect_triangle(triangle_soup_t const &soup, u32 triangle, bvh::ray_t const &ray, f32 &t) {
+  glm::vec3 p0    = soup.positions[soup.indices[triangle * 3 + 0]];
+  glm::vec3 edge1 = soup.positions[soup.indices[triangle * 3 + 1]] - p0;
+  glm::vec3 edge2 = soup.positions[soup.indices[triangle * 3 + 2]] - p0;
+
+  glm::vec3 pvec = glm::cross(ray.direction, edge2);
+  f32       det  = glm::dot(edge1, pvec);
+  if (det == 0.f) {
+    return false;
+  }
+  f32 inverse_det = 1.f / det;
+
+  glm::vec3 tvec = ray.origin - p0;
+  f32       u    = glm::dot(tvec, pvec) * inverse_det;
+  glm::vec3 qvec = glm::cross(tvec, edge1);
+  f32       v    = glm::dot(ray.direction, qvec) * inverse_det;
+  if (u < 0.f || v < 0.f || u + v > 1.f) {
+    return false;
+  }
+
+  t = glm::dot(edge2, qvec) * inverse_det;
+  return t >= ray.t_min && t <= ray.t_max;
+}
+
+void bench_scene(std::string_view path, ThreadPool &pool, bench_options_t const &options) {
+  triangle_soup_t soup           = bench::load_scene(path, pool);
+  u32             triangle_count = (u32) (soup.indices.size() / 3);
+  if (triangle_count == 0) {
+    WERROR("skipping {}: no triangles", path);
+    return;
+  }
+
+  bvh::Bvh binary = bvh::Bvh::build_triangles(soup.positions, soup.indices, &pool);
+
+  stream_t streams[] = {
+    primary_rays(binary.bounds(), options.ray_count),
+    diffuse_rays(binary.bounds(), options.ray_count),
+  };
+
+  fmt::println(
+      "{}: {} triangles, {} rays per stream, {} threads", //
+      std::filesystem::path(path).filename().string(), triangle_count, options.ray_count, pool.thread_count() + 1
+  );
+  fmt::println(
+      "  {:<12} {:>7} {:>10} {:>12} {:>12} {:>12} {:>12} {:>10}", //
+      "traversal", "nodes", "memory MB", "primary", "primary any", "diffuse", "diffuse any", "mismatches"
+  );
+
+  // closest hit distances of binary traversal are reference for wide kernels, infinity on miss
+  std::vector<f32> reference[std::size(streams)];
+
+  f64 binary_mrays[std::size(streams)];
+  for (u32 s = 0; s < std::size(streams); s += 1) {
+    reference[s].assign(options.ray_count, std::numeric_limits<f32>::infinity());
+    binary_mrays[s] = measure_mrays(streams[s], pool, options.repeat, [&](std::span<bvh::ray_t> rays, u32 first) {
+      for (u32 i = 0; i < rays.size(); i += 1) {
+        bool hit = binary.traverse(rays[i], [&](u32 triangle, bvh::ray_t &ray) {
+          f32 t = 0.f;
+          if (not intersect_triangle(soup, triangle, ray, t)) {
+            return false;
+          }
+          ray.t_max = t;
+          return true;
+        });
+        reference[s][first + i] = hit ? rays[i].t_max : std::numeric_limits<f32>::infinity();
+      }
+    });
+  }
+  fmt::println(
+      "  {:<12} {:>7} {:>10.2f} {:>12.2f} {:>12} {:>12.2f} {:>12} {:>10}", //
+      "binary", binary.nodes().size(), (f64) binary.metrics().memory_bytes / (1024.0 * 1024.0), binary_mrays[0], "-", binary_mrays[1], "-", "-"
+  );
+
+  for (bvh::isa_t isa : { bvh::isa_t::scalar, bvh::isa_t::sse, bvh::isa_t::avx2 }) {
+    if (not bvh::is_supported(isa)) {
+      continue;
+    }
+    bvh::WideBvh wide = bvh::WideBvh::build_triangles(soup.positions, soup.indices, &pool, {}, isa);
+
+    f64 closest_mrays[std::size(streams)];
+    f64 any_mrays[std::size(streams)];
+    u32 mismatches = 0;
+    for (u32 s = 0; s < std::size(streams); s += 1) {
+      std::vector<bvh::hit_t> hits(options.ray_count);
+      std::vector<u8>         occluded(options.ray_count);
+
+      closest_mrays[s] = measure_mrays(streams[s], pool, options.repeat, [&](std::span<bvh::ray_t> rays, u32 first) { //
+        wide.intersect(rays, std::span<bvh::hit_t>{ hits.data() + first, rays.size() });
+      });
+      any_mrays[s] = measure_mrays(streams[s], pool, options.repeat, [&](std::span<bvh::ray_t> rays, u32 first) { //
+        wide.occluded(rays, std::span<u8>{ occluded.data() + first, rays.size() });
+      });
+
+      for (u32 i = 0; i < options.ray_count; i += 1) {
+        f32  t   = hits[i].primitive != bvh::invalid_index ? hits[i].t : std::numeric_limits<f32>::infinity();
+        bool hit = t != std::numeric_limits<f32>::infinity();
+        if (t != reference[s][i] || hit != (occluded[i] != 0)) {
+          mismatches += 1;
+        }
+      }
+    }
+
+    fmt::println(
+        "  {:<12} {:>7} {:>10.2f} {:>12.2f} {:>12.2f} {:>12.2f} {:>12.2f} {:>10}", //
+        fmt::format("bvh{} {}", wide.width(), bvh::to_string(isa)), wide.node_count(), (f64) wide.memory_bytes() / (1024.0 * 1024.0), //
+        closest_mrays[0], any_mrays[0], closest_mrays[1], any_mrays[1], mismatches
+    );
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench_options_t options = parse_options(argc, argv);
+
+  u32        thread_count = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+  ThreadPool pool{ thread_count - 1 };
+
+  fmt::println("best isa: {}, columns are Mrays/s", bvh::to_string(bvh::detect_isa()));
+  for (std::string_view path : options.scene_paths) {
+    bench_scene(path, pool, options);
+  }
+  return EXIT_SUCCESS;
+}
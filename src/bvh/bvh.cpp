@@ -0,0 +1,390 @@
+#include "bvh/bvh.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "utility/log.hpp"
+
+namespace whim::bvh {
+
+namespace {
+
+constexpr u32 max_bin_count = 32;
+
+/*
+  node during build, nodes are allocated in sibling pairs from shared counter, so tasks never touch each other's nodes.
+  no member initializers: storage for 2n - 1 nodes is reserved up front and only used part of it is ever touched
+*/
+struct build_node_t {
+  glm::vec3 min;
+  u32       first;
+  glm::vec3 max;
+  u32       count;
+};
+
+struct bin_t {
+  bounds_t bounds = {};
+  u32      count  = 0;
+};
+
+struct split_t {
+  i32 axis = -1;
+  u32 bin  = 0; // primitives from bins [0, bin] go to the left child
+  f32 cost = std::numeric_limits<f32>::infinity();
+};
+
+// bounds of primitives and of their centers over index range
+struct range_bounds_t {
+  bounds_t bounds        = {};
+  bounds_t center_bounds = {};
+};
+
+class Builder {
+public:
+  Builder(std::span<bounds_t const> primitive_bounds, ThreadPool* pool, build_options_t const &options) :
+      m_bounds(primitive_bounds),
+      m_pool(pool),
+      m_options(options) {
+
+    usize count = primitive_bounds.size();
+
+    m_centers.resize(count);
+    m_primitive_indices.resize(count);
+    for_chunks(0, (u32) count, [&](u32 first, u32 end) {
+      for (u32 i = first; i < end; i += 1) {
+        m_centers[i]           = m_bounds[i].center();
+        m_primitive_indices[i] = i;
+      }
+    });
+
+    // binary tree with at least one primitive per leaf never has more nodes
+    m_nodes = std::make_unique_for_overwrite<build_node_t[]>(2 * count - 1);
+  }
+
+  void build(std::vector<node_t> &out_nodes) {
+    m_node_count = 1;
+    build_node(0, 0, (u32) m_bounds.size(), 0);
+    flatten(out_nodes);
+  }
+
+  std::vector<u32> take_primitive_indices() { return std::move(m_primitive_indices); }
+
+private:
+  bool is_parallel(u32 count) const { return m_pool != nullptr && m_pool->thread_count() > 0 && count >= m_options.parallel_threshold; }
+
+  /*
+    splits [first, end) into chunks processed on pool if range is big enough
+  */
+  template<typename F>
+  void for_chunks(u32 first, u32 end, F &&body) {
+    u32 count = end - first;
+    if (not is_parallel(count)) {
+      body(first, end);
+      return;
+    }
+    u32 chunk_count = (m_pool->thread_count() + 1) * 4;
+    u32 chunk_size  = (count + chunk_count - 1) / chunk_count;
+    m_pool->parallel_for(chunk_count, [&](usize chunk) {
+      u32 chunk_first = first + (u32) chunk * chunk_size;
+      u32 chunk_end   = std::min(end, chunk_first + chunk_size);
+      if (chunk_first < chunk_end) {
+        body(chunk_first, chunk_end);
+      }
+    });
+  }
+
+  range_bounds_t compute_bounds(u32 first, u32 count) {
+    std::mutex     mutex{};
+    range_bounds_t result{};
+    for_chunks(first, first + count, [&](u32 chunk_first, u32 chunk_end) {
+      range_bounds_t local{};
+      for (u32 i = chunk_first; i < chunk_end; i += 1) {
+        u32 primitive = m_primitive_indices[i];
+        local.bounds.grow(m_bounds[primitive]);
+        local.center_bounds.grow(m_centers[primitive]);
+      }
+      std::lock_guard lock{ mutex };
+      result.bounds.grow(local.bounds);
+      result.center_bounds.grow(local.center_bounds);
+    });
+    return result;
+  }
+
+  u32 bin_index(glm::vec3 center, bounds_t const &center_bounds, i32 axis) const {
+    f32 extent = center_bounds.max[axis] - center_bounds.min[axis];
+    f32 scale  = (f32) m_options.bin_count / extent;
+    return std::min(m_options.bin_count - 1, (u32) ((center[axis] - center_bounds.min[axis]) * scale));
+  }
+
+  /*
+    bins all three axes in one pass and sweeps every plane between bins
+  */
+  split_t find_split(u32 first, u32 count, bounds_t const &bounds, bounds_t const &center_bounds) {
+    u32 bin_count = m_options.bin_count;
+
+    std::mutex                           mutex{};
+    std::array<bin_t, 3 * max_bin_count> bins{};
+    for_chunks(first, first + count, [&](u32 chunk_first, u32 chunk_end) {
+      std::array<bin_t, 3 * max_bin_count> local{};
+      for (u32 i = chunk_first; i < chunk_end; i += 1) {
+        u32 primitive = m_primitive_indices[i];
+        for (i32 axis = 0; axis < 3; axis += 1) {
+          if (center_bounds.max[axis] <= center_bounds.min[axis]) continue;
+          bin_t &bin = local[axis * bin_count + bin_index(m_centers[primitive], center_bounds, axis)];
+          bin.bounds.grow(m_bounds[primitive]);
+          bin.count += 1;
+        }
+      }
+      std::lock_guard lock{ mutex };
+      for (u32 i = 0; i < 3 * bin_count; i += 1) {
+        bins[i].bounds.grow(local[i].bounds);
+        bins[i].count += local[i].count;
+      }
+    });
+
+    split_t best{};
+    f32     inverse_area = 1.f / std::max(bounds.half_area(), std::numeric_limits<f32>::min());
+
+    std::array<f32, max_bin_count> right_costs{};
+    for (i32 axis = 0; axis < 3; axis += 1) {
+      if (center_bounds.max[axis] <= center_bounds.min[axis]) continue;
+      bin_t const* axis_bins = bins.data() + axis * bin_count;
+
+      // right side sweep: right_costs[i] covers bins (i, bin_count)
+      bounds_t right_bounds{};
+      u32      right_count = 0;
+      for (u32 i = bin_count - 1; i > 0; i -= 1) {
+        right_bounds.grow(axis_bins[i].bounds);
+        right_count += axis_bins[i].count;
+        right_costs[i - 1] = right_bounds.half_area() * (f32) right_count;
+      }
+
+      bounds_t left_bounds{};
+      u32      left_count = 0;
+      for (u32 i = 0; i + 1 < bin_count; i += 1) {
+        left_bounds.grow(axis_bins[i].bounds);
+        left_count += axis_bins[i].count;
+        if (left_count == 0 || left_count == count) continue;
+
+        f32 cost = m_options.traversal_cost + m_options.intersection_cost * (left_bounds.half_area() * (f32) left_count + right_costs[i]) * inverse_area;
+        if (cost < best.cost) {
+          best = split_t{ .axis = axis, .bin = i, .cost = cost };
+        }
+      }
+    }
+    return best;
+  }
+
+  void build_node(u32 node_index, u32 first, u32 count, u32 depth) {
+    range_bounds_t range = compute_bounds(first, count);
+
+    build_node_t &node = m_nodes[node_index];
+    node.min           = range.bounds.min;
+    node.max           = range.bounds.max;
+
+    if (count == 1) {
+      make_leaf(node, first, count);
+      return;
+    }
+
+    u32 middle = first;
+    if (depth < Bvh::max_sah_depth) {
+      split_t split     = find_split(first, count, range.bounds, range.center_bounds);
+      f32     leaf_cost = m_options.intersection_cost * (f32) count;
+      if (count <= m_options.max_leaf_size && (split.axis < 0 || split.cost >= leaf_cost)) {
+        make_leaf(node, first, count);
+        return;
+      }
+
+      if (split.axis >= 0) {
+        auto begin   = m_primitive_indices.begin();
+        auto is_left = [&](u32 primitive) { return bin_index(m_centers[primitive], range.center_bounds, split.axis) <= split.bin; };
+        middle       = (u32) (std::partition(begin + first, begin + first + count, is_left) - begin);
+      }
+    } else if (count <= m_options.max_leaf_size) {
+      make_leaf(node, first, count);
+      return;
+    }
+
+    // degenerate centers or too deep tree: object median of the widest axis
+    if (middle == first || middle == first + count) {
+      glm::vec3 extent = range.center_bounds.max - range.center_bounds.min;
+      i32       axis   = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+      middle     = first + count / 2;
+      auto begin = m_primitive_indices.begin();
+      std::nth_element(begin + first, begin + middle, begin + first + count, [&](u32 a, u32 b) { //
+        return m_centers[a][axis] < m_centers[b][axis];
+      });
+    }
+
+    u32 left   = m_node_count.fetch_add(2);
+    node.first = left;
+    node.count = 0;
+
+    u32 left_count  = middle - first;
+    u32 right_count = count - left_count;
+    if (is_parallel(count)) {
+      m_pool->parallel_for(2, [&](usize child) {
+        if (child == 0) {
+          build_node(left, first, left_count, depth + 1);
+        } else {
+          build_node(left + 1, middle, right_count, depth + 1);
+        }
+      });
+    } else {
+      build_node(left, first, left_count, depth + 1);
+      build_node(left + 1, middle, right_count, depth + 1);
+    }
+  }
+
+  void make_leaf(build_node_t &node, u32 first, u32 count) {
+    node.first = first;
+    node.count = count;
+  }
+
+  /*
+    rewrites nodes in depth first order, siblings stay next to each other
+  */
+  void flatten(std::vector<node_t> &out_nodes) {
+    u32 node_count = m_node_count.load();
+    out_nodes.clear();
+    out_nodes.reserve(node_count);
+
+    auto convert = [](build_node_t const &node) { //
+      return node_t{ .min = node.min, .first = node.first, .max = node.max, .count = node.count };
+    };
+
+    struct pending_t {
+      u32 source = 0;
+      u32 target = 0;
+    };
+    std::vector<pending_t> stack{};
+    stack.push_back({ 0, 0 });
+    out_nodes.push_back(convert(m_nodes[0]));
+
+    while (not stack.empty()) {
+      pending_t pending = stack.back();
+      stack.pop_back();
+
+      build_node_t const &node = m_nodes[pending.source];
+      if (node.count > 0) {
+        continue;
+      }
+
+      u32 left = (u32) out_nodes.size();
+      out_nodes.push_back(convert(m_nodes[node.first]));
+      out_nodes.push_back(convert(m_nodes[node.first + 1]));
+      out_nodes[pending.target].first = left;
+
+      stack.push_back({ node.first + 1, left + 1 });
+      stack.push_back({ node.first, left });
+    }
+
+    m_nodes = nullptr;
+  }
+
+private:
+  std::span<bounds_t const> m_bounds;
+  ThreadPool*               m_pool = nullptr;
+  build_options_t           m_options{};
+
+  std::vector<glm::vec3> m_centers{};
+  std::vector<u32>       m_primitive_indices{};
+  uptr<build_node_t[]>   m_nodes      = nullptr;
+  std::atomic<u32>       m_node_count = 0;
+};
+
+} // namespace
+
+Bvh::Bvh(std::vector<node_t> &&nodes, std::vector<u32> &&primitive_indices) :
+    m_nodes(std::move(nodes)),
+    m_primitive_indices(std::move(primitive_indices)) {}
+
+Bvh Bvh::build(std::span<bounds_t const> primitive_bounds, ThreadPool* pool, build_options_t const &options) {
+  if (primitive_bounds.empty()) {
+    return {};
+  }
+
+  WASSERT(options.bin_count >= 2 && options.bin_count <= max_bin_count, "bin count should be in [2, 32]");
+  WASSERT(options.max_leaf_size >= 1, "leaf should fit at least one primitive");
+
+  std::vector<node_t> nodes{};
+  Builder             builder{ primitive_bounds, pool, options };
+  builder.build(nodes);
+  return Bvh{ std::move(nodes), builder.take_primitive_indices() };
+}
+
+Bvh Bvh::build_triangles(std::span<glm::vec3 const> positions, std::span<u32 const> indices, ThreadPool* pool, build_options_t const &options) {
+  u32                   triangle_count = (u32) (indices.size() / 3);
+  std::vector<bounds_t> triangle_bounds(triangle_count);
+
+  auto compute = [&](usize first, usize end) {
+    for (usize triangle = first; triangle < end; triangle += 1) {
+      for (u32 corner = 0; corner < 3; corner += 1) {
+        triangle_bounds[triangle].grow(positions[indices[triangle * 3 + corner]]);
+      }
+    }
+  };
+
+  if (pool != nullptr && triangle_count >= options.parallel_threshold) {
+    usize chunk_count = (pool->thread_count() + 1) * 4;
+    usize chunk_size  = (triangle_count + chunk_count - 1) / chunk_count;
+    pool->parallel_for(chunk_count, [&](usize chunk) { //
+      compute(std::min<usize>(chunk * chunk_size, triangle_count), std::min<usize>((chunk + 1) * chunk_size, triangle_count));
+    });
+  } else {
+    compute(0, triangle_count);
+  }
+
+  return build(triangle_bounds, pool, options);
+}
+
+metrics_t Bvh::metrics(build_options_t const &options) const {
+  metrics_t result{};
+  if (m_nodes.empty()) {
+    return result;
+  }
+
+  result.node_count   = (u32) m_nodes.size();
+  result.memory_bytes = m_nodes.size() * sizeof(node_t) + m_primitive_indices.size() * sizeof(u32);
+  result.leaf_size_histogram.resize(options.max_leaf_size + 1, 0);
+
+  f64 root_area = std::max((f64) bounds().half_area(), (f64) std::numeric_limits<f32>::min());
+  u64 depth_sum = 0;
+
+  struct pending_t {
+    u32 node  = 0;
+    u32 depth = 0;
+  };
+  std::vector<pending_t> stack{ { 0, 0 } };
+  while (not stack.empty()) {
+    pending_t pending = stack.back();
+    stack.pop_back();
+
+    node_t const &node = m_nodes[pending.node];
+    f64           area = bounds_t{ node.min, node.max }.half_area() / root_area;
+
+    result.max_depth = std::max(result.max_depth, pending.depth);
+    if (node.count > 0) {
+      result.sah_cost += area * options.intersection_cost * node.count;
+      result.leaf_count += 1;
+      depth_sum += pending.depth;
+      if (node.count >= result.leaf_size_histogram.size()) {
+        result.leaf_size_histogram.resize(node.count + 1, 0);
+      }
+      result.leaf_size_histogram[node.count] += 1;
+      continue;
+    }
+
+    result.sah_cost += area * options.traversal_cost;
+    stack.push_back({ node.first, pending.depth + 1 });
+    stack.push_back({ node.first + 1, pending.depth + 1 });
+  }
+
+  result.average_leaf_depth = (f64) depth_sum / (f64) result.leaf_count;
+  return result;
+}
+
+} // namespace whim::bvh
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/types.hpp"
+
+namespace whim::bvh {
+
+struct bounds_t {
+  glm::vec3 min = glm::vec3{ std::numeric_limits<f32>::max() };
+  glm::vec3 max = glm::vec3{ std::numeric_limits<f32>::lowest() };
+
+  void grow(glm::vec3 point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  void grow(bounds_t const &other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+
+  [[nodiscard]] glm::vec3 center() const { return (min + max) * 0.5f; }
+
+  // zero for empty bounds
+  [[nodiscard]] f32 half_area() const {
+    glm::vec3 extent = max - min;
+    return extent.x < 0.f ? 0.f : extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+  }
+};
+
+struct ray_t {
+  glm::vec3 origin    = {};
+  glm::vec3 direction = {};
+  f32       t_min     = 0.f;
+  f32       t_max     = 0.f;
+};
+
+/*
+  flattened node, 32 bytes.
+  inner node: first is index of left child, right child is stored right after it.
+  leaf: [first, first + count) range of primitive_indices
+*/
+struct node_t {
+  glm::vec3 min   = {};
+  u32       first = 0;
+  glm::vec3 max   = {};
+  u32       count = 0; // zero for inner nodes
+};
+static_assert(sizeof(node_t) == 32, "node should stay 32 bytes");
+
+struct build_options_t {
+  u32 bin_count     = 16;
+  u32 max_leaf_size = 4;
+  // SAH costs of one node visit and one primitive test
+  f32 traversal_cost    = 1.f;
+  f32 intersection_cost = 1.f;
+  // ranges with more primitives are binned in parallel and their children are built as separate tasks
+  u32 parallel_threshold = 16 * 1024;
+};
+
+/*
+  tree quality report
+*/
+struct metrics_t {
+  f64   sah_cost           = 0.0;
+  u32   node_count         = 0;
+  u32   leaf_count         = 0;
+  u32   max_depth          = 0;
+  f64   average_leaf_depth = 0.0;
+  usize memory_bytes       = 0;
+  // leaf_size_histogram[n] - number of leaves with n primitives
+  std::vector<u32> leaf_size_histogram{};
+};
+
+/*
+  binary BVH built with binned SAH. children of big nodes are built in parallel on given pool
+  (or serially without pool), result is flattened in depth first order
+*/
+class Bvh {
+public:
+  // below this depth splits follow SAH, deeper nodes are split at median, so depth stays under traversal_stack_size
+  constexpr static u32 max_sah_depth        = 64;
+  constexpr static u32 traversal_stack_size = 128;
+
+public:
+  Bvh() = default;
+
+  static Bvh build(std::span<bounds_t const> primitive_bounds, ThreadPool* pool = nullptr, build_options_t const &options = {});
+
+  /*
+    triangles are index triples into positions, same layout as scene_data_t uses for one primitive
+  */
+  static Bvh build_triangles(
+      std::span<glm::vec3 const> positions, std::span<u32 const> indices, //
+      ThreadPool* pool = nullptr, build_options_t const &options = {}
+  );
+
+  [[nodiscard]] bool                      empty() const { return m_nodes.empty(); }
+  [[nodiscard]] bounds_t                  bounds() const { return { m_nodes.front().min, m_nodes.front().max }; }
+  [[nodiscard]] std::vector<node_t> const &nodes() const { return m_nodes; }
+  [[nodiscard]] std::vector<u32> const    &primitive_indices() const { return m_primitive_indices; }
+
+  [[nodiscard]] metrics_t metrics(build_options_t const &options = {}) const;
+
+  /*
+    calls intersect(primitive_index, ray) for every primitive whose leaf is hit by ray,
+    intersect returns true and shortens ray.t_max when it finds closer hit
+  */
+  template<typename F>
+  bool traverse(ray_t &ray, F &&intersect) const;
+
+private:
+  Bvh(std::vector<node_t> &&nodes, std::vector<u32> &&primitive_indices);
+
+private:
+  std::vector<node_t> m_nodes{};
+  std::vector<u32>    m_primitive_indices{};
+};
+
+/*
+  slab test, returns entry distance or infinity on miss
+*/
+inline f32 intersect_bounds(glm::vec3 min, glm::vec3 max, glm::vec3 origin, glm::vec3 inverse_direction, f32 t_min, f32 t_max) {
+  glm::vec3 t0 = (min - origin) * inverse_direction;
+  glm::vec3 t1 = (max - origin) * inverse_direction;
+
+  glm::vec3 t_near = glm::min(t0, t1);
+  glm::vec3 t_far  = glm::max(t0, t1);
+
+  f32 entry = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, t_min));
+  f32 exit  = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, t_max));
+  return entry <= exit ? entry : std::numeric_limits<f32>::infinity();
+}
+
+template<typename F>
+bool Bvh::traverse(ray_t &ray, F &&intersect) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+
+  constexpr f32 miss              = std::numeric_limits<f32>::infinity();
+  glm::vec3     inverse_direction = 1.f / ray.direction;
+  bool          hit               = false;
+
+  if (intersect_bounds(m_nodes[0].min, m_nodes[0].max, ray.origin, inverse_direction, ray.t_min, ray.t_max) == miss) {
+    return false;
+  }
+
+  // entry distance is kept with node, so nodes behind closer hit found meanwhile are skipped.
+  // stack is left uninitialized on purpose, it is too big to clear for every ray
+  struct entry_t {
+    u32 node;
+    f32 t;
+  };
+  std::array<entry_t, traversal_stack_size> stack;
+  u32                                       stack_size = 0;
+  stack[stack_size++]                                  = entry_t{ 0, ray.t_min };
+
+  while (stack_size > 0) {
+    entry_t entry = stack[--stack_size];
+    if (entry.t > ray.t_max) {
+      continue;
+    }
+    node_t const &node = m_nodes[entry.node];
+
+    if (node.count > 0) {
+      for (u32 i = node.first; i < node.first + node.count; i += 1) {
+        hit = intersect(m_primitive_indices[i], ray) || hit;
+      }
+      continue;
+    }
+
+    // children are tested before push, nearer one is visited first so t_max shrinks early
+    node_t const &left    = m_nodes[node.first];
+    node_t const &right   = m_nodes[node.first + 1];
+    entry_t       closer  = { node.first, intersect_bounds(left.min, left.max, ray.origin, inverse_direction, ray.t_min, ray.t_max) };
+    entry_t       farther = { node.first + 1, intersect_bounds(right.min, right.max, ray.origin, inverse_direction, ray.t_min, ray.t_max) };
+    if (farther.t < closer.t) {
+      std::swap(closer, farther);
+    }
+    if (farther.t != miss) {
+      stack[stack_size++] = farther;
+    }
+    if (closer.t != miss) {
+      stack[stack_size++] = closer;
+    }
+  }
+  return hit;
+}
+
+} // namespace whim::bvh
@@ -0,0 +1,311 @@
+#include "bvh/wide_bvh.hpp"
+
+#include "bvh/wide_kernels.hpp"
+#include "utility/log.hpp"
+
+#if WHIM_BVH_X86 && defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
+namespace whim::bvh {
+
+namespace {
+
+/*
+  portable lanes, used where no SIMD kernels are built. masks hold 1 or 0 per lane
+*/
+struct scalar_t {
+  struct vec_t {
+    f32 lane[4];
+  };
+  constexpr static u32 width = 4;
+
+  template<typename F>
+  static vec_t map(vec_t a, vec_t b, F &&op) {
+    return { op(a.lane[0], b.lane[0]), op(a.lane[1], b.lane[1]), op(a.lane[2], b.lane[2]), op(a.lane[3], b.lane[3]) };
+  }
+
+  static vec_t load(f32 const* data) { return { data[0], data[1], data[2], data[3] }; }
+  static void  store(f32* data, vec_t a) { std::copy_n(a.lane, 4, data); }
+  static vec_t splat(f32 value) { return { value, value, value, value }; }
+
+  static vec_t add(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x + y; }); }
+  static vec_t sub(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x - y; }); }
+  static vec_t mul(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x * y; }); }
+  static vec_t div(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x / y; }); }
+  static vec_t min(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x < y ? x : y; }); }
+  static vec_t max(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x > y ? x : y; }); }
+
+  static vec_t cmp_le(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x <= y ? 1.f : 0.f; }); }
+  static vec_t cmp_ge(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x >= y ? 1.f : 0.f; }); }
+  static vec_t cmp_ne(vec_t a, vec_t b) { return map(a, b, [](f32 x, f32 y) { return x != y ? 1.f : 0.f; }); }
+  static vec_t logical_and(vec_t a, vec_t b) { return mul(a, b); }
+
+  static u32 movemask(vec_t mask) {
+    u32 bits = 0;
+    for (u32 lane = 0; lane < width; lane += 1) {
+      bits |= mask.lane[lane] != 0.f ? 1u << lane : 0u;
+    }
+    return bits;
+  }
+};
+
+constexpr kernels_t<4> portable_kernels = {
+  &traversal_t<scalar_t>::intersect_stream,
+  &traversal_t<scalar_t>::occluded_stream,
+};
+
+bool cpu_has_avx2() {
+#if WHIM_BVH_X86 && defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  // avx needs os support of ymm state, checked through xgetbv
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx     = (info[2] & (1 << 28)) != 0;
+  if (not osxsave || not avx || (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif WHIM_BVH_X86
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+/*
+  turns binary tree into W-wide one: children of every wide node are gathered by opening
+  biggest inner child until W slots are used, leaves are packed into triangle packets
+*/
+template<u32 W>
+class Collapser {
+public:
+  Collapser(
+      Bvh const &binary, std::span<glm::vec3 const> positions, std::span<u32 const> indices, //
+      std::vector<wide_node_t<W>> &nodes, std::vector<triangle_packet_t<W>> &packets
+  ) :
+      m_binary(binary),
+      m_positions(positions),
+      m_indices(indices),
+      m_nodes(nodes),
+      m_packets(packets) {}
+
+  void collapse() {
+    m_nodes.reserve(m_binary.nodes().size() / (W - 1) + 1);
+    m_packets.reserve(m_binary.primitive_indices().size() / W + m_binary.nodes().size() / 2 + 1);
+    collapse_node(0);
+  }
+
+private:
+  u32 collapse_node(u32 binary_index) {
+    std::vector<node_t> const &binary_nodes = m_binary.nodes();
+
+    u32 children[W];
+    u32 child_count = 0;
+    if (binary_nodes[binary_index].count > 0) {
+      // only root can be leaf here, it still gets wide node so traversal always starts from one
+      children[child_count++] = binary_index;
+    } else {
+      children[child_count++] = binary_nodes[binary_index].first;
+      children[child_count++] = binary_nodes[binary_index].first + 1;
+    }
+
+    while (child_count < W) {
+      i32 best      = -1;
+      f32 best_area = -1.f;
+      for (u32 i = 0; i < child_count; i += 1) {
+        node_t const &child = binary_nodes[children[i]];
+        f32           area  = bounds_t{ child.min, child.max }.half_area();
+        if (child.count == 0 && area > best_area) {
+          best      = (i32) i;
+          best_area = area;
+        }
+      }
+      if (best < 0) {
+        break;
+      }
+      u32 opened              = children[best];
+      children[best]          = binary_nodes[opened].first;
+      children[child_count++] = binary_nodes[opened].first + 1;
+    }
+
+    u32 index = (u32) m_nodes.size();
+    m_nodes.push_back(empty_node());
+
+    // recursion may reallocate m_nodes, so node is written by index
+    for (u32 slot = 0; slot < child_count; slot += 1) {
+      node_t const &child = binary_nodes[children[slot]];
+      u32           first = 0;
+      u32           count = 0;
+      if (child.count > 0) {
+        first = (u32) m_packets.size();
+        count = pack_leaf(child);
+      } else {
+        first = collapse_node(children[slot]);
+      }
+
+      wide_node_t<W> &node = m_nodes[index];
+      for (u32 axis = 0; axis < 3; axis += 1) {
+        node.bounds[axis][slot]     = child.min[axis];
+        node.bounds[axis + 3][slot] = child.max[axis];
+      }
+      node.child[slot] = first;
+      node.count[slot] = count;
+    }
+    return index;
+  }
+
+  u32 pack_leaf(node_t const &leaf) {
+    u32 packet_count = (leaf.count + W - 1) / W;
+    for (u32 p = 0; p < packet_count; p += 1) {
+      triangle_packet_t<W> packet{};
+      std::fill_n(packet.primitive, W, invalid_index);
+
+      for (u32 lane = 0; lane < W && p * W + lane < leaf.count; lane += 1) {
+        u32       triangle = m_binary.primitive_indices()[leaf.first + p * W + lane];
+        glm::vec3 p0       = m_positions[m_indices[triangle * 3 + 0]];
+        glm::vec3 edge1    = m_positions[m_indices[triangle * 3 + 1]] - p0;
+        glm::vec3 edge2    = m_positions[m_indices[triangle * 3 + 2]] - p0;
+        for (u32 axis = 0; axis < 3; axis += 1) {
+          packet.v0[axis][lane]    = p0[axis];
+          packet.edge1[axis][lane] = edge1[axis];
+          packet.edge2[axis][lane] = edge2[axis];
+        }
+        packet.primitive[lane] = triangle;
+      }
+      m_packets.push_back(packet);
+    }
+    return packet_count;
+  }
+
+  static wide_node_t<W> empty_node() {
+    wide_node_t<W> node{};
+    for (u32 axis = 0; axis < 3; axis += 1) {
+      std::fill_n(node.bounds[axis], W, std::numeric_limits<f32>::infinity());
+      std::fill_n(node.bounds[axis + 3], W, -std::numeric_limits<f32>::infinity());
+    }
+    std::fill_n(node.child, W, invalid_index);
+    return node;
+  }
+
+private:
+  Bvh const                         &m_binary;
+  std::span<glm::vec3 const>         m_positions;
+  std::span<u32 const>               m_indices;
+  std::vector<wide_node_t<W>>       &m_nodes;
+  std::vector<triangle_packet_t<W>> &m_packets;
+};
+
+} // namespace
+
+kernels_t<4> const* scalar_kernels() {
+  return &portable_kernels;
+}
+
+isa_t detect_isa() {
+  if (is_supported(isa_t::avx2)) {
+    return isa_t::avx2;
+  }
+  if (is_supported(isa_t::sse)) {
+    return isa_t::sse;
+  }
+  return isa_t::scalar;
+}
+
+bool is_supported(isa_t isa) {
+  switch (isa) {
+    case isa_t::scalar: return true;
+    case isa_t::sse:    return sse_kernels() != nullptr;
+    case isa_t::avx2:   return avx2_kernels() != nullptr && cpu_has_avx2();
+  }
+  return false;
+}
+
+std::string_view to_string(isa_t isa) {
+  switch (isa) {
+    case isa_t::scalar: return "scalar";
+    case isa_t::sse:    return "sse";
+    case isa_t::avx2:   return "avx2";
+  }
+  return "unknown";
+}
+
+WideBvh WideBvh::build_triangles(
+    std::span<glm::vec3 const> positions, std::span<u32 const> indices, //
+    ThreadPool* pool, build_options_t const &options, isa_t isa
+) {
+  WASSERT(is_supported(isa), "requested bvh isa is not supported by this cpu or build");
+
+  WideBvh result{};
+  result.m_isa = isa;
+
+  // one packet test covers whole leaf, so triangle cost is shared by lanes and SAH makes fuller leaves
+  build_options_t binary_options   = options;
+  binary_options.max_leaf_size     = result.width();
+  binary_options.intersection_cost = options.intersection_cost / (f32) result.width();
+  Bvh binary                       = Bvh::build_triangles(positions, indices, pool, binary_options);
+  if (binary.empty()) {
+    return result;
+  }
+  result.m_bounds = binary.bounds();
+
+  if (result.width() == 8) {
+    Collapser<8>{ binary, positions, indices, result.m_nodes8, result.m_packets8 }.collapse();
+    result.m_node_count = (u32) result.m_nodes8.size();
+  } else {
+    Collapser<4>{ binary, positions, indices, result.m_nodes4, result.m_packets4 }.collapse();
+    result.m_node_count = (u32) result.m_nodes4.size();
+  }
+  return result;
+}
+
+usize WideBvh::memory_bytes() const {
+  return m_nodes4.size() * sizeof(wide_node_t<4>) + m_packets4.size() * sizeof(triangle_packet_t<4>) + //
+         m_nodes8.size() * sizeof(wide_node_t<8>) + m_packets8.size() * sizeof(triangle_packet_t<8>);
+}
+
+bool WideBvh::intersect(ray_t &ray, hit_t &hit) const {
+  intersect(std::span<ray_t>{ &ray, 1 }, std::span<hit_t>{ &hit, 1 });
+  return hit.primitive != invalid_index;
+}
+
+bool WideBvh::occluded(ray_t const &ray) const {
+  u8 result = 0;
+  occluded(std::span<ray_t const>{ &ray, 1 }, std::span<u8>{ &result, 1 });
+  return result != 0;
+}
+
+void WideBvh::intersect(std::span<ray_t> rays, std::span<hit_t> hits) const {
+  WASSERT(hits.size() >= rays.size(), "every ray needs hit record");
+  if (empty()) {
+    std::fill_n(hits.begin(), rays.size(), hit_t{});
+    return;
+  }
+
+  switch (m_isa) {
+    case isa_t::scalar: scalar_kernels()->intersect(m_nodes4.data(), m_packets4.data(), rays.data(), hits.data(), (u32) rays.size()); break;
+    case isa_t::sse:    sse_kernels()->intersect(m_nodes4.data(), m_packets4.data(), rays.data(), hits.data(), (u32) rays.size()); break;
+    case isa_t::avx2:   avx2_kernels()->intersect(m_nodes8.data(), m_packets8.data(), rays.data(), hits.data(), (u32) rays.size()); break;
+  }
+}
+
+void WideBvh::occluded(std::span<ray_t const> rays, std::span<u8> results) const {
+  WASSERT(results.size() >= rays.size(), "every ray needs result");
+  if (empty()) {
+    std::fill_n(results.begin(), rays.size(), 0);
+    return;
+  }
+
+  switch (m_isa) {
+    case isa_t::scalar: scalar_kernels()->occluded(m_nodes4.data(), m_packets4.data(), rays.data(), results.data(), (u32) rays.size()); break;
+    case isa_t::sse:    sse_kernels()->occluded(m_nodes4.data(), m_packets4.data(), rays.data(), results.data(), (u32) rays.size()); break;
+    case isa_t::avx2:   avx2_kernels()->occluded(m_nodes8.data(), m_packets8.data(), rays.data(), results.data(), (u32) rays.size()); break;
+  }
+}
+
+} // namespace whim::bvh
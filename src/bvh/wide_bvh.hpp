@@ -0,0 +1,110 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "bvh/bvh.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/types.hpp"
+
+namespace whim::bvh {
+
+constexpr u32 invalid_index = ~0u;
+
+/*
+  instruction set of traversal kernels, it also defines tree width:
+  scalar and sse use 4-wide nodes, avx2 uses 8-wide nodes
+*/
+enum class isa_t : u8 {
+  scalar,
+  sse,
+  avx2,
+};
+
+// best isa supported by both build and cpu
+[[nodiscard]] isa_t            detect_isa();
+[[nodiscard]] bool             is_supported(isa_t isa);
+[[nodiscard]] std::string_view to_string(isa_t isa);
+
+struct hit_t {
+  u32       primitive    = invalid_index; // triangle index, invalid_index on miss
+  f32       t            = 0.f;
+  glm::vec2 barycentrics = {};            // weights of second and third vertex
+};
+
+/*
+  child bounds are stored as structure of arrays, so one node is tested against ray with W lanes at once.
+  empty child slots have inverted bounds, which are never hit
+*/
+template<u32 W>
+struct alignas(W * sizeof(f32)) wide_node_t {
+  f32 bounds[6][W]; // min x, y, z, then max x, y, z
+  u32 child[W];     // inner: wide node index, leaf: first triangle packet
+  u32 count[W];     // inner: 0, leaf: number of triangle packets
+};
+
+/*
+  W triangles prepared for Moller-Trumbore, unused lanes have zero edges and invalid_index primitive
+*/
+template<u32 W>
+struct alignas(W * sizeof(f32)) triangle_packet_t {
+  f32 v0[3][W];
+  f32 edge1[3][W];
+  f32 edge2[3][W];
+  u32 primitive[W];
+};
+
+/*
+  BVH4/BVH8 over triangles, collapsed from binary Bvh.
+  traversal tests all children of node and all triangles of packet with one SIMD kernel call,
+  kernel is picked at runtime from cpu features. triangles are copied into packets, positions are not referenced after build
+*/
+class WideBvh {
+public:
+  WideBvh() = default;
+
+  /*
+    max_leaf_size of options is replaced by tree width and intersection_cost is split between lanes
+  */
+  static WideBvh build_triangles(
+      std::span<glm::vec3 const> positions, std::span<u32 const> indices, //
+      ThreadPool* pool = nullptr, build_options_t const &options = {}, isa_t isa = detect_isa()
+  );
+
+  [[nodiscard]] bool     empty() const { return m_node_count == 0; }
+  [[nodiscard]] isa_t    isa() const { return m_isa; }
+  [[nodiscard]] u32      width() const { return m_isa == isa_t::avx2 ? 8 : 4; }
+  [[nodiscard]] bounds_t bounds() const { return m_bounds; }
+  [[nodiscard]] u32      node_count() const { return m_node_count; }
+  [[nodiscard]] usize    memory_bytes() const;
+
+  /*
+    closest hit, ray.t_max is shortened to hit distance
+  */
+  bool intersect(ray_t &ray, hit_t &hit) const;
+
+  /*
+    any hit, stops at first triangle found in [t_min, t_max]
+  */
+  [[nodiscard]] bool occluded(ray_t const &ray) const;
+
+  /*
+    ray streams: same queries for every ray, one kernel call for whole stream
+  */
+  void intersect(std::span<ray_t> rays, std::span<hit_t> hits) const;
+  void occluded(std::span<ray_t const> rays, std::span<u8> results) const;
+
+private:
+  isa_t    m_isa        = isa_t::scalar;
+  bounds_t m_bounds     = {};
+  u32      m_node_count = 0;
+
+  // only pair of tree width is used
+  std::vector<wide_node_t<4>>       m_nodes4{};
+  std::vector<triangle_packet_t<4>> m_packets4{};
+  std::vector<wide_node_t<8>>       m_nodes8{};
+  std::vector<triangle_packet_t<8>> m_packets8{};
+};
+
+} // namespace whim::bvh
@@ -0,0 +1,237 @@
+#pragma once
+
+/*
+  internal header of wide_bvh.cpp and kernel files.
+
+  every isa instantiates traversal_t with its own lane traits (load, splat, arithmetic, compare, movemask),
+  traits types live in anonymous namespaces, so each instantiation stays local to its translation unit.
+  kernel files are compiled with extra isa flags, so code here must not call inline functions shared with
+  other files (glm operators, std algorithms): linker may keep isa copy of such function for whole program
+*/
+
+#include "bvh/wide_bvh.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define WHIM_BVH_X86 1
+#else
+  #define WHIM_BVH_X86 0
+#endif
+
+namespace whim::bvh {
+
+template<u32 W>
+struct kernels_t {
+  void (*intersect)(wide_node_t<W> const* nodes, triangle_packet_t<W> const* packets, ray_t* rays, hit_t* hits, u32 count);
+  void (*occluded)(wide_node_t<W> const* nodes, triangle_packet_t<W> const* packets, ray_t const* rays, u8* results, u32 count);
+};
+
+// nullptr when kernels of isa are not part of build
+kernels_t<4> const* scalar_kernels();
+kernels_t<4> const* sse_kernels();
+kernels_t<8> const* avx2_kernels();
+
+template<typename S>
+struct traversal_t {
+  constexpr static u32 W          = S::width;
+  constexpr static u32 stack_size = Bvh::traversal_stack_size * W;
+  // zero direction components are replaced, so box test never multiplies zero by infinity
+  constexpr static f32 min_direction = 1e-20f;
+
+  using vec_t    = typename S::vec_t;
+  using node_t   = wide_node_t<W>;
+  using packet_t = triangle_packet_t<W>;
+
+  // ray broadcast to all lanes
+  struct lanes_t {
+    vec_t origin[3];
+    vec_t direction[3];
+    vec_t inverse_direction[3];
+    vec_t t_min;
+    // rows of node bounds which ray enters and exits through, chosen by direction signs
+    u32 near_row[3];
+    u32 far_row[3];
+  };
+
+  struct entry_t {
+    u32 child;
+    u32 count;
+    f32 t;
+  };
+
+  static lanes_t prepare(ray_t const &ray) {
+    f32 origin[3]    = { ray.origin.x, ray.origin.y, ray.origin.z };
+    f32 direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+
+    lanes_t lanes;
+    for (u32 axis = 0; axis < 3; axis += 1) {
+      f32 d = direction[axis];
+      if (d >= 0.f && d < min_direction) {
+        d = min_direction;
+      } else if (d < 0.f && d > -min_direction) {
+        d = -min_direction;
+      }
+      lanes.origin[axis]            = S::splat(origin[axis]);
+      lanes.direction[axis]         = S::splat(direction[axis]);
+      lanes.inverse_direction[axis] = S::splat(1.f / d);
+      lanes.near_row[axis]          = d < 0.f ? axis + 3 : axis;
+      lanes.far_row[axis]           = d < 0.f ? axis : axis + 3;
+    }
+    lanes.t_min = S::splat(ray.t_min);
+    return lanes;
+  }
+
+  /*
+    slab test of all children, returns hit mask and writes entry distances
+  */
+  static u32 intersect_children(node_t const &node, lanes_t const &lanes, f32 t_max, f32* entry_out) {
+    vec_t entry = lanes.t_min;
+    vec_t exit  = S::splat(t_max);
+    for (u32 axis = 0; axis < 3; axis += 1) {
+      vec_t t_near = S::mul(S::sub(S::load(node.bounds[lanes.near_row[axis]]), lanes.origin[axis]), lanes.inverse_direction[axis]);
+      vec_t t_far  = S::mul(S::sub(S::load(node.bounds[lanes.far_row[axis]]), lanes.origin[axis]), lanes.inverse_direction[axis]);
+      entry        = S::max(entry, t_near);
+      exit         = S::min(exit, t_far);
+    }
+    S::store(entry_out, entry);
+    return S::movemask(S::cmp_le(entry, exit));
+  }
+
+  static vec_t dot(vec_t ax, vec_t ay, vec_t az, vec_t bx, vec_t by, vec_t bz) { //
+    return S::add(S::add(S::mul(ax, bx), S::mul(ay, by)), S::mul(az, bz));
+  }
+
+  /*
+    Moller-Trumbore over packet lanes without culling, instances use VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR.
+    barycentrics are weights of second and third vertex like hitAttributeEXT in closest hit shader
+  */
+  static u32 intersect_packet(packet_t const &packet, lanes_t const &lanes, f32 t_max, f32* t_out, f32* u_out, f32* v_out) {
+    vec_t dx = lanes.direction[0];
+    vec_t dy = lanes.direction[1];
+    vec_t dz = lanes.direction[2];
+
+    vec_t e1x = S::load(packet.edge1[0]);
+    vec_t e1y = S::load(packet.edge1[1]);
+    vec_t e1z = S::load(packet.edge1[2]);
+    vec_t e2x = S::load(packet.edge2[0]);
+    vec_t e2y = S::load(packet.edge2[1]);
+    vec_t e2z = S::load(packet.edge2[2]);
+
+    vec_t px  = S::sub(S::mul(dy, e2z), S::mul(dz, e2y));
+    vec_t py  = S::sub(S::mul(dz, e2x), S::mul(dx, e2z));
+    vec_t pz  = S::sub(S::mul(dx, e2y), S::mul(dy, e2x));
+    vec_t det = dot(e1x, e1y, e1z, px, py, pz);
+    vec_t inv = S::div(S::splat(1.f), det);
+
+    vec_t sx = S::sub(lanes.origin[0], S::load(packet.v0[0]));
+    vec_t sy = S::sub(lanes.origin[1], S::load(packet.v0[1]));
+    vec_t sz = S::sub(lanes.origin[2], S::load(packet.v0[2]));
+    vec_t u  = S::mul(dot(sx, sy, sz, px, py, pz), inv);
+
+    vec_t qx = S::sub(S::mul(sy, e1z), S::mul(sz, e1y));
+    vec_t qy = S::sub(S::mul(sz, e1x), S::mul(sx, e1z));
+    vec_t qz = S::sub(S::mul(sx, e1y), S::mul(sy, e1x));
+    vec_t v  = S::mul(dot(dx, dy, dz, qx, qy, qz), inv);
+    vec_t t  = S::mul(dot(e2x, e2y, e2z, qx, qy, qz), inv);
+
+    // unused lanes have zero det
+    vec_t valid = S::cmp_ne(det, S::splat(0.f));
+    valid       = S::logical_and(valid, S::cmp_ge(u, S::splat(0.f)));
+    valid       = S::logical_and(valid, S::cmp_ge(v, S::splat(0.f)));
+    valid       = S::logical_and(valid, S::cmp_le(S::add(u, v), S::splat(1.f)));
+    valid       = S::logical_and(valid, S::cmp_ge(t, lanes.t_min));
+    valid       = S::logical_and(valid, S::cmp_le(t, S::splat(t_max)));
+
+    S::store(t_out, t);
+    S::store(u_out, u);
+    S::store(v_out, v);
+    return S::movemask(valid);
+  }
+
+  /*
+    closest hit when any_hit is false, otherwise returns at first hit
+  */
+  template<bool any_hit>
+  static bool traverse(node_t const* nodes, packet_t const* packets, ray_t const &ray, hit_t* hit) {
+    lanes_t lanes = prepare(ray);
+    f32     t_max = ray.t_max;
+    bool    found = false;
+
+    alignas(W * sizeof(f32)) f32 entry[W];
+    alignas(W * sizeof(f32)) f32 t[W];
+    alignas(W * sizeof(f32)) f32 u[W];
+    alignas(W * sizeof(f32)) f32 v[W];
+
+    // left uninitialized, it is too big to clear for every ray
+    entry_t stack[stack_size];
+    u32     stack_top  = 0;
+    stack[stack_top++] = entry_t{ 0, 0, ray.t_min };
+
+    while (stack_top > 0) {
+      entry_t current = stack[--stack_top];
+      if (current.t > t_max) {
+        continue;
+      }
+
+      if (current.count > 0) {
+        for (u32 p = current.child; p < current.child + current.count; p += 1) {
+          u32 mask = intersect_packet(packets[p], lanes, t_max, t, u, v);
+          if (mask == 0) {
+            continue;
+          }
+          if constexpr (any_hit) {
+            return true;
+          }
+          for (u32 lane = 0; lane < W; lane += 1) {
+            if ((mask >> lane & 1) == 0 || t[lane] > t_max) {
+              continue;
+            }
+            found               = true;
+            t_max               = t[lane];
+            hit->primitive      = packets[p].primitive[lane];
+            hit->t              = t[lane];
+            hit->barycentrics.x = u[lane];
+            hit->barycentrics.y = v[lane];
+          }
+        }
+        continue;
+      }
+
+      node_t const &node = nodes[current.child];
+      u32           mask = intersect_children(node, lanes, t_max, entry);
+
+      // hit children are pushed sorted by entry distance, nearest ends on top
+      u32 first = stack_top;
+      for (u32 lane = 0; lane < W; lane += 1) {
+        if ((mask >> lane & 1) == 0) {
+          continue;
+        }
+        entry_t child = { node.child[lane], node.count[lane], entry[lane] };
+        u32     slot  = stack_top;
+        while (slot > first && stack[slot - 1].t < child.t) {
+          stack[slot] = stack[slot - 1];
+          slot -= 1;
+        }
+        stack[slot] = child;
+        stack_top += 1;
+      }
+    }
+    return found;
+  }
+
+  static void intersect_stream(node_t const* nodes, packet_t const* packets, ray_t* rays, hit_t* hits, u32 count) {
+    for (u32 i = 0; i < count; i += 1) {
+      hits[i].primitive = invalid_index;
+      if (traverse<false>(nodes, packets, rays[i], &hits[i])) {
+        rays[i].t_max = hits[i].t;
+      }
+    }
+  }
+
+  static void occluded_stream(node_t const* nodes, packet_t const* packets, ray_t const* rays, u8* results, u32 count) {
+    for (u32 i = 0; i < count; i += 1) {
+      results[i] = traverse<true>(nodes, packets, rays[i], nullptr) ? 1 : 0;
+    }
+  }
+};
+
+} // namespace whim::bvh
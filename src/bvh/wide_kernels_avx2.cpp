@@ -0,0 +1,59 @@
+/*
+  BVH8 kernels. this file alone is compiled with avx2 enabled (see CMakeLists.txt),
+  they are called only after cpu feature check in wide_bvh.cpp
+*/
+
+#include "bvh/wide_kernels.hpp"
+
+#if WHIM_BVH_X86 && defined(__AVX2__)
+  #include <immintrin.h>
+#endif
+
+namespace whim::bvh {
+
+#if WHIM_BVH_X86 && defined(__AVX2__)
+
+namespace {
+
+struct avx2_t {
+  using vec_t                = __m256;
+  constexpr static u32 width = 8;
+
+  static vec_t load(f32 const* data) { return _mm256_load_ps(data); }
+  static void  store(f32* data, vec_t a) { _mm256_store_ps(data, a); }
+  static vec_t splat(f32 value) { return _mm256_set1_ps(value); }
+
+  static vec_t add(vec_t a, vec_t b) { return _mm256_add_ps(a, b); }
+  static vec_t sub(vec_t a, vec_t b) { return _mm256_sub_ps(a, b); }
+  static vec_t mul(vec_t a, vec_t b) { return _mm256_mul_ps(a, b); }
+  static vec_t div(vec_t a, vec_t b) { return _mm256_div_ps(a, b); }
+  static vec_t min(vec_t a, vec_t b) { return _mm256_min_ps(a, b); }
+  static vec_t max(vec_t a, vec_t b) { return _mm256_max_ps(a, b); }
+
+  static vec_t cmp_le(vec_t a, vec_t b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  static vec_t cmp_ge(vec_t a, vec_t b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  static vec_t cmp_ne(vec_t a, vec_t b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+  static vec_t logical_and(vec_t a, vec_t b) { return _mm256_and_ps(a, b); }
+  static u32   movemask(vec_t mask) { return (u32) _mm256_movemask_ps(mask); }
+};
+
+constexpr kernels_t<8> kernels = {
+  &traversal_t<avx2_t>::intersect_stream,
+  &traversal_t<avx2_t>::occluded_stream,
+};
+
+} // namespace
+
+kernels_t<8> const* avx2_kernels() {
+  return &kernels;
+}
+
+#else
+
+kernels_t<8> const* avx2_kernels() {
+  return nullptr;
+}
+
+#endif
+
+} // namespace whim::bvh
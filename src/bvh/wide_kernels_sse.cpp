@@ -0,0 +1,58 @@
+/*
+  BVH4 kernels, sse2 is part of x86-64 baseline so this file needs no extra flags
+*/
+
+#include "bvh/wide_kernels.hpp"
+
+#if WHIM_BVH_X86
+  #include <immintrin.h>
+#endif
+
+namespace whim::bvh {
+
+#if WHIM_BVH_X86
+
+namespace {
+
+struct sse_t {
+  using vec_t                = __m128;
+  constexpr static u32 width = 4;
+
+  static vec_t load(f32 const* data) { return _mm_load_ps(data); }
+  static void  store(f32* data, vec_t a) { _mm_store_ps(data, a); }
+  static vec_t splat(f32 value) { return _mm_set1_ps(value); }
+
+  static vec_t add(vec_t a, vec_t b) { return _mm_add_ps(a, b); }
+  static vec_t sub(vec_t a, vec_t b) { return _mm_sub_ps(a, b); }
+  static vec_t mul(vec_t a, vec_t b) { return _mm_mul_ps(a, b); }
+  static vec_t div(vec_t a, vec_t b) { return _mm_div_ps(a, b); }
+  static vec_t min(vec_t a, vec_t b) { return _mm_min_ps(a, b); }
+  static vec_t max(vec_t a, vec_t b) { return _mm_max_ps(a, b); }
+
+  static vec_t cmp_le(vec_t a, vec_t b) { return _mm_cmple_ps(a, b); }
+  static vec_t cmp_ge(vec_t a, vec_t b) { return _mm_cmpge_ps(a, b); }
+  static vec_t cmp_ne(vec_t a, vec_t b) { return _mm_cmpneq_ps(a, b); }
+  static vec_t logical_and(vec_t a, vec_t b) { return _mm_and_ps(a, b); }
+  static u32   movemask(vec_t mask) { return (u32) _mm_movemask_ps(mask); }
+};
+
+constexpr kernels_t<4> kernels = {
+  &traversal_t<sse_t>::intersect_stream,
+  &traversal_t<sse_t>::occluded_stream,
+};
+
+} // namespace
+
+kernels_t<4> const* sse_kernels() {
+  return &kernels;
+}
+
+#else
+
+kernels_t<4> const* sse_kernels() {
+  return nullptr;
+}
+
+#endif
+
+} // namespace whim::bvh
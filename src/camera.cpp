@@ -8,7 +8,14 @@ namespace whim {
 
 CameraManipulator::CameraManipulator(Input const &input, camera_t camera) :
     m_camera(camera),
-    m_input(input) {
+    m_input(&input) {
+
+  update_proj();
+  update_view();
+}
+
+CameraManipulator::CameraManipulator(camera_t camera) :
+    m_camera(camera) {
 
   update_proj();
   update_view();
@@ -23,12 +30,19 @@ void CameraManipulator::set_look_at(glm::vec3 up, glm::vec3 center, glm::vec3 ey
   m_camera.center = center;
   m_camera.eye    = eye;
   m_camera.fov    = fov;
+
+  update_proj();
+  update_view();
 }
 
 // TODO: move input from constructor to update function?...
 void CameraManipulator::update() {
+  if (m_input == nullptr) {
+    update_view();
+    return;
+  }
 
-  Input::state_t const &state    = m_input.get().state();
+  Input::state_t const &state    = m_input->state();
   auto                  keyboard = state.keyboard;
   auto                  mouse    = state.mouse;
   auto                  dt       = state.dt;
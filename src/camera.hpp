@@ -24,6 +24,8 @@ public:
 
 public:
   CameraManipulator(Input const &input, camera_t camera);
+  // camera without input, used in headless mode
+  explicit CameraManipulator(camera_t camera);
 
   camera_t const& camera() const;
   camera_t& camera();
@@ -52,6 +54,7 @@ private:
 
   f32 m_speed = 3.f;
 
-  cref<Input> m_input;
+  // nullptr if camera is not controlled by user
+  Input const* m_input = nullptr;
 };
 } // namespace whim
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "cli.hpp"
+
+#include <charconv>
+#include <cstdlib>
+#include <stdexcept>
+#include <string_view>
+
+#include "utility/log.hpp"
+
+namespace whim {
+
+namespace {
+
+constexpr std::string_view usage = R"(usage: main [options]
+  --scene <path>          .gltf, .glb or .obj scene to load
+  --headless              render without window and write result to --output
+  --backend <vulkan|cpu>  renderer backend, cpu backend always renders headless
+  --output <path>         output image (.png, .exr or .pfm), headless only
+  --width <n>             render width
+  --height <n>            render height
+  --samples <n>           accumulated samples per pixel, headless only
+  --target-samples <n>    interactive accumulation stops at this many samples per pixel (default 1024)
+  --noise <threshold>     interactive accumulation stops when relative error of pixels drops below it, 0 - off (default 0.01)
+  --frames-in-flight <n>  frames recorded ahead of gpu, 1..4 (default 2)
+  --no-scene-cache        always parse the scene, do not read or write scene cache
+  --no-gltf-streaming     let tinygltf read whole gltf buffers into memory instead of mapping them (for peak memory comparison)
+  --optimize-meshes       weld equal vertices and reorder meshes for vertex fetch locality, reports before/after sizes
+  --vertex-layout <name>  separate, interleaved, compressed or quantized vertex attributes on gpu (default separate),
+                          all - render --samples headless with every layout and print their footprint and throughput
+  --compact-blas          compact every BLAS after build and report memory saved by compaction
+  --blas-merge <n>        merge static primitives of at most n triangles of one gltf node into one BLAS, 0 - off (default 0)
+  --blas-merge-bench      render --samples headless without and with BLAS merging (threshold of --blas-merge, 4096 if off)
+                          and print build time, BLAS memory and throughput, e.g. with --scene ../assets/gltf/Sponza/Sponza.gltf
+  --eye <x,y,z>           camera position
+  --center <x,y,z>        camera target
+  --up <x,y,z>            camera up vector
+  --fov <degrees>         camera field of view
+  --trace <path>          chrome trace of cpu zones written at exit, WHIM_ENABLE_TRACE builds only (default trace.json)
+  --log <path>            copy of log messages, binary records if path ends with .bin, json lines otherwise
+  --profile-dir <path>    directory of gpu profile exports, created if missing, files are named by export time (default .)
+  --help                  show this message)";
+
+[[noreturn]] void fail(std::string_view message, std::string_view arg) {
+  WERROR("{} '{}'", message, arg);
+  log::flush();
+  fmt::println(stderr, "{}", usage);
+  throw std::runtime_error("invalid command line arguments");
+}
+
+template<typename T>
+T parse_number(std::string_view str) {
+  T value = {};
+  auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (error != std::errc{} || end != str.data() + str.size()) {
+    fail("invalid number", str);
+  }
+  return value;
+}
+
+glm::vec3 parse_vec3(std::string_view str) {
+  glm::vec3 result{};
+  for (u32 i = 0; i < 3; i += 1) {
+    usize comma = str.find(',');
+    if ((i < 2) == (comma == std::string_view::npos)) {
+      fail("expected three comma separated numbers", str);
+    }
+    result[(int) i] = parse_number<f32>(str.substr(0, comma));
+    str             = comma == std::string_view::npos ? std::string_view{} : str.substr(comma + 1);
+  }
+  return result;
+}
+
+} // namespace
+
+cli_options_t parse_cli(int argc, char** argv) {
+  cli_options_t options{};
+
+  for (int i = 1; i < argc; i += 1) {
+    std::string_view arg = argv[i];
+
+    auto next = [&]() -> std::string_view {
+      if (i + 1 >= argc) {
+        fail("missing value for", arg);
+      }
+      i += 1;
+      return argv[i];
+    };
+
+    if (arg == "--help") {
+      fmt::println("{}", usage);
+      std::exit(EXIT_SUCCESS);
+    } else if (arg == "--headless") {
+      options.headless = true;
+    } else if (arg == "--no-scene-cache") {
+      options.use_scene_cache = false;
+    } else if (arg == "--no-gltf-streaming") {
+      options.stream_gltf_buffers = false;
+    } else if (arg == "--optimize-meshes") {
+      options.optimize_meshes = true;
+    } else if (arg == "--compact-blas") {
+      options.compact_blas = true;
+    } else if (arg == "--blas-merge-bench") {
+      options.blas_merge_bench = true;
+    } else if (arg == "--backend") {
+      std::string_view backend = next();
+      if (backend == "vulkan") {
+        options.backend = backend_t::vulkan;
+      } else if (backend == "cpu") {
+        options.backend = backend_t::cpu;
+      } else {
+        fail("unknown backend", backend);
+      }
+    } else if (arg == "--scene") {
+      options.scene_path = next();
+    } else if (arg == "--output") {
+      options.output_path = next();
+    } else if (arg == "--width") {
+      options.width = parse_number<u32>(next());
+    } else if (arg == "--height") {
+      options.height = parse_number<u32>(next());
+    } else if (arg == "--samples") {
+      options.samples = parse_number<u32>(next());
+    } else if (arg == "--target-samples") {
+      options.target_samples = parse_number<u32>(next());
+    } else if (arg == "--noise") {
+      options.noise_threshold = parse_number<f32>(next());
+    } else if (arg == "--frames-in-flight") {
+      options.frames_in_flight = parse_number<u32>(next());
+    } else if (arg == "--vertex-layout") {
+      std::string_view name = next();
+      if (name == "all") {
+        options.vertex_layout_bench = true;
+      } else if (auto layout = parse_vertex_layout(name)) {
+        options.vertex_layout = *layout;
+      } else {
+        fail("unknown vertex layout", name);
+      }
+    } else if (arg == "--blas-merge") {
+      options.blas_merge_triangles = parse_number<u32>(next());
+    } else if (arg == "--eye") {
+      options.camera.eye = parse_vec3(next());
+    } else if (arg == "--center") {
+      options.camera.center = parse_vec3(next());
+    } else if (arg == "--up") {
+      options.camera.up = parse_vec3(next());
+    } else if (arg == "--fov") {
+      options.camera.fov = parse_number<f32>(next());
+    } else if (arg == "--trace") {
+      options.trace_path = next();
+    } else if (arg == "--log") {
+      options.log_path = next();
+    } else if (arg == "--profile-dir") {
+      options.profile_directory = next();
+    } else {
+      fail("unknown option", arg);
+    }
+  }
+
+  if (options.width == 0 || options.height == 0 || options.samples == 0 || options.target_samples == 0) {
+    fail("resolution and sample count should be positive", fmt::format("{}x{}, {} samples", options.width, options.height, options.samples));
+  }
+  if (options.frames_in_flight == 0 || options.frames_in_flight > 4) {
+    fail("frames in flight should be in 1..4", fmt::format("{}", options.frames_in_flight));
+  }
+  if (options.noise_threshold < 0.f) {
+    fail("noise threshold should not be negative", fmt::format("{}", options.noise_threshold));
+  }
+  options.camera.aspect = (f32) options.width / (f32) options.height;
+  if (options.vertex_layout_bench && options.backend != backend_t::vulkan) {
+    fail("vertex layouts exist only on vulkan backend", "--vertex-layout all");
+  }
+  if (options.blas_merge_bench && options.backend != backend_t::vulkan) {
+    fail("BLAS merging exists only on vulkan backend", "--blas-merge-bench");
+  }
+  if (options.vertex_layout_bench && options.blas_merge_bench) {
+    fail("only one benchmark can run at a time", "--blas-merge-bench");
+  }
+  // cpu backend has nothing to present into, benchmarks render offline
+  options.headless = options.headless || options.backend == backend_t::cpu || options.vertex_layout_bench || options.blas_merge_bench;
+
+  return options;
+}
+
+} // namespace whim
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+
+#include "camera.hpp"
+#include "utility/types.hpp"
+#include "vertex_layout.hpp"
+
+namespace whim {
+
+enum class backend_t { vulkan, cpu };
+
+struct cli_options_t {
+  backend_t   backend     = backend_t::vulkan;
+  bool        headless    = false;
+  std::string scene_path  = "../assets/gltf/FlightHelmet/FlightHelmet.gltf";
+  std::string output_path = "render.png";
+  u32         width       = 960;
+  u32         height      = 600;
+  u32         samples     = 64;
+  // progressive accumulation limits of interactive mode
+  u32 target_samples   = 1024;
+  f32 noise_threshold  = 0.01f;
+  u32 frames_in_flight = 2;
+  // gltf loading, see gltf_load_options_t
+  bool use_scene_cache     = true;
+  bool stream_gltf_buffers = true;
+  // weld and reorder vertices of loaded meshes
+  bool optimize_meshes = false;
+  // vertex_layout_bench renders scene headless once per layout and compares them
+  vertex_layout_t vertex_layout       = vertex_layout_t::separate;
+  bool            vertex_layout_bench = false;
+  // compact BLASes after build, build log reports memory before and after
+  bool compact_blas = false;
+  // blas_merge_bench renders scene headless without and with BLAS merging and compares them
+  u32  blas_merge_triangles = 0;
+  bool blas_merge_bench     = false;
+  // chrome trace of cpu zones, written only by builds with WHIM_ENABLE_TRACE
+  std::string trace_path = "trace.json";
+  // log file next to console, .bin - binary records, anything else - json lines. empty - console only
+  std::string log_path = {};
+  // csv and json exports of gpu profiler window
+  std::string profile_directory = ".";
+  // aspect is derived from resolution
+  camera_t camera = { .eye = glm::vec3{ 0.f, 0.f, 3.f } };
+};
+
+/*
+  throws std::runtime_error with usage printed on invalid arguments,
+  exits on --help
+*/
+cli_options_t parse_cli(int argc, char** argv);
+
+} // namespace whim
@@ -4,6 +4,7 @@
 
 #include "utility/macros.hpp"
 #include "utility/types.hpp"
+#include "vertex_layout.hpp"
 #include <string>
 
 struct config_t {
@@ -17,6 +18,33 @@ struct config_t {
     bool is_fullscreen             = false;
     bool validation_layers_support = true;
     bool raytracing_enabled        = true;
+    // compact every BLAS after the build, trades a bit of load time for less memory
+    bool compact_blas = false;
+    // static primitives of at most this many triangles which belong to one gltf node (or one obj file) are merged into
+    // multi geometry BLASes, one TLAS instance traces all of them. 0 - every primitive gets its own BLAS instance
+    whim::u32 blas_merge_triangles = 0;
+    // moved instances refit the TLAS, it is rebuilt after this many refits (0 - never periodically) or when swept bounds
+    // of moved instances grow total instance bounds area by tlas_refit_growth_limit times
+    whim::u32 tlas_rebuild_period     = 256;
+    whim::f32 tlas_refit_growth_limit = 1.5f;
+    // store parsed gltf scenes in scene_cache_directory and reuse them on the next start
+    bool use_scene_cache = true;
+    // memory map glb and external gltf buffers instead of reading them whole with tinygltf, lowers peak memory of loading
+    bool stream_gltf_buffers = true;
+    // weld equal vertices and reorder indices and vertices of every primitive for fetch locality in hit shaders
+    bool optimize_meshes = false;
+    // vertex attributes layout on gpu, see vertex_layout.hpp
+    whim::vertex_layout_t vertex_layout = whim::vertex_layout_t::separate;
+    // threads used to decode scenes and by cpu backend to render: 0 - one per hardware thread, 1 - serial
+    whim::u32 loader_threads = 0;
+    // interactive accumulation stops after target_samples per pixel or earlier, when relative standard error
+    // of almost every pixel luminance is below noise_threshold. 0 threshold - only sample count is used
+    whim::u32 target_samples  = 1024;
+    whim::f32 noise_threshold = 0.01f;
+    // frames recorded ahead of gpu, 1 - cpu waits for every frame to finish before recording next one
+    whim::u32 frames_in_flight = 2;
+    // gpu profiler window writes its csv and json exports into this directory
+    std::string profile_directory = ".";
 
   } options;
 };
@@ -0,0 +1,314 @@
+#include "cpu/raytracer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <span>
+
+#include "gltf_loader.hpp"
+#include "obj_loader.hpp"
+#include "utility/log.hpp"
+
+namespace whim::cpu {
+
+namespace {
+
+// random.glsl
+u32 tea(u32 val0, u32 val1) {
+  u32 v0 = val0;
+  u32 v1 = val1;
+  u32 s0 = 0;
+
+  for (u32 n = 0; n < 16; n += 1) {
+    s0 += 0x9e3779b9;
+    v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+    v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+  }
+  return v0;
+}
+
+u32 lcg(u32 &prev) {
+  constexpr u32 lcg_a = 1664525u;
+  constexpr u32 lcg_c = 1013904223u;
+  prev                = lcg_a * prev + lcg_c;
+  return prev & 0x00FFFFFF;
+}
+
+f32 rnd(u32 &prev) { return (f32) lcg(prev) / (f32) 0x01000000; }
+
+/*
+  textures are sampled as VK_FORMAT_R8G8B8A8_SRGB, so color channels are decoded on fetch
+*/
+std::array<f32, 256> const &srgb_to_linear_table() {
+  static std::array<f32, 256> const table = []() {
+    std::array<f32, 256> result{};
+    for (u32 i = 0; i < 256; i += 1) {
+      f32 c     = (f32) i / 255.f;
+      result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return result;
+  }();
+  return table;
+}
+
+/*
+  VK_SAMPLER_ADDRESS_MODE_REPEAT for nearest filtering
+*/
+u32 wrap_texel(f32 coord, u32 size) {
+  i64 texel = (i64) std::floor(coord * (f32) size) % (i64) size;
+  return (u32) (texel < 0 ? texel + size : texel);
+}
+
+} // namespace
+
+RayTracer::RayTracer(CameraManipulator const &man, config_t const &config) :
+    m_options(config.options),
+    m_width(config.width),
+    m_height(config.height),
+    m_camera_ref(man) {
+
+  // calling thread takes part in parallel loops, so it is not counted as worker
+  u32 thread_count = m_options.loader_threads != 0 ? m_options.loader_threads : std::max(1u, std::thread::hardware_concurrency());
+  m_thread_pool    = std::make_unique<ThreadPool>(thread_count - 1);
+
+  m_image.resize((usize) m_width * m_height, glm::vec4{ 0.f });
+}
+
+void RayTracer::load_gltf_scene(std::string_view file_path) {
+  gltf_load_options_t options = {
+    .use_scene_cache = m_options.use_scene_cache,     //
+    .stream_buffers  = m_options.stream_gltf_buffers, //
+    .optimize_meshes = m_options.optimize_meshes,
+  };
+  load_gltf(file_path, m_scene, *m_thread_pool, options);
+
+  build_acceleration_structures();
+}
+
+void RayTracer::load_obj_scene(std::string_view file_path) {
+  load_obj(file_path, m_scene, *m_thread_pool, { .use_scene_cache = m_options.use_scene_cache, .optimize_meshes = m_options.optimize_meshes });
+
+  build_acceleration_structures();
+}
+
+void RayTracer::build_acceleration_structures() {
+  auto build_start = std::chrono::steady_clock::now();
+
+  // BLAS: one per primitive in object space, same as on gpu. big primitives build their subtrees in parallel too,
+  // primitives sharing geometry of an earlier one stay empty and are traced through its BLAS
+  m_blases.resize(m_scene.primitive_infos.size());
+  m_thread_pool->parallel_for(m_scene.primitive_infos.size(), [&](usize i) {
+    auto const &info = m_scene.primitive_infos[i];
+    if (info.geometry_owner >= 0) {
+      return;
+    }
+
+    std::span<glm::vec3 const> positions{ m_scene.positions.data() + info.vertex_offset, info.vertex_count };
+    std::span<u32 const>       indices{ m_scene.indices.data() + info.index_offset, info.index_count };
+    m_blases[i] = bvh::WideBvh::build_triangles(positions, indices, m_thread_pool.get());
+  });
+
+  // TLAS: instance per node, bounds are world space boxes of transformed BLAS bounds
+  std::vector<bvh::bounds_t> instance_bounds{};
+  m_instances.clear();
+  m_instances.reserve(m_scene.nodes.size());
+  for (auto const &node : m_scene.nodes) {
+    i32                 owner      = m_scene.primitive_infos[node.primitive_mesh].geometry_owner;
+    u32                 blas_index = owner >= 0 ? (u32) owner : (u32) node.primitive_mesh;
+    bvh::WideBvh const &blas       = m_blases[blas_index];
+    if (blas.empty()) {
+      continue;
+    }
+
+    instance_t instance      = {};
+    instance.object_to_world = node.world_matrix;
+    instance.world_to_object = glm::inverse(node.world_matrix);
+    instance.primitive       = (u32) node.primitive_mesh;
+    instance.blas            = blas_index;
+    m_instances.push_back(instance);
+
+    bvh::bounds_t world_bounds{};
+    for (u32 corner = 0; corner < 8; corner += 1) {
+      glm::vec3 point = {
+        corner & 1 ? blas.bounds().max.x : blas.bounds().min.x, //
+        corner & 2 ? blas.bounds().max.y : blas.bounds().min.y, //
+        corner & 4 ? blas.bounds().max.z : blas.bounds().min.z  //
+      };
+      world_bounds.grow(glm::vec3(node.world_matrix * glm::vec4(point, 1.f)));
+    }
+    instance_bounds.push_back(world_bounds);
+  }
+  m_tlas = bvh::Bvh::build(instance_bounds, m_thread_pool.get());
+
+  usize blas_nodes  = 0;
+  usize blas_shared = 0;
+  for (usize i = 0; i < m_blases.size(); i += 1) {
+    blas_nodes += m_blases[i].node_count();
+    blas_shared += m_scene.primitive_infos[i].geometry_owner >= 0 ? 1 : 0;
+  }
+
+  std::chrono::duration<f64, std::milli> build_time = std::chrono::steady_clock::now() - build_start;
+  WINFO(
+      "cpu: built {} BLAS ({} shared, {} nodes, {} kernels) and TLAS over {} instances in {:.2f} ms", //
+      m_blases.size() - blas_shared, blas_shared, blas_nodes, bvh::to_string(bvh::detect_isa()), m_instances.size(), build_time.count()
+  );
+}
+
+std::vector<f32> RayTracer::render_offline(u32 sample_count) {
+  WASSERT(sample_count > 0, "at least one sample is needed");
+
+  CameraManipulator const &cam = m_camera_ref;
+  m_inverse_view               = cam.inverse_view_matrix();
+  m_inverse_proj               = cam.inverse_proj_matrix();
+
+  // every call starts new accumulation, like vk::RayTracer::render_offline
+  reset_frame();
+
+  u32 tiles_x    = (m_width + tile_size - 1) / tile_size;
+  u32 tiles_y    = (m_height + tile_size - 1) / tile_size;
+  u32 tile_count = tiles_x * tiles_y;
+
+  auto render_start = std::chrono::steady_clock::now();
+
+  // tiles are pulled from shared counter, so threads which got cheap tiles take more of them
+  std::atomic<u32> next_tile = 0;
+  m_thread_pool->parallel_for(m_thread_pool->thread_count() + 1, [&](usize) {
+    for (u32 tile = next_tile.fetch_add(1); tile < tile_count; tile = next_tile.fetch_add(1)) {
+      render_tile(tile, 0, sample_count);
+    }
+  });
+  m_frame = sample_count;
+
+  std::chrono::duration<f64> render_time = std::chrono::steady_clock::now() - render_start;
+  WINFO(
+      "cpu: rendered {} samples at {}x{} on {} threads in {:.3f} s ({:.2f} samples/s, {:.2f} Mrays/s)", sample_count, m_width, m_height, //
+      m_thread_pool->thread_count() + 1, render_time.count(), sample_count / render_time.count(),                                       //
+      (f64) sample_count * m_width * m_height / render_time.count() / 1e6
+  );
+
+  std::vector<f32> result((usize) m_width * m_height * 4);
+  memcpy(result.data(), m_image.data(), result.size() * sizeof(f32));
+  return result;
+}
+
+void RayTracer::reset_frame() { m_frame = 0; }
+
+void RayTracer::render_tile(u32 tile, u32 first_sample, u32 sample_count) {
+  u32 tiles_x = (m_width + tile_size - 1) / tile_size;
+  u32 x_begin = (tile % tiles_x) * tile_size;
+  u32 y_begin = (tile / tiles_x) * tile_size;
+  u32 x_end   = std::min(x_begin + tile_size, m_width);
+  u32 y_end   = std::min(y_begin + tile_size, m_height);
+
+  for (u32 y = y_begin; y < y_end; y += 1) {
+    for (u32 x = x_begin; x < x_end; x += 1) {
+      glm::vec4 &pixel = m_image[(usize) y * m_width + x];
+
+      // accumulation over frames like in default.rgen, pixels are independent so frames are looped per pixel
+      for (u32 frame = first_sample; frame < first_sample + sample_count; frame += 1) {
+        glm::vec4 color = ray_gen(x, y, frame);
+        pixel           = frame > 0 ? glm::mix(pixel, color, 1.f / (f32) (frame + 1)) : color;
+      }
+    }
+  }
+}
+
+glm::vec4 RayTracer::ray_gen(u32 x, u32 y, u32 frame) const {
+  u32 seed = tea(y * m_width + x, frame);
+  f32 r1   = rnd(seed);
+  f32 r2   = rnd(seed);
+
+  glm::vec2 subpixel_jitter = frame == 0 ? glm::vec2(0.5f, 0.5f) : glm::vec2(r1, r2);
+  glm::vec2 pixel_center    = glm::vec2((f32) x, (f32) y) + subpixel_jitter;
+
+  glm::vec2 in_uv = pixel_center / glm::vec2((f32) m_width, (f32) m_height);
+  glm::vec2 d     = in_uv * 2.f - 1.f;
+
+  glm::vec4 origin    = m_inverse_view * glm::vec4(0, 0, 0, 1);
+  glm::vec4 target    = m_inverse_proj * glm::vec4(d.x, d.y, 1, 1);
+  glm::vec4 direction = m_inverse_view * glm::vec4(glm::normalize(glm::vec3(target)), 0);
+
+  bvh::ray_t ray = {};
+  ray.origin     = glm::vec3(origin);
+  ray.direction  = glm::vec3(direction);
+  ray.t_min      = ray_t_min;
+  ray.t_max      = ray_t_max;
+
+  hit_t hit = {};
+  return trace_ray(ray, hit) ? closest_hit(hit) : miss();
+}
+
+bool RayTracer::trace_ray(bvh::ray_t &ray, hit_t &hit) const {
+  return m_tlas.traverse(ray, [&](u32 instance_index, bvh::ray_t &world_ray) { //
+    return intersect_primitive(instance_index, world_ray, hit);
+  });
+}
+
+bool RayTracer::intersect_primitive(u32 instance_index, bvh::ray_t &world_ray, hit_t &hit) const {
+  instance_t const &instance = m_instances[instance_index];
+
+  // direction is not normalized, so hit distance is the same in both spaces
+  bvh::ray_t object_ray = world_ray;
+  object_ray.origin     = glm::vec3(instance.world_to_object * glm::vec4(world_ray.origin, 1.f));
+  object_ray.direction  = glm::vec3(instance.world_to_object * glm::vec4(world_ray.direction, 0.f));
+
+  bvh::hit_t blas_hit = {};
+  if (not m_blases[instance.blas].intersect(object_ray, blas_hit)) {
+    return false;
+  }
+
+  hit.instance     = instance_index;
+  hit.triangle     = blas_hit.primitive;
+  hit.barycentrics = blas_hit.barycentrics;
+  world_ray.t_max  = object_ray.t_max;
+  return true;
+}
+
+glm::vec4 RayTracer::closest_hit(hit_t const &hit) const {
+  instance_t const          &instance = m_instances[hit.instance];
+  primitive_full_info const &info     = m_scene.primitive_infos[instance.primitive];
+
+  u32 index_offset  = info.index_offset + 3 * hit.triangle;
+  u32 vertex_offset = info.vertex_offset;
+  u32 mat_index     = info.material_index;
+
+  glm::uvec3 triangle_index = glm::uvec3(m_scene.indices[index_offset + 0], m_scene.indices[index_offset + 1], m_scene.indices[index_offset + 2]);
+  triangle_index += glm::uvec3(vertex_offset);
+
+  glm::vec3 barycentrics = glm::vec3(1.f - hit.barycentrics.x - hit.barycentrics.y, hit.barycentrics.x, hit.barycentrics.y);
+
+  // only values which affect default.rchit output are evaluated
+  glm::vec2 uv0       = m_scene.uvs[triangle_index.x];
+  glm::vec2 uv1       = m_scene.uvs[triangle_index.y];
+  glm::vec2 uv2       = m_scene.uvs[triangle_index.z];
+  glm::vec2 texcoord0 = uv0 * barycentrics.x + uv1 * barycentrics.y + uv2 * barycentrics.z;
+
+  material const &mat = m_scene.materials[mat_index];
+  if (mat.base_color_texture > -1) {
+    return glm::vec4(mat.base_color_factor, 1.f) * sample_texture(mat.base_color_texture, texcoord0);
+  }
+  return glm::vec4(mat.base_color_factor, 1.f);
+}
+
+glm::vec4 RayTracer::miss() const { return glm::vec4(0.3f, 0.3f, 0.3f, 1.f); }
+
+glm::vec4 RayTracer::sample_texture(i32 texture_index, glm::vec2 uv) const {
+  // scene without images has no textured materials, index is checked only to stay in bounds
+  if ((usize) texture_index >= m_scene.images.size()) {
+    return glm::vec4{ 1.f };
+  }
+
+  // textureLod(.., 0) with VK_FILTER_NEAREST reads single texel of base level
+  image_data_t const &image = m_scene.images[texture_index];
+  u32                 x     = wrap_texel(uv.x, image.width);
+  u32                 y     = wrap_texel(uv.y, image.height);
+  u8 const*           texel = image.data().data() + ((usize) y * image.width + x) * 4;
+
+  auto const &srgb = srgb_to_linear_table();
+  return glm::vec4(srgb[texel[0]], srgb[texel[1]], srgb[texel[2]], (f32) texel[3] / 255.f);
+}
+
+} // namespace whim::cpu
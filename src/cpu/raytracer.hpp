@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "bvh/bvh.hpp"
+#include "bvh/wide_bvh.hpp"
+#include "camera.hpp"
+#include "config.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/types.hpp"
+
+namespace whim::cpu {
+
+/*
+  reference ray tracer which runs default.rgen, default.rchit and default.rmiss on cpu.
+  consumes the same scene data as vk::RayTracer, so both backends should produce the same image
+*/
+class RayTracer final : public Renderer {
+
+public:
+  RayTracer(CameraManipulator const &man, config_t const &config);
+  ~RayTracer() override = default;
+
+  RayTracer(RayTracer &&) noexcept            = default;
+  RayTracer &operator=(RayTracer &&) noexcept = default;
+  RayTracer(const RayTracer &)                = delete;
+  RayTracer &operator=(const RayTracer &)     = delete;
+
+  void load_gltf_scene(std::string_view file_path) override;
+  void load_obj_scene(std::string_view file_path) override;
+
+  void reset_frame() override;
+
+  /*
+    renders sample_count accumulated samples on all pool threads,
+    result is linear RGBA, rows go from top to bottom
+  */
+  std::vector<f32> render_offline(u32 sample_count) override;
+
+private:
+  constexpr static u32 tile_size = 16;
+  // same as in default.rgen
+  constexpr static f32 ray_t_min = 0.001f;
+  constexpr static f32 ray_t_max = 10000.f;
+
+  /*
+    equivalent of VkAccelerationStructureInstanceKHR
+  */
+  struct instance_t {
+    glm::mat4 object_to_world = glm::mat4{ 1.f };
+    glm::mat4 world_to_object = glm::mat4{ 1.f };
+    u32       primitive       = 0; // gl_InstanceCustomIndexEXT
+    u32       blas            = 0; // primitive or geometry owner of primitive, m_blases index
+  };
+
+  /*
+    closest hit attributes
+  */
+  struct hit_t {
+    u32       instance     = 0;
+    u32       triangle     = 0; // gl_PrimitiveID
+    glm::vec2 barycentrics = {};
+  };
+
+private:
+  void build_acceleration_structures();
+
+  void render_tile(u32 tile, u32 first_sample, u32 sample_count);
+
+  // default.rgen for one pixel and sample
+  glm::vec4 ray_gen(u32 x, u32 y, u32 frame) const;
+  bool      trace_ray(bvh::ray_t &ray, hit_t &hit) const;
+  bool      intersect_primitive(u32 instance_index, bvh::ray_t &world_ray, hit_t &hit) const;
+  glm::vec4 closest_hit(hit_t const &hit) const;
+  glm::vec4 miss() const;
+
+  glm::vec4 sample_texture(i32 texture_index, glm::vec2 uv) const;
+
+private:
+  config_t::options_t m_options     = {};
+  uptr<ThreadPool>    m_thread_pool = nullptr;
+
+  u32 m_width  = 0;
+  u32 m_height = 0;
+
+  scene_data_t m_scene = {};
+
+  // ACCELERATION STRUCTURE DATA
+  std::vector<bvh::WideBvh> m_blases{};
+  std::vector<instance_t>   m_instances{};
+  bvh::Bvh                  m_tlas{};
+
+  // accumulation image, equivalent of storage image
+  std::vector<glm::vec4> m_image{};
+  u32                    m_frame = 0;
+
+  // camera matrices of current render_offline call
+  glm::mat4 m_inverse_view = glm::mat4{ 1.f };
+  glm::mat4 m_inverse_proj = glm::mat4{ 1.f };
+
+  // REFERENCES
+  cref<CameraManipulator> m_camera_ref;
+};
+
+} // namespace whim::cpu
@@ -0,0 +1,883 @@
+#include "gltf_loader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include <external/stb_image.h>
+
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#include "tiny_gltf.h"
+#include "json.hpp" // nlohmann json shipped with tinygltf
+
+#include "scene_cache.hpp"
+#include "utility/hash.hpp"
+#include "utility/mapped_file.hpp"
+#include "utility/process_memory.hpp"
+#include "utility/trace.hpp"
+#include "whim.hpp"
+
+namespace whim {
+
+namespace {
+
+/*
+  bytes of gltf buffer or of a range inside it
+*/
+struct buffer_source_t {
+  u8 const*         data = nullptr;
+  usize             size = 0;
+  MappedFile const* file = nullptr; // mapping holding data, null if data is owned by tinygltf model
+};
+
+/*
+  encoded image, one of: range of mapped buffer, external file mapped only while decoding, bytes copied out of tinygltf
+*/
+struct image_source_t {
+  i32             buffer_view = -1;
+  buffer_source_t bytes{};
+  std::string     path{};
+  std::vector<u8> encoded{};
+};
+
+/*
+  parsed gltf with raw bytes of its buffers and images
+
+  streamed - tinygltf parses json without buffers and images, glb binary chunk and external .bin files are memory mapped
+             and read in place, pages are released as soon as their primitive or image is decoded
+  otherwise - tinygltf reads every buffer into model, images are copied out by store_encoded_image
+*/
+struct gltf_source_t {
+  tinygltf::Model               model{};
+  std::vector<buffer_source_t>  buffers{};
+  std::vector<image_source_t>   images{};
+  std::vector<uptr<MappedFile>> files{};
+  // external buffer and image files, scene cache is checked against them
+  std::vector<std::string> dependencies{};
+};
+
+void release(buffer_source_t const &bytes) {
+  if (bytes.file != nullptr) {
+    bytes.file->release(bytes.data, bytes.size);
+  }
+}
+
+/*
+  strided view over accessor data inside gltf buffer
+*/
+struct accessor_view_t {
+  u8 const* data           = nullptr;
+  usize     stride         = 0;
+  usize     count          = 0;
+  int       component_type = 0;
+};
+
+accessor_view_t make_accessor_view(gltf_source_t const &source, tinygltf::Accessor const &accessor) {
+  auto const &buffer_view = source.model.bufferViews[accessor.bufferView];
+  auto const &buffer      = source.buffers[buffer_view.buffer];
+
+  const size_t stride = accessor.ByteStride(buffer_view);
+  WASSERT(stride != size_t(-1), "??");
+  WASSERT(buffer_view.byteOffset + buffer_view.byteLength <= buffer.size, "buffer view is out of buffer bounds");
+
+  accessor_view_t view = {};
+  view.data            = buffer.data + accessor.byteOffset + buffer_view.byteOffset;
+  view.stride          = stride;
+  view.count           = accessor.count;
+  view.component_type  = accessor.componentType;
+  return view;
+}
+
+usize element_bytes(tinygltf::Accessor const &accessor) {
+  return (usize) tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type);
+}
+
+// whole range of accessor inside its buffer
+buffer_source_t accessor_bytes(gltf_source_t const &source, tinygltf::Accessor const &accessor) {
+  if (accessor.bufferView < 0 || accessor.count == 0) {
+    return {};
+  }
+  auto const &buffer_view = source.model.bufferViews[accessor.bufferView];
+  auto const &buffer      = source.buffers[buffer_view.buffer];
+  usize       stride      = (usize) accessor.ByteStride(buffer_view);
+  usize       element     = element_bytes(accessor);
+
+  buffer_source_t bytes = {};
+  bytes.data            = buffer.data + buffer_view.byteOffset + accessor.byteOffset;
+  bytes.size            = stride * (accessor.count - 1) + element;
+  bytes.file            = buffer.file;
+  return bytes;
+}
+
+template<typename T>
+void copy_elements(accessor_view_t const &view, T* out) {
+  // tightly packed data is copied at once
+  if (view.stride == sizeof(T)) {
+    memcpy(out, view.data, view.count * sizeof(T));
+    return;
+  }
+  for (usize i = 0; i < view.count; i += 1) {
+    memcpy(&out[i], view.data + view.stride * i, sizeof(T));
+  }
+}
+
+template<typename T>
+void widen_indices(accessor_view_t const &view, u32* out) {
+  for (usize i = 0; i < view.count; i += 1) {
+    T index = 0;
+    memcpy(&index, view.data + view.stride * i, sizeof(T));
+    out[i] = index;
+  }
+}
+
+void decode_indices(accessor_view_t const &view, u32* out) {
+  // component type is checked once per accessor, not per index
+  switch (view.component_type) {
+    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:   copy_elements(view, out); break;
+    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: widen_indices<u16>(view, out); break;
+    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:  widen_indices<u8>(view, out); break;
+    default:                                     WASSERT(false, "WHAT THE HELL?");
+  }
+}
+
+void generate_normals(primitive_full_info const &info, u32 const* indices, glm::vec3 const* positions, glm::vec3* normals) {
+  std::fill(normals, normals + info.vertex_count, glm::vec3(0.f));
+  for (u32 i = 0; i + 2 < info.index_count; i += 3) {
+    u32         ind0 = indices[i + 0];
+    u32         ind1 = indices[i + 1];
+    u32         ind2 = indices[i + 2];
+    const auto &pos0 = positions[ind0];
+    const auto &pos1 = positions[ind1];
+    const auto &pos2 = positions[ind2];
+    const auto  v1   = glm::normalize(pos1 - pos0); // Many normalize, but when objects are really small the
+    const auto  v2   = glm::normalize(pos2 - pos0); // cross will go below nv_eps and the normal will be (0,0,0)
+    const auto  n    = glm::cross(v1, v2);
+    normals[ind0] += n;
+    normals[ind1] += n;
+    normals[ind2] += n;
+  }
+  for (u32 i = 0; i < info.vertex_count; i += 1) {
+    normals[i] = glm::normalize(normals[i]);
+  }
+}
+
+/*
+  tinygltf image loader which only keeps encoded bytes, decoding happens later on worker threads
+*/
+bool store_encoded_image(
+    tinygltf::Image* image, const int image_idx, std::string* error, std::string* warning, //
+    int req_width, int req_height, const unsigned char* bytes, int size, void* user_data
+) {
+  UNUSED(image);
+  UNUSED(error);
+  UNUSED(warning);
+  UNUSED(req_width);
+  UNUSED(req_height);
+
+  auto &encoded_images = *static_cast<std::vector<std::vector<u8>>*>(user_data);
+  if (encoded_images.size() <= (usize) image_idx) {
+    encoded_images.resize(image_idx + 1);
+  }
+  encoded_images[image_idx].assign(bytes, bytes + size);
+  return true;
+}
+
+image_data_t decode_image(u8 const* encoded, usize size) {
+  WTRACE_FUNCTION();
+  int      width = 0, height = 0, channels = 0;
+  stbi_uc* stbi_pixels = stbi_load_from_memory(encoded, (int) size, &width, &height, &channels, STBI_rgb_alpha);
+
+  if (stbi_pixels == nullptr) {
+    WERROR("Failed to decode texture: {}", stbi_failure_reason());
+    throw std::runtime_error("failed to decode texture");
+  }
+
+  image_data_t result = {};
+  result.width        = (u32) width;
+  result.height       = (u32) height;
+  result.pixels.assign(stbi_pixels, stbi_pixels + (usize) width * height * 4);
+  stbi_image_free(stbi_pixels);
+  return result;
+}
+
+// source memory is released right after decoding
+image_data_t decode_image(image_source_t &image) {
+  if (not image.encoded.empty()) {
+    image_data_t result = decode_image(image.encoded.data(), image.encoded.size());
+    image.encoded       = {};
+    return result;
+  }
+  if (image.bytes.data != nullptr) {
+    image_data_t result = decode_image(image.bytes.data, image.bytes.size);
+    release(image.bytes);
+    return result;
+  }
+
+  MappedFile file{ image.path };
+  if (not file.is_open()) {
+    WERROR("Failed to open texture: {}", image.path);
+    throw std::runtime_error("failed to open texture");
+  }
+  return decode_image(file.data(), file.size());
+}
+
+void report_parse_result(std::string_view file_path, bool res, std::string const &warning, std::string const &error) {
+  if (not warning.empty()) {
+    WERROR(" GLTF WARNING: {}", warning);
+  }
+
+  if (not error.empty()) {
+    WERROR("error while loading gltf file {}, message:{}", file_path, error);
+  }
+
+  if (not res) {
+    WERROR("some how gltf return error code with empty error string, filename:{}", file_path);
+  }
+}
+
+/*
+  whole file goes through tinygltf, .glb and .gltf with external or embedded buffers
+*/
+void open_gltf(std::string_view file_path, gltf_source_t &source) {
+  tinygltf::TinyGLTF loader{};
+  std::string        warning{};
+  std::string        error{};
+
+  // tinygltf only collects encoded images, they are decoded in parallel after parsing
+  std::vector<std::vector<u8>> encoded_images{};
+  loader.SetImageLoader(store_encoded_image, &encoded_images);
+
+  bool res = false;
+  {
+    WTRACE_ZONE("parse gltf");
+    if (std::filesystem::path(file_path).extension() == ".glb") {
+      res = loader.LoadBinaryFromFile(&source.model, &error, &warning, std::string(file_path));
+    } else {
+      res = loader.LoadASCIIFromFile(&source.model, &error, &warning, std::string(file_path));
+    }
+  }
+  report_parse_result(file_path, res, warning, error);
+
+  for (auto const &buffer : source.model.buffers) {
+    source.buffers.push_back(buffer_source_t{ .data = buffer.data.data(), .size = buffer.data.size() });
+  }
+  encoded_images.resize(source.model.images.size());
+  for (auto &encoded : encoded_images) {
+    source.images.push_back(image_source_t{ .encoded = std::move(encoded) });
+  }
+}
+
+constexpr u32 glb_magic      = 0x46546C67; // "glTF"
+constexpr u32 glb_chunk_json = 0x4E4F534A; // "JSON"
+constexpr u32 glb_chunk_bin  = 0x004E4942; // "BIN\0"
+
+u32 read_u32(u8 const* data) {
+  u32 value = 0;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+// "%20" and friends of relative uris
+std::string decode_uri(std::string_view uri) {
+  std::string result{};
+  result.reserve(uri.size());
+  for (usize i = 0; i < uri.size(); i += 1) {
+    if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit((u8) uri[i + 1]) && std::isxdigit((u8) uri[i + 2])) {
+      result.push_back((char) std::stoi(std::string(uri.substr(i + 1, 2)), nullptr, 16));
+      i += 2;
+    } else {
+      result.push_back(uri[i]);
+    }
+  }
+  return result;
+}
+
+/*
+  external files of scene parsed by tinygltf, data uris and glb binary chunk live inside the scene file itself
+*/
+void collect_dependencies(std::string_view file_path, gltf_source_t &source) {
+  std::filesystem::path base_dir = std::filesystem::path(file_path).parent_path();
+  auto                  add      = [&](std::string const &uri) {
+    if (not uri.empty() && not uri.starts_with("data:")) {
+      source.dependencies.push_back((base_dir / decode_uri(uri)).string());
+    }
+  };
+  for (auto const &buffer : source.model.buffers) {
+    add(buffer.uri);
+  }
+  for (auto const &image : source.model.images) {
+    add(image.uri);
+  }
+}
+
+[[noreturn]] void fail_streamed(std::string_view file_path, std::string_view message) {
+  WERROR("Cant stream gltf scene {}: {}", file_path, message);
+  throw std::runtime_error("cant stream gltf scene");
+}
+
+/*
+  returns false if scene embeds buffers or images as data uris: they live inside json anyway,
+  such scenes go through open_gltf
+*/
+bool open_gltf_streamed(std::string_view file_path, gltf_source_t &source) {
+  auto file = std::make_unique<MappedFile>(file_path);
+  if (not file->is_open()) {
+    fail_streamed(file_path, "file cant be mapped");
+  }
+
+  // glb: 12 byte header, json chunk, optional binary chunk. chunk: u32 size, u32 type, data
+  std::string_view json_text{};
+  buffer_source_t  binary_chunk{};
+  if (file->size() >= 12 && read_u32(file->data()) == glb_magic) {
+    usize offset = 12;
+    while (offset + 8 <= file->size()) {
+      u32 chunk_size = read_u32(file->data() + offset);
+      u32 chunk_type = read_u32(file->data() + offset + 4);
+      offset += 8;
+      if (offset + chunk_size > file->size()) {
+        fail_streamed(file_path, "glb chunk is out of file bounds");
+      }
+
+      if (chunk_type == glb_chunk_json && json_text.empty()) {
+        json_text = std::string_view{ (char const*) file->data() + offset, chunk_size };
+      } else if (chunk_type == glb_chunk_bin && binary_chunk.data == nullptr) {
+        binary_chunk = buffer_source_t{ .data = file->data() + offset, .size = chunk_size, .file = file.get() };
+      }
+      offset += chunk_size;
+    }
+  } else {
+    json_text = std::string_view{ (char const*) file->data(), file->size() };
+  }
+
+  nlohmann::json root{};
+  {
+    WTRACE_ZONE("parse gltf json");
+    root = nlohmann::json::parse(json_text, nullptr, false);
+  }
+  if (root.is_discarded() || not root.is_object()) {
+    fail_streamed(file_path, "invalid json");
+  }
+
+  auto buffers = root.value("buffers", nlohmann::json::array());
+  auto images  = root.value("images", nlohmann::json::array());
+  auto has_data_uri = [](nlohmann::json const &items) {
+    return std::any_of(items.begin(), items.end(), [](nlohmann::json const &item) { return item.value("uri", std::string{}).starts_with("data:"); });
+  };
+  if (has_data_uri(buffers) || has_data_uri(images)) {
+    return false;
+  }
+
+  std::filesystem::path base_dir = std::filesystem::path(file_path).parent_path();
+  for (auto const &buffer : buffers) {
+    usize byte_length = buffer.value("byteLength", usize(0));
+
+    // buffer without uri is binary chunk of glb
+    if (not buffer.contains("uri")) {
+      if (binary_chunk.size < byte_length) {
+        fail_streamed(file_path, "glb binary chunk is smaller than its buffer");
+      }
+      source.buffers.push_back(buffer_source_t{ .data = binary_chunk.data, .size = byte_length, .file = binary_chunk.file });
+      continue;
+    }
+
+    std::string bin_path = (base_dir / decode_uri(buffer["uri"].get<std::string>())).string();
+    auto        bin_file = std::make_unique<MappedFile>(bin_path);
+    if (not bin_file->is_open() || bin_file->size() < byte_length) {
+      fail_streamed(file_path, fmt::format("buffer {} is missing or smaller than {} bytes", bin_path, byte_length));
+    }
+    source.buffers.push_back(buffer_source_t{ .data = bin_file->data(), .size = byte_length, .file = bin_file.get() });
+    source.files.push_back(std::move(bin_file));
+    source.dependencies.push_back(bin_path);
+  }
+
+  for (auto const &image : images) {
+    if (image.contains("uri")) {
+      source.images.push_back(image_source_t{ .path = (base_dir / decode_uri(image["uri"].get<std::string>())).string() });
+      source.dependencies.push_back(source.images.back().path);
+    } else {
+      source.images.push_back(image_source_t{ .buffer_view = image.value("bufferView", -1) });
+    }
+  }
+
+  // tinygltf parses the rest, it never sees buffer and image bytes
+  root.erase("buffers");
+  root.erase("images");
+  std::string stripped = root.dump();
+
+  tinygltf::TinyGLTF loader{};
+  std::string        warning{};
+  std::string        error{};
+  bool               res = false;
+  {
+    WTRACE_ZONE("parse gltf");
+    res = loader.LoadASCIIFromString(&source.model, &error, &warning, stripped.data(), (unsigned int) stripped.size(), base_dir.string());
+  }
+  report_parse_result(file_path, res, warning, error);
+
+  for (auto &image : source.images) {
+    if (image.buffer_view < 0) {
+      continue;
+    }
+    if ((usize) image.buffer_view >= source.model.bufferViews.size()) {
+      fail_streamed(file_path, "image buffer view does not exist");
+    }
+    auto const &view   = source.model.bufferViews[image.buffer_view];
+    auto const &buffer = source.buffers[view.buffer];
+    if (view.byteOffset + view.byteLength > buffer.size) {
+      fail_streamed(file_path, "image buffer view is out of buffer bounds");
+    }
+    image.bytes = buffer_source_t{ .data = buffer.data + view.byteOffset, .size = view.byteLength, .file = buffer.file };
+  }
+
+  source.files.push_back(std::move(file));
+  return true;
+}
+
+/*
+  accessors decode_primitive reads, -1 if primitive has no such accessor
+*/
+struct geometry_key_t {
+  i32 indices  = -1;
+  i32 position = -1;
+  i32 normal   = -1;
+  i32 uv       = -1;
+};
+
+geometry_key_t geometry_key(tinygltf::Primitive const &tprimitive) {
+  auto attribute = [&](char const* name) {
+    auto it = tprimitive.attributes.find(name);
+    return it != tprimitive.attributes.end() ? it->second : -1;
+  };
+  return geometry_key_t{ .indices = tprimitive.indices, .position = attribute("POSITION"), .normal = attribute("NORMAL"), .uv = attribute("TEXCOORD_0") };
+}
+
+// accessor type and elements, strided elements are hashed one by one, so bytes between them do not matter
+u64 hash_accessor(gltf_source_t const &source, i32 accessor_index, u64 seed) {
+  if (accessor_index < 0) {
+    return hash_words(&accessor_index, sizeof(accessor_index), seed);
+  }
+  auto const &accessor = source.model.accessors[accessor_index];
+
+  u64 header[3] = { (u64) accessor.componentType, (u64) accessor.type, (u64) accessor.count };
+  u64 hash      = hash_words(header, sizeof(header), seed);
+  if (accessor.bufferView < 0) {
+    return hash;
+  }
+
+  accessor_view_t view    = make_accessor_view(source, accessor);
+  usize           element = element_bytes(accessor);
+  if (view.stride == element) {
+    return hash_words(view.data, element * view.count, hash);
+  }
+  for (usize i = 0; i < view.count; i += 1) {
+    hash = hash_words(view.data + view.stride * i, element, hash);
+  }
+  return hash;
+}
+
+u64 hash_geometry(gltf_source_t const &source, geometry_key_t const &key) {
+  u64 hash = hash_accessor(source, key.indices, fnv1a_offset_basis);
+  hash     = hash_accessor(source, key.position, hash);
+  hash     = hash_accessor(source, key.normal, hash);
+  return hash_accessor(source, key.uv, hash);
+}
+
+bool same_accessor_data(gltf_source_t const &source, i32 lhs_index, i32 rhs_index) {
+  if (lhs_index == rhs_index) {
+    return true;
+  }
+  if (lhs_index < 0 or rhs_index < 0) {
+    return false;
+  }
+  auto const &lhs = source.model.accessors[lhs_index];
+  auto const &rhs = source.model.accessors[rhs_index];
+  if (lhs.componentType != rhs.componentType or lhs.type != rhs.type or lhs.count != rhs.count or lhs.bufferView < 0 or rhs.bufferView < 0) {
+    return false;
+  }
+
+  accessor_view_t lhs_view = make_accessor_view(source, lhs);
+  accessor_view_t rhs_view = make_accessor_view(source, rhs);
+  usize           element  = element_bytes(lhs);
+  if (lhs_view.stride == element and rhs_view.stride == element) {
+    return memcmp(lhs_view.data, rhs_view.data, element * lhs_view.count) == 0;
+  }
+  for (usize i = 0; i < lhs_view.count; i += 1) {
+    if (memcmp(lhs_view.data + lhs_view.stride * i, rhs_view.data + rhs_view.stride * i, element) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// equal hashes are confirmed byte by byte, so collisions never merge different geometry
+bool same_geometry(gltf_source_t const &source, geometry_key_t const &lhs, geometry_key_t const &rhs) {
+  return same_accessor_data(source, lhs.indices, rhs.indices) and same_accessor_data(source, lhs.position, rhs.position) and
+         same_accessor_data(source, lhs.normal, rhs.normal) and same_accessor_data(source, lhs.uv, rhs.uv);
+}
+
+// mapped pages of primitive accessors are not needed after decoding or deduplication
+void release_primitive(gltf_source_t const &source, tinygltf::Primitive const &tprimitive) {
+  for (auto const &[name, accessor_index] : tprimitive.attributes) {
+    release(accessor_bytes(source, source.model.accessors[accessor_index]));
+  }
+  if (tprimitive.indices > -1) {
+    release(accessor_bytes(source, source.model.accessors[tprimitive.indices]));
+  }
+}
+
+/*
+  decode one primitive into its preallocated ranges of scene arrays
+*/
+void decode_primitive(gltf_source_t const &source, tinygltf::Primitive const &tprimitive, primitive_full_info const &info, scene_data_t &scene) {
+  WTRACE_FUNCTION();
+  auto const &tmodel = source.model;
+
+  u32*       indices   = scene.indices.data() + info.index_offset;
+  glm::vec3* positions = scene.positions.data() + info.vertex_offset;
+  glm::vec3* normals   = scene.normals.data() + info.vertex_offset;
+  glm::vec2* uvs       = scene.uvs.data() + info.vertex_offset;
+
+  // INDICES
+  if (tprimitive.indices > -1) {
+    decode_indices(make_accessor_view(source, tmodel.accessors[tprimitive.indices]), indices);
+  } else {
+    // Primitive without indices, creating them
+    std::iota(indices, indices + info.index_count, 0u);
+  }
+
+  // VERTICES
+  auto const &pos_accessor = tmodel.accessors[tprimitive.attributes.find("POSITION")->second];
+  WASSERT(pos_accessor.componentType == TINYGLTF_PARAMETER_TYPE_FLOAT, "");
+  WASSERT(pos_accessor.type == TINYGLTF_TYPE_VEC3, "");
+  copy_elements(make_accessor_view(source, pos_accessor), positions);
+
+  // NORMALS
+  auto const &it_norm_accessor = tprimitive.attributes.find("NORMAL");
+  if (it_norm_accessor != tprimitive.attributes.end()) {
+    auto const &norm_accessor = tmodel.accessors[it_norm_accessor->second];
+    WASSERT(norm_accessor.componentType == TINYGLTF_PARAMETER_TYPE_FLOAT, "");
+    WASSERT(norm_accessor.type == TINYGLTF_TYPE_VEC3, "");
+    WASSERT(norm_accessor.count == info.vertex_count, "normal count differs from vertex count");
+    copy_elements(make_accessor_view(source, norm_accessor), normals);
+  } else {
+    generate_normals(info, indices, positions, normals);
+  }
+
+  // UVS
+  auto const &it_uv_accessor = tprimitive.attributes.find("TEXCOORD_0");
+  if (it_uv_accessor != tprimitive.attributes.end()) {
+    auto const &uv_accessor = tmodel.accessors[it_uv_accessor->second];
+    WASSERT(uv_accessor.componentType == TINYGLTF_PARAMETER_TYPE_FLOAT, "");
+    WASSERT(uv_accessor.type == TINYGLTF_TYPE_VEC2, "");
+    WASSERT(uv_accessor.count == info.vertex_count, "uv count differs from vertex count");
+    copy_elements(make_accessor_view(source, uv_accessor), uvs);
+  } else {
+    std::fill(uvs, uvs + info.vertex_count, glm::vec2(0.f));
+  }
+
+  release_primitive(source, tprimitive);
+}
+
+
+void process_node(const tinygltf::Model &tmodel, int node_idx, const glm::mat4 &parent_matrix, scene_data_t &scene) {
+  WTRACE_FUNCTION();
+  const auto &tnode = tmodel.nodes[node_idx];
+
+  glm::mat4 translation_matrix = 1;
+  glm::mat4 scale_matrix       = 1;
+  glm::mat4 rotation_matrix    = 1;
+  glm::mat4 node_matrix        = 1;
+  glm::quat rotation{};
+
+  if (not tnode.translation.empty())
+    translation_matrix = glm::translate(glm::mat4(1), glm::vec3(tnode.translation[0], tnode.translation[1], tnode.translation[2]));
+  if (not tnode.scale.empty()) {
+    scale_matrix = glm::scale(glm::mat4(1), glm::vec3(tnode.scale[0], tnode.scale[1], tnode.scale[2]));
+  }
+  if (not tnode.rotation.empty()) {
+    rotation        = glm::make_quat(tnode.rotation.data());
+    rotation_matrix = glm::mat4_cast(rotation);
+  }
+  if (!tnode.matrix.empty()) {
+    node_matrix = glm::make_mat4(tnode.matrix.data());
+  }
+
+  glm::mat4 matrix       = translation_matrix * rotation_matrix * scale_matrix * node_matrix;
+  glm::mat4 world_matrix = parent_matrix * matrix;
+
+  if (tnode.mesh > -1) {
+    const auto &meshes = scene.mesh_to_primitives[tnode.mesh]; // A mesh could have many primitives
+    for (const auto &mesh : meshes) {
+      node node;
+      node.primitive_mesh = mesh;
+      node.world_matrix   = world_matrix;
+      node.source_node    = node_idx;
+      scene.nodes.emplace_back(node);
+    }
+  }
+
+  for (auto child : tnode.children) {
+    process_node(tmodel, child, world_matrix, scene);
+  }
+}
+
+void log_memory(std::string_view file_path, gltf_load_stats_t const &stats) {
+  std::string_view mode = stats.from_cache ? "scene cache" : (stats.streamed ? "streamed" : "tinygltf");
+  WINFO(
+      "loaded {} ({}): peak rss {:.1f} MB, {:.1f} MB before load", file_path, mode, (f64) stats.peak_rss_bytes / (1024.0 * 1024.0),
+      (f64) stats.rss_before_bytes / (1024.0 * 1024.0)
+  );
+}
+
+} // namespace
+
+gltf_load_stats_t load_gltf(std::string_view file_path, scene_data_t &scene, ThreadPool &pool, gltf_load_options_t const &options) {
+  WTRACE_FUNCTION();
+  if (!std::filesystem::exists(file_path)) {
+    WERROR("Cant parse gltf scene: file not found - {}", file_path);
+    throw std::runtime_error("cant find gltf scene");
+  }
+
+  reset_process_peak_rss();
+  gltf_load_stats_t stats = {};
+  stats.decode_threads    = pool.thread_count() + 1;
+  stats.rss_before_bytes  = process_rss_bytes();
+
+  // optimized scenes differ from plain ones, so they are cached under their own variant
+  u64 cache_variant = options.optimize_meshes ? 1 : 0;
+  if (options.use_scene_cache && read_scene_cache(file_path, cache_variant, scene)) {
+    stats.from_cache     = true;
+    stats.peak_rss_bytes = process_peak_rss_bytes();
+    log_memory(file_path, stats);
+    return stats;
+  }
+
+  gltf_source_t source{};
+  stats.streamed = options.stream_buffers && open_gltf_streamed(file_path, source);
+  if (not stats.streamed) {
+    open_gltf(file_path, source);
+    collect_dependencies(file_path, source);
+  }
+  auto const &tmodel = source.model;
+
+  // UPDATING MATERIALS
+  scene.materials.reserve(tmodel.materials.size());
+
+  for (auto const &tmat : tmodel.materials) {
+    material    m   = {};
+    auto const &pbr = tmat.pbrMetallicRoughness;
+
+    m.base_color_factor  = glm::vec3{ pbr.baseColorFactor[0], pbr.baseColorFactor[1], pbr.baseColorFactor[3] };
+    m.base_color_texture = pbr.baseColorTexture.index;
+    m.roughness_factor   = (float) pbr.roughnessFactor;
+    m.metallic_factor    = (float) pbr.metallicFactor;
+    m.rm_texture         = pbr.metallicRoughnessTexture.index;
+    m.emissive_factor    = tmat.emissiveFactor.size() == 3 ? glm::vec3(tmat.emissiveFactor[0], tmat.emissiveFactor[1], tmat.emissiveFactor[2]) : glm::vec3(0.f);
+    m.e_texture          = tmat.emissiveTexture.index;
+    m.n_texture          = tmat.normalTexture.index;
+
+    scene.materials.emplace_back(m);
+  }
+  // add default if there is no materials
+  if (scene.materials.empty()) {
+    material m           = {};
+    m.base_color_texture = -1;
+    m.rm_texture         = -1;
+    m.n_texture          = -1;
+    m.e_texture          = -1;
+    scene.materials.push_back(m);
+  }
+
+  int         default_scene = tmodel.defaultScene > -1 ? tmodel.defaultScene : 0;
+  auto const &tscene        = tmodel.scenes[default_scene];
+
+  std::set<i32> used_meshes;
+  WASSERT(not tscene.nodes.empty(), "empty scene =/");
+
+  std::queue<i32> nodes_queue{};
+  for (auto node_idx : tscene.nodes) {
+    nodes_queue.push(node_idx);
+  }
+  // BFS for nodes tree and get all unique meshes
+  while (not nodes_queue.empty()) {
+    i32 node_idx = nodes_queue.front();
+    nodes_queue.pop();
+
+    auto const &tnode = tmodel.nodes[node_idx];
+    if (tnode.mesh > -1) used_meshes.insert(tnode.mesh);
+    for (int child : tnode.children) {
+      nodes_queue.push(child);
+    }
+  }
+
+  // COUNTING PASS: output ranges of every primitive are known before decoding
+  std::vector<tinygltf::Primitive const*> primitives{};
+
+  for (i32 mesh_idx : used_meshes) {
+
+    std::vector<u32> mesh_primitives{};
+
+    auto const &tmesh = tmodel.meshes[mesh_idx];
+    for (const auto &tprimitive : tmesh.primitives) {
+      if (tprimitive.mode != TINYGLTF_MODE_TRIANGLES)
+        continue;
+
+      WASSERT(tprimitive.attributes.find("POSITION") != tprimitive.attributes.end(), "no position data");
+      mesh_primitives.emplace_back(static_cast<u32>(primitives.size()));
+      primitives.push_back(&tprimitive);
+    }
+    scene.mesh_to_primitives[mesh_idx] = std::move(mesh_primitives);
+  }
+
+  // DEDUPLICATION: geometry is hashed on pool threads, primitive equal to an earlier one takes its ranges instead of new ones.
+  // owners always come first, so the result does not depend on scheduling
+  auto dedup_start = std::chrono::steady_clock::now();
+
+  std::vector<geometry_key_t> keys(primitives.size());
+  std::vector<u64>            hashes(primitives.size());
+  pool.parallel_for(primitives.size(), [&](usize i) {
+    keys[i]   = geometry_key(*primitives[i]);
+    hashes[i] = hash_geometry(source, keys[i]);
+  });
+
+  std::vector<i32>                          owners(primitives.size(), -1);
+  std::unordered_map<u64, std::vector<u32>> owners_by_hash{};
+  for (usize i = 0; i < primitives.size(); i += 1) {
+    auto &candidates = owners_by_hash[hashes[i]];
+    for (u32 candidate : candidates) {
+      if (same_geometry(source, keys[candidate], keys[i])) {
+        owners[i] = (i32) candidate;
+        break;
+      }
+    }
+    if (owners[i] < 0) {
+      candidates.push_back((u32) i);
+    }
+  }
+  stats.dedup_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - dedup_start).count();
+
+  u32 index_count  = 0;
+  u32 vertex_count = 0;
+  for (usize i = 0; i < primitives.size(); i += 1) {
+    auto const &tprimitive = *primitives[i];
+
+    primitive_full_info info{};
+    info.material_index = std::max(0, tprimitive.material);
+    if (owners[i] >= 0) {
+      auto const &owner   = scene.primitive_infos[owners[i]];
+      info.vertex_offset  = owner.vertex_offset;
+      info.vertex_count   = owner.vertex_count;
+      info.index_offset   = owner.index_offset;
+      info.index_count    = owner.index_count;
+      info.geometry_owner = owners[i];
+
+      stats.deduplicated_primitives += 1;
+      stats.deduplicated_bytes += (usize) info.vertex_count * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + (usize) info.index_count * sizeof(u32);
+    } else {
+      auto const &pos_accessor = tmodel.accessors[keys[i].position];
+      info.vertex_offset       = vertex_count;
+      info.vertex_count        = static_cast<u32>(pos_accessor.count);
+      info.index_offset        = index_count;
+      info.index_count         = tprimitive.indices > -1 ? static_cast<u32>(tmodel.accessors[tprimitive.indices].count) : info.vertex_count;
+
+      index_count += info.index_count;
+      vertex_count += info.vertex_count;
+    }
+    scene.primitive_infos.push_back(info);
+  }
+  if (stats.deduplicated_primitives > 0) {
+    WINFO(
+        "deduplicated {} of {} primitives in {:.2f} ms, {:.2f} MB of vertices and indices saved", stats.deduplicated_primitives, primitives.size(), //
+        stats.dedup_ms, (f64) stats.deduplicated_bytes / (1024.0 * 1024.0)
+    );
+  }
+
+  scene.indices.resize(index_count);
+  scene.positions.resize(vertex_count);
+  scene.normals.resize(vertex_count);
+  scene.uvs.resize(vertex_count);
+
+  // DECODING PASS: every primitive writes only into its own ranges, so result does not depend on scheduling
+  auto decode_start = std::chrono::steady_clock::now();
+
+  pool.parallel_for(primitives.size(), [&](usize i) {
+    if (scene.primitive_infos[i].geometry_owner < 0) {
+      decode_primitive(source, *primitives[i], scene.primitive_infos[i], scene);
+    } else {
+      release_primitive(source, *primitives[i]);
+    }
+  });
+  // images were copied out of tinygltf buffers while parsing, streamed scenes have nothing here
+  source.model.buffers = {};
+  source.buffers       = {};
+
+  std::chrono::duration<f64, std::milli> decode_time = std::chrono::steady_clock::now() - decode_start;
+  WINFO("decoded {} primitives ({} vertices, {} indices) on {} threads in {:.2f} ms", primitives.size(), vertex_count, index_count, pool.thread_count() + 1, decode_time.count());
+
+  if (options.optimize_meshes) {
+    stats.meshes_optimized = true;
+    stats.mesh_stats       = optimize_meshes(scene, pool);
+
+    auto const &mesh_stats = stats.mesh_stats;
+    WINFO(
+        "optimized {} primitives in {:.2f} ms: {} -> {} vertices, buffers {:.2f} -> {:.2f} MB, estimated hit fetches {:.2f} -> {:.2f} MB", //
+        mesh_stats.primitive_count, mesh_stats.optimize_ms, mesh_stats.vertices_before, mesh_stats.vertices_after,                         //
+        (f64) mesh_stats.buffer_bytes_before / (1024.0 * 1024.0), (f64) mesh_stats.buffer_bytes_after / (1024.0 * 1024.0),                 //
+        (f64) mesh_stats.fetch_bytes_before / (1024.0 * 1024.0), (f64) mesh_stats.fetch_bytes_after / (1024.0 * 1024.0)
+    );
+  }
+
+  // proccess all nodes
+
+  for (auto node_idx : tscene.nodes) {
+    process_node(tmodel, node_idx, glm::scale(glm::mat4{1.f}, glm::vec3{-1.f, 1.f, 1.f}), scene);
+  }
+
+  // DECODE TEXTURES (uploaded later in create_textures)
+  auto image_decode_start = std::chrono::steady_clock::now();
+
+  std::vector<image_data_t> decoded_images(source.images.size());
+
+  pool.parallel_for(source.images.size(), [&](usize i) { //
+    decoded_images[i] = decode_image(source.images[i]);
+  });
+
+  // several textures can share one image, so only its last user takes it without copy
+  std::vector<u32> image_uses(source.images.size(), 0);
+  for (auto const &texture : tmodel.textures) {
+    image_uses[texture.source] += 1;
+  }
+
+  scene.images.reserve(tmodel.textures.size());
+  for (auto const &texture : tmodel.textures) {
+    image_uses[texture.source] -= 1;
+    if (image_uses[texture.source] == 0) {
+      scene.images.push_back(std::move(decoded_images[texture.source]));
+    } else {
+      scene.images.push_back(decoded_images[texture.source]);
+    }
+  }
+
+  stats.image_decode_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - image_decode_start).count();
+
+  if (options.use_scene_cache) {
+    write_scene_cache(file_path, cache_variant, scene, source.dependencies);
+  }
+
+  stats.peak_rss_bytes = process_peak_rss_bytes();
+  log_memory(file_path, stats);
+  return stats;
+}
+
+} // namespace whim
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string_view>
+
+#include "mesh_optimizer.hpp"
+#include "scene.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/types.hpp"
+
+namespace whim {
+
+struct gltf_load_options_t {
+  bool use_scene_cache = true;
+  // glb binary chunk and external .bin buffers are memory mapped and read in place instead of being loaded by tinygltf.
+  // scenes with data uri buffers or images are always loaded by tinygltf
+  bool stream_buffers = true;
+  // weld and reorder vertices of every primitive, see mesh_optimizer.hpp. cached separately from plain scenes
+  bool optimize_meshes = false;
+};
+
+/*
+  gltf parsing statistics
+*/
+struct gltf_load_stats_t {
+  bool                  from_cache       = false;
+  bool                  streamed         = false;
+  u32                   decode_threads   = 0;
+  f64                   image_decode_ms  = 0.0;   // zero if scene comes from cache
+  bool                  meshes_optimized = false; // false if scene comes from cache, it was optimized before writing
+  mesh_optimize_stats_t mesh_stats       = {};
+  usize                 rss_before_bytes = 0;     // process memory, see process_memory.hpp
+  usize                 peak_rss_bytes   = 0;
+  // primitives sharing geometry of an earlier primitive, and vertex and index bytes they did not add to the scene
+  u32   deduplicated_primitives = 0;
+  usize deduplicated_bytes      = 0;
+  f64   dedup_ms                = 0.0;
+};
+
+/*
+  parses .gltf or .glb file into flat scene arrays, primitives and images are decoded on pool threads.
+  primitives with byte identical indices and attributes (exported copies of one mesh) are decoded once and share
+  vertex and index ranges, see primitive_full_info::geometry_owner. scene is read from scene cache when it is up to date and written into it after parsing otherwise
+*/
+gltf_load_stats_t load_gltf(std::string_view file_path, scene_data_t &scene, ThreadPool &pool, gltf_load_options_t const &options);
+
+} // namespace whim
@@ -0,0 +1,185 @@
+#include "image_io.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "stb_image_write.h"
+
+#include "utility/log.hpp"
+
+namespace whim {
+
+namespace {
+
+u8 to_srgb8(f32 linear) {
+  f32 c    = std::clamp(linear, 0.f, 1.f);
+  f32 srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+  return (u8) std::lround(srgb * 255.f);
+}
+
+void write_png(std::string const &file_path, u32 width, u32 height, std::vector<f32> const &rgba) {
+  std::vector<u8> pixels(rgba.size());
+  for (usize i = 0; i < rgba.size(); i += 4) {
+    pixels[i + 0] = to_srgb8(rgba[i + 0]);
+    pixels[i + 1] = to_srgb8(rgba[i + 1]);
+    pixels[i + 2] = to_srgb8(rgba[i + 2]);
+    pixels[i + 3] = (u8) std::lround(std::clamp(rgba[i + 3], 0.f, 1.f) * 255.f);
+  }
+
+  if (stbi_write_png(file_path.c_str(), (int) width, (int) height, 4, pixels.data(), (int) width * 4) == 0) {
+    WERROR("failed to write png image {}", file_path);
+    throw std::runtime_error("failed to write png image");
+  }
+}
+
+/*
+  PFM stores rows from bottom to top, negative scale marks little endian data
+*/
+void write_pfm(std::ofstream &out, u32 width, u32 height, std::vector<f32> const &rgba) {
+  std::string header = fmt::format("PF\n{} {}\n-1.0\n", width, height);
+  out.write(header.data(), (std::streamsize) header.size());
+
+  std::vector<f32> row(width * 3);
+  for (u32 y = 0; y < height; y += 1) {
+    f32 const* src = rgba.data() + (usize) (height - 1 - y) * width * 4;
+    for (u32 x = 0; x < width; x += 1) {
+      row[x * 3 + 0] = src[x * 4 + 0];
+      row[x * 3 + 1] = src[x * 4 + 1];
+      row[x * 3 + 2] = src[x * 4 + 2];
+    }
+    out.write((char const*) row.data(), (std::streamsize) (row.size() * sizeof(f32)));
+  }
+}
+
+/*
+  minimal single part scanline OpenEXR without compression,
+  channels are stored in alphabetical order as the format requires
+*/
+void write_exr(std::ofstream &out, u32 width, u32 height, std::vector<f32> const &rgba) {
+  auto put = [&out](auto value) { out.write((char const*) &value, sizeof(value)); };
+  auto put_string = [&out](std::string_view str) {
+    out.write(str.data(), (std::streamsize) str.size());
+    out.put('\0');
+  };
+  auto put_attribute = [&](std::string_view name, std::string_view type, i32 size) {
+    put_string(name);
+    put_string(type);
+    put(size);
+  };
+
+  constexpr std::array<char, 4> magic       = { 0x76, 0x2f, 0x31, 0x01 };
+  constexpr i32                 version     = 2;
+  constexpr i32                 pixel_float = 2;
+  // channel name -> component index inside rgba
+  constexpr std::array<std::pair<char, u32>, 4> channels = {
+    std::pair{ 'A', 3u },
+    std::pair{ 'B', 2u },
+    std::pair{ 'G', 1u },
+    std::pair{ 'R', 0u },
+  };
+
+  out.write(magic.data(), magic.size());
+  put(version);
+
+  // every channel: name + '\0', pixel type, pLinear + 3 reserved bytes, x and y sampling
+  put_attribute("channels", "chlist", (i32) (channels.size() * 18 + 1));
+  for (auto const &channel : channels) {
+    out.put(channel.first);
+    out.put('\0');
+    put(pixel_float);
+    put(u32{ 0 });
+    put(i32{ 1 });
+    put(i32{ 1 });
+  }
+  out.put('\0');
+
+  put_attribute("compression", "compression", 1);
+  out.put('\0');
+
+  std::array<i32, 4> window = { 0, 0, (i32) width - 1, (i32) height - 1 };
+  put_attribute("dataWindow", "box2i", sizeof(window));
+  put(window);
+  put_attribute("displayWindow", "box2i", sizeof(window));
+  put(window);
+
+  put_attribute("lineOrder", "lineOrder", 1);
+  out.put('\0');
+
+  put_attribute("pixelAspectRatio", "float", 4);
+  put(1.f);
+
+  put_attribute("screenWindowCenter", "v2f", 8);
+  put(0.f);
+  put(0.f);
+
+  put_attribute("screenWindowWidth", "float", 4);
+  put(1.f);
+
+  // end of header
+  out.put('\0');
+
+  // offset table: one scanline per block without compression
+  u64 line_size   = (u64) width * channels.size() * sizeof(f32);
+  u64 block_size  = sizeof(i32) * 2 + line_size;
+  u64 data_offset = (u64) out.tellp() + (u64) height * sizeof(u64);
+  for (u32 y = 0; y < height; y += 1) {
+    put(data_offset + y * block_size);
+  }
+
+  std::vector<f32> line(width * channels.size());
+  for (u32 y = 0; y < height; y += 1) {
+    f32 const* src = rgba.data() + (usize) y * width * 4;
+    for (u32 c = 0; c < channels.size(); c += 1) {
+      for (u32 x = 0; x < width; x += 1) {
+        line[c * width + x] = src[x * 4 + channels[c].second];
+      }
+    }
+    put((i32) y);
+    put((i32) line_size);
+    out.write((char const*) line.data(), (std::streamsize) line_size);
+  }
+}
+
+} // namespace
+
+void write_image(std::string_view file_path, u32 width, u32 height, std::vector<f32> const &rgba) {
+  WASSERT(rgba.size() == (usize) width * height * 4, "image size does not match its extent");
+
+  std::string path      = std::string(file_path);
+  std::string extension = std::filesystem::path(path).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char) std::tolower(c); });
+
+  if (extension == ".png") {
+    write_png(path, width, height, rgba);
+  } else if (extension == ".pfm" || extension == ".exr") {
+    std::ofstream out{ path, std::ios::binary | std::ios::trunc };
+    if (!out) {
+      WERROR("failed to open {} for writing", path);
+      throw std::runtime_error("failed to open image for writing");
+    }
+
+    if (extension == ".pfm") {
+      write_pfm(out, width, height, rgba);
+    } else {
+      write_exr(out, width, height, rgba);
+    }
+
+    if (!out) {
+      WERROR("failed to write image {}", path);
+      throw std::runtime_error("failed to write image");
+    }
+  } else {
+    WERROR("unsupported image format {}, expected .png, .exr or .pfm", extension);
+    throw std::runtime_error("unsupported image format");
+  }
+
+  WINFO("image {}x{} written to {}", width, height, path);
+}
+
+} // namespace whim
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "utility/types.hpp"
+
+namespace whim {
+
+/*
+  writes linear RGBA image (rows from top to bottom), format is chosen by file extension:
+    .png - 8 bit, sRGB encoded and clamped
+    .exr - uncompressed 32 bit float RGBA
+    .pfm - 32 bit float RGB
+*/
+void write_image(std::string_view file_path, u32 width, u32 height, std::vector<f32> const &rgba);
+
+} // namespace whim
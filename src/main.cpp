@@ -8,6 +8,7 @@
 #include "glm/fwd.hpp"
 #include "input.hpp"
 #include "shader.h"
+#include "cpu/raytracer.hpp"
 #include "vk/raytracer.hpp"
 
 #include <vulkan/vulkan_core.h>
@@ -21,37 +22,179 @@
 #include "vk/context.hpp"
 #include "utility/types.hpp"
 
-int main() {
-  WINFO("Hello, world {}", 12);
-  WASSERT(true, "THIS SHOULD BE TRUE");
-  WERROR("THIS IS ERROR!!{}!", 42);
+#include "cli.hpp"
+#include "image_io.hpp"
+#include "utility/log.hpp"
+#include "utility/trace.hpp"
+
+#include <optional>
+
+// obj files go through tinyobjloader, everything else is gltf
+void load_scene(whim::Renderer &renderer, std::string_view path) {
+  if (path.ends_with(".obj")) {
+    renderer.load_obj_scene(path);
+  } else {
+    renderer.load_gltf_scene(path);
+  }
+}
+
+/*
+  renders options.samples samples of the scene without window and writes result to options.output_path
+*/
+int run_headless(config_t const &config, whim::cli_options_t const &options) {
+  whim::CameraManipulator cam_man{ options.camera };
+
+  // vulkan context is not created at all for cpu backend, so it works without gpu.
+  // renderer is declared after context, so it is destroyed first
+  std::optional<whim::vk::Context> context{};
+  whim::uptr<whim::Renderer>       renderer = nullptr;
+  if (options.backend == whim::backend_t::cpu) {
+    renderer = std::make_unique<whim::cpu::RayTracer>(cam_man, config);
+  } else {
+    context.emplace(config);
+    renderer = std::make_unique<whim::vk::RayTracer>(*context, cam_man, config);
+  }
+
+  load_scene(*renderer, options.scene_path);
+
+  std::vector<whim::f32> pixels = renderer->render_offline(options.samples);
+  whim::write_image(options.output_path, options.width, options.height, pixels);
+
+  return 0;
+}
+
+/*
+  loads and renders the scene once per vertex layout and prints memory footprint and trace throughput of every layout.
+  one sample is rendered before measuring, so shader compilation and first touch of memory are not counted
+*/
+int run_vertex_layout_bench(config_t config, whim::cli_options_t const &options) {
+  whim::CameraManipulator cam_man{ options.camera };
+  whim::vk::Context       context{ config };
+
+  struct result_t {
+    whim::vk::RayTracer::geometry_stats_t geometry = {};
+    whim::vk::RayTracer::offline_stats_t  offline  = {};
+  };
+  std::vector<result_t> results{};
+
+  for (whim::vertex_layout_t layout : whim::vertex_layouts) {
+    config.options.vertex_layout = layout;
+
+    whim::vk::RayTracer raytracer{ context, cam_man, config };
+    load_scene(raytracer, options.scene_path);
+    raytracer.render_offline(1);
+    raytracer.render_offline(options.samples);
+    results.push_back(result_t{ .geometry = raytracer.geometry_stats(), .offline = raytracer.offline_stats() });
+  }
+
+  // results go after log messages of loading
+  whim::log::flush();
+  fmt::println("{} at {}x{}, {} samples", options.scene_path, options.width, options.height, options.samples);
+  fmt::println("{:<12} {:>10} {:>10} {:>10} {:>10} {:>10}", "layout", "bytes/vtx", "vertex MB", "index MB", "samples/s", "Mrays/s");
+  for (auto const &[geometry, offline] : results) {
+    fmt::println(
+        "{:<12} {:>10.1f} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}", whim::to_string(geometry.layout),                                //
+        (whim::f64) geometry.vertex_bytes / std::max(1u, geometry.vertex_count), (whim::f64) geometry.vertex_bytes / (1024.0 * 1024.0), //
+        (whim::f64) geometry.index_bytes / (1024.0 * 1024.0), offline.samples_per_second, offline.mrays_per_second
+    );
+  }
+  return 0;
+}
+
+/*
+  loads and renders the scene with every primitive in its own BLAS and with small static primitives merged,
+  prints acceleration structure build cost and trace throughput of both. warmup is the same as in run_vertex_layout_bench
+*/
+int run_blas_merge_bench(config_t config, whim::cli_options_t const &options) {
+  whim::CameraManipulator cam_man{ options.camera };
+  whim::vk::Context       context{ config };
+
+  struct result_t {
+    whim::u32                               threshold = 0;
+    whim::vk::RayTracer::blas_build_stats_t blas      = {};
+    whim::vk::RayTracer::offline_stats_t    offline   = {};
+  };
+  std::vector<result_t> results{};
+
+  whim::u32 merge_threshold = options.blas_merge_triangles != 0 ? options.blas_merge_triangles : 4096;
+  for (whim::u32 threshold : { 0u, merge_threshold }) {
+    config.options.blas_merge_triangles = threshold;
+
+    whim::vk::RayTracer raytracer{ context, cam_man, config };
+    load_scene(raytracer, options.scene_path);
+    raytracer.render_offline(1);
+    raytracer.render_offline(options.samples);
+    results.push_back(result_t{ .threshold = threshold, .blas = raytracer.blas_stats(), .offline = raytracer.offline_stats() });
+  }
+
+  // results go after log messages of loading
+  whim::log::flush();
+  fmt::println("{} at {}x{}, {} samples", options.scene_path, options.width, options.height, options.samples);
+  fmt::println(
+      "{:<12} {:>8} {:>8} {:>10} {:>10} {:>10} {:>10} {:>10}", "merge tris", "BLAS", "merged", "instances", "build ms", "BLAS MB", "samples/s", "Mrays/s"
+  );
+  for (auto const &[threshold, blas, offline] : results) {
+    fmt::println(
+        "{:<12} {:>8} {:>8} {:>10} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}", threshold, blas.blas_count, blas.merged_count, blas.instance_count, //
+        blas.build_ms, (whim::f64) blas.compacted_bytes / (1024.0 * 1024.0), offline.samples_per_second, offline.mrays_per_second
+    );
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  whim::cli_options_t options = whim::parse_cli(argc, argv);
+  whim::trace::write_at_exit(options.trace_path);
+  WTRACE_THREAD("main");
+
+  if (not options.log_path.empty()) {
+    bool binary = options.log_path.ends_with(".bin");
+    if (not whim::log::open_sink(options.log_path, binary ? whim::log::sink_format_t::binary : whim::log::sink_format_t::json)) {
+      WERROR("failed to open log file {}", options.log_path);
+    }
+  }
 
   config_t config{
-    .width    = 960,
-    .height   = 600,
+    .width    = options.width,
+    .height   = options.height,
     .app_name = "_", //
     .options  = {//
-      .is_resizable       = false, //
-      .is_fullscreen      = false, //
-      .raytracing_enabled = true
+      .is_resizable         = false,                        //
+      .is_fullscreen        = false,                        //
+      .raytracing_enabled   = true,                         //
+      .compact_blas         = options.compact_blas,         //
+      .blas_merge_triangles = options.blas_merge_triangles, //
+      .use_scene_cache      = options.use_scene_cache,      //
+      .stream_gltf_buffers  = options.stream_gltf_buffers,  //
+      .optimize_meshes      = options.optimize_meshes,      //
+      .vertex_layout        = options.vertex_layout,        //
+      .target_samples       = options.target_samples,       //
+      .noise_threshold      = options.noise_threshold,      //
+      .frames_in_flight     = options.frames_in_flight,     //
+      .profile_directory    = options.profile_directory
       }
   };
 
-  whim::Window   w{ config };
-  whim::Input    input{ w };
-  whim::camera_t camera{
-    .aspect = (whim::f32) config.width / (whim::f32) config.height, // F
-  };
-  camera.center = glm::vec3{ 0.f, 0.f, 0.f };
-  camera.eye    = glm::vec3{ 0.f, 0.f, 3.f };
+  if (options.vertex_layout_bench) {
+    return run_vertex_layout_bench(config, options);
+  }
+  if (options.blas_merge_bench) {
+    return run_blas_merge_bench(config, options);
+  }
+  if (options.headless) {
+    return run_headless(config, options);
+  }
+
+  whim::Window w{ config };
+  whim::Input  input{ w };
 
-  whim::CameraManipulator cam_man{ input, camera };
+  whim::CameraManipulator cam_man{ input, options.camera };
   // cam_man.set_look_at(glm::vec3(5, 4, -4), glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), 60.f);
 
   whim::vk::Context context{ config, w };
 
   WINFO("CREATING RAYTRACER");
-  whim::vk::RayTracer raytracer{ context, cam_man };
+  whim::vk::RayTracer raytracer{ context, cam_man, config };
 
   WINFO("MESHES LOADED");
   // raytracer.load_gltf_scene("../assets/gltf/DragonAttenuation/DragonAttenuation.gltf");
@@ -59,7 +202,8 @@ int main() {
   // raytracer.load_gltf_scene("../assets/gltf/Sponza/Sponza.gltf");
   // raytracer.load_gltf_scene("../assets/gltf/DamagedHelmet/DamagedHelmet.gltf");
   // raytracer.load_gltf_scene("../assets/gltf/cornellBox/cornellBox.gltf");
-  raytracer.load_gltf_scene("../assets/gltf/FlightHelmet/FlightHelmet.gltf");
+  // raytracer.load_gltf_scene("../assets/gltf/FlightHelmet/FlightHelmet.gltf");
+  load_scene(raytracer, options.scene_path);
 
   // tests
   // raytracer.load_gltf_scene("../assets/gltf/BoomBoxWithAxes/BoomBoxWithAxes.gltf");
@@ -80,9 +224,10 @@ int main() {
     if (input.state().keyboard.esc) {
       w.close();
     }
+    // accumulation restarts by itself when camera moves, r restarts it by hand
     if (input.state().keyboard.r) {
+      raytracer.reset_frame();
     }
-    raytracer.reset_frame();
 
     // renderer.draw();
     raytracer.draw();
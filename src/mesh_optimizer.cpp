@@ -0,0 +1,376 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "utility/hash.hpp"
+#include "utility/trace.hpp"
+
+namespace whim {
+
+namespace {
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+constexpr u32 vertex_cache_size   = 32;
+constexpr f32 cache_decay_power   = 1.5f;
+constexpr f32 last_triangle_score = 0.75f;
+constexpr f32 valence_boost_scale = 2.f;
+constexpr f32 valence_boost_power = 0.5f;
+
+// fetch estimation cache, 32 KB 4 way set associative with lru replacement
+constexpr u64 fetch_line_size  = 64;
+constexpr u32 fetch_cache_sets = 128;
+constexpr u32 fetch_cache_ways = 4;
+constexpr u64 no_line          = ~0ull;
+
+// every buffer gets its own address range, they are separate allocations on gpu
+constexpr u64 position_base = 0ull << 40;
+constexpr u64 normal_base   = 1ull << 40;
+constexpr u64 uv_base       = 2ull << 40;
+constexpr u64 index_base    = 3ull << 40;
+
+constexpr u64 vertex_bytes = sizeof(glm::vec3) + sizeof(glm::vec3) + sizeof(glm::vec2);
+
+struct vertex_key_t {
+  glm::vec3 position = {};
+  glm::vec3 normal   = {};
+  glm::vec2 uv       = {};
+
+  // bitwise, so -0 and 0 or different nans are not merged, they may mean something to the author
+  bool operator==(vertex_key_t const &other) const { return std::memcmp(this, &other, sizeof(vertex_key_t)) == 0; }
+};
+
+struct vertex_key_hash_t {
+  usize operator()(vertex_key_t const &key) const { return (usize) fnv1a(&key, sizeof(vertex_key_t)); }
+};
+
+/*
+  vertices of one primitive after welding, indices refer to them
+*/
+struct primitive_vertices_t {
+  std::vector<glm::vec3> positions{};
+  std::vector<glm::vec3> normals{};
+  std::vector<glm::vec2> uvs{};
+};
+
+class FetchCache {
+
+public:
+  FetchCache() {
+    for (auto &set : m_tags) {
+      set.fill(no_line);
+    }
+  }
+
+  void fetch(u64 address, u64 size) {
+    u64 last = (address + size - 1) / fetch_line_size;
+    for (u64 line = address / fetch_line_size; line <= last; line += 1) {
+      access(line);
+    }
+  }
+
+  [[nodiscard]] u64 bytes() const { return m_bytes; }
+
+private:
+  void access(u64 line) {
+    auto &set = m_tags[line % fetch_cache_sets];
+    u32   way = 0;
+    while (way < fetch_cache_ways and set[way] != line) {
+      way += 1;
+    }
+    if (way == fetch_cache_ways) {
+      m_bytes += fetch_line_size;
+      way      = fetch_cache_ways - 1;
+    }
+    // most recently used line is kept first
+    for (; way > 0; way -= 1) {
+      set[way] = set[way - 1];
+    }
+    set[0] = line;
+  }
+
+private:
+  std::array<std::array<u64, fetch_cache_ways>, fetch_cache_sets> m_tags{};
+  u64                                                              m_bytes = 0;
+};
+
+/*
+  replays hit shader fetches of every triangle in index buffer order, offsets are global as in shader
+*/
+u64 estimate_fetch_bytes(u32 const* indices, primitive_full_info const &info) {
+  FetchCache cache{};
+  for (u32 i = 0; i + 2 < info.index_count; i += 3) {
+    cache.fetch(index_base + (u64) (info.index_offset + i) * sizeof(u32), 3 * sizeof(u32));
+    for (u32 corner = 0; corner < 3; corner += 1) {
+      u64 vertex = (u64) info.vertex_offset + indices[i + corner];
+      cache.fetch(position_base + vertex * sizeof(glm::vec3), sizeof(glm::vec3));
+      cache.fetch(normal_base + vertex * sizeof(glm::vec3), sizeof(glm::vec3));
+      cache.fetch(uv_base + vertex * sizeof(glm::vec2), sizeof(glm::vec2));
+    }
+  }
+  return cache.bytes();
+}
+
+/*
+  merges equal vertices and drops unreferenced ones, indices are rewritten in place
+*/
+primitive_vertices_t weld_vertices(scene_data_t const &scene, primitive_full_info const &info, u32* indices) {
+  glm::vec3 const* positions = scene.positions.data() + info.vertex_offset;
+  glm::vec3 const* normals   = scene.normals.data() + info.vertex_offset;
+  glm::vec2 const* uvs       = scene.uvs.data() + info.vertex_offset;
+
+  primitive_vertices_t result{};
+  result.positions.reserve(info.vertex_count);
+  result.normals.reserve(info.vertex_count);
+  result.uvs.reserve(info.vertex_count);
+
+  std::unordered_map<vertex_key_t, u32, vertex_key_hash_t> unique{};
+  unique.reserve(info.vertex_count);
+
+  for (u32 i = 0; i < info.index_count; i += 1) {
+    u32          vertex = indices[i];
+    vertex_key_t key{ .position = positions[vertex], .normal = normals[vertex], .uv = uvs[vertex] };
+
+    auto [it, inserted] = unique.try_emplace(key, (u32) result.positions.size());
+    if (inserted) {
+      result.positions.push_back(key.position);
+      result.normals.push_back(key.normal);
+      result.uvs.push_back(key.uv);
+    }
+    indices[i] = it->second;
+  }
+  return result;
+}
+
+f32 vertex_score(i32 cache_position, u32 remaining_triangles) {
+  if (remaining_triangles == 0) {
+    return -1.f;
+  }
+
+  f32 score = 0.f;
+  if (cache_position >= 0) {
+    // three vertices of the last triangle get fixed score, so next triangle does not prefer any of its edges
+    if (cache_position < 3) {
+      score = last_triangle_score;
+    } else {
+      f32 scale = 1.f / (f32) (vertex_cache_size - 3);
+      score     = std::pow(1.f - (f32) (cache_position - 3) * scale, cache_decay_power);
+    }
+  }
+  // vertices with few triangles left are finished first, so they do not stay alone
+  score += valence_boost_scale * std::pow((f32) remaining_triangles, -valence_boost_power);
+  return score;
+}
+
+/*
+  greedy triangle order: next triangle is the best scored one among triangles of cached vertices,
+  when there are none, first unused triangle is taken
+*/
+void optimize_triangle_order(u32* indices, u32 index_count, u32 vertex_count) {
+  u32 triangle_count = index_count / 3;
+  if (triangle_count < 2) {
+    return;
+  }
+
+  // triangles of every vertex, first remaining[v] entries of a list are not emitted yet
+  std::vector<u32> adjacency_offsets(vertex_count + 1, 0);
+  for (u32 i = 0; i < triangle_count * 3; i += 1) {
+    adjacency_offsets[indices[i] + 1] += 1;
+  }
+  for (u32 v = 0; v < vertex_count; v += 1) {
+    adjacency_offsets[v + 1] += adjacency_offsets[v];
+  }
+
+  std::vector<u32> remaining(vertex_count, 0);
+  std::vector<u32> adjacency(triangle_count * 3);
+  for (u32 i = 0; i < triangle_count * 3; i += 1) {
+    u32 vertex                                               = indices[i];
+    adjacency[adjacency_offsets[vertex] + remaining[vertex]] = i / 3;
+    remaining[vertex]                                       += 1;
+  }
+
+  std::vector<i32> cache_positions(vertex_count, -1);
+  std::vector<f32> vertex_scores(vertex_count);
+  for (u32 v = 0; v < vertex_count; v += 1) {
+    vertex_scores[v] = vertex_score(-1, remaining[v]);
+  }
+
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<u32>  output(triangle_count * 3);
+  std::vector<u32>  cache{};
+  std::vector<u32>  next_cache{};
+  cache.reserve(vertex_cache_size + 3);
+  next_cache.reserve(vertex_cache_size + 3);
+
+  i64 best        = -1;
+  u32 next_unused = 0;
+  for (u32 emitted_count = 0; emitted_count < triangle_count; emitted_count += 1) {
+    if (best < 0) {
+      while (emitted[next_unused]) {
+        next_unused += 1;
+      }
+      best = next_unused;
+    }
+
+    u32        triangle = (u32) best;
+    u32 const* corners  = indices + triangle * 3;
+    std::memcpy(output.data() + emitted_count * 3, corners, 3 * sizeof(u32));
+    emitted[triangle] = true;
+
+    for (u32 corner = 0; corner < 3; corner += 1) {
+      u32  vertex = corners[corner];
+      u32* first  = adjacency.data() + adjacency_offsets[vertex];
+      u32* last   = first + remaining[vertex];
+      std::swap(*std::find(first, last, triangle), *(last - 1));
+      remaining[vertex] -= 1;
+    }
+
+    // emitted triangle goes to the front of lru cache
+    next_cache.assign(corners, corners + 3);
+    for (u32 vertex : cache) {
+      if (vertex != corners[0] and vertex != corners[1] and vertex != corners[2]) {
+        next_cache.push_back(vertex);
+      }
+    }
+    for (u32 i = 0; i < (u32) next_cache.size(); i += 1) {
+      u32 vertex              = next_cache[i];
+      cache_positions[vertex] = i < vertex_cache_size ? (i32) i : -1;
+      vertex_scores[vertex]   = vertex_score(cache_positions[vertex], remaining[vertex]);
+    }
+
+    // only triangles of touched vertices change score, best of them is the next one
+    best           = -1;
+    f32 best_score = -1.f;
+    for (u32 vertex : next_cache) {
+      for (u32 i = 0; i < remaining[vertex]; i += 1) {
+        u32        t     = adjacency[adjacency_offsets[vertex] + i];
+        u32 const* tri   = indices + t * 3;
+        f32        score = vertex_scores[tri[0]] + vertex_scores[tri[1]] + vertex_scores[tri[2]];
+        if (score > best_score) {
+          best       = t;
+          best_score = score;
+        }
+      }
+    }
+
+    if (next_cache.size() > vertex_cache_size) {
+      next_cache.resize(vertex_cache_size);
+    }
+    std::swap(cache, next_cache);
+  }
+
+  std::memcpy(indices, output.data(), output.size() * sizeof(u32));
+}
+
+/*
+  renumbers vertices in order of first use in index buffer
+*/
+void optimize_vertex_order(u32* indices, u32 index_count, primitive_vertices_t &vertices) {
+  u32 vertex_count = (u32) vertices.positions.size();
+
+  std::vector<u32> remap(vertex_count, ~0u);
+  u32              next = 0;
+  for (u32 i = 0; i < index_count; i += 1) {
+    u32 &slot = remap[indices[i]];
+    if (slot == ~0u) {
+      slot  = next;
+      next += 1;
+    }
+    indices[i] = slot;
+  }
+
+  primitive_vertices_t reordered{};
+  reordered.positions.resize(next);
+  reordered.normals.resize(next);
+  reordered.uvs.resize(next);
+  for (u32 v = 0; v < vertex_count; v += 1) {
+    if (remap[v] == ~0u) {
+      continue;
+    }
+    reordered.positions[remap[v]] = vertices.positions[v];
+    reordered.normals[remap[v]]   = vertices.normals[v];
+    reordered.uvs[remap[v]]       = vertices.uvs[v];
+  }
+  vertices = std::move(reordered);
+}
+
+} // namespace
+
+mesh_optimize_stats_t optimize_meshes(scene_data_t &scene, ThreadPool &pool) {
+  WTRACE_FUNCTION();
+  auto start = std::chrono::steady_clock::now();
+
+  usize                 primitive_count = scene.primitive_infos.size();
+  mesh_optimize_stats_t stats           = {};
+  stats.primitive_count                 = (u32) primitive_count;
+  stats.vertices_before                 = (u32) scene.positions.size();
+  stats.buffer_bytes_before             = scene.positions.size() * vertex_bytes + scene.indices.size() * sizeof(u32);
+
+  std::vector<primitive_vertices_t> optimized(primitive_count);
+  std::vector<u64>                  fetch_before(primitive_count, 0);
+  std::vector<u64>                  fetch_after(primitive_count, 0);
+
+  // primitives sharing geometry of another one are skipped, they take its new ranges when vertices are packed
+  pool.parallel_for(primitive_count, [&](usize i) {
+    auto const &info    = scene.primitive_infos[i];
+    u32*        indices = scene.indices.data() + info.index_offset;
+    if (info.geometry_owner >= 0) {
+      return;
+    }
+
+    fetch_before[i] = estimate_fetch_bytes(indices, info);
+    optimized[i]    = weld_vertices(scene, info, indices);
+    optimize_triangle_order(indices, info.index_count, (u32) optimized[i].positions.size());
+    optimize_vertex_order(indices, info.index_count, optimized[i]);
+  });
+
+  // primitives shrink, so their vertex ranges are packed again
+  u32 vertex_count = 0;
+  for (usize i = 0; i < primitive_count; i += 1) {
+    auto &info = scene.primitive_infos[i];
+    if (info.geometry_owner >= 0) {
+      info.vertex_offset = scene.primitive_infos[info.geometry_owner].vertex_offset;
+      info.vertex_count  = scene.primitive_infos[info.geometry_owner].vertex_count;
+      continue;
+    }
+    info.vertex_offset = vertex_count;
+    info.vertex_count  = (u32) optimized[i].positions.size();
+
+    vertex_count += info.vertex_count;
+  }
+
+  scene.positions.resize(vertex_count);
+  scene.normals.resize(vertex_count);
+  scene.uvs.resize(vertex_count);
+  scene.positions.shrink_to_fit();
+  scene.normals.shrink_to_fit();
+  scene.uvs.shrink_to_fit();
+
+  pool.parallel_for(primitive_count, [&](usize i) {
+    auto const &info     = scene.primitive_infos[i];
+    auto const &vertices = optimized[i];
+    if (info.geometry_owner >= 0) {
+      return;
+    }
+    std::copy(vertices.positions.begin(), vertices.positions.end(), scene.positions.begin() + info.vertex_offset);
+    std::copy(vertices.normals.begin(), vertices.normals.end(), scene.normals.begin() + info.vertex_offset);
+    std::copy(vertices.uvs.begin(), vertices.uvs.end(), scene.uvs.begin() + info.vertex_offset);
+
+    fetch_after[i] = estimate_fetch_bytes(scene.indices.data() + info.index_offset, info);
+  });
+
+  for (usize i = 0; i < primitive_count; i += 1) {
+    stats.fetch_bytes_before += fetch_before[i];
+    stats.fetch_bytes_after  += fetch_after[i];
+  }
+  stats.vertices_after     = vertex_count;
+  stats.buffer_bytes_after = (u64) vertex_count * vertex_bytes + scene.indices.size() * sizeof(u32);
+  stats.optimize_ms        = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return stats;
+}
+
+} // namespace whim
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "scene.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/types.hpp"
+
+namespace whim {
+
+/*
+  Mesh optimization at load time
+
+  every primitive is processed on its own, in three steps:
+  - welding: vertices with bitwise equal position, normal and uv are merged, non indexed primitives get shared vertices
+  - index reorder: triangles are ordered for post transform cache (Forsyth), neighbouring triangles share vertices
+  - vertex reorder: vertices are renumbered in order of first use, so triangles close in index buffer fetch close memory
+
+  hit shaders fetch three indices and three vertices of every attribute per hit, fetch traffic is estimated by replaying
+  these fetches in index buffer order through a small direct mapped cache of 64 byte lines
+*/
+struct mesh_optimize_stats_t {
+  u32 primitive_count     = 0;
+  u32 vertices_before     = 0;
+  u32 vertices_after      = 0;
+  u64 buffer_bytes_before = 0; // vertex attributes and indices
+  u64 buffer_bytes_after  = 0;
+  u64 fetch_bytes_before  = 0; // estimated closest hit traffic for every triangle hit once
+  u64 fetch_bytes_after   = 0;
+  f64 optimize_ms         = 0.0;
+};
+
+// primitive ranges of scene are rewritten, index counts stay the same. shared geometry is optimized once by its owner
+mesh_optimize_stats_t optimize_meshes(scene_data_t &scene, ThreadPool &pool);
+
+} // namespace whim
@@ -0,0 +1,616 @@
+#include "obj_loader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <istream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <unordered_map>
+
+#include <glm/ext/matrix_transform.hpp>
+
+#include <external/stb_image.h>
+
+#include "tiny_obj_loader.h"
+
+#include "mesh_optimizer.hpp"
+#include "scene_cache.hpp"
+#include "utility/hash.hpp"
+#include "utility/log.hpp"
+#include "utility/macros.hpp"
+#include "utility/mapped_file.hpp"
+#include "utility/trace.hpp"
+
+namespace whim {
+
+namespace {
+
+// smaller files are parsed by one thread
+constexpr usize min_chunk_bytes = 256 << 10;
+constexpr u32   no_index        = std::numeric_limits<u32>::max();
+
+/*
+  indices of one triangle corner into obj attribute arrays, no_index if attribute is missing
+*/
+struct corner_t {
+  u32 position = no_index;
+  u32 uv       = no_index;
+  u32 normal   = no_index;
+
+  bool operator==(corner_t const &) const = default;
+};
+
+struct corner_hash_t {
+  usize operator()(corner_t const &corner) const { return (usize) fnv1a(&corner, sizeof(corner_t)); }
+};
+
+/*
+  attributes of the whole file, indexed the same way obj faces index them
+*/
+struct obj_attributes_t {
+  std::vector<glm::vec3> positions{};
+  std::vector<glm::vec3> normals{};
+  std::vector<glm::vec2> uvs{};
+};
+
+/*
+  line aligned part of obj text, counted and parsed by one thread
+*/
+struct chunk_t {
+  std::string_view text{};
+
+  // counting pass
+  u32                      position_count = 0;
+  u32                      normal_count   = 0;
+  u32                      uv_count       = 0;
+  std::vector<std::string> mtllibs{};
+
+  // chunk writes its attributes into obj_attributes_t starting at these offsets
+  u32 position_base = 0;
+  u32 normal_base   = 0;
+  u32 uv_base       = 0;
+
+  // parsing pass
+  u32                      positions_read = 0;
+  u32                      normals_read   = 0;
+  u32                      uvs_read       = 0;
+  std::vector<corner_t>    corners{};        // three per triangle
+  std::vector<u32>         triangle_slots{}; // index into material_names, no_index before first usemtl of chunk
+  std::vector<std::string> material_names{}; // usemtl names in order of appearance
+  u32                      current_slot = no_index;
+  bool                     overflow     = false; // more attributes than counted, text is not what counting pass saw
+
+  // build, material of every slot and material in effect at chunk start
+  std::vector<u32> slot_materials{};
+  u32              first_material = 0;
+};
+
+/*
+  istream over memory without copy, tinyobjloader reads streams only
+*/
+class MemoryStreamBuffer : public std::streambuf {
+public:
+  explicit MemoryStreamBuffer(std::string_view text) {
+    char* data = const_cast<char*>(text.data()); // get area is only read
+    setg(data, data, data + text.size());
+  }
+};
+
+struct parse_context_t {
+  chunk_t*          chunk      = nullptr;
+  obj_attributes_t* attributes = nullptr;
+};
+
+std::vector<chunk_t> split_chunks(std::string_view text, usize max_chunks) {
+  usize chunk_count = std::clamp<usize>(text.size() / min_chunk_bytes, 1, std::max<usize>(1, max_chunks));
+  usize chunk_size  = text.size() / chunk_count;
+
+  std::vector<chunk_t> chunks{};
+  usize                begin = 0;
+  for (usize i = 0; i < chunk_count && begin < text.size(); i += 1) {
+    usize end = text.size();
+    if (i + 1 < chunk_count) {
+      usize line_end = text.find('\n', std::max(begin, (i + 1) * chunk_size));
+      end            = line_end == std::string_view::npos ? text.size() : line_end + 1;
+    }
+    chunks.push_back(chunk_t{ .text = text.substr(begin, end - begin) });
+    begin = end;
+  }
+  return chunks;
+}
+
+bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+// same keyword rules tinyobjloader uses: keyword at line start after blanks, followed by blank
+bool starts_with_keyword(std::string_view line, std::string_view keyword) {
+  return line.size() > keyword.size() && line.starts_with(keyword) && is_space(line[keyword.size()]);
+}
+
+std::string_view trim(std::string_view str) {
+  while (not str.empty() && (is_space(str.front()) || str.front() == '\r')) {
+    str.remove_prefix(1);
+  }
+  while (not str.empty() && (is_space(str.back()) || str.back() == '\r')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+void count_chunk(chunk_t &chunk) {
+  WTRACE_FUNCTION();
+  std::string_view text = chunk.text;
+  while (not text.empty()) {
+    usize            line_end = text.find('\n');
+    std::string_view line     = text.substr(0, line_end);
+    text.remove_prefix(line_end == std::string_view::npos ? text.size() : line_end + 1);
+
+    while (not line.empty() && is_space(line.front())) {
+      line.remove_prefix(1);
+    }
+    if (starts_with_keyword(line, "v")) {
+      chunk.position_count += 1;
+    } else if (starts_with_keyword(line, "vn")) {
+      chunk.normal_count += 1;
+    } else if (starts_with_keyword(line, "vt")) {
+      chunk.uv_count += 1;
+    } else if (starts_with_keyword(line, "mtllib")) {
+      chunk.mtllibs.emplace_back(trim(line.substr(6)));
+    }
+  }
+}
+
+/*
+  obj indices are 1 based, negative ones count back from the last attribute read so far, 0 - attribute is missing
+*/
+u32 resolve_index(int index, u32 base, u32 read) {
+  if (index > 0) {
+    return (u32) index - 1;
+  }
+  if (index < 0) {
+    i64 resolved = (i64) base + read + index;
+    return resolved >= 0 ? (u32) resolved : no_index - 1; // out of range, reported while building
+  }
+  return no_index;
+}
+
+/*
+  tinyobjloader callbacks, user data is parse_context_t of the chunk
+*/
+void on_position(void* user_data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z, tinyobj::real_t w) {
+  UNUSED(w);
+  auto &context = *static_cast<parse_context_t*>(user_data);
+  auto &chunk   = *context.chunk;
+  if (chunk.positions_read == chunk.position_count) {
+    chunk.overflow = true;
+    return;
+  }
+  context.attributes->positions[chunk.position_base + chunk.positions_read] = glm::vec3{ x, y, z };
+  chunk.positions_read += 1;
+}
+
+void on_normal(void* user_data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z) {
+  auto &context = *static_cast<parse_context_t*>(user_data);
+  auto &chunk   = *context.chunk;
+  if (chunk.normals_read == chunk.normal_count) {
+    chunk.overflow = true;
+    return;
+  }
+  context.attributes->normals[chunk.normal_base + chunk.normals_read] = glm::vec3{ x, y, z };
+  chunk.normals_read += 1;
+}
+
+void on_uv(void* user_data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z) {
+  UNUSED(z);
+  auto &context = *static_cast<parse_context_t*>(user_data);
+  auto &chunk   = *context.chunk;
+  if (chunk.uvs_read == chunk.uv_count) {
+    chunk.overflow = true;
+    return;
+  }
+  // obj uv origin is bottom left, gltf and our textures start at top left
+  context.attributes->uvs[chunk.uv_base + chunk.uvs_read] = glm::vec2{ x, 1.f - y };
+  chunk.uvs_read += 1;
+}
+
+void on_face(void* user_data, tinyobj::index_t* indices, int count) {
+  auto &chunk = *static_cast<parse_context_t*>(user_data)->chunk;
+
+  auto corner = [&](int i) {
+    return corner_t{
+      .position = resolve_index(indices[i].vertex_index, chunk.position_base, chunk.positions_read),
+      .uv       = resolve_index(indices[i].texcoord_index, chunk.uv_base, chunk.uvs_read),
+      .normal   = resolve_index(indices[i].normal_index, chunk.normal_base, chunk.normals_read),
+    };
+  };
+  // polygons are triangulated as fans
+  for (int i = 1; i + 1 < count; i += 1) {
+    chunk.corners.push_back(corner(0));
+    chunk.corners.push_back(corner(i));
+    chunk.corners.push_back(corner(i + 1));
+    chunk.triangle_slots.push_back(chunk.current_slot);
+  }
+}
+
+void on_usemtl(void* user_data, char const* name, int material_id) {
+  UNUSED(material_id); // chunks do not see mtllib, materials are matched by name after parsing
+  auto &chunk = *static_cast<parse_context_t*>(user_data)->chunk;
+  chunk.material_names.emplace_back(trim(name));
+  chunk.current_slot = (u32) chunk.material_names.size() - 1;
+}
+
+void parse_chunk(chunk_t &chunk, obj_attributes_t &attributes) {
+  WTRACE_FUNCTION();
+  tinyobj::callback_t callbacks{};
+  callbacks.vertex_cb   = on_position;
+  callbacks.normal_cb   = on_normal;
+  callbacks.texcoord_cb = on_uv;
+  callbacks.index_cb    = on_face;
+  callbacks.usemtl_cb   = on_usemtl;
+
+  MemoryStreamBuffer buffer{ chunk.text };
+  std::istream       stream{ &buffer };
+  parse_context_t    context = { .chunk = &chunk, .attributes = &attributes };
+  std::string        warning{};
+  std::string        error{};
+
+  bool res = tinyobj::LoadObjWithCallback(stream, callbacks, &context, nullptr, &warning, &error);
+  if (not res || not error.empty()) {
+    WERROR("error while parsing obj chunk, message:{}", error);
+    throw std::runtime_error("failed to parse obj");
+  }
+}
+
+material default_material() {
+  material m           = {};
+  m.base_color_factor  = glm::vec3{ 1.f };
+  m.base_color_texture = -1;
+  m.roughness_factor   = 1.f;
+  m.rm_texture         = -1;
+  m.n_texture          = -1;
+  m.e_texture          = -1;
+  return m;
+}
+
+/*
+  mtl has no metallic roughness texture, blender exports keep roughness in Pr, older files only have Ns
+*/
+material convert_material(tinyobj::material_t const &tmat, std::map<std::string, i32> &textures) {
+  auto texture_index = [&](std::string const &name) {
+    if (name.empty()) {
+      return -1;
+    }
+    auto [it, inserted] = textures.emplace(name, (i32) textures.size());
+    return it->second;
+  };
+
+  material m           = default_material();
+  m.base_color_factor  = glm::vec3{ tmat.diffuse[0], tmat.diffuse[1], tmat.diffuse[2] };
+  m.base_color_texture = texture_index(tmat.diffuse_texname);
+  m.roughness_factor   = tmat.roughness > 0.f ? tmat.roughness : std::sqrt(2.f / (std::max(tmat.shininess, 0.f) + 2.f));
+  m.metallic_factor    = tmat.metallic;
+  m.emissive_factor    = glm::vec3{ tmat.emission[0], tmat.emission[1], tmat.emission[2] };
+  m.e_texture          = texture_index(tmat.emissive_texname);
+  m.n_texture          = texture_index(tmat.normal_texname);
+  return m;
+}
+
+// missing textures are common in old obj assets, they turn into white pixel instead of failing the whole scene
+image_data_t decode_image_file(std::string const &path) {
+  WTRACE_FUNCTION();
+  int      width = 0, height = 0, channels = 0;
+  stbi_uc* stbi_pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (stbi_pixels == nullptr) {
+    WWARN("Failed to load texture {}: {}", path, stbi_failure_reason());
+    return image_data_t{ .width = 1, .height = 1, .pixels = { 255, 255, 255, 255 } };
+  }
+
+  image_data_t result = {};
+  result.width        = (u32) width;
+  result.height       = (u32) height;
+  result.pixels.assign(stbi_pixels, stbi_pixels + (usize) width * height * 4);
+  stbi_image_free(stbi_pixels);
+  return result;
+}
+
+/*
+  one primitive per material, welded
+*/
+struct primitive_build_t {
+  std::vector<glm::vec3> positions{};
+  std::vector<glm::vec3> normals{};
+  std::vector<glm::vec2> uvs{};
+  std::vector<u32>       indices{};
+  bool                   invalid_index = false;
+};
+
+void weld_primitive(std::vector<corner_t> const &corners, obj_attributes_t const &attributes, primitive_build_t &out) {
+  WTRACE_FUNCTION();
+  std::unordered_map<corner_t, u32, corner_hash_t> unique{};
+  unique.reserve(corners.size() / 2);
+
+  bool missing_normals = false;
+  out.indices.reserve(corners.size());
+  for (corner_t const &corner : corners) {
+    auto [it, inserted] = unique.emplace(corner, (u32) out.positions.size());
+    out.indices.push_back(it->second);
+    if (not inserted) {
+      continue;
+    }
+
+    bool valid = corner.position < attributes.positions.size() && (corner.uv == no_index || corner.uv < attributes.uvs.size()) &&
+                 (corner.normal == no_index || corner.normal < attributes.normals.size());
+    if (not valid) {
+      out.invalid_index = true;
+      return;
+    }
+    out.positions.push_back(attributes.positions[corner.position]);
+    out.uvs.push_back(corner.uv != no_index ? attributes.uvs[corner.uv] : glm::vec2{ 0.f });
+    out.normals.push_back(corner.normal != no_index ? attributes.normals[corner.normal] : glm::vec3{ 0.f });
+    missing_normals = missing_normals || corner.normal == no_index;
+  }
+
+  if (not missing_normals) {
+    return;
+  }
+  // vertices without normal get area weighted average of their faces
+  std::vector<glm::vec3> generated(out.positions.size(), glm::vec3{ 0.f });
+  for (usize i = 0; i + 2 < out.indices.size(); i += 3) {
+    u32       i0     = out.indices[i + 0];
+    u32       i1     = out.indices[i + 1];
+    u32       i2     = out.indices[i + 2];
+    glm::vec3 normal = glm::cross(out.positions[i1] - out.positions[i0], out.positions[i2] - out.positions[i0]);
+    generated[i0] += normal;
+    generated[i1] += normal;
+    generated[i2] += normal;
+  }
+  for (usize i = 0; i < out.normals.size(); i += 1) {
+    if (out.normals[i] == glm::vec3{ 0.f } && glm::dot(generated[i], generated[i]) > 0.f) {
+      out.normals[i] = glm::normalize(generated[i]);
+    }
+  }
+}
+
+} // namespace
+
+obj_load_stats_t load_obj(std::string_view file_path, scene_data_t &scene, ThreadPool &pool, obj_load_options_t const &options) {
+  WTRACE_FUNCTION();
+  if (!std::filesystem::exists(file_path)) {
+    WERROR("Cant parse obj scene: file not found - {}", file_path);
+    throw std::runtime_error("cant find obj scene");
+  }
+
+  obj_load_stats_t stats = {};
+  stats.parse_threads    = pool.thread_count() + 1;
+
+  u64 cache_variant = options.optimize_meshes ? 1 : 0;
+  if (options.use_scene_cache && read_scene_cache(file_path, cache_variant, scene)) {
+    stats.from_cache = true;
+    return stats;
+  }
+
+  MappedFile file{ file_path };
+  if (not file.is_open()) {
+    throw std::runtime_error("cant map obj scene");
+  }
+  std::string_view text{ (char const*) file.data(), file.size() };
+  stats.file_bytes = file.size();
+
+  // PARSING: counting pass gives every chunk its attribute offsets, so parsing pass writes straight into shared arrays
+  auto parse_start = std::chrono::steady_clock::now();
+
+  std::vector<chunk_t> chunks = split_chunks(text, (usize) stats.parse_threads * 4);
+  stats.chunk_count           = (u32) chunks.size();
+  pool.parallel_for(chunks.size(), [&](usize i) { //
+    count_chunk(chunks[i]);
+  });
+
+  obj_attributes_t attributes{};
+  u32              position_count = 0;
+  u32              normal_count   = 0;
+  u32              uv_count       = 0;
+  for (chunk_t &chunk : chunks) {
+    chunk.position_base = position_count;
+    chunk.normal_base   = normal_count;
+    chunk.uv_base       = uv_count;
+    position_count += chunk.position_count;
+    normal_count += chunk.normal_count;
+    uv_count += chunk.uv_count;
+  }
+  attributes.positions.resize(position_count);
+  attributes.normals.resize(normal_count);
+  attributes.uvs.resize(uv_count);
+
+  pool.parallel_for(chunks.size(), [&](usize i) { //
+    parse_chunk(chunks[i], attributes);
+  });
+  for (chunk_t const &chunk : chunks) {
+    bool complete = chunk.positions_read == chunk.position_count && chunk.normals_read == chunk.normal_count && chunk.uvs_read == chunk.uv_count;
+    if (chunk.overflow || not complete) {
+      WERROR("obj attribute count differs between counting and parsing passes - {}", file_path);
+      throw std::runtime_error("failed to parse obj");
+    }
+  }
+  stats.parse_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - parse_start).count();
+
+  // MATERIALS
+  auto build_start = std::chrono::steady_clock::now();
+
+  std::vector<tinyobj::material_t> tmaterials{};
+  std::map<std::string, int>       material_map{};
+  tinyobj::MaterialFileReader      material_reader{ (std::filesystem::path(file_path).parent_path() / "").string() };
+  // material libraries and textures, scene cache is checked against them
+  std::vector<std::string> dependencies{};
+  for (chunk_t const &chunk : chunks) {
+    for (std::string const &mtllib : chunk.mtllibs) {
+      dependencies.push_back((std::filesystem::path(file_path).parent_path() / mtllib).string());
+      std::string warning{};
+      std::string error{};
+      if (not material_reader(mtllib, &tmaterials, &material_map, &warning, &error)) {
+        WWARN("failed to read material library {}: {}", mtllib, error);
+      }
+    }
+  }
+
+  std::map<std::string, i32> textures{};
+  scene.materials.reserve(tmaterials.size() + 1);
+  for (auto const &tmat : tmaterials) {
+    scene.materials.push_back(convert_material(tmat, textures));
+  }
+  // faces before any usemtl and faces of unknown materials
+  u32 fallback_material = (u32) scene.materials.size();
+  scene.materials.push_back(default_material());
+  u32 material_count = (u32) scene.materials.size();
+
+  // material in effect at chunk start comes from the last usemtl of previous chunks
+  u32 current_material = fallback_material;
+  for (chunk_t &chunk : chunks) {
+    chunk.first_material = current_material;
+    for (std::string const &name : chunk.material_names) {
+      auto it = material_map.find(name);
+      if (it == material_map.end()) {
+        WWARN("obj uses unknown material {}", name);
+      }
+      chunk.slot_materials.push_back(it != material_map.end() ? (u32) it->second : fallback_material);
+    }
+    if (not chunk.slot_materials.empty()) {
+      current_material = chunk.slot_materials.back();
+    }
+  }
+
+  // MATERIAL SPLIT: chunks count their triangles per material, then scatter corners into disjoint ranges
+  std::vector<std::vector<u32>> chunk_triangle_counts(chunks.size(), std::vector<u32>(material_count, 0));
+  pool.parallel_for(chunks.size(), [&](usize i) {
+    chunk_t const &chunk = chunks[i];
+    for (u32 slot : chunk.triangle_slots) {
+      chunk_triangle_counts[i][slot != no_index ? chunk.slot_materials[slot] : chunk.first_material] += 1;
+    }
+  });
+
+  std::vector<std::vector<corner_t>> material_corners(material_count);
+  std::vector<std::vector<u32>>      chunk_offsets(chunks.size(), std::vector<u32>(material_count, 0));
+  for (u32 material = 0; material < material_count; material += 1) {
+    u32 triangle_count = 0;
+    for (usize i = 0; i < chunks.size(); i += 1) {
+      chunk_offsets[i][material] = triangle_count;
+      triangle_count += chunk_triangle_counts[i][material];
+    }
+    material_corners[material].resize((usize) triangle_count * 3);
+    stats.corner_count += triangle_count * 3;
+  }
+
+  pool.parallel_for(chunks.size(), [&](usize i) {
+    chunk_t &chunk = chunks[i];
+    for (usize triangle = 0; triangle < chunk.triangle_slots.size(); triangle += 1) {
+      u32  slot     = chunk.triangle_slots[triangle];
+      u32  material = slot != no_index ? chunk.slot_materials[slot] : chunk.first_material;
+      u32 &offset   = chunk_offsets[i][material];
+      std::copy_n(chunk.corners.begin() + (i64) triangle * 3, 3, material_corners[material].begin() + (i64) offset * 3);
+      offset += 1;
+    }
+    chunk.corners        = {};
+    chunk.triangle_slots = {};
+  });
+
+  // WELDING: every material on its own thread
+  std::vector<primitive_build_t> builds(material_count);
+  pool.parallel_for(material_count, [&](usize i) {
+    weld_primitive(material_corners[i], attributes, builds[i]);
+    material_corners[i] = {};
+  });
+
+  // FLATTENING into scene arrays, empty materials get no primitive
+  std::vector<u32> mesh_primitives{};
+  u32              vertex_count = 0;
+  u32              index_count  = 0;
+  for (u32 material = 0; material < material_count; material += 1) {
+    primitive_build_t const &build = builds[material];
+    if (build.invalid_index) {
+      WERROR("obj face references attribute which does not exist - {}", file_path);
+      throw std::runtime_error("failed to parse obj");
+    }
+    if (build.indices.empty()) {
+      continue;
+    }
+
+    primitive_full_info info{};
+    info.material_index = material;
+    info.vertex_offset  = vertex_count;
+    info.vertex_count   = (u32) build.positions.size();
+    info.index_offset   = index_count;
+    info.index_count    = (u32) build.indices.size();
+
+    vertex_count += info.vertex_count;
+    index_count += info.index_count;
+
+    mesh_primitives.push_back((u32) scene.primitive_infos.size());
+    scene.primitive_infos.push_back(info);
+  }
+  stats.vertex_count = vertex_count;
+
+  scene.indices.resize(index_count);
+  scene.positions.resize(vertex_count);
+  scene.normals.resize(vertex_count);
+  scene.uvs.resize(vertex_count);
+
+  pool.parallel_for(scene.primitive_infos.size(), [&](usize i) {
+    primitive_full_info const &info  = scene.primitive_infos[i];
+    primitive_build_t         &build = builds[info.material_index];
+    std::copy(build.indices.begin(), build.indices.end(), scene.indices.begin() + info.index_offset);
+    std::copy(build.positions.begin(), build.positions.end(), scene.positions.begin() + info.vertex_offset);
+    std::copy(build.normals.begin(), build.normals.end(), scene.normals.begin() + info.vertex_offset);
+    std::copy(build.uvs.begin(), build.uvs.end(), scene.uvs.begin() + info.vertex_offset);
+    build = {};
+  });
+
+  // obj has no node hierarchy, one mesh holds every primitive. mirrored like gltf root nodes, so both formats face the same way
+  glm::mat4 world_matrix = glm::scale(glm::mat4{ 1.f }, glm::vec3{ -1.f, 1.f, 1.f });
+  for (u32 primitive : mesh_primitives) {
+    scene.nodes.push_back(node{ .world_matrix = world_matrix, .primitive_mesh = (int) primitive, .source_node = 0 });
+  }
+  scene.mesh_to_primitives[0] = std::move(mesh_primitives);
+
+  stats.build_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+  f64 file_mb = (f64) stats.file_bytes / (1024.0 * 1024.0);
+  WINFO(
+      "parsed obj {} ({:.2f} MB) in {} chunks on {} threads: parse {:.2f} ms ({:.1f} MB/s), build {:.2f} ms, {} corners welded into {} vertices", //
+      file_path, file_mb, stats.chunk_count, stats.parse_threads, stats.parse_ms, file_mb / (stats.parse_ms / 1000.0), stats.build_ms,                //
+      stats.corner_count, stats.vertex_count
+  );
+
+  if (options.optimize_meshes) {
+    mesh_optimize_stats_t mesh_stats = optimize_meshes(scene, pool);
+    WINFO(
+        "optimized {} primitives in {:.2f} ms: {} -> {} vertices, estimated hit fetches {:.2f} -> {:.2f} MB", //
+        mesh_stats.primitive_count, mesh_stats.optimize_ms, mesh_stats.vertices_before, mesh_stats.vertices_after,
+        (f64) mesh_stats.fetch_bytes_before / (1024.0 * 1024.0), (f64) mesh_stats.fetch_bytes_after / (1024.0 * 1024.0)
+    );
+  }
+
+  // TEXTURES, indexed in order of first use by materials
+  auto image_decode_start = std::chrono::steady_clock::now();
+
+  std::vector<std::string> texture_paths(textures.size());
+  for (auto const &[name, index] : textures) {
+    std::string path = name;
+    std::replace(path.begin(), path.end(), '\\', '/');
+    texture_paths[index] = (std::filesystem::path(file_path).parent_path() / path).string();
+  }
+  dependencies.insert(dependencies.end(), texture_paths.begin(), texture_paths.end());
+  scene.images.resize(texture_paths.size());
+  pool.parallel_for(texture_paths.size(), [&](usize i) { //
+    scene.images[i] = decode_image_file(texture_paths[i]);
+  });
+  stats.image_decode_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - image_decode_start).count();
+
+  if (options.use_scene_cache) {
+    write_scene_cache(file_path, cache_variant, scene, dependencies);
+  }
+  return stats;
+}
+
+} // namespace whim
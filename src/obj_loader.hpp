@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+
+#include "scene.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/types.hpp"
+
+namespace whim {
+
+struct obj_load_options_t {
+  bool use_scene_cache = true;
+  // reorder welded meshes for fetch locality, see mesh_optimizer.hpp. cached separately from plain scenes
+  bool optimize_meshes = false;
+};
+
+/*
+  obj parsing statistics, parse and build times are zero if scene comes from cache
+*/
+struct obj_load_stats_t {
+  bool  from_cache      = false;
+  usize file_bytes      = 0;
+  u32   chunk_count     = 0;
+  u32   parse_threads   = 0;
+  f64   parse_ms        = 0.0; // counting and tinyobjloader passes over text
+  f64   build_ms        = 0.0; // index resolution, material split and welding
+  f64   image_decode_ms = 0.0;
+  u32   corner_count    = 0; // vertices before welding, three per triangle
+  u32   vertex_count    = 0;
+};
+
+/*
+  parses wavefront obj with its mtl libraries into flat scene arrays, same ones load_gltf fills.
+
+  text is split into line aligned chunks which tinyobjloader parses in parallel through its callback api,
+  every chunk writes its attributes at offsets known from a counting pass. triangles are split into one primitive
+  per used material, corners with equal position, uv and normal indices are welded into one vertex.
+  scene is read from scene cache when it is up to date and written into it after parsing otherwise
+*/
+obj_load_stats_t load_obj(std::string_view file_path, scene_data_t &scene, ThreadPool &pool, obj_load_options_t const &options);
+
+} // namespace whim
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "utility/types.hpp"
+
+namespace whim {
+
+/*
+  common interface of rendering backends, every backend renders the same scene data with the same camera
+  and must produce the same image up to floating point differences
+*/
+class Renderer {
+public:
+  virtual ~Renderer() = default;
+
+  virtual void load_gltf_scene(std::string_view file_path) = 0;
+  virtual void load_obj_scene(std::string_view file_path)  = 0;
+
+  virtual void reset_frame() = 0;
+
+  /*
+    renders sample_count accumulated samples and returns linear RGBA image,
+    rows go from top to bottom
+  */
+  virtual std::vector<f32> render_offline(u32 sample_count) = 0;
+};
+
+} // namespace whim
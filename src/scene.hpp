@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "shader.h"
+#include "utility/types.hpp"
+
+namespace whim {
+
+class MappedFile;
+
+struct primitive_full_info {
+  u32 index_count    = 0;
+  u32 index_offset   = 0;
+  u32 vertex_count   = 0;
+  u32 vertex_offset  = 0;
+  u32 material_index = 0;
+  // earlier primitive with identical geometry whose vertex and index ranges (and blas) this one shares, -1 if ranges are its own
+  i32 geometry_owner = -1;
+};
+
+struct node {
+  glm::mat4 world_matrix   = glm::mat4{ 1.f };
+  int       primitive_mesh = 0;
+  // gltf node this primitive instance comes from (0 for obj, which has one), primitives of one source node move together
+  int source_node = -1;
+};
+
+/*
+  decoded 8 bit RGBA image, only base level is stored (mips are generated on gpu)
+*/
+struct image_data_t {
+  u32             width  = 0;
+  u32             height = 0;
+  std::vector<u8> pixels{};
+  // images read from scene cache leave pixels empty and point into scene_data_t::cache_mapping instead
+  std::span<u8 const> mapped_pixels{};
+
+  [[nodiscard]] std::span<u8 const> data() const { return pixels.empty() ? mapped_pixels : std::span<u8 const>{ pixels }; }
+};
+
+/*
+  flattened scene: all primitives share the same vertex and index arrays,
+  images are indexed by gltf texture index
+*/
+struct scene_data_t {
+  std::vector<glm::vec3> positions{};
+  std::vector<u32>       indices{};
+  std::vector<glm::vec3> normals{};
+  std::vector<glm::vec2> uvs{};
+  std::vector<material>  materials{};
+  //
+  std::vector<primitive_full_info>          primitive_infos{};
+  std::vector<node>                         nodes{};
+  std::unordered_map<i32, std::vector<u32>> mesh_to_primitives{};
+  //
+  std::vector<image_data_t> images{};
+  // scene cache file backing mapped_pixels of images, alive until images are uploaded
+  std::shared_ptr<MappedFile const> cache_mapping{};
+};
+
+} // namespace whim
@@ -0,0 +1,379 @@
+#include "scene_cache.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+
+#include "utility/align.hpp"
+#include "utility/hash.hpp"
+#include "utility/log.hpp"
+#include "utility/mapped_file.hpp"
+
+namespace whim {
+
+namespace {
+
+constexpr u32   cache_magic       = 0x31435357; // "WSC1"
+constexpr u32   cache_version     = 4;
+constexpr usize section_alignment = 16;
+
+enum class section : u32 {
+  positions = 0,
+  indices,
+  normals,
+  uvs,
+  materials,
+  primitive_infos,
+  nodes,
+  mesh_ranges,
+  mesh_primitives,
+  image_infos,
+  image_pixels,
+  dependencies,
+  dependency_paths,
+  count
+};
+
+struct section_t {
+  u64 offset = 0;
+  u64 size   = 0;
+};
+
+struct mesh_range_t {
+  i32 mesh  = 0;
+  u32 first = 0;
+  u32 count = 0;
+};
+
+struct image_info_t {
+  u32 width  = 0;
+  u32 height = 0;
+  u64 offset = 0; // inside image_pixels section
+  u64 size   = 0;
+};
+
+// file referenced by source scene, path is a range of dependency_paths section
+struct dependency_t {
+  u64 path_offset  = 0;
+  u64 path_size    = 0;
+  u64 size         = 0;
+  i64 mtime        = 0;
+  u64 content_hash = 0;
+};
+
+struct cache_header_t {
+  u32       magic        = cache_magic;
+  u32       version      = cache_version;
+  u64       layout_hash  = 0;
+  u64       path_hash    = 0;
+  u64       source_size  = 0;
+  i64       mtime        = 0;
+  u64       content_hash = 0;
+  u64       variant      = 0;
+  section_t sections[(u32) section::count]{};
+};
+
+/*
+  sections are raw struct dumps, so any change of their layout must invalidate old caches
+*/
+constexpr u64 layout_hash() {
+  constexpr std::array<u64, 7> sizes = {
+    sizeof(glm::vec3), sizeof(glm::vec2), sizeof(material), sizeof(primitive_full_info), sizeof(node), sizeof(image_info_t), sizeof(dependency_t) //
+  };
+  u64 hash = fnv1a_offset_basis;
+  for (u64 size : sizes) {
+    hash ^= size;
+    hash *= fnv1a_prime;
+  }
+  return hash;
+}
+
+// size of files which do not exist, so a file appearing later invalidates cache as well
+constexpr u64 missing_file = ~0ull;
+
+struct file_stamp_t {
+  u64 size  = missing_file;
+  i64 mtime = 0;
+};
+
+file_stamp_t stamp_of(std::filesystem::path const &path) {
+  std::error_code error{};
+  u64             size  = std::filesystem::file_size(path, error);
+  auto            mtime = std::filesystem::last_write_time(path, error);
+  if (error) {
+    return {};
+  }
+  return file_stamp_t{ .size = size, .mtime = (i64) mtime.time_since_epoch().count() };
+}
+
+u64 hash_file(std::string_view file_path) {
+  MappedFile file{ file_path };
+  return file.is_open() ? hash_words(file.data(), file.size()) : 0;
+}
+
+/*
+  same stamp is trusted, touched file of the same size (checkout, copy) is hashed and still valid if content is equal
+*/
+bool is_unchanged(std::string const &file_path, file_stamp_t const &recorded, u64 content_hash) {
+  file_stamp_t current = stamp_of(file_path);
+  if (current.size != recorded.size) {
+    return false;
+  }
+  return current.mtime == recorded.mtime or current.size == missing_file or hash_file(file_path) == content_hash;
+}
+
+std::string normalized_path(std::string_view file_path) { //
+  return std::filesystem::absolute(std::filesystem::path{ file_path }).lexically_normal().generic_string();
+}
+
+struct source_key_t {
+  u64          path_hash = 0;
+  file_stamp_t stamp     = {};
+  u64          variant   = 0;
+};
+
+/*
+  path and file stamp only, reading source is left for the case when stamp does not match
+*/
+source_key_t make_source_key(std::string_view source_path, u64 variant) {
+  return source_key_t{ .path_hash = fnv1a(normalized_path(source_path)), .stamp = stamp_of(source_path), .variant = variant };
+}
+
+std::filesystem::path cache_path(source_key_t const &key) {
+  auto name = key.variant == 0 ? fmt::format("{:016x}.wsc", key.path_hash) : fmt::format("{:016x}.{}.wsc", key.path_hash, key.variant);
+  return std::filesystem::path{ scene_cache_directory } / name;
+}
+
+template<typename T>
+std::span<u8 const> bytes_of(std::vector<T> const &values) { //
+  return { reinterpret_cast<u8 const*>(values.data()), values.size() * sizeof(T) };
+}
+
+// offset and size come from file, so their sum may wrap around
+bool in_bounds(u64 offset, u64 size, u64 limit) { return offset <= limit and size <= limit - offset; }
+
+template<typename T>
+bool read_section(MappedFile const &file, cache_header_t const &header, section s, std::vector<T> &out) {
+  auto const &sec = header.sections[(u32) s];
+  if (!in_bounds(sec.offset, sec.size, file.size()) || sec.size % sizeof(T) != 0) {
+    return false;
+  }
+  auto const* first = reinterpret_cast<T const*>(file.data() + sec.offset);
+  out.assign(first, first + sec.size / sizeof(T));
+  return true;
+}
+
+} // namespace
+
+bool read_scene_cache(std::string_view source_path, u64 variant, scene_data_t &scene) {
+  source_key_t key  = make_source_key(source_path, variant);
+  auto         path = cache_path(key);
+  if (!std::filesystem::exists(path)) {
+    return false;
+  }
+
+  // mapping outlives this call, image pixels are uploaded straight from it
+  auto        mapping = std::make_shared<MappedFile const>(path.string());
+  auto const &file    = *mapping;
+  if (!file.is_open() || file.size() < sizeof(cache_header_t)) {
+    return false;
+  }
+
+  cache_header_t header = {};
+  std::memcpy(&header, file.data(), sizeof(cache_header_t));
+
+  bool valid = header.magic == cache_magic and header.version == cache_version and header.layout_hash == layout_hash();
+  valid      = valid and header.path_hash == key.path_hash and header.variant == key.variant;
+  valid      = valid and is_unchanged(std::string(source_path), { .size = header.source_size, .mtime = header.mtime }, header.content_hash);
+
+  // external buffers, images and material libraries are checked the same way
+  std::vector<dependency_t> dependencies{};
+  std::vector<char>         dependency_paths{};
+  valid = valid and read_section(file, header, section::dependencies, dependencies);
+  valid = valid and read_section(file, header, section::dependency_paths, dependency_paths);
+  for (usize i = 0; valid and i < dependencies.size(); i += 1) {
+    auto const &dependency = dependencies[i];
+    if (!in_bounds(dependency.path_offset, dependency.path_size, dependency_paths.size())) {
+      valid = false;
+      break;
+    }
+    std::string dependency_path{ dependency_paths.data() + dependency.path_offset, dependency.path_size };
+    valid = is_unchanged(dependency_path, { .size = dependency.size, .mtime = dependency.mtime }, dependency.content_hash);
+    if (not valid) {
+      WINFO("{} referenced by {} changed", dependency_path, source_path);
+    }
+  }
+  if (!valid) {
+    WINFO("scene cache for {} is stale, reparsing", source_path);
+    return false;
+  }
+
+  std::vector<mesh_range_t> mesh_ranges{};
+  std::vector<u32>          mesh_primitives{};
+  std::vector<image_info_t> image_infos{};
+
+  valid = read_section(file, header, section::positions, scene.positions);
+  valid = valid and read_section(file, header, section::indices, scene.indices);
+  valid = valid and read_section(file, header, section::normals, scene.normals);
+  valid = valid and read_section(file, header, section::uvs, scene.uvs);
+  valid = valid and read_section(file, header, section::materials, scene.materials);
+  valid = valid and read_section(file, header, section::primitive_infos, scene.primitive_infos);
+  valid = valid and read_section(file, header, section::nodes, scene.nodes);
+  valid = valid and read_section(file, header, section::mesh_ranges, mesh_ranges);
+  valid = valid and read_section(file, header, section::mesh_primitives, mesh_primitives);
+  valid = valid and read_section(file, header, section::image_infos, image_infos);
+
+  auto const &pixels = header.sections[(u32) section::image_pixels];
+  valid              = valid and in_bounds(pixels.offset, pixels.size, file.size());
+
+  if (!valid) {
+    WERROR("scene cache {} is corrupted", path.string());
+    scene = {};
+    return false;
+  }
+
+  scene.mesh_to_primitives.clear();
+  for (auto const &range : mesh_ranges) {
+    if (!in_bounds(range.first, range.count, mesh_primitives.size())) {
+      scene = {};
+      return false;
+    }
+    auto first                           = mesh_primitives.begin() + range.first;
+    scene.mesh_to_primitives[range.mesh] = std::vector<u32>(first, first + range.count);
+  }
+
+  scene.images.clear();
+  scene.images.reserve(image_infos.size());
+  for (auto const &info : image_infos) {
+    if (!in_bounds(info.offset, info.size, pixels.size) || info.size != (u64) info.width * info.height * 4) {
+      scene = {};
+      return false;
+    }
+    u8 const* first = file.data() + pixels.offset + info.offset;
+    scene.images.push_back(image_data_t{ .width = info.width, .height = info.height, .mapped_pixels = std::span{ first, info.size } });
+  }
+  scene.cache_mapping = std::move(mapping);
+
+  WINFO("scene {} loaded from cache {} ({} bytes)", source_path, path.string(), file.size());
+  return true;
+}
+
+void write_scene_cache(std::string_view source_path, u64 variant, scene_data_t const &scene, std::span<std::string const> dependencies) {
+  source_key_t key  = make_source_key(source_path, variant);
+  auto         path = cache_path(key);
+
+  std::error_code error{};
+  std::filesystem::create_directories(path.parent_path(), error);
+  if (error) {
+    WERROR("failed to create scene cache directory {}: {}", path.parent_path().string(), error.message());
+    return;
+  }
+
+  // flatten map and images into plain arrays
+  std::vector<mesh_range_t> mesh_ranges{};
+  std::vector<u32>          mesh_primitives{};
+  for (auto const &[mesh, primitives] : scene.mesh_to_primitives) {
+    mesh_ranges.push_back(mesh_range_t{ .mesh = mesh, .first = (u32) mesh_primitives.size(), .count = (u32) primitives.size() });
+    mesh_primitives.insert(mesh_primitives.end(), primitives.begin(), primitives.end());
+  }
+
+  std::vector<image_info_t> image_infos{};
+  u64                       pixels_size = 0;
+  for (auto const &image : scene.images) {
+    image_infos.push_back(image_info_t{ .width = image.width, .height = image.height, .offset = pixels_size, .size = image.data().size() });
+    pixels_size += image.data().size();
+  }
+
+  std::vector<dependency_t> dependency_infos{};
+  std::vector<char>         dependency_paths{};
+  for (std::string const &dependency : dependencies) {
+    std::string  path  = normalized_path(dependency);
+    file_stamp_t stamp = stamp_of(path);
+    dependency_infos.push_back(dependency_t{
+        .path_offset  = dependency_paths.size(),
+        .path_size    = path.size(),
+        .size         = stamp.size,
+        .mtime        = stamp.mtime,
+        .content_hash = stamp.size != missing_file ? hash_file(path) : 0,
+    });
+    dependency_paths.insert(dependency_paths.end(), path.begin(), path.end());
+  }
+
+  std::array<std::span<u8 const>, (u32) section::count> blobs{};
+  blobs[(u32) section::positions]        = bytes_of(scene.positions);
+  blobs[(u32) section::indices]          = bytes_of(scene.indices);
+  blobs[(u32) section::normals]          = bytes_of(scene.normals);
+  blobs[(u32) section::uvs]              = bytes_of(scene.uvs);
+  blobs[(u32) section::materials]        = bytes_of(scene.materials);
+  blobs[(u32) section::primitive_infos]  = bytes_of(scene.primitive_infos);
+  blobs[(u32) section::nodes]            = bytes_of(scene.nodes);
+  blobs[(u32) section::mesh_ranges]      = bytes_of(mesh_ranges);
+  blobs[(u32) section::mesh_primitives]  = bytes_of(mesh_primitives);
+  blobs[(u32) section::image_infos]      = bytes_of(image_infos);
+  blobs[(u32) section::dependencies]     = bytes_of(dependency_infos);
+  blobs[(u32) section::dependency_paths] = bytes_of(dependency_paths);
+
+  cache_header_t header = {};
+  header.layout_hash    = layout_hash();
+  header.path_hash      = key.path_hash;
+  header.source_size    = key.stamp.size;
+  header.mtime          = key.stamp.mtime;
+  header.content_hash   = hash_file(source_path);
+  header.variant        = key.variant;
+
+  u64 offset = align_up<u64>(sizeof(cache_header_t), section_alignment);
+  for (u32 i = 0; i < (u32) section::count; i += 1) {
+    u64 size           = i == (u32) section::image_pixels ? pixels_size : blobs[i].size();
+    header.sections[i] = section_t{ .offset = offset, .size = size };
+    offset             = align_up<u64>(offset + size, section_alignment);
+  }
+
+  // write into temporary file first, so interrupted write never leaves valid looking cache
+  auto temp_path = path;
+  temp_path += ".tmp";
+
+  std::ofstream out{ temp_path, std::ios::binary | std::ios::trunc };
+  if (!out) {
+    WERROR("failed to open scene cache for writing - {}", temp_path.string());
+    return;
+  }
+
+  constexpr std::array<char, section_alignment> padding{};
+  auto pad_to = [&](u64 position) {
+    u64 current = (u64) out.tellp();
+    out.write(padding.data(), (std::streamsize) (position - current));
+  };
+
+  out.write((char const*) &header, sizeof(cache_header_t));
+  for (u32 i = 0; i < (u32) section::count; i += 1) {
+    pad_to(header.sections[i].offset);
+    if (i == (u32) section::image_pixels) {
+      for (auto const &image : scene.images) {
+        out.write((char const*) image.data().data(), (std::streamsize) image.data().size());
+      }
+    } else {
+      out.write((char const*) blobs[i].data(), (std::streamsize) blobs[i].size());
+    }
+  }
+  out.close();
+
+  if (!out) {
+    WERROR("failed to write scene cache - {}", temp_path.string());
+    std::filesystem::remove(temp_path, error);
+    return;
+  }
+
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    WERROR("failed to move scene cache into place {}: {}", path.string(), error.message());
+    std::filesystem::remove(temp_path, error);
+    return;
+  }
+  WINFO("scene cache written to {} ({} bytes)", path.string(), offset);
+}
+
+} // namespace whim
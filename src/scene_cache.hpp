@@ -0,0 +1,30 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "scene.hpp"
+
+namespace whim {
+
+/*
+  Binary scene cache
+
+  Parsed scene (flattened arrays, primitive infos, node matrices, materials and decoded images) is dumped
+  as is into one file per source scene. Cache is keyed by source path and validated by source size and mtime,
+  content hash is checked only when mtime differs, so warm loads never read the whole source. Warm loads map
+  the file and copy geometry sections into scene_data_t without touching tinygltf, image pixels stay in the
+  mapping (scene_data_t::cache_mapping) and are uploaded from it.
+  variant tells apart scenes parsed with different load options, every variant has its own file.
+  files referenced by the scene (external buffers, images, material libraries) are recorded with their stamps
+  and checked the same way, a missing one invalidates cache when it appears.
+*/
+constexpr std::string_view scene_cache_directory = "./cache";
+
+// returns false if there is no valid cache entry for source file
+bool read_scene_cache(std::string_view source_path, u64 variant, scene_data_t &scene);
+// dependencies are paths of files the source references, see above
+void write_scene_cache(std::string_view source_path, u64 variant, scene_data_t const &scene, std::span<std::string const> dependencies);
+
+} // namespace whim
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+
+#include "utility/types.hpp"
+
+namespace whim {
+
+constexpr u64 fnv1a_offset_basis = 0xcbf29ce484222325ull;
+constexpr u64 fnv1a_prime        = 0x100000001b3ull;
+
+/*
+  64 bit FNV-1a, pass previous result as seed to hash several ranges
+*/
+inline u64 fnv1a(void const* data, usize size, u64 seed = fnv1a_offset_basis) noexcept {
+  auto const* bytes = static_cast<u8 const*>(data);
+  u64         hash  = seed;
+  for (usize i = 0; i < size; i += 1) {
+    hash ^= bytes[i];
+    hash *= fnv1a_prime;
+  }
+  return hash;
+}
+
+inline u64 fnv1a(std::string_view str, u64 seed = fnv1a_offset_basis) noexcept { //
+  return fnv1a(str.data(), str.size(), seed);
+}
+
+constexpr u64 murmur64_multiplier = 0xc6a4a7935bd1e995ull;
+
+/*
+  64 bit hash over 8 byte words (MurmurHash64A mixing), several times faster than fnv1a on large buffers.
+  tail bytes go through fnv1a, pass previous result as seed to hash several ranges
+*/
+inline u64 hash_words(void const* data, usize size, u64 seed = fnv1a_offset_basis) noexcept {
+  auto const* bytes = static_cast<u8 const*>(data);
+  u64         hash  = seed ^ (size * murmur64_multiplier);
+  usize       i     = 0;
+  for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+    u64 word = 0;
+    std::memcpy(&word, bytes + i, sizeof(u64));
+    word *= murmur64_multiplier;
+    word ^= word >> 47;
+    word *= murmur64_multiplier;
+
+    hash ^= word;
+    hash *= murmur64_multiplier;
+  }
+  return fnv1a(bytes + i, size - i, hash);
+}
+
+} // namespace whim
@@ -0,0 +1,430 @@
+#include "utility/log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utility/hash.hpp"
+
+namespace whim::log {
+
+namespace {
+
+constexpr u32 ring_capacity  = 4096; // power of two
+constexpr u32 binary_version = 1;
+
+struct record_t {
+  u64                                time_ns    = 0;
+  level_t                            level      = level_t::info;
+  u32                                thread     = 0;
+  u32                                suppressed = 0;
+  u16                                size       = 0;
+  std::array<char, max_message_size> text       = {};
+};
+
+/*
+  bounded multi producer ring (Vyukov): slot sequence tells whose turn it is,
+  producers claim positions by CAS on enqueue position, the only consumer is writer thread
+*/
+class Logger {
+
+public:
+  Logger();
+  ~Logger() = delete; // leaked, messages may come while static objects are destroyed
+
+  // false if ring is full, record is counted as dropped unless it is an error
+  bool try_push(record_t const &record);
+  void flush();
+  void stop();
+
+  bool open_sink(std::string_view path, sink_format_t format);
+
+  [[nodiscard]] bool is_running() const { return m_running.load(std::memory_order_acquire); }
+
+  // used after stop(), when there is no writer thread
+  void write_now(record_t const &record);
+
+private:
+  struct slot_t {
+    std::atomic<u64> sequence = 0;
+    record_t         record   = {};
+  };
+
+  bool try_pop(record_t &record);
+  void writer_loop();
+  void write(record_t const &record);
+
+private:
+  std::vector<slot_t> m_slots;
+
+  alignas(64) std::atomic<u64> m_enqueue = 0;
+  alignas(64) std::atomic<u64> m_written = 0; // dequeue position, advanced by writer only
+  alignas(64) std::atomic<u64> m_dropped = 0;
+  std::atomic<u32>             m_signal  = 0; // bumped on every push, writer sleeps on it
+  std::atomic<bool>            m_stop    = false;
+  std::atomic<bool>            m_running = false;
+
+  std::mutex    m_write_mutex; // writer thread against write_now() and open_sink()
+  std::FILE*    m_sink        = nullptr;
+  sink_format_t m_sink_format = sink_format_t::json;
+
+  std::thread m_writer;
+};
+
+auto const process_start = std::chrono::steady_clock::now();
+
+u64 now_ns() { return (u64) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - process_start).count(); }
+
+u32 thread_index() {
+  static std::atomic<u32> next  = 0;
+  thread_local u32        index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+// call sites with suppressed messages, see rate_limit_t
+std::atomic<rate_limit_t*> suppressing_sites = nullptr;
+
+void register_site(rate_limit_t &limit, level_t level, std::string_view format) {
+  if (limit.registered.exchange(true, std::memory_order_relaxed)) {
+    return;
+  }
+  limit.level  = level;
+  limit.format = format;
+  limit.next   = suppressing_sites.load(std::memory_order_relaxed);
+  while (not suppressing_sites.compare_exchange_weak(limit.next, &limit, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+}
+
+void report_repeats(level_t level, std::string_view format, u32 repeats) {
+  std::array<char, max_message_size> text{};
+  auto result = fmt::format_to_n(text.data(), text.size(), "previous message \"{}\" repeated {} more times", format, repeats);
+  submit(level, 0, std::string_view{ text.data(), std::min<usize>(result.size, text.size()) });
+}
+
+void stop_logger();
+void terminate_handler();
+
+std::terminate_handler previous_terminate = nullptr;
+
+Logger &logger() {
+  static Logger* instance = []() {
+    Logger* created = new Logger{};
+    std::atexit(stop_logger);
+    // uncaught exceptions skip atexit, errors logged right before throw would be lost
+    previous_terminate = std::set_terminate(terminate_handler);
+    return created;
+  }();
+  return *instance;
+}
+
+void stop_logger() { logger().stop(); }
+
+void terminate_handler() {
+  logger().flush();
+  if (previous_terminate != nullptr) {
+    previous_terminate();
+  }
+  std::abort();
+}
+
+char const* level_prefix(level_t level) {
+  switch (level) {
+    case level_t::debug: return "[DEBUG] ";
+    case level_t::info: return "[INFO]  ";
+    case level_t::warn: return "[WARN]  ";
+    case level_t::error: return "[ERROR] ";
+  }
+  return "";
+}
+
+char const* level_name(level_t level) {
+  switch (level) {
+    case level_t::debug: return "debug";
+    case level_t::info: return "info";
+    case level_t::warn: return "warn";
+    case level_t::error: return "error";
+  }
+  return "";
+}
+
+void append_json_string(fmt::memory_buffer &out, std::string_view text) {
+  out.push_back('"');
+  for (char c : text) {
+    switch (c) {
+      case '"': fmt::format_to(std::back_inserter(out), "\\\""); break;
+      case '\\': fmt::format_to(std::back_inserter(out), "\\\\"); break;
+      case '\n': fmt::format_to(std::back_inserter(out), "\\n"); break;
+      case '\t': fmt::format_to(std::back_inserter(out), "\\t"); break;
+      default:
+        if ((u8) c < 0x20) {
+          fmt::format_to(std::back_inserter(out), "\\u{:04x}", (u32) c);
+        } else {
+          out.push_back(c);
+        }
+    }
+  }
+  out.push_back('"');
+}
+
+Logger::Logger() :
+    m_slots(ring_capacity) {
+  for (u32 i = 0; i < ring_capacity; i += 1) {
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  m_running.store(true, std::memory_order_release);
+  m_writer = std::thread{ [this]() { writer_loop(); } };
+}
+
+bool Logger::try_push(record_t const &record) {
+  u64     position = m_enqueue.load(std::memory_order_relaxed);
+  slot_t* slot     = nullptr;
+  while (true) {
+    slot         = &m_slots[position & (ring_capacity - 1)];
+    u64 sequence = slot->sequence.load(std::memory_order_acquire);
+    i64 diff     = (i64) sequence - (i64) position;
+    if (diff == 0) {
+      if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // writer did not free this slot yet, ring is full. errors are written by caller instead, they are not dropped
+      if (record.level != level_t::error) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+      return false;
+    } else {
+      position = m_enqueue.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->record = record;
+  slot->sequence.store(position + 1, std::memory_order_release);
+
+  m_signal.fetch_add(1, std::memory_order_release);
+  m_signal.notify_one();
+  return true;
+}
+
+bool Logger::try_pop(record_t &record) {
+  u64     position = m_written.load(std::memory_order_relaxed);
+  slot_t &slot     = m_slots[position & (ring_capacity - 1)];
+  if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+    return false;
+  }
+
+  record = slot.record;
+  slot.sequence.store(position + ring_capacity, std::memory_order_release);
+  m_written.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+void Logger::flush() {
+  if (not is_running() or std::this_thread::get_id() == m_writer.get_id()) {
+    return;
+  }
+
+  u64 target = m_enqueue.load(std::memory_order_acquire);
+  m_signal.fetch_add(1, std::memory_order_release);
+  m_signal.notify_one();
+  while (m_written.load(std::memory_order_acquire) < target) {
+    std::this_thread::yield();
+  }
+}
+
+void Logger::stop() {
+  if (not is_running()) {
+    return;
+  }
+
+  // repeats suppressed after the last passed message of their call site would be lost otherwise
+  for (rate_limit_t* site = suppressing_sites.load(std::memory_order_acquire); site != nullptr; site = site->next) {
+    if (u32 repeats = site->suppressed.exchange(0, std::memory_order_relaxed); repeats > 0) {
+      report_repeats(site->level, site->format, repeats);
+    }
+  }
+
+  m_stop.store(true, std::memory_order_release);
+  m_signal.fetch_add(1, std::memory_order_release);
+  m_signal.notify_one();
+  m_writer.join();
+  m_running.store(false, std::memory_order_release);
+
+  std::lock_guard lock{ m_write_mutex };
+  if (m_sink != nullptr) {
+    std::fclose(m_sink);
+    m_sink = nullptr;
+  }
+}
+
+bool Logger::open_sink(std::string_view path, sink_format_t format) {
+  std::FILE* file = std::fopen(std::string(path).c_str(), format == sink_format_t::binary ? "wb" : "w");
+  if (file == nullptr) {
+    return false;
+  }
+
+  if (format == sink_format_t::binary) {
+    std::fwrite("WLOG", 1, 4, file);
+    std::fwrite(&binary_version, sizeof(binary_version), 1, file);
+  }
+
+  std::lock_guard lock{ m_write_mutex };
+  if (m_sink != nullptr) {
+    std::fclose(m_sink);
+  }
+  m_sink        = file;
+  m_sink_format = format;
+  return true;
+}
+
+void Logger::write_now(record_t const &record) {
+  std::lock_guard lock{ m_write_mutex };
+  write(record);
+  std::fflush(stdout);
+  std::fflush(stderr);
+}
+
+void Logger::writer_loop() {
+  record_t record{};
+  while (true) {
+    // signal is read before ring is checked, so push made after the check wakes wait() up
+    u32 signal = m_signal.load(std::memory_order_acquire);
+
+    bool wrote = false;
+    {
+      std::lock_guard lock{ m_write_mutex };
+      while (try_pop(record)) {
+        write(record);
+        wrote = true;
+      }
+
+      u64 dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+      if (dropped > 0) {
+        record_t report{};
+        report.time_ns = now_ns();
+        report.level   = level_t::warn;
+        report.thread  = thread_index();
+        auto result    = fmt::format_to_n(report.text.data(), report.text.size(), "log ring was full, {} messages are dropped", dropped);
+        report.size    = (u16) std::min<usize>(result.size, report.text.size());
+        write(report);
+        wrote = true;
+      }
+
+      if (wrote) {
+        std::fflush(stdout);
+        std::fflush(stderr);
+        if (m_sink != nullptr) {
+          std::fflush(m_sink);
+        }
+      }
+    }
+
+    if (wrote) {
+      continue;
+    }
+    if (m_stop.load(std::memory_order_acquire)) {
+      return;
+    }
+    m_signal.wait(signal, std::memory_order_acquire);
+  }
+}
+
+void Logger::write(record_t const &record) {
+  std::string_view message{ record.text.data(), record.size };
+
+  std::FILE* console = record.level == level_t::error ? stderr : stdout;
+  if (record.suppressed > 0) {
+    fmt::println(console, "{}{} (+{} identical messages suppressed)", level_prefix(record.level), message, record.suppressed);
+  } else {
+    fmt::println(console, "{}{}", level_prefix(record.level), message);
+  }
+
+  if (m_sink == nullptr) {
+    return;
+  }
+
+  if (m_sink_format == sink_format_t::binary) {
+    u8 level = (u8) record.level;
+    std::fwrite(&record.time_ns, sizeof(record.time_ns), 1, m_sink);
+    std::fwrite(&level, sizeof(level), 1, m_sink);
+    std::fwrite(&record.thread, sizeof(record.thread), 1, m_sink);
+    std::fwrite(&record.suppressed, sizeof(record.suppressed), 1, m_sink);
+    std::fwrite(&record.size, sizeof(record.size), 1, m_sink);
+    std::fwrite(record.text.data(), 1, record.size, m_sink);
+    return;
+  }
+
+  fmt::memory_buffer line{};
+  fmt::format_to(
+      std::back_inserter(line), "{{\"time_ns\":{},\"level\":\"{}\",\"thread\":{},\"suppressed\":{},\"message\":", //
+      record.time_ns, level_name(record.level), record.thread, record.suppressed
+  );
+  append_json_string(line, message);
+  line.push_back('}');
+  line.push_back('\n');
+  std::fwrite(line.data(), 1, line.size(), m_sink);
+}
+
+} // namespace
+
+void submit_limited(rate_limit_t &limit, level_t level, std::string_view format, std::string_view message) {
+  // every error may be a different failure, none of them is dropped
+  if (level == level_t::error) {
+    submit(level, 0, message);
+    return;
+  }
+
+  u64 now   = now_ns();
+  u64 start = limit.window_start_ns.load(std::memory_order_relaxed);
+  if (now - start >= window_ns and limit.window_start_ns.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+    limit.count.store(0, std::memory_order_relaxed);
+  }
+
+  // different text always passes and restarts counting, repeats of previous one are reported before it
+  u64 hash = fnv1a(message);
+  if (limit.last_hash.exchange(hash, std::memory_order_relaxed) != hash) {
+    if (u32 repeats = limit.suppressed.exchange(0, std::memory_order_relaxed); repeats > 0) {
+      report_repeats(level, format, repeats);
+    }
+    limit.count.store(1, std::memory_order_relaxed);
+    submit(level, 0, message);
+    return;
+  }
+
+  if (limit.count.fetch_add(1, std::memory_order_relaxed) >= max_per_window) {
+    limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+    register_site(limit, level, format);
+    return;
+  }
+  submit(level, limit.suppressed.exchange(0, std::memory_order_relaxed), message);
+}
+
+void submit(level_t level, u32 suppressed, std::string_view message) {
+  record_t record{};
+  record.time_ns    = now_ns();
+  record.level      = level;
+  record.thread     = thread_index();
+  record.suppressed = suppressed;
+  record.size       = (u16) std::min(message.size(), record.text.size());
+  std::memcpy(record.text.data(), message.data(), record.size);
+
+  Logger &instance = logger();
+  if (instance.is_running()) {
+    // error logged right before throw or abort must not vanish in a flood of other messages
+    if (not instance.try_push(record) and level == level_t::error) {
+      instance.write_now(record);
+    }
+  } else {
+    instance.write_now(record);
+  }
+}
+
+bool open_sink(std::string_view path, sink_format_t format) { return logger().open_sink(path, format); }
+
+void flush() { logger().flush(); }
+
+} // namespace whim::log
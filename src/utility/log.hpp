@@ -1,17 +1,128 @@
+#pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdlib>
+#include <string_view>
 #include "fmt/format.h"
 
-namespace whim {
+#include "utility/types.hpp"
 
-#define WERROR(message, ...) fmt::println(stderr, "[ERROR] " message, __VA_ARGS__) // NOLINT
-#define WINFO(message, ...)  fmt::println("[INFO]  " message, __VA_ARGS__)         // NOLINT
+/*
+  Asynchronous logging
+
+  message is formatted on calling thread into a fixed size record (longer ones are truncated) and pushed into
+  lock free ring, a background thread writes records to console and optional file sink.
+  logging of debug, info and warn never blocks: when ring is full record is dropped and drop count is reported later.
+  errors are never dropped, with full ring they are written right on calling thread (ahead of queued records).
+  repeats of the same text from one call site pass at most max_per_window times per second, the rest are counted and
+  reported with the next passed one (or before next different message, or at shutdown). errors are never limited.
+
+  levels below WHIM_LOG_LEVEL are compiled out together with their arguments:
+  0 - debug, 1 - info (default), 2 - warn, 3 - error
+*/
+
+#ifndef WHIM_LOG_LEVEL
+#define WHIM_LOG_LEVEL 1
+#endif
+
+namespace whim::log {
+
+enum class level_t : u8 {
+  debug,
+  info,
+  warn,
+  error,
+};
+
+/*
+  json - one json object per line
+  binary - "WLOG" and u32 version, then records: u64 time ns, u8 level, u32 thread, u32 suppressed, u16 size, message
+*/
+enum class sink_format_t : u8 {
+  json,
+  binary,
+};
+
+constexpr usize max_message_size = 480;
+constexpr u32   max_per_window   = 8;
+constexpr u64   window_ns        = 1'000'000'000;
+
+/*
+  per call site state, lock free. only repeats of the last passed text are counted against the window
+*/
+struct rate_limit_t {
+  std::atomic<u64> window_start_ns = 0;
+  std::atomic<u32> count           = 0;
+  std::atomic<u64> last_hash       = 0;
+  std::atomic<u32> suppressed      = 0;
+  // call sites which ever suppressed a message form a list, their leftover counts are reported at shutdown
+  std::atomic<bool> registered = false;
+  rate_limit_t*     next       = nullptr;
+  level_t           level      = level_t::info;
+  std::string_view  format     = {};
+};
+
+void submit(level_t level, u32 suppressed, std::string_view message);
+// applies call site limit to formatted message
+void submit_limited(rate_limit_t &limit, level_t level, std::string_view format, std::string_view message);
+
+template<typename... Args>
+void push(rate_limit_t &limit, level_t level, fmt::format_string<Args...> format, Args &&...args) {
+  std::array<char, max_message_size> text{};
+  auto result = fmt::format_to_n(text.data(), text.size(), format, std::forward<Args>(args)...);
+  fmt::string_view format_text = format;
+  submit_limited(limit, level, { format_text.data(), format_text.size() }, std::string_view{ text.data(), std::min<usize>(result.size, text.size()) });
+}
+
+// file sink next to console, returns false if file could not be opened
+bool open_sink(std::string_view path, sink_format_t format);
+// blocks until everything pushed before the call is written
+void flush();
+
+} // namespace whim::log
+
+#define WHIM_LOG(level, message, ...)                                                  \
+  do {                                                                                 \
+    static ::whim::log::rate_limit_t whim_log_rate_limit{};                            \
+    ::whim::log::push(whim_log_rate_limit, level, message __VA_OPT__(, ) __VA_ARGS__); \
+  } while (false)
+
+#define WHIM_LOG_DISABLED() \
+  do {                      \
+  } while (false)
+
+#if WHIM_LOG_LEVEL <= 0
+#define WDEBUG(message, ...) WHIM_LOG(::whim::log::level_t::debug, message __VA_OPT__(, ) __VA_ARGS__) // NOLINT
+#else
+#define WDEBUG(message, ...) WHIM_LOG_DISABLED()
+#endif
+
+#if WHIM_LOG_LEVEL <= 1
+#define WINFO(message, ...) WHIM_LOG(::whim::log::level_t::info, message __VA_OPT__(, ) __VA_ARGS__) // NOLINT
+#else
+#define WINFO(message, ...) WHIM_LOG_DISABLED()
+#endif
+
+#if WHIM_LOG_LEVEL <= 2
+#define WWARN(message, ...) WHIM_LOG(::whim::log::level_t::warn, message __VA_OPT__(, ) __VA_ARGS__) // NOLINT
+#else
+#define WWARN(message, ...) WHIM_LOG_DISABLED()
+#endif
+
+#if WHIM_LOG_LEVEL <= 3
+#define WERROR(message, ...) WHIM_LOG(::whim::log::level_t::error, message __VA_OPT__(, ) __VA_ARGS__) // NOLINT
+#else
+#define WERROR(message, ...) WHIM_LOG_DISABLED()
+#endif
+
+// pending messages are written before assert message, so the cause is not lost
 #define WASSERT(exp, msg)                                                                                                 \
   do {                                                                                                                    \
     if (!(exp)) {                                                                                                         \
+      ::whim::log::flush();                                                                                               \
       fmt::println(stderr, "[ASSERT] {} \n    Expected: {} \n    Source: {}, line: {}", (msg), #exp, __FILE__, __LINE__); \
       std::abort();                                                                                                       \
     }                                                                                                                     \
   } while (false)
-
-} // namespace whim
@@ -0,0 +1,130 @@
+#include "utility/mapped_file.hpp"
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#include "utility/log.hpp"
+
+namespace whim {
+
+namespace {
+
+/*
+  page aligned part of range, empty if range does not cover a whole page
+*/
+bool inner_pages(u8 const* data, usize size, usize page_size, u8 const*&begin, usize &length) {
+  auto first = ((uintptr_t) data + page_size - 1) / page_size * page_size;
+  auto last  = ((uintptr_t) data + size) / page_size * page_size;
+  if (last <= first) {
+    return false;
+  }
+  begin  = (u8 const*) first;
+  length = last - first;
+  return true;
+}
+
+} // namespace
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string_view file_path) {
+  HANDLE file = CreateFileA(std::string(file_path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    WERROR("failed to open file for mapping - {}", file_path);
+    return;
+  }
+  m_file = file;
+
+  LARGE_INTEGER file_size = {};
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    return;
+  }
+
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_mapping) {
+    WERROR("failed to create file mapping - {}", file_path);
+    return;
+  }
+
+  m_data = static_cast<u8 const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  m_size = m_data ? static_cast<usize>(file_size.QuadPart) : 0;
+}
+
+void MappedFile::release(u8 const* data, usize size) const {
+  SYSTEM_INFO info = {};
+  GetSystemInfo(&info);
+
+  u8 const* begin  = nullptr;
+  usize     length = 0;
+  if (inner_pages(data, size, info.dwPageSize, begin, length)) {
+    // unlocking pages which are not locked removes them from working set
+    VirtualUnlock(const_cast<u8*>(begin), length);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+}
+
+#else
+
+MappedFile::MappedFile(std::string_view file_path) {
+  int fd = open(std::string(file_path).c_str(), O_RDONLY);
+  if (fd == -1) {
+    WERROR("failed to open file for mapping - {}", file_path);
+    return;
+  }
+
+  struct stat file_stat = {};
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    void* data = mmap(nullptr, static_cast<usize>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      m_data = static_cast<u8 const*>(data);
+      m_size = static_cast<usize>(file_stat.st_size);
+    } else {
+      WERROR("failed to map file - {}", file_path);
+    }
+  }
+  // mapping keeps its own reference to the file
+  close(fd);
+}
+
+void MappedFile::release(u8 const* data, usize size) const {
+  static usize const page_size = (usize) sysconf(_SC_PAGESIZE);
+
+  u8 const* begin  = nullptr;
+  usize     length = 0;
+  if (inner_pages(data, size, page_size, begin, length)) {
+    // pages are clean, they are dropped without writeback
+    madvise(const_cast<u8*>(begin), length, MADV_DONTNEED);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (m_data) {
+    munmap(const_cast<u8*>(static_cast<u8 const*>(m_data)), m_size);
+  }
+}
+
+#endif
+
+} // namespace whim
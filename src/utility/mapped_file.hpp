@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string_view>
+#include <utility>
+
+#include "utility/types.hpp"
+
+namespace whim {
+
+/*
+  Read only memory mapping of the whole file
+  if file cant be opened mapping stays empty, check with is_open()
+
+  on move: old mapping becomes empty. move assignment is deleted, defaulted one would leak mapping it overwrites
+*/
+class MappedFile {
+
+public:
+  MappedFile() = default;
+  explicit MappedFile(std::string_view file_path);
+  ~MappedFile();
+
+  MappedFile(MappedFile &&) noexcept        = default;
+  MappedFile &operator=(MappedFile &&)      = delete;
+  MappedFile(const MappedFile &)            = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  [[nodiscard]] u8 const* data() const { return m_data; }
+
+  [[nodiscard]] usize size() const { return m_size; }
+
+  [[nodiscard]] bool is_open() const { return m_data; }
+
+  /*
+    drops resident pages lying fully inside [data, data + size) from memory, mapping stays valid:
+    next access reads them from file again
+  */
+  void release(u8 const* data, usize size) const;
+
+private:
+  ptr<u8 const> m_data = nullptr;
+  usize         m_size = 0;
+#ifdef _WIN32
+  ptr<void> m_file    = nullptr;
+  ptr<void> m_mapping = nullptr;
+#endif
+};
+
+} // namespace whim
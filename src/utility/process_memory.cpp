@@ -0,0 +1,81 @@
+#include "utility/process_memory.hpp"
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+  #include <psapi.h>
+#elif defined(__linux__)
+  #include <fstream>
+  #include <string>
+  #include <string_view>
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace whim {
+
+#ifdef _WIN32
+
+namespace {
+
+PROCESS_MEMORY_COUNTERS memory_counters() {
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return {};
+  }
+  return counters;
+}
+
+} // namespace
+
+usize process_rss_bytes() { return memory_counters().WorkingSetSize; }
+
+usize process_peak_rss_bytes() { return memory_counters().PeakWorkingSetSize; }
+
+void reset_process_peak_rss() {}
+
+#elif defined(__linux__)
+
+namespace {
+
+// "VmRSS:   1234 kB" lines of /proc/self/status
+usize read_status_kb(std::string_view key) {
+  std::ifstream status{ "/proc/self/status" };
+  std::string   line{};
+  while (std::getline(status, line)) {
+    if (line.starts_with(key)) {
+      return std::stoull(line.substr(key.size())) * 1024;
+    }
+  }
+  return 0;
+}
+
+} // namespace
+
+usize process_rss_bytes() { return read_status_kb("VmRSS:"); }
+
+usize process_peak_rss_bytes() { return read_status_kb("VmHWM:"); }
+
+void reset_process_peak_rss() {
+  // peak drops to current rss
+  std::ofstream clear_refs{ "/proc/self/clear_refs" };
+  clear_refs << "5";
+}
+
+#else
+
+usize process_rss_bytes() { return 0; }
+
+usize process_peak_rss_bytes() {
+  rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+  // bytes on macos
+  return (usize) usage.ru_maxrss;
+}
+
+void reset_process_peak_rss() {}
+
+#endif
+
+} // namespace whim
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "utility/types.hpp"
+
+namespace whim {
+
+/*
+  Resident memory of the process, zero where the platform does not report it
+
+  peak can be reset only on linux, elsewhere it covers whole lifetime of the process
+*/
+[[nodiscard]] usize process_rss_bytes();
+[[nodiscard]] usize process_peak_rss_bytes();
+void                reset_process_peak_rss();
+
+} // namespace whim
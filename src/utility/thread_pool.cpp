@@ -0,0 +1,176 @@
+#include "utility/thread_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#include "fmt/format.h"
+#include "utility/trace.hpp"
+
+namespace whim {
+
+namespace {
+// pool and worker index owning current thread
+thread_local ThreadPool const* current_pool   = nullptr;
+thread_local i32               current_worker = -1;
+} // namespace
+
+ThreadPool::ThreadPool(u32 thread_count) {
+  m_queues.reserve(thread_count);
+  for (u32 i = 0; i < thread_count; i += 1) {
+    m_queues.push_back(std::make_unique<worker_queue_t>());
+  }
+
+  m_workers.reserve(thread_count);
+  for (u32 i = 0; i < thread_count; i += 1) {
+    m_workers.emplace_back([this, i]() { worker_loop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock{ m_sleep_mutex };
+    m_stop = true;
+  }
+  m_wake.notify_all();
+
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(task_t &&task) {
+  if (m_workers.empty()) {
+    task();
+    return;
+  }
+
+  // workers keep their own tasks local, everything else is spread round robin
+  i32 worker      = worker_index();
+  u32 queue_index = worker >= 0 ? (u32) worker : m_next_queue.fetch_add(1) % (u32) m_queues.size();
+
+  {
+    std::lock_guard lock{ m_sleep_mutex };
+    m_pending += 1;
+  }
+  {
+    std::lock_guard lock{ m_queues[queue_index]->mutex };
+    m_queues[queue_index]->tasks.push_back(std::move(task));
+  }
+  m_wake.notify_one();
+}
+
+void ThreadPool::parallel_for(usize count, std::function<void(usize)> const &body) {
+  if (count == 0) {
+    return;
+  }
+  // serial fallback
+  if (m_workers.empty() || count == 1) {
+    for (usize i = 0; i < count; i += 1) {
+      body(i);
+    }
+    return;
+  }
+
+  // few chunks per thread keep stealing useful without paying for a task per element
+  usize chunk_count = std::min(count, (usize) (thread_count() + 1) * 4);
+  usize chunk_size  = (count + chunk_count - 1) / chunk_count;
+  chunk_count       = (count + chunk_size - 1) / chunk_size;
+
+  std::atomic<usize> remaining = chunk_count;
+  std::exception_ptr error     = nullptr;
+  std::mutex         error_mutex{};
+
+  for (usize chunk = 0; chunk < chunk_count; chunk += 1) {
+    usize begin = chunk * chunk_size;
+    usize end   = std::min(count, begin + chunk_size);
+
+    submit([&, begin, end]() {
+      try {
+        for (usize i = begin; i < end; i += 1) {
+          body(i);
+        }
+      } catch (...) {
+        std::lock_guard lock{ error_mutex };
+        if (not error) error = std::current_exception();
+      }
+      remaining.fetch_sub(1, std::memory_order_release);
+    });
+  }
+
+  while (remaining.load(std::memory_order_acquire) != 0) {
+    if (not run_pending_task()) {
+      std::this_thread::yield();
+    }
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadPool::worker_loop(u32 index) {
+  current_pool   = this;
+  current_worker = (i32) index;
+  WTRACE_THREAD(fmt::format("pool worker #{}", index));
+
+  task_t task{};
+  while (true) {
+    if (try_pop(index, task) || try_steal(index, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock lock{ m_sleep_mutex };
+    m_wake.wait(lock, [this]() { return m_stop || m_pending.load() != 0; });
+    if (m_stop) {
+      return;
+    }
+  }
+}
+
+bool ThreadPool::try_pop(u32 queue_index, task_t &task) {
+  auto           &queue = *m_queues[queue_index];
+  std::lock_guard lock{ queue.mutex };
+  if (queue.tasks.empty()) {
+    return false;
+  }
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  m_pending -= 1;
+  return true;
+}
+
+bool ThreadPool::try_steal(u32 thief_index, task_t &task) {
+  u32 queue_count = (u32) m_queues.size();
+  for (u32 i = 1; i < queue_count; i += 1) {
+    auto           &queue = *m_queues[(thief_index + i) % queue_count];
+    std::lock_guard lock{ queue.mutex };
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    m_pending -= 1;
+    return true;
+  }
+  return false;
+}
+
+i32 ThreadPool::worker_index() const { //
+  return current_pool == this ? current_worker : -1;
+}
+
+bool ThreadPool::run_pending_task() {
+  task_t task{};
+  // outside threads have no own queue, they start stealing from the first one
+  i32 worker = worker_index();
+  u32 start  = worker >= 0 ? (u32) worker : 0;
+  if ((worker >= 0 && try_pop(start, task)) || try_steal(start, task) || (worker < 0 && try_pop(start, task))) {
+    task();
+    return true;
+  }
+  return false;
+}
+
+} // namespace whim
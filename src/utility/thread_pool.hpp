@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utility/types.hpp"
+
+namespace whim {
+
+/*
+  Work stealing thread pool
+
+  every worker owns a deque: it pops own tasks from the back and steals from the front of others,
+  tasks submitted from outside are distributed round robin.
+  pool without workers (thread_count == 0) runs everything on the calling thread
+*/
+class ThreadPool {
+
+public:
+  using task_t = std::function<void()>;
+
+  explicit ThreadPool(u32 thread_count = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool &&)                 = delete;
+  ThreadPool &operator=(ThreadPool &&)      = delete;
+  ThreadPool(const ThreadPool &)            = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(task_t &&task);
+
+  /*
+    calls body(i) for every i in [0, count) and blocks until all calls are finished,
+    calling thread executes tasks too. first exception thrown by body is rethrown here
+  */
+  void parallel_for(usize count, std::function<void(usize)> const &body);
+
+  [[nodiscard]] u32 thread_count() const { return (u32) m_workers.size(); }
+
+private:
+  struct worker_queue_t {
+    std::mutex         mutex{};
+    std::deque<task_t> tasks{};
+  };
+
+  void worker_loop(u32 index);
+  bool try_pop(u32 queue_index, task_t &task);
+  bool try_steal(u32 thief_index, task_t &task);
+  bool run_pending_task();
+  // -1 if current thread is not a worker of this pool
+  i32 worker_index() const;
+
+private:
+  std::vector<uptr<worker_queue_t>> m_queues{};
+  std::vector<std::thread>          m_workers{};
+
+  std::atomic<u32>   m_next_queue = 0;
+  std::atomic<usize> m_pending    = 0;
+
+  std::mutex              m_sleep_mutex{};
+  std::condition_variable m_wake{};
+  bool                    m_stop = false;
+};
+
+} // namespace whim
@@ -0,0 +1,183 @@
+#include "utility/trace.hpp"
+
+#if defined(WHIM_TRACE)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "utility/log.hpp"
+
+namespace whim::trace {
+
+namespace {
+
+constexpr u32 chunk_size    = 4096;
+constexpr u32 max_name_size = 64;
+
+struct event_t {
+  char const* name     = nullptr;
+  u64         begin_ns = 0;
+  u64         end_ns   = 0;
+};
+
+/*
+  written by owner thread only, count and next publish events to the writer of trace file
+*/
+struct chunk_t {
+  std::array<event_t, chunk_size> events = {};
+  std::atomic<u32>                count  = 0;
+  std::atomic<chunk_t*>           next   = nullptr;
+};
+
+struct thread_buffer_t {
+  u32                             id     = 0;
+  std::array<char, max_name_size> name   = {};
+  std::atomic<bool>               named  = false;
+  std::vector<uptr<chunk_t>>      chunks = {}; // owner thread only, others follow chunk_t::next
+  chunk_t*                        first  = nullptr;
+  chunk_t*                        tail   = nullptr;
+};
+
+struct registry_t {
+  std::mutex                         mutex        = {};
+  std::vector<uptr<thread_buffer_t>> buffers      = {};
+  std::string                        exit_path    = {};
+  bool                               exit_handler = false;
+};
+
+auto const process_start = std::chrono::steady_clock::now();
+
+// never destroyed: threads may still record while static objects are destroyed and exit handler reads buffers
+registry_t &registry() {
+  static registry_t* instance = new registry_t{};
+  return *instance;
+}
+
+thread_buffer_t &this_thread_buffer() {
+  thread_local thread_buffer_t* buffer = nullptr;
+  if (buffer != nullptr) {
+    return *buffer;
+  }
+
+  registry_t     &reg = registry();
+  std::lock_guard lock{ reg.mutex };
+
+  auto &created = reg.buffers.emplace_back(std::make_unique<thread_buffer_t>());
+  created->id   = (u32) reg.buffers.size();
+  created->chunks.push_back(std::make_unique<chunk_t>());
+  created->first = created->chunks.back().get();
+  created->tail  = created->first;
+
+  buffer = created.get();
+  return *buffer;
+}
+
+void write_registered_path() {
+  registry_t &reg = registry();
+  if (write(reg.exit_path)) {
+    WINFO("cpu trace is written to {}", reg.exit_path);
+  }
+}
+
+} // namespace
+
+u64 now_ns() { return (u64) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - process_start).count(); }
+
+void record(char const* name, u64 begin_ns, u64 end_ns) {
+  thread_buffer_t &buffer = this_thread_buffer();
+
+  chunk_t* chunk = buffer.tail;
+  u32      count = chunk->count.load(std::memory_order_relaxed);
+  if (count == chunk_size) {
+    buffer.chunks.push_back(std::make_unique<chunk_t>());
+    chunk_t* next = buffer.chunks.back().get();
+    chunk->next.store(next, std::memory_order_release);
+
+    buffer.tail = next;
+    chunk       = next;
+    count       = 0;
+  }
+
+  chunk->events[count] = event_t{ name, begin_ns, end_ns };
+  chunk->count.store(count + 1, std::memory_order_release);
+}
+
+void set_thread_name(std::string_view name) {
+  thread_buffer_t &buffer = this_thread_buffer();
+  if (buffer.named.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  usize size = std::min<usize>(name.size(), max_name_size - 1);
+  std::copy_n(name.data(), size, buffer.name.data());
+  buffer.name[size] = '\0';
+  buffer.named.store(true, std::memory_order_release);
+}
+
+bool write(std::string_view path) {
+  std::ofstream out{ std::string(path), std::ios::trunc };
+  if (!out) {
+    WERROR("failed to open {} for writing", path);
+    return false;
+  }
+
+  registry_t     &reg = registry();
+  std::lock_guard lock{ reg.mutex };
+
+  // names are function names and literals, they need no escaping. times are in microseconds
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first_event = true;
+  auto separator   = [&]() {
+    char const* result = first_event ? "" : ",\n";
+    first_event        = false;
+    return result;
+  };
+
+  for (auto const &buffer : reg.buffers) {
+    if (buffer->named.load(std::memory_order_acquire)) {
+      out << fmt::format(
+          "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}", //
+          separator(), buffer->id, buffer->name.data()
+      );
+    }
+
+    for (chunk_t const* chunk = buffer->first; chunk != nullptr; chunk = chunk->next.load(std::memory_order_acquire)) {
+      u32 count = chunk->count.load(std::memory_order_acquire);
+      for (u32 i = 0; i < count; i += 1) {
+        event_t const &event = chunk->events[i];
+        out << fmt::format(
+            "{}{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}", //
+            separator(), event.name, buffer->id, (f64) event.begin_ns / 1e3, (f64) (event.end_ns - event.begin_ns) / 1e3
+        );
+      }
+    }
+  }
+  out << "\n]}\n";
+
+  if (!out) {
+    WERROR("failed to write cpu trace {}", path);
+    return false;
+  }
+  return true;
+}
+
+void write_at_exit(std::string path) {
+  registry_t     &reg = registry();
+  std::lock_guard lock{ reg.mutex };
+
+  reg.exit_path = std::move(path);
+  if (not reg.exit_handler) {
+    std::atexit(write_registered_path);
+    reg.exit_handler = true;
+  }
+}
+
+} // namespace whim::trace
+
+#endif
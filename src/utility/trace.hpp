@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "utility/types.hpp"
+
+/*
+  Scoped cpu zones written as chrome trace json (ui.perfetto.dev, chrome://tracing)
+
+  WTRACE_ZONE("name") measures enclosing scope, WTRACE_FUNCTION() names zone after current function.
+  name is stored by pointer, it has to be a string literal or live until trace is written.
+  every thread appends zones to its own chunked buffer without locks, buffer is registered on first zone of a thread,
+  so threads created at any point are traced. buffers are never freed, zones of finished threads stay in trace.
+
+  everything is compiled out unless WHIM_TRACE is defined (cmake option WHIM_ENABLE_TRACE),
+  zone macros expand to nothing and write_at_exit() does nothing then
+*/
+
+#if defined(WHIM_TRACE)
+
+namespace whim::trace {
+
+// since process start
+u64 now_ns();
+
+void record(char const* name, u64 begin_ns, u64 end_ns);
+// shown instead of thread id, copied
+void set_thread_name(std::string_view name);
+
+// safe while other threads still record, their newest zones may be missing. returns false if file could not be written
+bool write(std::string_view path);
+void write_at_exit(std::string path);
+
+class zone_t {
+
+public:
+  explicit zone_t(char const* name) :
+      m_name(name),
+      m_begin_ns(now_ns()) {}
+
+  ~zone_t() { record(m_name, m_begin_ns, now_ns()); }
+
+  zone_t(zone_t &&)                 = delete;
+  zone_t &operator=(zone_t &&)      = delete;
+  zone_t(const zone_t &)            = delete;
+  zone_t &operator=(const zone_t &) = delete;
+
+private:
+  char const* m_name     = nullptr;
+  u64         m_begin_ns = 0;
+};
+
+} // namespace whim::trace
+
+#define WTRACE_CONCAT_IMPL(a, b) a##b
+#define WTRACE_CONCAT(a, b)      WTRACE_CONCAT_IMPL(a, b)
+#define WTRACE_ZONE(name)        ::whim::trace::zone_t WTRACE_CONCAT(whim_trace_zone_, __LINE__){ name } // NOLINT
+#define WTRACE_FUNCTION()        WTRACE_ZONE(__func__)                                                 // NOLINT
+#define WTRACE_THREAD(name)      ::whim::trace::set_thread_name(name)                                   // NOLINT
+
+#else
+
+namespace whim::trace {
+inline void write_at_exit(std::string const &) {}
+} // namespace whim::trace
+
+#define WTRACE_ZONE(name)
+#define WTRACE_FUNCTION()
+#define WTRACE_THREAD(name)
+
+#endif
@@ -0,0 +1,167 @@
+#include "vertex_layout.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "glm/packing.hpp"
+
+#include "scene.hpp"
+#include "utility/log.hpp"
+#include "utility/thread_pool.hpp"
+#include "utility/trace.hpp"
+
+namespace whim {
+
+static_assert((u32) vertex_layout_t::separate == VertexLayoutSeparate);
+static_assert((u32) vertex_layout_t::interleaved == VertexLayoutInterleaved);
+static_assert((u32) vertex_layout_t::compressed == VertexLayoutCompressed);
+static_assert((u32) vertex_layout_t::quantized == VertexLayoutQuantized);
+
+// shaders read these arrays with scalar layout
+static_assert(sizeof(vertex) == 32);
+static_assert(sizeof(compressed_vertex) == 20);
+static_assert(sizeof(quantized_vertex) == 16);
+
+namespace {
+
+f32 sign_not_zero(f32 value) { return value >= 0.f ? 1.f : -1.f; }
+
+/*
+  unit vector onto octahedron unfolded into [-1, 1] square, decoded by octahedral_decode of ray_common.glsl
+*/
+u32 encode_normal(glm::vec3 normal) {
+  f32 sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (sum == 0.f) {
+    return glm::packSnorm2x16(glm::vec2{ 0.f });
+  }
+
+  glm::vec2 folded{ normal.x / sum, normal.y / sum };
+  if (normal.z < 0.f) {
+    folded = glm::vec2{ (1.f - std::abs(folded.y)) * sign_not_zero(folded.x), (1.f - std::abs(folded.x)) * sign_not_zero(folded.y) };
+  }
+  return glm::packSnorm2x16(folded);
+}
+
+u32 encode_uv(glm::vec2 uv) { return glm::packHalf2x16(uv); }
+
+template<typename T>
+void write_vertex(packed_vertices_t &packed, u32 index, T const &value) {
+  std::memcpy(packed.bytes.data() + (usize) index * sizeof(T), &value, sizeof(T));
+}
+
+void pack_primitive(scene_data_t const &scene, primitive_full_info const &info, u32 primitive, packed_vertices_t &packed) {
+  u32 first = info.vertex_offset;
+  u32 last  = info.vertex_offset + info.vertex_count;
+
+  switch (packed.layout) {
+    case vertex_layout_t::separate: break;
+
+    case vertex_layout_t::interleaved:
+      for (u32 i = first; i < last; i += 1) {
+        write_vertex(packed, i, vertex{ .pos = scene.positions[i], .normal = scene.normals[i], .texture = scene.uvs[i] });
+      }
+      break;
+
+    case vertex_layout_t::compressed:
+      for (u32 i = first; i < last; i += 1) {
+        write_vertex(packed, i, compressed_vertex{ .pos = scene.positions[i], .normal = encode_normal(scene.normals[i]), .uv = encode_uv(scene.uvs[i]) });
+      }
+      break;
+
+    case vertex_layout_t::quantized: {
+      glm::vec3 min{ std::numeric_limits<f32>::max() };
+      glm::vec3 max{ -std::numeric_limits<f32>::max() };
+      for (u32 i = first; i < last; i += 1) {
+        min = glm::min(min, scene.positions[i]);
+        max = glm::max(max, scene.positions[i]);
+      }
+
+      // primitive bounds map onto [-1, 1] cube, flat axes keep unit scale
+      glm::vec3 offset = (min + max) * 0.5f;
+      glm::vec3 scale  = (max - min) * 0.5f;
+      for (u32 axis = 0; axis < 3; axis += 1) {
+        if (not(scale[(int) axis] > 0.f)) {
+          scale[(int) axis] = 1.f;
+        }
+      }
+      packed.dequantize_scales[primitive]  = scale;
+      packed.dequantize_offsets[primitive] = offset;
+
+      for (u32 i = first; i < last; i += 1) {
+        glm::vec3 position = glm::clamp((scene.positions[i] - offset) / scale, -1.f, 1.f);
+        write_vertex(
+            packed, i,
+            quantized_vertex{
+                .pos_xy = glm::packSnorm2x16(glm::vec2{ position.x, position.y }),
+                .pos_zw = glm::packSnorm2x16(glm::vec2{ position.z, 0.f }),
+                .normal = encode_normal(scene.normals[i]),
+                .uv     = encode_uv(scene.uvs[i]),
+            }
+        );
+      }
+      break;
+    }
+  }
+}
+
+} // namespace
+
+std::string_view to_string(vertex_layout_t layout) {
+  switch (layout) {
+    case vertex_layout_t::separate:    return "separate";
+    case vertex_layout_t::interleaved: return "interleaved";
+    case vertex_layout_t::compressed:  return "compressed";
+    case vertex_layout_t::quantized:   return "quantized";
+  }
+  return "unknown";
+}
+
+std::optional<vertex_layout_t> parse_vertex_layout(std::string_view name) {
+  for (vertex_layout_t layout : vertex_layouts) {
+    if (to_string(layout) == name) {
+      return layout;
+    }
+  }
+  return std::nullopt;
+}
+
+packed_vertices_t pack_vertices(scene_data_t const &scene, vertex_layout_t layout, ThreadPool &pool) {
+  WTRACE_FUNCTION();
+  WASSERT(layout != vertex_layout_t::separate, "separate layout is uploaded without packing");
+
+  packed_vertices_t packed = {};
+  packed.layout            = layout;
+  switch (layout) {
+    case vertex_layout_t::separate:    break;
+    case vertex_layout_t::interleaved: packed.stride = sizeof(vertex); break;
+    case vertex_layout_t::compressed:  packed.stride = sizeof(compressed_vertex); break;
+    case vertex_layout_t::quantized:   packed.stride = sizeof(quantized_vertex); break;
+  }
+
+  usize primitive_count = scene.primitive_infos.size();
+  packed.bytes.resize(scene.positions.size() * packed.stride);
+  if (layout == vertex_layout_t::quantized) {
+    packed.dequantize_scales.resize(primitive_count, glm::vec3{ 1.f });
+    packed.dequantize_offsets.resize(primitive_count, glm::vec3{ 0.f });
+  }
+
+  // every owner packs its own vertex range, primitives sharing it take owner dequantization afterwards
+  pool.parallel_for(primitive_count, [&](usize i) {
+    if (scene.primitive_infos[i].geometry_owner < 0) {
+      pack_primitive(scene, scene.primitive_infos[i], (u32) i, packed);
+    }
+  });
+  if (layout == vertex_layout_t::quantized) {
+    for (usize i = 0; i < primitive_count; i += 1) {
+      if (i32 owner = scene.primitive_infos[i].geometry_owner; owner >= 0) {
+        packed.dequantize_scales[i]  = packed.dequantize_scales[owner];
+        packed.dequantize_offsets[i] = packed.dequantize_offsets[owner];
+      }
+    }
+  }
+  return packed;
+}
+
+} // namespace whim
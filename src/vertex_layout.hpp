@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "utility/types.hpp"
+
+namespace whim {
+
+struct scene_data_t;
+class ThreadPool;
+
+/*
+  Vertex attribute layout on gpu
+
+  chosen at load time, hit shader reads it from scene_description (VertexLayout* constants of shader.h)
+  separate    - position, normal and uv in three arrays, 32 bytes per vertex in three fetches
+  interleaved - one array of vertex structs, 32 bytes in one fetch
+  compressed  - float position, octahedral snorm16 normal and half float uv, 20 bytes
+  quantized   - compressed with snorm16 position, dequantized by per primitive scale and offset, 16 bytes.
+                blas is built from quantized positions too, so float positions are not uploaded at all
+*/
+enum class vertex_layout_t : u32 {
+  separate    = 0,
+  interleaved = 1,
+  compressed  = 2,
+  quantized   = 3,
+};
+
+constexpr std::array<vertex_layout_t, 4> vertex_layouts = {
+  vertex_layout_t::separate, vertex_layout_t::interleaved, vertex_layout_t::compressed, vertex_layout_t::quantized //
+};
+
+[[nodiscard]] std::string_view               to_string(vertex_layout_t layout);
+[[nodiscard]] std::optional<vertex_layout_t> parse_vertex_layout(std::string_view name);
+
+/*
+  vertex array of interleaved, compressed or quantized layout, primitives keep their vertex offsets
+*/
+struct packed_vertices_t {
+  vertex_layout_t layout = vertex_layout_t::interleaved;
+  u32             stride = 0;
+  std::vector<u8> bytes{};
+  // quantized layout only, per primitive: object space position = snorm position * scale + offset
+  std::vector<glm::vec3> dequantize_scales{};
+  std::vector<glm::vec3> dequantize_offsets{};
+};
+
+// separate layout needs no packing, scene arrays are uploaded as they are
+packed_vertices_t pack_vertices(scene_data_t const &scene, vertex_layout_t layout, ThreadPool &pool);
+
+} // namespace whim
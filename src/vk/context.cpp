@@ -13,29 +13,45 @@
 #include "whim.hpp"
 #include "vk/result.hpp"
 #include "vk/loader.hpp"
+#include "vk/upload_batch.hpp"
 
 namespace whim::vk {
 
 Context::Context(config_t const &config, Window const &window) :
-    m_window_ref(window) {
-  WINFO("starting Context initialization");
+    Context(config, &window) {}
+
+Context::Context(config_t const &config) :
+    Context(config, nullptr) {}
+
+Context::Context(config_t const &config, Window const* window) :
+    m_window(window) {
+  WINFO("starting Context initialization{}", window == nullptr ? " (headless)" : "");
 
   vkb::InstanceBuilder instance_builder;
 
-  auto required_extensions = window.get_vulkan_required_extensions();
+  instance_builder //
+      .require_api_version(VK_API_VERSION_1_3)
+      .set_app_version(0, 1, 0)
+      .set_app_name(config.app_name.c_str())
+      .set_engine_name("WHIM ENGINE")
+      .enable_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)
+      .use_default_debug_messenger();
+
+  if (window != nullptr) {
+    auto required_extensions = window->get_vulkan_required_extensions();
+    instance_builder //
+        .enable_validation_layers(config.options.validation_layers_support)
+        .enable_extensions(required_extensions)
+        .enable_layer("VK_LAYER_LUNARG_monitor");
+  } else {
+    // render nodes may have no validation layers installed
+    instance_builder //
+        .request_validation_layers(config.options.validation_layers_support)
+        .set_headless(true);
+  }
 
   // TODO: add custom debug messenger
-  auto inst_result = instance_builder //
-                         .require_api_version(VK_API_VERSION_1_3)
-                         .set_app_version(0, 1, 0)
-                         .set_app_name(config.app_name.c_str())
-                         .set_engine_name("WHIM ENGINE")
-                         .enable_validation_layers(config.options.validation_layers_support)
-                         .enable_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)
-                         .enable_extensions(required_extensions)
-                         .use_default_debug_messenger()
-                         .enable_layer("VK_LAYER_LUNARG_monitor")
-                         .build();
+  auto inst_result = instance_builder.build();
 
   if (!inst_result.has_value()) {
     WERROR("Failed to get VulkanInstance, message: {}", inst_result.error().message());
@@ -46,14 +62,16 @@ Context::Context(config_t const &config, Window const &window) :
   m_debug_messenger = inst_result->debug_messenger;
   WINFO("created Vulkan Instance {}", (void*) m_instance);
 
-  m_surface = window.create_surface(inst_result->instance);
-
   vkb::PhysicalDeviceSelector selector{ inst_result.value() };
 
-  selector = selector //
-                 .set_surface(m_surface)
-                 .add_required_extension(VK_KHR_SWAPCHAIN_EXTENSION_NAME)
-                 .set_minimum_version(1, 3);
+  selector = selector.set_minimum_version(1, 3);
+
+  if (window != nullptr) {
+    m_surface = window->create_surface(inst_result->instance);
+    selector  = selector //
+                   .set_surface(m_surface)
+                   .add_required_extension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
 
   VkPhysicalDeviceVulkan13Features features13 = {};
   features13.sType                            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
@@ -64,6 +82,8 @@ Context::Context(config_t const &config, Window const &window) :
   features12.bufferDeviceAddress                       = true;
   features12.runtimeDescriptorArray                    = true;
   features12.shaderSampledImageArrayNonUniformIndexing = true;
+  features12.timelineSemaphore                         = true;
+  features12.hostQueryReset                            = true;
 
   VkPhysicalDeviceFeatures features = {};
   features.shaderInt64              = true;
@@ -123,9 +143,27 @@ Context::Context(config_t const &config, Window const &window) :
   m_device.compute_family_index = compute.value();
   m_device.compute_queue        = device_result->get_queue(vkb::QueueType::compute).value();
 
-  auto present                  = device_result->get_queue_index(vkb::QueueType::present);
-  m_device.present_family_index = present.value();
-  m_device.present_queue        = device_result->get_queue(vkb::QueueType::present).value();
+  // family with transfer but without graphics and compute is served by copy engine, uploads there run alongside rendering
+  auto transfer = device_result->get_dedicated_queue_index(vkb::QueueType::transfer);
+  if (transfer.has_value()) {
+    m_device.transfer_family_index = transfer.value();
+    m_device.transfer_queue        = device_result->get_dedicated_queue(vkb::QueueType::transfer).value();
+    WINFO("using dedicated transfer queue family {}", m_device.transfer_family_index);
+  } else {
+    m_device.transfer_family_index = m_device.graphics_family_index;
+    m_device.transfer_queue        = m_device.graphics_queue;
+    WINFO("no dedicated transfer queue, uploads go through graphics queue");
+  }
+
+  if (window != nullptr) {
+    auto present                  = device_result->get_queue_index(vkb::QueueType::present);
+    m_device.present_family_index = present.value();
+    m_device.present_queue        = device_result->get_queue(vkb::QueueType::present).value();
+  } else {
+    // nothing is presented, but keep getters valid
+    m_device.present_family_index = m_device.graphics_family_index;
+    m_device.present_queue        = m_device.graphics_queue;
+  }
 
   VmaAllocatorCreateInfo alloc_create_info = {};
   alloc_create_info.vulkanApiVersion       = VK_API_VERSION_1_2;
@@ -155,7 +193,21 @@ Context::Context(config_t const &config, Window const &window) :
   );
   WINFO("created main command pool");
 
-  vkb::SwapchainBuilder swapchain_builder{ device_result.value() };
+  set_debug_name(m_command_pool, "main command_pool");
+
+  if (window != nullptr) {
+    create_swapchain(device_result.value(), *window);
+  } else {
+    // headless: storage image and readbacks use render resolution from config
+    m_swapchain.extent = VkExtent2D{ config.width, config.height };
+  }
+
+  m_submitter     = std::make_unique<Submitter>(*this);
+  m_staging_arena = std::make_unique<StagingArena>(*this);
+}
+
+void Context::create_swapchain(vkb::Device const &device, Window const &window) {
+  vkb::SwapchainBuilder swapchain_builder{ device };
 
   auto window_size = window.window_size();
 
@@ -236,51 +288,12 @@ Context::Context(config_t const &config, Window const &window) :
     m_frames.push_back(frame);
   }
 
-  set_debug_name(m_command_pool, "main command_pool");
   for (u32 i = 0; i < m_swapchain.image_count; i += 1) {
     set_debug_name(m_frames[i].image, fmt::format("swapchain_image #{}", i + 1));
     set_debug_name(m_frames[i].image_view, fmt::format("swapchain_image_view #{}", i + 1));
     set_debug_name(m_frames[i].depth.image, fmt::format("swapchain_depth_image #{}", i + 1));
     set_debug_name(m_frames[i].depth.image_view, fmt::format("swapchain_depth_image_view #{}", i + 1));
   }
-
-  VkCommandPoolCreateInfo imm_cmd_pool_info = {};
-  imm_cmd_pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  imm_cmd_pool_info.pNext                   = nullptr;
-  imm_cmd_pool_info.queueFamilyIndex        = m_device.graphics_family_index;
-  imm_cmd_pool_info.flags                   = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-  check(
-      vkCreateCommandPool(m_device.logical, &imm_cmd_pool_info, nullptr, &m_immediate_data.cmd_pool), //
-      "creating command pool for immediate submission"
-  );
-  set_debug_name(m_immediate_data.cmd_pool, "immediate command pool");
-
-  VkCommandBufferAllocateInfo cmd_buffers_create_info = {};
-  cmd_buffers_create_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cmd_buffers_create_info.commandPool                 = m_immediate_data.cmd_pool;
-  cmd_buffers_create_info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  cmd_buffers_create_info.commandBufferCount          = 1;
-
-  check(
-      vkAllocateCommandBuffers(
-          m_device.logical, &cmd_buffers_create_info,
-          &m_immediate_data.cmd_buffer
-      ), //
-      "allocating command buffer for immediate command pool"
-  );
-  set_debug_name(m_immediate_data.cmd_buffer, "immediate command buffer");
-
-  VkFenceCreateInfo fence_create_info = {};
-  fence_create_info.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fence_create_info.pNext             = nullptr;
-  fence_create_info.flags             = VK_FENCE_CREATE_SIGNALED_BIT;
-
-  check(
-      vkCreateFence(m_device.logical, &fence_create_info, nullptr, &m_immediate_data.fence), //
-      "creating fence for immediate cmd buffers"
-  );
-  set_debug_name(m_immediate_data.fence, "immediate fence");
 }
 
 Context::~Context() {
@@ -290,7 +303,7 @@ Context::~Context() {
     /*
       ORDER OF DESTRUCTION:
         1. waiting until device is done touching our images
-        2. destroying immediate data
+        2. destroying staging arena and submitter
         3. destroying of swapchain's image_views
         4. destroying of swapchain
         5. destroying of command_pool
@@ -301,9 +314,8 @@ Context::~Context() {
 
     vkDeviceWaitIdle(m_device.logical);
 
-    vkDestroyFence(m_device.logical, m_immediate_data.fence, nullptr);
-    vkFreeCommandBuffers(m_device.logical, m_immediate_data.cmd_pool, 1, &m_immediate_data.cmd_buffer);
-    vkDestroyCommandPool(m_device.logical, m_immediate_data.cmd_pool, nullptr);
+    m_staging_arena.reset();
+    m_submitter.reset();
 
     for (auto const &frame : m_frames) {
       vkDestroyImageView(m_device.logical, frame.image_view, nullptr);
@@ -311,12 +323,16 @@ Context::~Context() {
       vmaDestroyImage(m_vma, frame.depth.image, frame.depth.allocation);
     }
 
-    vkDestroySwapchainKHR(m_device.logical, m_swapchain.handle, nullptr);
+    if (m_swapchain.handle) {
+      vkDestroySwapchainKHR(m_device.logical, m_swapchain.handle, nullptr);
+    }
     vkDestroyCommandPool(m_device.logical, m_command_pool, nullptr);
     vmaDestroyAllocator(m_vma);
 
     vkDestroyDevice(m_device.logical, nullptr);
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    if (m_surface) {
+      vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    }
 
     if (m_debug_messenger != nullptr) {
       vkDestroyDebugUtilsMessengerEXT(m_instance, m_debug_messenger, nullptr);
@@ -334,65 +350,13 @@ Context::~Context() {
   }
 }
 
-// FIXME: && - explain yourself
 void Context::immediate_submit(std::function<void(VkCommandBuffer cmd)> &&function) const {
-  // FIXME: wtf am i doing here?
-  check(vkResetFences(m_device.logical, 1, &m_immediate_data.fence), "reseting immediate fence");
-  check(vkResetCommandBuffer(m_immediate_data.cmd_buffer, 0), "reseting immediate cmd buffers");
-
-  VkCommandBuffer cmd = m_immediate_data.cmd_buffer;
-
-  VkCommandBufferBeginInfo cmd_begin_info = {};
-  cmd_begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  cmd_begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-  check(vkBeginCommandBuffer(cmd, &cmd_begin_info), "beginning immediate command buffer");
-
-  function(cmd);
-
-  check(vkEndCommandBuffer(cmd), "ending immediate command buffer");
-
-  VkCommandBufferSubmitInfo cmd_info = {};
-  cmd_info.sType                     = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
-  cmd_info.commandBuffer             = cmd;
-
-  VkSubmitInfo2 submit          = {};
-  submit.sType                  = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
-  submit.commandBufferInfoCount = 1;
-  submit.pCommandBufferInfos    = &cmd_info;
-
-  // submit command buffer to the queue and execute it.
-  //  fence will now block until the graphic commands finish execution
-  check(vkQueueSubmit2(m_device.graphics_queue, 1, &submit, m_immediate_data.fence), "submiting immediate cmd to queue");
-
-  check(vkWaitForFences(m_device.logical, 1, &m_immediate_data.fence, true, 9999999999), "waiting for fence");
+  m_submitter->wait(m_submitter->submit(function));
 }
 
 // STD::SPAN SUCKS LITERALLY PIESE OF GARBAGE
-image_t Context::create_image_on_gpu(VkImageCreateInfo image_info, u8* data, size_t size) {
+image_t Context::create_image_on_gpu(VkImageCreateInfo image_info, u8 const* data, size_t size) {
   WASSERT(size != 0, "zero size not allowed");
-  buffer_t staging = {};
-
-  VkBufferCreateInfo staging_info = {};
-  staging_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  staging_info.size               = size;
-  staging_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-  staging_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
-
-  VmaAllocationCreateInfo staging_alloc{};
-  staging_alloc.usage          = VMA_MEMORY_USAGE_CPU_TO_GPU;
-  staging_alloc.flags          = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-  staging_alloc.preferredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-  check(
-      vmaCreateBuffer(m_vma, &staging_info, &staging_alloc, &staging.handle, &staging.allocation, nullptr), //
-      "creating staging buffer"
-  );
-
-  void* mapped_data = nullptr;
-  vmaMapMemory(m_vma, staging.allocation, &mapped_data);
-  memcpy(mapped_data, data, size);
-  vmaUnmapMemory(m_vma, staging.allocation);
 
   image_t result = {};
 
@@ -404,102 +368,88 @@ image_t Context::create_image_on_gpu(VkImageCreateInfo image_info, u8* data, siz
       "creating result image"
   );
 
-  immediate_submit([&](VkCommandBuffer cmd) {
-    VkImageSubresourceRange subresource_range{};
-    subresource_range.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-    subresource_range.baseArrayLayer = 0;
-    subresource_range.baseMipLevel   = 0;
-    subresource_range.layerCount     = 1;
-    subresource_range.levelCount     = image_info.mipLevels;
+  UploadBatch batch{ *this };
+  batch.upload(result.handle, image_info, data, size);
+  batch.submit();
 
-    transition_image(cmd, result.handle, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresource_range);
-
-    VkImageSubresourceLayers subresource{};
-    subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subresource.layerCount = 1;
-
-    VkBufferImageCopy copy = {};
-    copy.imageSubresource  = subresource;
-    copy.imageExtent       = image_info.extent;
-
-    vkCmdCopyBufferToImage(cmd, staging.handle, result.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
-  });
-
-  vmaDestroyBuffer(m_vma, staging.handle, staging.allocation);
   return result;
 }
 
 void Context::generate_mipmaps(VkImage image, VkImageCreateInfo image_info) {
   WASSERT(image != VK_NULL_HANDLE, "invalid image handle");
 
-  immediate_submit([&](VkCommandBuffer cmd) {
-    VkImageMemoryBarrier barrier{};
-    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel   = 0;
-    barrier.subresourceRange.layerCount     = 1;
-    barrier.subresourceRange.levelCount     = 1;
-    barrier.image                           = image;
-    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-
-    i32 mip_width  = image_info.extent.width;
-    i32 mip_height = image_info.extent.height;
-    for (u32 i = 1; i < image_info.mipLevels; i += 1) {
-      barrier.subresourceRange.baseMipLevel = i - 1;
-      barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-      barrier.newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-      barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
-      barrier.dstAccessMask                 = VK_ACCESS_TRANSFER_READ_BIT;
-      vkCmdPipelineBarrier(
-          cmd,                            // cmd
-          VK_PIPELINE_STAGE_TRANSFER_BIT, // source stage
-          VK_PIPELINE_STAGE_TRANSFER_BIT, // destination stage
-          0,                              // dependencyFlags
-          0,                              // memoryBarrierCount
-          nullptr,                        // pMemoryBarriers
-          0,                              // bufferMemoryBarrierCount
-          nullptr,                        // pBufferMemoryBarriers
-          1,                              // imageMemoryBarrierCount
-          &barrier                        //  pImageMemoryBarriers
-      );
-
-      VkImageBlit blit{};
-      blit.srcOffsets[0]                 = { 0, 0, 0 };
-      blit.srcOffsets[1]                 = { mip_width, mip_height, 1 };
-      blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-      blit.srcSubresource.mipLevel       = i - 1;
-      blit.srcSubresource.baseArrayLayer = 0;
-      blit.srcSubresource.layerCount     = 1;
-      blit.dstOffsets[0]                 = { 0, 0, 0 };
-      blit.dstOffsets[1]                 = { mip_width > 1 ? mip_width / 2 : 1, mip_height > 1 ? mip_height / 2 : 1, 1 };
-      blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-      blit.dstSubresource.mipLevel       = i;
-      blit.dstSubresource.baseArrayLayer = 0;
-      blit.dstSubresource.layerCount     = 1;
-
-      vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
-
-      barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-      barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-      if (mip_width > 1) mip_width /= 2;
-      if (mip_height > 1) mip_height /= 2;
-    }
+  immediate_submit([&](VkCommandBuffer cmd) { record_mipmaps(cmd, image, image_info); });
+}
+
+void Context::record_mipmaps(VkCommandBuffer cmd, VkImage image, VkImageCreateInfo const &image_info) const {
+  WASSERT(image != VK_NULL_HANDLE, "invalid image handle");
 
-    barrier.subresourceRange.baseMipLevel = image_info.mipLevels - 1;
+  VkImageMemoryBarrier barrier{};
+  barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel   = 0;
+  barrier.subresourceRange.layerCount     = 1;
+  barrier.subresourceRange.levelCount     = 1;
+  barrier.image                           = image;
+  barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+
+  i32 mip_width  = image_info.extent.width;
+  i32 mip_height = image_info.extent.height;
+  for (u32 i = 1; i < image_info.mipLevels; i += 1) {
+    barrier.subresourceRange.baseMipLevel = i - 1;
     barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout                     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
     barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask                 = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(
+        cmd,                            // cmd
+        VK_PIPELINE_STAGE_TRANSFER_BIT, // source stage
+        VK_PIPELINE_STAGE_TRANSFER_BIT, // destination stage
+        0,                              // dependencyFlags
+        0,                              // memoryBarrierCount
+        nullptr,                        // pMemoryBarriers
+        0,                              // bufferMemoryBarrierCount
+        nullptr,                        // pBufferMemoryBarriers
+        1,                              // imageMemoryBarrierCount
+        &barrier                        //  pImageMemoryBarriers
+    );
+
+    VkImageBlit blit{};
+    blit.srcOffsets[0]                 = { 0, 0, 0 };
+    blit.srcOffsets[1]                 = { mip_width, mip_height, 1 };
+    blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel       = i - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount     = 1;
+    blit.dstOffsets[0]                 = { 0, 0, 0 };
+    blit.dstOffsets[1]                 = { mip_width > 1 ? mip_width / 2 : 1, mip_height > 1 ? mip_height / 2 : 1, 1 };
+    blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel       = i;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount     = 1;
+
+    vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+
+    barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
     vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-  });
+
+    if (mip_width > 1) mip_width /= 2;
+    if (mip_height > 1) mip_height /= 2;
+  }
+
+  barrier.subresourceRange.baseMipLevel = image_info.mipLevels - 1;
+  barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout                     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask                 = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
 
 VkDeviceAddress Context::get_buffer_device_address(VkBuffer buffer) const {
@@ -514,65 +464,9 @@ buffer_t Context::create_buffer(
     VkDeviceSize size, const void* data, //
     VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_props
 ) {
-  WASSERT(size != 0, "zero size not allowed");
-  buffer_t staging = {};
-
-  VkBufferCreateInfo staging_buffer_info = {};
-  staging_buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  staging_buffer_info.size               = size;
-  staging_buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-  staging_buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
-
-  VmaAllocationCreateInfo staging_buffer_alloc = {};
-  staging_buffer_alloc.usage                   = VMA_MEMORY_USAGE_CPU_TO_GPU;
-  staging_buffer_alloc.flags                   = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-  staging_buffer_alloc.preferredFlags          = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-  check(
-      vmaCreateBuffer(
-          m_vma,                                       //
-          &staging_buffer_info, &staging_buffer_alloc, //
-          &staging.handle, &staging.allocation, nullptr
-      ),
-      "creating staging buffer"
-  );
-
-  void* mapped_data = nullptr;
-  vmaMapMemory(m_vma, staging.allocation, &mapped_data);
-  memcpy(mapped_data, data, size);
-  vmaUnmapMemory(m_vma, staging.allocation);
-
-  buffer_t result = {};
-
-  VkBufferCreateInfo result_buffer_info = {};
-  result_buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  result_buffer_info.size               = size;
-  result_buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage;
-  result_buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
-
-  VmaAllocationCreateInfo result_buffer_alloc = {};
-  result_buffer_alloc.usage                   = VMA_MEMORY_USAGE_GPU_ONLY;
-  result_buffer_alloc.requiredFlags           = mem_props;
-
-  check(
-      vmaCreateBuffer(
-          m_vma,                                     //
-          &result_buffer_info, &result_buffer_alloc, //
-          &result.handle, &result.allocation, nullptr
-      ),
-      "creating destination buffer for transferring"
-  );
-
-  immediate_submit([&](VkCommandBuffer cmd) {
-    VkBufferCopy copy_region{};
-    copy_region.srcOffset = 0;
-    copy_region.dstOffset = 0;
-    copy_region.size      = size;
-
-    vkCmdCopyBuffer(cmd, staging.handle, result.handle, 1, &copy_region);
-  });
-
-  vmaDestroyBuffer(m_vma, staging.handle, staging.allocation);
+  UploadBatch batch{ *this };
+  buffer_t    result = batch.create_buffer(size, data, usage, mem_props);
+  batch.submit();
 
   return result;
 }
@@ -807,10 +701,18 @@ void Context::set_debug_name(VkBuffer buffer, std::string_view name) const {
 
 [[nodiscard]] u32 Context::present_family_index() const { return m_device.present_family_index; }
 
+[[nodiscard]] VkQueue Context::transfer_queue() const { return m_device.transfer_queue; }
+
+[[nodiscard]] u32 Context::transfer_family_index() const { return m_device.transfer_family_index; }
+
 [[nodiscard]] VkCommandPool Context::command_pool() const { return m_command_pool; }
 
 [[nodiscard]] VmaAllocator Context::vma_allocator() const { return m_vma; }
 
+[[nodiscard]] StagingArena &Context::staging_arena() const { return *m_staging_arena; }
+
+[[nodiscard]] Submitter &Context::submitter() const { return *m_submitter; }
+
 [[nodiscard]] VkSwapchainKHR Context::swapchain() const { return m_swapchain.handle; }
 
 [[nodiscard]] std::vector<swapchain_frame_t> const &Context::swapchain_frames() const { return m_frames; }
@@ -825,6 +727,8 @@ void Context::set_debug_name(VkBuffer buffer, std::string_view name) const {
 
 [[nodiscard]] u32 Context::swapchain_image_count() const { return m_swapchain.image_count; }
 
-[[nodiscard]] GLFWwindow* Context::window() const { return m_window_ref.get().handle(); }
+[[nodiscard]] GLFWwindow* Context::window() const { return m_window != nullptr ? m_window->handle() : nullptr; }
+
+[[nodiscard]] bool Context::is_headless() const { return m_window == nullptr; }
 
 } // namespace whim::vk
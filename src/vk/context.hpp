@@ -10,9 +10,15 @@
 
 #include "window.hpp"
 #include "config.hpp"
+#include "vk/staging_arena.hpp"
+#include "vk/submitter.hpp"
 
 #include "whim.hpp"
 
+namespace vkb {
+struct Device;
+}
+
 namespace whim::vk {
 
 struct swapchain_frame_t {
@@ -31,6 +37,11 @@ class Context {
 public:
   // TODO: add options to specify which device we want to choose
   Context(config_t const &config, Window const &window);
+  /*
+    headless context: no GLFW, surface or swapchain,
+    swapchain_extent() returns render resolution from config
+  */
+  explicit Context(config_t const &config);
   // TODO: add more nice way for COntext creation:
   // for example: context_builder.add_device_extention(...)
   //                .add_instance_extension(...)
@@ -42,13 +53,20 @@ public:
   Context(const Context &)                = delete;
   Context &operator=(const Context &)     = delete;
 
+  // records and submits commands through submitter() and waits until gpu is done with them
   void immediate_submit(std::function<void(VkCommandBuffer cmd)> &&function) const;
 
   VkDeviceAddress get_buffer_device_address(VkBuffer buffer) const;
 
-  image_t create_image_on_gpu(VkImageCreateInfo image_info, u8* data, size_t size);
+  /*
+    one-off uploads through staging arena, batch uploads with UploadBatch instead.
+    results are ready for any later graphics queue submission, image ends in SHADER_READ_ONLY_OPTIMAL
+  */
+  image_t create_image_on_gpu(VkImageCreateInfo image_info, u8 const* data, size_t size);
 
   void generate_mipmaps(VkImage image, VkImageCreateInfo image_info);
+  // expects whole mip chain in TRANSFER_DST_OPTIMAL with filled level 0, leaves it in SHADER_READ_ONLY_OPTIMAL
+  void record_mipmaps(VkCommandBuffer cmd, VkImage image, VkImageCreateInfo const &image_info) const;
 
   buffer_t create_buffer(
       VkDeviceSize size, const void* data_, //
@@ -89,9 +107,14 @@ public:
   [[nodiscard]] u32              graphics_family_index() const;
   [[nodiscard]] u32              compute_family_index() const;
   [[nodiscard]] u32              present_family_index() const;
+  // graphics queue when device has no dedicated transfer family
+  [[nodiscard]] VkQueue transfer_queue() const;
+  [[nodiscard]] u32     transfer_family_index() const;
 
   [[nodiscard]] VkCommandPool command_pool() const;
   [[nodiscard]] VmaAllocator  vma_allocator() const;
+  [[nodiscard]] StagingArena &staging_arena() const;
+  [[nodiscard]] Submitter    &submitter() const;
 
   [[nodiscard]] VkSwapchainKHR                        swapchain() const;
   [[nodiscard]] std::vector<swapchain_frame_t> const &swapchain_frames() const;
@@ -102,6 +125,7 @@ public:
   [[nodiscard]] u32                                   swapchain_image_count() const;
 
   [[nodiscard]] GLFWwindow* window() const;
+  [[nodiscard]] bool        is_headless() const;
 
   // TODO: handling resizing
   //  - recreate swapchain
@@ -134,9 +158,11 @@ private:
     handle<VkQueue>          graphics_queue        = VK_NULL_HANDLE;
     handle<VkQueue>          compute_queue         = VK_NULL_HANDLE;
     handle<VkQueue>          present_queue         = VK_NULL_HANDLE;
+    handle<VkQueue>          transfer_queue        = VK_NULL_HANDLE;
     u32                      graphics_family_index = 0;
     u32                      compute_family_index  = 0;
     u32                      present_family_index  = 0;
+    u32                      transfer_family_index = 0;
   } m_device;
 
   handle<VmaAllocator>  m_vma          = VK_NULL_HANDLE;
@@ -154,15 +180,17 @@ private:
 
   std::vector<swapchain_frame_t> m_frames{};
 
-  struct {
-    handle<VkFence>         fence      = VK_NULL_HANDLE;
-    handle<VkCommandPool>   cmd_pool   = VK_NULL_HANDLE;
-    handle<VkCommandBuffer> cmd_buffer = VK_NULL_HANDLE;
-  } m_immediate_data;
+  // arena submits under queue lock of submitter, so it is created after and destroyed before it
+  uptr<Submitter>    m_submitter     = nullptr;
+  uptr<StagingArena> m_staging_arena = nullptr;
 
-  cref<Window> m_window_ref;
+  // nullptr in headless mode
+  Window const* m_window = nullptr;
 
 private:
+  Context(config_t const &config, Window const* window);
+
+  void create_swapchain(vkb::Device const &device, Window const &window);
 };
 
 } // namespace whim::vk
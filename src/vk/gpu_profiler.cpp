@@ -0,0 +1,384 @@
+#include "vk/gpu_profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <numeric>
+#include <span>
+
+#include "fmt/chrono.h"
+#include "imgui/imgui.h"
+#include "vk/context.hpp"
+#include "vk/result.hpp"
+
+namespace whim::vk {
+
+namespace {
+
+/*
+  absolute path of new export file, named by utc time so exports of one session and of earlier runs are kept
+*/
+std::filesystem::path export_path(std::filesystem::path const &directory, std::string_view extension) {
+  std::error_code error{};
+  std::filesystem::create_directories(directory, error);
+  if (error) {
+    WERROR("failed to create gpu profile directory {}: {}", directory.string(), error.message());
+  }
+
+  auto now  = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+  auto name = fmt::format("gpu_profile_{:%Y%m%d_%H%M%S}.{}", now, extension);
+  return std::filesystem::absolute(directory / name).lexically_normal();
+}
+
+} // namespace
+
+GpuProfiler::GpuProfiler(Context const &context, u32 frame_count, std::filesystem::path export_directory) :
+    m_device(context.device()),
+    m_slots(frame_count),
+    m_export_directory(std::move(export_directory)) {
+  WASSERT(frame_count > 0, "profiler needs at least one frame");
+
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(context.physical_device(), &properties);
+  m_period_ns = properties.limits.timestampPeriod;
+
+  u32 family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(context.physical_device(), &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(context.physical_device(), &family_count, families.data());
+
+  u32 valid_bits = families[context.graphics_family_index()].timestampValidBits;
+  if (valid_bits == 0) {
+    WINFO("gpu profiler is disabled, graphics queue family has no timestamps ({} bits)", valid_bits);
+    return;
+  }
+  m_tick_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  VkQueryPoolCreateInfo pool_info = {};
+  pool_info.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  pool_info.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+  pool_info.queryCount            = frame_count * max_frame_zones * 2;
+
+  check(
+      vkCreateQueryPool(m_device, &pool_info, nullptr, &m_frame_pool), //
+      "creating frame timestamp query pool"
+  );
+  context.set_debug_name(m_frame_pool, "frame timestamps");
+
+  pool_info.queryCount = max_load_zones * 2;
+  check(
+      vkCreateQueryPool(m_device, &pool_info, nullptr, &m_load_pool), //
+      "creating load timestamp query pool"
+  );
+  context.set_debug_name(m_load_pool, "load timestamps");
+
+  // queries start in undefined state, they are reset by host as frame slots are reused
+  vkResetQueryPool(m_device, m_frame_pool, 0, frame_count * max_frame_zones * 2);
+  vkResetQueryPool(m_device, m_load_pool, 0, max_load_zones * 2);
+}
+
+GpuProfiler::~GpuProfiler() {
+  vkDestroyQueryPool(m_device, m_frame_pool, nullptr);
+  vkDestroyQueryPool(m_device, m_load_pool, nullptr);
+}
+
+void GpuProfiler::begin_frame(u32 frame_index) {
+  WASSERT(frame_index < m_slots.size(), "frame index is out of profiler slots");
+  m_current_slot = frame_index;
+  m_frame += 1;
+
+  frame_slot_t &slot = m_slots[frame_index];
+  if (slot.zone_count == 0) {
+    return;
+  }
+
+  u32                                  first = frame_index * max_frame_zones * 2;
+  std::array<u64, max_frame_zones * 2> ticks{};
+  VkResult                             result = vkGetQueryPoolResults(
+      m_device, m_frame_pool, first, slot.zone_count * 2, //
+      slot.zone_count * 2 * sizeof(u64), ticks.data(), sizeof(u64), VK_QUERY_RESULT_64_BIT
+  );
+
+  // zone which was begun but never ended leaves its query unavailable, whole frame is dropped then
+  if (result == VK_SUCCESS) {
+    for (u32 i = 0; i < slot.zone_count; i += 1) {
+      history_t &history = m_history[slot.history[i]];
+      f64        ms      = ticks_to_ms(ticks[i * 2], ticks[i * 2 + 1]);
+
+      history.samples[history.next] = ms;
+      history.next                  = (history.next + 1) % window_size;
+      history.count                 = std::min(history.count + 1, window_size);
+      history.last_ms               = ms;
+      history.last_frame            = m_frame;
+    }
+  }
+
+  vkResetQueryPool(m_device, m_frame_pool, first, slot.zone_count * 2);
+  slot.zone_count = 0;
+}
+
+u32 GpuProfiler::begin_zone(VkCommandBuffer cmd, std::string_view name) {
+  frame_slot_t &slot = m_slots[m_current_slot];
+  if (not is_enabled() or slot.zone_count == max_frame_zones) {
+    return no_zone;
+  }
+
+  u32 zone           = slot.zone_count;
+  slot.history[zone] = find_history(name);
+  slot.zone_count += 1;
+
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_frame_pool, (m_current_slot * max_frame_zones + zone) * 2);
+  return zone;
+}
+
+void GpuProfiler::end_zone(VkCommandBuffer cmd, u32 zone) {
+  if (zone == no_zone) {
+    return;
+  }
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frame_pool, (m_current_slot * max_frame_zones + zone) * 2 + 1);
+}
+
+f64 GpuProfiler::resolved_ms(std::string_view name) const {
+  for (auto const &history : m_history) {
+    if (history.name == name) {
+      return history.last_frame == m_frame ? history.last_ms : -1.0;
+    }
+  }
+  return -1.0;
+}
+
+u32 GpuProfiler::begin_load_zone(VkCommandBuffer cmd, std::string_view name) {
+  if (not is_enabled() or m_load_names.size() == max_load_zones) {
+    return no_zone;
+  }
+
+  u32 zone = (u32) m_load_names.size();
+  m_load_names.emplace_back(name);
+
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_load_pool, zone * 2);
+  return zone;
+}
+
+void GpuProfiler::end_load_zone(VkCommandBuffer cmd, u32 zone) {
+  if (zone == no_zone) {
+    return;
+  }
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_load_pool, zone * 2 + 1);
+}
+
+void GpuProfiler::resolve_load_zones() {
+  if (m_load_names.empty()) {
+    return;
+  }
+
+  u32              query_count = (u32) m_load_names.size() * 2;
+  std::vector<u64> ticks(query_count);
+  check(
+      vkGetQueryPoolResults(
+          m_device, m_load_pool, 0, query_count, //
+          query_count * sizeof(u64), ticks.data(), sizeof(u64), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+      ),
+      "reading load timestamps"
+  );
+
+  for (usize i = 0; i < m_load_names.size(); i += 1) {
+    add_load_time(m_load_names[i], ticks_to_ms(ticks[i * 2], ticks[i * 2 + 1]));
+  }
+
+  vkResetQueryPool(m_device, m_load_pool, 0, query_count);
+  m_load_names.clear();
+}
+
+void GpuProfiler::add_load_time(std::string_view name, f64 gpu_ms) {
+  pass_stats_t &stats = find_load_stats(name);
+  stats.min_ms        = stats.samples == 0 ? gpu_ms : std::min(stats.min_ms, gpu_ms);
+  stats.max_ms        = stats.samples == 0 ? gpu_ms : std::max(stats.max_ms, gpu_ms);
+
+  stats.samples += 1;
+  stats.last_ms += gpu_ms;
+  stats.average_ms = stats.last_ms / stats.samples;
+}
+
+std::vector<GpuProfiler::pass_stats_t> GpuProfiler::frame_stats() const {
+  std::vector<pass_stats_t> result{};
+  result.reserve(m_history.size());
+
+  for (auto const &history : m_history) {
+    pass_stats_t stats = {};
+    stats.name         = history.name;
+    stats.samples      = history.count;
+    stats.last_ms      = history.last_ms;
+    if (history.count > 0) {
+      auto samples     = std::span{ history.samples.data(), history.count };
+      auto [min, max]  = std::minmax_element(samples.begin(), samples.end());
+      stats.min_ms     = *min;
+      stats.max_ms     = *max;
+      stats.average_ms = std::accumulate(samples.begin(), samples.end(), 0.0) / history.count;
+    }
+    result.push_back(stats);
+  }
+  return result;
+}
+
+void GpuProfiler::draw_ui() {
+  ImGui::Begin("gpu profiler");
+
+  if (not is_enabled()) {
+    ImGui::Text("timestamps are not supported by graphics queue");
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Text("frame passes, last %u frames", window_size);
+  if (ImGui::BeginTable("frame passes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    for (char const* header : { "pass", "avg ms", "min ms", "max ms", "last ms" }) {
+      ImGui::TableSetupColumn(header);
+    }
+    ImGui::TableHeadersRow();
+
+    for (auto const &stats : frame_stats()) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(stats.name.c_str());
+      for (f64 ms : { stats.average_ms, stats.min_ms, stats.max_ms, stats.last_ms }) {
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", ms);
+      }
+    }
+    ImGui::EndTable();
+  }
+
+  if (not m_load_stats.empty()) {
+    ImGui::Separator();
+    ImGui::Text("load passes");
+    if (ImGui::BeginTable("load passes", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+      for (char const* header : { "pass", "zones", "total ms" }) {
+        ImGui::TableSetupColumn(header);
+      }
+      ImGui::TableHeadersRow();
+
+      for (auto const &stats : m_load_stats) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(stats.name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", stats.samples);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", stats.last_ms);
+      }
+      ImGui::EndTable();
+    }
+  }
+
+  ImGui::Separator();
+  if (ImGui::Button("reset")) {
+    reset_frame_stats();
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("export csv")) {
+    auto path = export_path(m_export_directory, "csv");
+    if (export_csv(path)) {
+      WINFO("gpu profile is written to {}", path.string());
+    }
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("export json")) {
+    auto path = export_path(m_export_directory, "json");
+    if (export_json(path)) {
+      WINFO("gpu profile is written to {}", path.string());
+    }
+  }
+
+  ImGui::End();
+}
+
+void GpuProfiler::reset_frame_stats() {
+  for (auto &history : m_history) {
+    history.count = 0;
+    history.next  = 0;
+  }
+}
+
+bool GpuProfiler::export_csv(std::filesystem::path const &path) const {
+  std::ofstream out{ path, std::ios::trunc };
+  if (!out) {
+    WERROR("failed to open {} for writing", path.string());
+    return false;
+  }
+
+  out << "kind,pass,samples,average_ms,min_ms,max_ms,last_ms\n";
+  auto write_rows = [&](std::string_view kind, std::vector<pass_stats_t> const &passes) {
+    for (auto const &stats : passes) {
+      out << fmt::format(
+          "{},{},{},{:.6f},{:.6f},{:.6f},{:.6f}\n", //
+          kind, stats.name, stats.samples, stats.average_ms, stats.min_ms, stats.max_ms, stats.last_ms
+      );
+    }
+  };
+  write_rows("frame", frame_stats());
+  write_rows("load", m_load_stats);
+
+  if (!out) {
+    WERROR("failed to write gpu profile {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+bool GpuProfiler::export_json(std::filesystem::path const &path) const {
+  std::ofstream out{ path, std::ios::trunc };
+  if (!out) {
+    WERROR("failed to open {} for writing", path.string());
+    return false;
+  }
+
+  // pass names are string literals of the renderer, they need no escaping
+  auto write_passes = [&](std::vector<pass_stats_t> const &passes) {
+    for (usize i = 0; i < passes.size(); i += 1) {
+      pass_stats_t const &stats = passes[i];
+      out << fmt::format(
+          "    {{ \"pass\": \"{}\", \"samples\": {}, \"average_ms\": {:.6f}, \"min_ms\": {:.6f}, \"max_ms\": {:.6f}, \"last_ms\": {:.6f} }}{}\n", //
+          stats.name, stats.samples, stats.average_ms, stats.min_ms, stats.max_ms, stats.last_ms, i + 1 < passes.size() ? "," : ""
+      );
+    }
+  };
+
+  out << "{\n";
+  out << fmt::format("  \"window\": {},\n", window_size);
+  out << "  \"frame\": [\n";
+  write_passes(frame_stats());
+  out << "  ],\n";
+  out << "  \"load\": [\n";
+  write_passes(m_load_stats);
+  out << "  ]\n";
+  out << "}\n";
+
+  if (!out) {
+    WERROR("failed to write gpu profile {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+u32 GpuProfiler::find_history(std::string_view name) {
+  for (u32 i = 0; i < m_history.size(); i += 1) {
+    if (m_history[i].name == name) {
+      return i;
+    }
+  }
+  m_history.push_back(history_t{ .name = std::string(name) });
+  return (u32) m_history.size() - 1;
+}
+
+f64 GpuProfiler::ticks_to_ms(u64 begin, u64 end) const { return (f64) ((end - begin) & m_tick_mask) * m_period_ns / 1e6; }
+
+GpuProfiler::pass_stats_t &GpuProfiler::find_load_stats(std::string_view name) {
+  for (auto &stats : m_load_stats) {
+    if (stats.name == name) {
+      return stats;
+    }
+  }
+  return m_load_stats.emplace_back(pass_stats_t{ .name = std::string(name) });
+}
+
+} // namespace whim::vk
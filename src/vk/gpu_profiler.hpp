@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "vk/types.hpp"
+#include "whim.hpp"
+
+namespace whim::vk {
+
+class Context;
+
+/*
+  Gpu pass timings by timestamp queries
+
+  frame zones: every frame in flight owns its own range of timestamp pool. range is read back and reset by host
+  in begin_frame(), caller guarantees that gpu is done with previous use of the frame slot (fence is waited),
+  so results are never waited for. zones may nest and may be recorded into any command buffer of the frame.
+  every pass keeps last window_size samples, panel shows rolling average, min and max.
+
+  load zones: one shot passes recorded into Submitter command buffers (acceleration structure builds, ...),
+  they are read by resolve_load_zones() once caller waited for their tickets. timings measured elsewhere
+  (staging arena on transfer queue) are added by add_load_time().
+
+  profiler is disabled on queue family without timestamp support, zones are not written then.
+  not thread safe, everything is recorded by one thread
+*/
+class GpuProfiler {
+
+public:
+  constexpr static u32 max_frame_zones = 16;
+  constexpr static u32 max_load_zones  = 64;
+  constexpr static u32 window_size     = 120;
+  constexpr static u32 no_zone         = ~0u;
+
+  struct pass_stats_t {
+    std::string name       = {};
+    u32         samples    = 0;
+    f64         average_ms = 0.0;
+    f64         min_ms     = 0.0;
+    f64         max_ms     = 0.0;
+    f64         last_ms    = 0.0;
+  };
+
+  // ui exports are written into export_directory
+  GpuProfiler(Context const &context, u32 frame_count, std::filesystem::path export_directory);
+  ~GpuProfiler();
+
+  GpuProfiler(GpuProfiler &&)                 = delete;
+  GpuProfiler &operator=(GpuProfiler &&)      = delete;
+  GpuProfiler(const GpuProfiler &)            = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  // reads finished zones of frame slot into history and makes it ready for new ones
+  void begin_frame(u32 frame_index);
+  // returns no_zone when profiler is disabled or frame is out of zones, end_zone() ignores it
+  u32  begin_zone(VkCommandBuffer cmd, std::string_view name);
+  void end_zone(VkCommandBuffer cmd, u32 zone);
+  // time of pass in frame resolved by last begin_frame(), negative if pass was not recorded in it
+  [[nodiscard]] f64 resolved_ms(std::string_view name) const;
+
+  u32  begin_load_zone(VkCommandBuffer cmd, std::string_view name);
+  void end_load_zone(VkCommandBuffer cmd, u32 zone);
+  // every submission with load zones has to be finished, zones with the same name are summed
+  void resolve_load_zones();
+  void add_load_time(std::string_view name, f64 gpu_ms);
+
+  [[nodiscard]] std::vector<pass_stats_t> frame_stats() const;
+  // samples is number of zones with the same name, last_ms is their sum
+  [[nodiscard]] std::vector<pass_stats_t> load_stats() const { return m_load_stats; }
+
+  void draw_ui();
+  void reset_frame_stats();
+
+  // return false if file could not be written
+  bool export_csv(std::filesystem::path const &path) const;
+  bool export_json(std::filesystem::path const &path) const;
+
+  [[nodiscard]] bool is_enabled() const { return m_frame_pool != VK_NULL_HANDLE; }
+
+private:
+  struct history_t {
+    std::string                  name       = {};
+    std::array<f64, window_size> samples    = {};
+    u32                          count      = 0;
+    u32                          next       = 0;
+    f64                          last_ms    = 0.0;
+    u64                          last_frame = 0; // begin_frame() which resolved last_ms
+  };
+
+  struct frame_slot_t {
+    u32                              zone_count = 0;
+    std::array<u32, max_frame_zones> history    = {}; // history index of every written zone
+  };
+
+  u32 find_history(std::string_view name);
+  f64 ticks_to_ms(u64 begin, u64 end) const;
+
+  pass_stats_t &find_load_stats(std::string_view name);
+
+private:
+  VkDevice m_device    = VK_NULL_HANDLE;
+  f64      m_period_ns = 1.0;
+  u64      m_tick_mask = ~0ull; // timestampValidBits of graphics family
+
+  handle<VkQueryPool>       m_frame_pool   = VK_NULL_HANDLE;
+  std::vector<frame_slot_t> m_slots        = {};
+  u32                       m_current_slot = 0;
+  u64                       m_frame        = 0;
+  std::vector<history_t>    m_history      = {};
+
+  handle<VkQueryPool>       m_load_pool  = VK_NULL_HANDLE;
+  std::vector<std::string>  m_load_names = {}; // of zones waiting for resolve_load_zones()
+  std::vector<pass_stats_t> m_load_stats = {};
+
+  std::filesystem::path m_export_directory = {};
+};
+
+} // namespace whim::vk
@@ -5,18 +5,27 @@
 #include <cstddef>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <filesystem>
+#include <numeric>
+#include <span>
 
 #include <external/stb_image.h>
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_vulkan.h"
 #include "imgui/imgui_impl_glfw.h"
+#include "gltf_loader.hpp"
+#include "obj_loader.hpp"
+#include "vertex_layout.hpp"
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #include "tiny_gltf.h"
 #include "utility/align.hpp"
+#include "utility/trace.hpp"
 #include "vk/context.hpp"
+#include "vk/upload_batch.hpp"
 #include "vk/types.hpp"
 #include "whim.hpp"
 
@@ -28,14 +37,46 @@
 
 namespace whim::vk {
 
-RayTracer::RayTracer(Context &context, CameraManipulator const &man) :
+namespace {
+
+// world space box around transformed corners of object space box
+bvh::bounds_t transform_bounds(bvh::bounds_t const &bounds, glm::mat4 const &matrix) {
+  // empty blas stays empty
+  if (bounds.min.x > bounds.max.x) {
+    return bounds;
+  }
+  bvh::bounds_t result{};
+  for (u32 corner = 0; corner < 8; corner += 1) {
+    glm::vec3 point = {
+      (corner & 1u) != 0 ? bounds.max.x : bounds.min.x, //
+      (corner & 2u) != 0 ? bounds.max.y : bounds.min.y, //
+      (corner & 4u) != 0 ? bounds.max.z : bounds.min.z  //
+    };
+    result.grow(glm::vec3(matrix * glm::vec4(point, 1.f)));
+  }
+  return result;
+}
+
+} // namespace
+
+RayTracer::RayTracer(Context &context, CameraManipulator const &man, config_t const &config) :
+    m_options(config.options),
     m_context_ref(context),
     m_camera_ref(man) {
 
+  // calling thread takes part in parallel loops, so it is not counted as worker
+  u32 thread_count = m_options.loader_threads != 0 ? m_options.loader_threads : std::max(1u, std::thread::hardware_concurrency());
+  m_thread_pool    = std::make_unique<ThreadPool>(thread_count - 1);
+
   create_frame_data();
-  init_imgui();
+  // headless context has no window to draw ui and no swapchain to blit into
+  if (not context.is_headless()) {
+    init_imgui();
+  }
 
+  m_as_prop.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
   m_rt_prop.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+  m_rt_prop.pNext = &m_as_prop;
 
   VkPhysicalDeviceProperties2 prop2{};
   prop2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
@@ -43,8 +84,11 @@ RayTracer::RayTracer(Context &context, CameraManipulator const &man) :
   vkGetPhysicalDeviceProperties2(context.physical_device(), &prop2);
 
   create_storage_image();
+  create_accumulation_buffers();
   create_uniform_buffer();
-  create_offscreen_renderer();
+  if (not context.is_headless()) {
+    create_offscreen_renderer();
+  }
 }
 
 RayTracer::~RayTracer() {
@@ -63,10 +107,11 @@ RayTracer::~RayTracer() {
       2 - Meshes data cleanup
       2 - Spheres cleanup
       3 - imgui cleanup
-      4 - frame data cleanup
+      4 - frame data and gpu profiler cleanup
       5 - offscreen renderer desctruction
       5 - storage image cleanup
-      6 - ubo cleanup
+      6 - accumulation buffers cleanup
+      6 - uniform ring cleanup
       7 - textures cleanup
     */
     Context const &context = m_context_ref;
@@ -86,6 +131,8 @@ RayTracer::~RayTracer() {
 
     vmaDestroyBuffer(context.vma_allocator(), m_tlas.buffer.handle, m_tlas.buffer.allocation);
     vkDestroyAccelerationStructureKHR(context.device(), m_tlas.handle, nullptr);
+    vmaDestroyBuffer(context.vma_allocator(), m_tlas.instances.handle, m_tlas.instances.allocation);
+    vmaDestroyBuffer(context.vma_allocator(), m_tlas.scratch.handle, m_tlas.scratch.allocation);
 
     vmaDestroyBuffer(context.vma_allocator(), m_description.buffer.handle, m_description.buffer.allocation);
 
@@ -107,8 +154,11 @@ RayTracer::~RayTracer() {
     vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.index_buffer.handle, m_meshes.device.index_buffer.allocation);
     vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.normal_buffer.handle, m_meshes.device.normal_buffer.allocation);
     vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.uv_buffer.handle, m_meshes.device.uv_buffer.allocation);
+    vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.vertex_buffer.handle, m_meshes.device.vertex_buffer.allocation);
+    vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.blas_transforms.handle, m_meshes.device.blas_transforms.allocation);
     vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.material_buffer.handle, m_meshes.device.material_buffer.allocation);
     vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.prim_infos.handle, m_meshes.device.prim_infos.allocation);
+    vmaDestroyBuffer(context.vma_allocator(), m_meshes.device.geometry_primitives.handle, m_meshes.device.geometry_primitives.allocation);
 
     // // SPHERES
     // vmaDestroyBuffer(context.vma_allocator(), m_spheres.blas.buffer.handle, m_spheres.blas.buffer.allocation);
@@ -119,14 +169,17 @@ RayTracer::~RayTracer() {
     // vmaDestroyBuffer(context.vma_allocator(), m_spheres.gpu_data.material_index.handle, m_spheres.gpu_data.material_index.allocation);
     // vmaDestroyBuffer(context.vma_allocator(), m_spheres.gpu_data.aabbs.handle, m_spheres.gpu_data.aabbs.allocation);
 
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (not context.is_headless()) {
+      ImGui_ImplVulkan_Shutdown();
+      ImGui_ImplGlfw_Shutdown();
+      ImGui::DestroyContext();
+    }
     vkDestroyDescriptorPool(context.device(), m_imgui.desc_pool, nullptr);
 
-    std::vector<VkCommandBuffer> buffers{ (size_t) max_frames };
+    std::vector<VkCommandBuffer> buffers{};
     for (auto frame_data : m_frames) {
       buffers.push_back(frame_data.cmd);
+      buffers.push_back(frame_data.present_cmd);
       vkDestroyFence(context.device(), frame_data.fence, nullptr);
       vkDestroySemaphore(context.device(), frame_data.image_semaphore, nullptr);
       vkDestroySemaphore(context.device(), frame_data.render_semaphore, nullptr);
@@ -135,9 +188,10 @@ RayTracer::~RayTracer() {
     vkFreeCommandBuffers(
         context.device(),       //
         context.command_pool(), //
-        max_frames,             //
+        (u32) buffers.size(),   //
         buffers.data()
     );
+    m_profiler.reset();
 
     vkDestroyDescriptorSetLayout(context.device(), m_offscreen.desc_layout, nullptr);
     vkDestroyDescriptorPool(context.device(), m_offscreen.desc_pool, nullptr);
@@ -148,7 +202,10 @@ RayTracer::~RayTracer() {
     vkDestroyImageView(context.device(), m_storage_image.view, nullptr);
     vmaDestroyImage(context.vma_allocator(), m_storage_image.image, m_storage_image.allocation);
 
-    vmaDestroyBuffer(context.vma_allocator(), m_ubo.handle, m_ubo.allocation);
+    vmaDestroyBuffer(context.vma_allocator(), m_accumulation.moments.handle, m_accumulation.moments.allocation);
+    vmaDestroyBuffer(context.vma_allocator(), m_accumulation.noise_counters.handle, m_accumulation.noise_counters.allocation);
+
+    m_uniform_ring.reset();
 
     // TEXTURES
 
@@ -165,7 +222,7 @@ RayTracer::~RayTracer() {
   }
 }
 
-void RayTracer::update_uniform_buffer(VkCommandBuffer cmd) {
+u32 RayTracer::update_uniform_buffer(VkCommandBuffer cmd, u32 frame_index) {
 
   CameraManipulator const &cam = m_camera_ref;
   // updating ubo
@@ -175,33 +232,41 @@ void RayTracer::update_uniform_buffer(VkCommandBuffer cmd) {
   host_ubo.proj         = cam.proj_matrix();
   host_ubo.view         = cam.view_matrix();
 
+  m_uniform_ring->begin_frame(frame_index);
+
+  if (m_uniform_upload == uniform_upload_t::mapped) {
+    UniformRing::allocation_t allocation = m_uniform_ring->push(host_ubo);
+    m_uniform_ring->flush();
+    return allocation.offset;
+  }
+
+  // transfer path for comparison: ubo is copied into command buffer and written by gpu at the same offset
+  UniformRing::allocation_t allocation = m_uniform_ring->allocate(sizeof(global_ubo));
+
   VkPipelineStageFlagBits ubo_shader_stages = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
 
-  // Ensure that the modified UBO is not visible to previous frames.
   VkBufferMemoryBarrier before_barrier{};
   before_barrier.sType         = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
   before_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
   before_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  before_barrier.buffer        = m_ubo.handle;
-  before_barrier.offset        = 0;
+  before_barrier.buffer        = m_uniform_ring->buffer();
+  before_barrier.offset        = allocation.offset;
   before_barrier.size          = sizeof(host_ubo);
-  vkCmdPipelineBarrier(cmd, ubo_shader_stages, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0, nullptr, 1, &before_barrier, 0, nullptr);
+  vkCmdPipelineBarrier(cmd, ubo_shader_stages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &before_barrier, 0, nullptr);
 
-  // Schedule the host-to-device upload. (hostUBO is copied into the cmd
-  // buffer so it is okay to deallocate when the function returns).
-  vkCmdUpdateBuffer(cmd, m_ubo.handle, 0, sizeof(global_ubo), &host_ubo);
+  vkCmdUpdateBuffer(cmd, m_uniform_ring->buffer(), allocation.offset, sizeof(global_ubo), &host_ubo);
 
-  // Making sure the updated UBO will be visible.
   VkBufferMemoryBarrier after_barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
   after_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  after_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  after_barrier.buffer        = m_ubo.handle;
-  after_barrier.offset        = 0;
+  after_barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+  after_barrier.buffer        = m_uniform_ring->buffer();
+  after_barrier.offset        = allocation.offset;
   after_barrier.size          = sizeof(host_ubo);
-  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, ubo_shader_stages, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0, nullptr, 1, &after_barrier, 0, nullptr);
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, ubo_shader_stages, 0, 0, nullptr, 1, &after_barrier, 0, nullptr);
+  return allocation.offset;
 }
 
-void RayTracer::create_default_texture() {
+void RayTracer::create_default_texture(UploadBatch &batch) {
   // TODO: add error handling
 
   if (!std::filesystem::exists(default_texture_path)) {
@@ -216,41 +281,83 @@ void RayTracer::create_default_texture() {
     throw std::runtime_error("failed to read default texture at path");
   }
   std::vector<unsigned char> data(stbi_pixels, stbi_pixels + width * height * 4);
+  stbi_image_free(stbi_pixels);
 
-  m_default_texture = create_texture(width, height, data, VK_FILTER_NEAREST, VK_FILTER_NEAREST);
+  m_default_texture = create_texture(batch, width, height, data, VK_FILTER_NEAREST, VK_FILTER_NEAREST);
   m_textures.push_back(m_default_texture);
 }
 
 void RayTracer::load_gltf_scene(std::string_view file_path) {
+  WTRACE_FUNCTION();
+  load_gltf_raw(file_path);
+  upload_scene();
+}
 
-  Context &context = m_context_ref;
+void RayTracer::load_obj_scene(std::string_view file_path) {
+  WTRACE_FUNCTION();
+  load_obj_raw(file_path);
+  upload_scene();
+}
 
-  load_gltf_raw(file_path);
+void RayTracer::upload_scene() {
+  WTRACE_FUNCTION();
+
+  Context      &context = m_context_ref;
+  StagingArena &arena   = context.staging_arena();
+
+  ticket_t             uploads = {};
+  UploadBatch::stats_t stats   = {};
+
+  // geometry table of instances is uploaded with scene buffers
+  plan_blases();
+  {
+    // textures and geometry share one batch, blas builds wait for it on gpu, so cpu does not wait.
+    // textures are submitted before buffers are staged, so no segment holds both and their transfer times are exact
+    UploadBatch batch{ context };
+    create_textures(batch);
+    batch.submit();
+    load_gltf_device(batch);
+    uploads = batch.submit();
 
-  load_gltf_device();
+    build_blases(uploads);
 
-  m_meshes.blases.reserve(m_meshes.raw.prim_meshes.size());
-  for (auto &primitive : m_meshes.raw.primitive_infos) {
-    m_meshes.blases.emplace_back(acceleration_structure_t{});
-    load_primitive_to_blas(primitive, m_meshes.blases.back());
+    // builds waited for uploads, so waiting here only reads their timestamps
+    arena.wait(uploads.value);
+    stats = batch.stats();
   }
 
-  m_blas_instances.reserve(m_meshes.raw.nodes.size());
+  auto const &textures = m_texture_stats;
+  WINFO(
+      "textures: {} decoded on {} threads in {:.2f} ms, {:.2f} MB uploaded (staging {:.2f} ms, transfer {:.2f} ms)", //
+      stats.images.count, textures.decode_threads, textures.decode_ms, (f64) stats.images.bytes / (1024.0 * 1024.0), stats.images.staging_ms,
+      stats.images.gpu_ms
+  );
+  WINFO(
+      "scene buffers: {}, {:.2f} MB uploaded (staging {:.2f} ms, transfer {:.2f} ms)", //
+      stats.buffers.count, (f64) stats.buffers.bytes / (1024.0 * 1024.0), stats.buffers.staging_ms, stats.buffers.gpu_ms
+  );
+  WINFO("scene upload: {} submits, gpu wait {:.2f} ms", stats.submit_count, stats.wait_ms);
+  if (arena.has_timestamps()) {
+    m_profiler->add_load_time("texture uploads (transfer)", stats.images.gpu_ms);
+    m_profiler->add_load_time("buffer uploads (transfer)", stats.buffers.gpu_ms);
+  }
 
-  for (auto &node : m_meshes.raw.nodes) {
+  m_blas_instances.reserve(m_meshes.instances.size());
 
-    glm::mat3x4          rtxT             = glm::transpose(node.world_matrix);
+  for (auto const &plan : m_meshes.instances) {
+
+    glm::mat3x4          rtxT             = glm::transpose(plan.world_matrix);
     VkTransformMatrixKHR transform_matrix = {};
     memcpy(&transform_matrix, glm::value_ptr(rtxT), sizeof(VkTransformMatrixKHR));
 
     VkAccelerationStructureDeviceAddressInfoKHR acceleration_device_address_info{};
     acceleration_device_address_info.sType                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-    acceleration_device_address_info.accelerationStructure = m_meshes.blases[node.primitive_mesh].handle;
+    acceleration_device_address_info.accelerationStructure = m_meshes.blases[plan.blas].handle;
     auto device_address                                    = vkGetAccelerationStructureDeviceAddressKHR(context.device(), &acceleration_device_address_info);
 
     VkAccelerationStructureInstanceKHR instance{};
     instance.transform                              = transform_matrix;
-    instance.instanceCustomIndex                    = node.primitive_mesh;
+    instance.instanceCustomIndex                    = plan.first_geometry;
     instance.accelerationStructureReference         = device_address;
     instance.flags                                  = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
     instance.mask                                   = 0xFF;
@@ -261,395 +368,592 @@ void RayTracer::load_gltf_scene(std::string_view file_path) {
   // create tlas
   create_tlas();
 
+  m_profiler->resolve_load_zones();
+  for (auto const &stats : m_profiler->load_stats()) {
+    WINFO("gpu load pass {}: {:.3f} ms in {} zone(s)", stats.name, stats.last_ms, stats.samples);
+  }
+
   init_descriptors();
 
   // init_descriptors();
   create_pipeline();
+
+  reset_frame();
 }
 
 void RayTracer::load_gltf_raw(std::string_view file_path) {
-  if (!std::filesystem::exists(file_path)) {
-    WERROR("Cant parse gltf scene: file not found - {}", file_path);
-    throw std::runtime_error("cant find gltf scene");
-  }
-  tinygltf::TinyGLTF loader{};
-  std::string        warning{};
-  std::string        error{};
-  tinygltf::Model    tmodel{};
+  WTRACE_FUNCTION();
+  gltf_load_options_t options = {
+    .use_scene_cache = m_options.use_scene_cache,     //
+    .stream_buffers  = m_options.stream_gltf_buffers, //
+    .optimize_meshes = m_options.optimize_meshes,
+  };
+  gltf_load_stats_t stats = load_gltf(file_path, m_meshes.raw, *m_thread_pool, options);
 
-  bool res = loader.LoadASCIIFromFile(&tmodel, &error, &warning, std::string(file_path));
+  m_texture_stats.decode_threads = stats.decode_threads;
+  m_texture_stats.decode_ms      = stats.image_decode_ms;
+}
 
-  if (not warning.empty()) {
-    WERROR(" GLTF WARNING: {}", warning);
-  }
+void RayTracer::load_obj_raw(std::string_view file_path) {
+  WTRACE_FUNCTION();
+  obj_load_options_t options = { .use_scene_cache = m_options.use_scene_cache, .optimize_meshes = m_options.optimize_meshes };
+  obj_load_stats_t   stats   = load_obj(file_path, m_meshes.raw, *m_thread_pool, options);
+
+  m_texture_stats.decode_threads = stats.parse_threads;
+  m_texture_stats.decode_ms      = stats.image_decode_ms;
+}
 
-  if (not error.empty()) {
-    WERROR("error while loading gltf file {}, message:{}", file_path, error);
+void RayTracer::create_textures(UploadBatch &batch) {
+  WTRACE_FUNCTION();
+  // load default one if nothing is found
+  if (m_meshes.raw.images.empty()) {
+    create_default_texture(batch);
+    return;
   }
 
-  if (not res) {
-    WERROR("some how gltf return error code with empty error string, filename:{}", file_path);
+  m_textures.reserve(m_meshes.raw.images.size());
+  for (auto const &image : m_meshes.raw.images) {
+    m_textures.push_back(create_texture(batch, image.width, image.height, image.data(), VK_FILTER_NEAREST, VK_FILTER_NEAREST));
   }
 
-  // UPDATING MATERIALS
-  m_meshes.raw.materials.reserve(tmodel.materials.size());
+  // pixels are copied into staging arena, they are not needed anymore (and neither is cache file they may point into)
+  m_meshes.raw.images        = {};
+  m_meshes.raw.cache_mapping = {};
+}
 
-  for (auto const &tmat : tmodel.materials) {
-    material    m   = {};
-    auto const &pbr = tmat.pbrMetallicRoughness;
+void RayTracer::load_gltf_device(UploadBatch &batch) {
+  WTRACE_FUNCTION();
+  Context &context = m_context_ref;
 
-    m.base_color_factor  = glm::vec3{ pbr.baseColorFactor[0], pbr.baseColorFactor[1], pbr.baseColorFactor[3] };
-    m.base_color_texture = pbr.baseColorTexture.index;
-    m.roughness_factor   = (float) pbr.roughnessFactor;
-    m.metallic_factor    = (float) pbr.metallicFactor;
-    m.rm_texture         = pbr.metallicRoughnessTexture.index;
-    m.emissive_factor    = tmat.emissiveFactor.size() == 3 ? glm::vec3(tmat.emissiveFactor[0], tmat.emissiveFactor[1], tmat.emissiveFactor[2]) : glm::vec3(0.f);
-    m.e_texture          = tmat.emissiveTexture.index;
-    m.n_texture          = tmat.normalTexture.index;
+  auto flags       = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+  auto build_input = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
 
-    m_meshes.raw.materials.emplace_back(m);
+  vertex_layout_t   layout = m_options.vertex_layout;
+  packed_vertices_t packed = {};
+  if (layout != vertex_layout_t::separate) {
+    packed = pack_vertices(m_meshes.raw, layout, *m_thread_pool);
   }
-  // add default if there is no materials
-  if (m_meshes.raw.materials.empty()) {
-    material m           = {};
-    m.base_color_texture = -1;
-    m.rm_texture         = -1;
-    m.n_texture          = -1;
-    m.e_texture          = -1;
-    m_meshes.raw.materials.push_back(m);
-  }
-
-  int         default_scene = tmodel.defaultScene > -1 ? tmodel.defaultScene : 0;
-  auto const &tscene        = tmodel.scenes[default_scene];
-
-  std::set<i32> used_meshes;
-  WASSERT(not tscene.nodes.empty(), "empty scene =/");
 
-  std::queue<i32> nodes_queue{};
-  for (auto node_idx : tscene.nodes) {
-    nodes_queue.push(node_idx);
+  scene_description scene{};
+  scene.vertex_layout = (u32) layout;
+
+  geometry_stats_t &geometry = m_meshes.geometry_stats;
+  geometry                   = geometry_stats_t{ .layout = layout, .vertex_count = (u32) m_meshes.raw.positions.size() };
+
+  if (layout == vertex_layout_t::separate) {
+    m_meshes.device.pos_buffer    = batch.create_buffer(m_meshes.raw.positions, flags | build_input);
+    m_meshes.device.normal_buffer = batch.create_buffer(m_meshes.raw.normals, flags);
+    m_meshes.device.uv_buffer     = batch.create_buffer(m_meshes.raw.uvs, flags);
+
+    scene.pos_address    = context.get_buffer_device_address(m_meshes.device.pos_buffer.handle);
+    scene.normal_address = context.get_buffer_device_address(m_meshes.device.normal_buffer.handle);
+    scene.uv_address     = context.get_buffer_device_address(m_meshes.device.uv_buffer.handle);
+
+    geometry.vertex_bytes = m_meshes.raw.positions.size() * (sizeof(glm::vec3) + sizeof(glm::vec3) + sizeof(glm::vec2));
+    context.set_debug_name(m_meshes.device.pos_buffer.handle, "position");
+    context.set_debug_name(m_meshes.device.normal_buffer.handle, "normal");
+    context.set_debug_name(m_meshes.device.uv_buffer.handle, "uv");
+  } else {
+    // blas builds read positions straight from packed vertices
+    m_meshes.device.vertex_buffer = batch.create_buffer(packed.bytes, flags | build_input);
+    scene.vertex_address          = context.get_buffer_device_address(m_meshes.device.vertex_buffer.handle);
+
+    geometry.vertex_bytes = packed.bytes.size();
+    context.set_debug_name(m_meshes.device.vertex_buffer.handle, fmt::format("{} vertices", to_string(layout)));
   }
-  // BFS for nodes tree and get all unique meshes
-  while (not nodes_queue.empty()) {
-    i32 node_idx = nodes_queue.front();
-    nodes_queue.pop();
-
-    auto const &tnode = tmodel.nodes[node_idx];
-    if (tnode.mesh > -1) used_meshes.insert(tnode.mesh);
-    for (int child : tnode.children) {
-      nodes_queue.push(child);
+
+  if (layout == vertex_layout_t::quantized) {
+    std::vector<VkTransformMatrixKHR> transforms(packed.dequantize_scales.size());
+    for (usize i = 0; i < transforms.size(); i += 1) {
+      glm::vec3 scale  = packed.dequantize_scales[i];
+      glm::vec3 offset = packed.dequantize_offsets[i];
+      transforms[i]    = VkTransformMatrixKHR{ .matrix = {
+                            { scale.x, 0.f, 0.f, offset.x },
+                            { 0.f, scale.y, 0.f, offset.y },
+                            { 0.f, 0.f, scale.z, offset.z },
+                        } };
     }
+    m_meshes.device.blas_transforms = batch.create_buffer(transforms, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | build_input);
+    context.set_debug_name(m_meshes.device.blas_transforms.handle, "blas dequantize transforms");
   }
 
-  u32 index_count     = 0;
-  u32 primitive_count = 0;
-  for (i32 mesh_idx : used_meshes) {
+  m_meshes.device.index_buffer    = batch.create_buffer(m_meshes.raw.indices, flags | build_input);
+  m_meshes.device.material_buffer = batch.create_buffer(m_meshes.raw.materials, flags);
+  geometry.index_bytes            = m_meshes.raw.indices.size() * sizeof(u32);
+
+  bool quantized = layout == vertex_layout_t::quantized;
+  m_meshes.prim_meshes.reserve(m_meshes.raw.primitive_infos.size());
+  for (usize i = 0; i < m_meshes.raw.primitive_infos.size(); i += 1) {
+    auto const &info = m_meshes.raw.primitive_infos[i];
+    m_meshes.prim_meshes.emplace_back(primitive_shader_info{
+        .index_offset      = info.index_offset,
+        .vertex_offset     = info.vertex_offset,
+        .material_index    = (int) info.material_index,
+        .dequantize_scale  = quantized ? packed.dequantize_scales[i] : glm::vec3{ 1.f },
+        .dequantize_offset = quantized ? packed.dequantize_offsets[i] : glm::vec3{ 0.f },
+    });
+  }
+  m_meshes.device.prim_infos          = batch.create_buffer(m_meshes.prim_meshes, flags);
+  m_meshes.device.geometry_primitives = batch.create_buffer(m_meshes.geometry_primitives, flags);
 
-    std::vector<u32> primitives{};
+  scene.index_address     = context.get_buffer_device_address(m_meshes.device.index_buffer.handle);
+  scene.material_address  = context.get_buffer_device_address(m_meshes.device.material_buffer.handle);
+  scene.prim_info_address = context.get_buffer_device_address(m_meshes.device.prim_infos.handle);
+  scene.geometry_address  = context.get_buffer_device_address(m_meshes.device.geometry_primitives.handle);
 
-    auto const &tmesh = tmodel.meshes[mesh_idx];
-    for (const auto &tprimitive : tmesh.primitives) {
-      if (tprimitive.mode != 4) // Triangle
-        continue;
+  m_description.data.emplace_back(scene);
 
-      const auto &pos_accessor = tmodel.accessors[tprimitive.attributes.find("POSITION")->second];
-      if (tprimitive.indices > -1) {
-        const auto &index_accessor = tmodel.accessors[tprimitive.indices];
-        index_count += static_cast<uint32_t>(index_accessor.count);
-      } else {
-        index_count += static_cast<uint32_t>(pos_accessor.count);
-      }
-      primitives.emplace_back(primitive_count++);
-    }
-    m_meshes.raw.mesh_to_primitives[mesh_idx] = std::move(primitives);
-  }
+  m_description.buffer = batch.create_buffer(m_description.data, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
-  m_meshes.raw.indices.reserve(index_count);
-
-  // Convert all mesh/primitives+ to a single primitive per mesh
-  for (const auto &m : used_meshes) {
-    auto &tmesh = tmodel.meshes[m];
-    for (const auto &tprimitive : tmesh.primitives) {
-      primitive_full_info result_mesh{};
-      result_mesh.material_index = std::max(0, tprimitive.material);
-      result_mesh.vertex_offset  = static_cast<uint32_t>(m_meshes.raw.positions.size());
-      result_mesh.index_offset   = static_cast<uint32_t>(m_meshes.raw.indices.size());
-
-      // TODO: primitive cache?...
-      // INDICES
-      if (tprimitive.indices > -1) {
-        const tinygltf::Accessor &index_accessor = tmodel.accessors[tprimitive.indices];
-
-        auto const &index_buffer_view = tmodel.bufferViews[index_accessor.bufferView];
-        auto const &index_buffer      = tmodel.buffers[index_buffer_view.buffer];
-
-        auto old_size = m_meshes.raw.indices.size();
-        m_meshes.raw.indices.resize(m_meshes.raw.indices.size() + index_accessor.count);
-
-        auto         offset = index_accessor.byteOffset + index_buffer_view.byteOffset;
-        const size_t stride = index_accessor.ByteStride(index_buffer_view);
-        WASSERT(stride != size_t(-1), "??");
-
-        for (int i = 0; i < (int) index_accessor.count; i += 1) {
-          if (index_accessor.componentType == TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT) {
-            m_meshes.raw.indices[i + old_size] = *(u32*) (&index_buffer.data[stride * i + offset]);
-          } else if (index_accessor.componentType == TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT) {
-            m_meshes.raw.indices[i + old_size] = *(u16*) (&index_buffer.data[stride * i + offset]);
-          } else if (index_accessor.componentType == TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE) {
-            m_meshes.raw.indices[i + old_size] = *(u8*) (&index_buffer.data[stride * i + offset]);
-          } else {
-            WASSERT(false, "WHAT THE HELL?");
-          }
-        }
+  WINFO(
+      "{} vertex layout: {} vertices in {:.2f} MB, indices {:.2f} MB", to_string(layout), geometry.vertex_count, //
+      (f64) geometry.vertex_bytes / (1024.0 * 1024.0), (f64) geometry.index_bytes / (1024.0 * 1024.0)
+  );
 
-        result_mesh.index_count = index_accessor.count;
-      } else {
-        // Primitive without indices, creating them
-        const auto &taccessor = tmodel.accessors[tprimitive.attributes.find("POSITION")->second];
-        for (u32 i = 0; i < taccessor.count; i++)
-          m_meshes.raw.indices.push_back(i);
-        result_mesh.index_count = taccessor.count;
-      }
+  context.set_debug_name(m_meshes.device.index_buffer.handle, "index");
+  context.set_debug_name(m_meshes.device.material_buffer.handle, "material");
+  context.set_debug_name(m_meshes.device.prim_infos.handle, "primitive infos");
+  context.set_debug_name(m_meshes.device.geometry_primitives.handle, "instance geometry primitives");
+  context.set_debug_name(m_description.buffer.handle, "scene description");
+}
 
-      // TODO: add cache check
-      // VERTICES
-      auto const &it_pos_accessor = tprimitive.attributes.find("POSITION");
-      WASSERT(it_pos_accessor != tprimitive.attributes.end(), "no position data");
+void RayTracer::plan_blases() {
+  WTRACE_FUNCTION();
+  auto const &primitive_infos = m_meshes.raw.primitive_infos;
+  auto const &nodes           = m_meshes.raw.nodes;
+  u32         merge_triangles = m_options.blas_merge_triangles;
+
+  m_meshes.blas_geometries.clear();
+  m_meshes.instances.clear();
+  m_meshes.node_instances.assign(nodes.size(), 0);
+  m_meshes.geometry_primitives.clear();
+
+  // identical geometry is traced through one blas, so primitives are counted by their geometry owners
+  auto owner_of = [&](u32 primitive) {
+    i32 owner = primitive_infos[primitive].geometry_owner;
+    return owner >= 0 ? (u32) owner : primitive;
+  };
+  std::vector<u32> node_uses(primitive_infos.size(), 0);
+  for (auto const &node : nodes) {
+    node_uses[owner_of((u32) node.primitive_mesh)] += 1;
+  }
 
-      auto const &pos_accessor = tmodel.accessors[it_pos_accessor->second];
-      result_mesh.vertex_count = pos_accessor.count;
-      WASSERT(pos_accessor.componentType == TINYGLTF_PARAMETER_TYPE_FLOAT, "");
-      WASSERT(pos_accessor.type == TINYGLTF_TYPE_VEC3, "");
+  // instanced geometry keeps its shared blas, merging it would build a copy for every node
+  auto mergeable = [&](u32 primitive) {
+    return merge_triangles > 0 and primitive_infos[primitive].index_count / 3 <= merge_triangles and node_uses[owner_of(primitive)] == 1;
+  };
 
-      auto const &pos_buffer_view = tmodel.bufferViews[pos_accessor.bufferView];
-      auto const &pos_buffer      = tmodel.buffers[pos_buffer_view.buffer];
+  std::vector<u32> owner_blases(primitive_infos.size(), ~0u);
+  auto             add_instance = [&](usize node, u32 blas, std::span<u32 const> primitives) {
+    m_meshes.instances.push_back(instance_plan_t{
+        .world_matrix   = nodes[node].world_matrix,
+        .blas           = blas,
+        .first_geometry = (u32) m_meshes.geometry_primitives.size(),
+        .source_node    = nodes[node].source_node,
+    });
+    m_meshes.geometry_primitives.insert(m_meshes.geometry_primitives.end(), primitives.begin(), primitives.end());
+  };
+  auto add_single = [&](usize node) {
+    u32 primitive = (u32) nodes[node].primitive_mesh;
+    u32 owner     = owner_of(primitive);
+    if (owner_blases[owner] == ~0u) {
+      owner_blases[owner] = (u32) m_meshes.blas_geometries.size();
+      m_meshes.blas_geometries.push_back({ owner });
+    }
+    m_meshes.node_instances[node] = (u32) m_meshes.instances.size();
+    add_instance(node, owner_blases[owner], std::span{ &primitive, 1 });
+  };
 
-      auto old_size = m_meshes.raw.positions.size();
-      m_meshes.raw.positions.resize(m_meshes.raw.positions.size() + result_mesh.vertex_count);
+  // only primitives of one source node (gltf node or whole obj file) are merged, they share its transform and never move apart.
+  // loaders emit them consecutively, separate nodes with equal transforms stay separate instances
+  std::vector<usize> merged_nodes{};
+  std::vector<u32>   merged{};
+  for (usize first = 0; first < nodes.size();) {
+    usize last = first + 1;
+    while (last < nodes.size() and nodes[first].source_node >= 0 and nodes[last].source_node == nodes[first].source_node) {
+      last += 1;
+    }
 
-      auto         offset = pos_accessor.byteOffset + pos_buffer_view.byteOffset;
-      const size_t stride = pos_accessor.ByteStride(pos_buffer_view);
-      WASSERT(stride != size_t(-1), "??");
+    // animated nodes keep an instance per primitive, so moving them never drags anything else along
+    bool dynamic = std::ranges::find(m_meshes.dynamic_nodes, nodes[first].source_node) != m_meshes.dynamic_nodes.end();
 
-      for (int i = 0; i < (int) result_mesh.vertex_count; i += 1) {
-        m_meshes.raw.positions[i + old_size] = *(glm::vec3*) (&pos_buffer.data[stride * i + offset]);
+    merged_nodes.clear();
+    merged.clear();
+    for (usize i = first; i < last; i += 1) {
+      if (not dynamic and mergeable((u32) nodes[i].primitive_mesh)) {
+        merged_nodes.push_back(i);
+        merged.push_back((u32) nodes[i].primitive_mesh);
+      } else {
+        add_single(i);
       }
+    }
 
-      auto const &it_norm_accessor = tprimitive.attributes.find("NORMAL");
-      if (it_norm_accessor != tprimitive.attributes.end()) {
-        auto const &norm_accessor = tmodel.accessors[it_norm_accessor->second];
-        WASSERT(norm_accessor.componentType == TINYGLTF_PARAMETER_TYPE_FLOAT, "");
-        WASSERT(norm_accessor.type == TINYGLTF_TYPE_VEC3, "");
-
-        auto const &norm_buffer_view = tmodel.bufferViews[norm_accessor.bufferView];
-        auto const &norm_buffer      = tmodel.buffers[norm_buffer_view.buffer];
+    if (merged.size() == 1) {
+      add_single(merged_nodes.front());
+    } else if (merged.size() > 1) {
+      for (usize node : merged_nodes) {
+        m_meshes.node_instances[node] = (u32) m_meshes.instances.size();
+      }
+      add_instance(first, (u32) m_meshes.blas_geometries.size(), merged);
+      m_meshes.blas_geometries.push_back(merged);
+    }
+    first = last;
+  }
+}
 
-        auto old_norm_size = m_meshes.raw.normals.size();
-        m_meshes.raw.normals.resize(m_meshes.raw.normals.size() + norm_accessor.count);
+void RayTracer::build_blases(ticket_t uploads) {
+  WTRACE_FUNCTION();
+  Context   &context   = m_context_ref;
+  Submitter &submitter = context.submitter();
+  auto       start     = std::chrono::steady_clock::now();
+
+  VkDeviceAddress index_address = context.get_buffer_device_address(m_meshes.device.index_buffer.handle);
+  VkDeviceSize    scratch_align = m_as_prop.minAccelerationStructureScratchOffsetAlignment;
+
+  // positions are the first member of every packed vertex, quantized ones are brought back to object space by per primitive transforms
+  vertex_layout_t layout            = m_meshes.geometry_stats.layout;
+  VkDeviceAddress vertex_address    = 0;
+  VkDeviceAddress transform_address = 0;
+  VkFormat        vertex_format     = VK_FORMAT_R32G32B32_SFLOAT;
+  VkDeviceSize    vertex_stride     = sizeof(glm::vec3);
+  switch (layout) {
+    case vertex_layout_t::separate:
+      vertex_address = context.get_buffer_device_address(m_meshes.device.pos_buffer.handle);
+      break;
+    case vertex_layout_t::interleaved:
+      vertex_address = context.get_buffer_device_address(m_meshes.device.vertex_buffer.handle);
+      vertex_stride  = sizeof(vertex);
+      break;
+    case vertex_layout_t::compressed:
+      vertex_address = context.get_buffer_device_address(m_meshes.device.vertex_buffer.handle);
+      vertex_stride  = sizeof(compressed_vertex);
+      break;
+    case vertex_layout_t::quantized:
+      vertex_address    = context.get_buffer_device_address(m_meshes.device.vertex_buffer.handle);
+      transform_address = context.get_buffer_device_address(m_meshes.device.blas_transforms.handle);
+      vertex_format     = VK_FORMAT_R16G16B16A16_SNORM;
+      vertex_stride     = sizeof(quantized_vertex);
+      break;
+  }
 
-        auto         norm_offset = norm_accessor.byteOffset + norm_buffer_view.byteOffset;
-        const size_t norm_stride = norm_accessor.ByteStride(norm_buffer_view);
-        WASSERT(norm_stride != size_t(-1), "??");
+  // every geometry of every blas reads ranges of one primitive, see plan_blases
+  auto const &primitive_infos = m_meshes.raw.primitive_infos;
+  auto const &blas_geometries = m_meshes.blas_geometries;
+
+  usize              blas_count = blas_geometries.size();
+  std::vector<usize> first_geometries(blas_count);
+  std::vector<u64>   blas_triangles(blas_count, 0);
+  usize              geometry_count = 0;
+  for (usize i = 0; i < blas_count; i += 1) {
+    first_geometries[i] = geometry_count;
+    geometry_count += blas_geometries[i].size();
+    for (u32 primitive : blas_geometries[i]) {
+      blas_triangles[i] += primitive_infos[primitive].index_count / 3;
+    }
+  }
+  m_meshes.blases.resize(blas_count);
 
-        for (int i = 0; i < (int) norm_accessor.count; i += 1) {
-          m_meshes.raw.normals[i + old_norm_size] = *(glm::vec3*) (&norm_buffer.data[norm_stride * i + norm_offset]);
-        }
-      } else {
-        // generating normals
-        std::vector<glm::vec3> normals(result_mesh.vertex_count);
-        for (size_t i = 0; i < index_count; i += 3) {
-          uint32_t    ind0 = m_meshes.raw.indices[result_mesh.index_offset + i + 0];
-          uint32_t    ind1 = m_meshes.raw.indices[result_mesh.index_offset + i + 1];
-          uint32_t    ind2 = m_meshes.raw.indices[result_mesh.index_offset + i + 2];
-          const auto &pos0 = m_meshes.raw.positions[ind0 + result_mesh.vertex_offset];
-          const auto &pos1 = m_meshes.raw.positions[ind1 + result_mesh.vertex_offset];
-          const auto &pos2 = m_meshes.raw.positions[ind2 + result_mesh.vertex_offset];
-          const auto  v1   = glm::normalize(pos1 - pos0); // Many normalize, but when objects are really small the
-          const auto  v2   = glm::normalize(pos2 - pos0); // cross will go below nv_eps and the normal will be (0,0,0)
-          const auto  n    = glm::cross(v1, v2);
-          normals[ind0] += n;
-          normals[ind1] += n;
-          normals[ind2] += n;
-        }
-        for (auto &n : normals)
-          n = glm::normalize(n);
-        m_meshes.raw.normals.insert(m_meshes.raw.normals.end(), normals.begin(), normals.end());
-      }
+  bool                                 compact     = m_options.compact_blas;
+  VkBuildAccelerationStructureFlagsKHR build_flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+  if (compact) {
+    build_flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+  }
 
-      // UVS
-      auto const &it_uv_accessor = tprimitive.attributes.find("TEXCOORD_0");
-      if (it_uv_accessor != tprimitive.attributes.end()) {
-        auto const &uv_accessor = tmodel.accessors[it_uv_accessor->second];
-        WASSERT(uv_accessor.componentType == TINYGLTF_PARAMETER_TYPE_FLOAT, "");
-        WASSERT(uv_accessor.type == TINYGLTF_TYPE_VEC2, "");
+  // build descriptions are referenced by pointers, so they have to stay alive (and unmoved) until every batch is recorded
+  std::vector<VkAccelerationStructureGeometryKHR>          geometries(geometry_count);
+  std::vector<VkAccelerationStructureBuildRangeInfoKHR>    ranges(geometry_count);
+  std::vector<u32>                                         max_primitive_counts(geometry_count);
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR> build_infos(blas_count);
+  std::vector<VkDeviceSize>                                scratch_sizes(blas_count);
+  std::vector<VkDeviceSize>                                blas_sizes(blas_count);
+  std::vector<VkDeviceSize>                                compacted_sizes(blas_count);
+
+  blas_build_stats_t stats = {};
+  stats.blas_count         = (u32) blas_count;
+  stats.geometry_count     = (u32) geometry_count;
+  stats.instance_count     = (u32) m_meshes.instances.size();
+
+  // 1. query all build sizes up front and create acceleration structures
+  for (usize i = 0; i < blas_count; i += 1) {
+    usize first_geometry = first_geometries[i];
+    for (usize g = 0; g < blas_geometries[i].size(); g += 1) {
+      u32                        primitive_index = blas_geometries[i][g];
+      primitive_full_info const &primitive       = primitive_infos[primitive_index];
+      usize                      geometry        = first_geometry + g;
+
+      VkAccelerationStructureGeometryTrianglesDataKHR triangles{};
+      triangles.sType                       = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+      triangles.vertexFormat                = vertex_format;
+      triangles.vertexData.deviceAddress    = vertex_address;
+      triangles.vertexStride                = vertex_stride;
+      triangles.indexType                   = VK_INDEX_TYPE_UINT32;
+      triangles.indexData.deviceAddress     = index_address;
+      triangles.transformData.deviceAddress = transform_address;
+      triangles.maxVertex                   = primitive.vertex_count;
+
+      geometries[geometry].sType              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+      geometries[geometry].geometryType       = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+      geometries[geometry].flags              = VK_GEOMETRY_NO_DUPLICATE_ANY_HIT_INVOCATION_BIT_KHR;
+      geometries[geometry].geometry.triangles = triangles;
+
+      max_primitive_counts[geometry] = primitive.index_count / 3;
+
+      ranges[geometry].firstVertex     = primitive.vertex_offset;
+      ranges[geometry].primitiveCount  = max_primitive_counts[geometry];
+      ranges[geometry].primitiveOffset = (u32) (primitive.index_offset * sizeof(u32));
+      ranges[geometry].transformOffset = transform_address != 0 ? (u32) (primitive_index * sizeof(VkTransformMatrixKHR)) : 0;
+    }
+    if (blas_geometries[i].size() > 1) {
+      stats.merged_count += 1;
+    }
 
-        auto const &uv_buffer_view = tmodel.bufferViews[uv_accessor.bufferView];
-        auto const &uv_buffer      = tmodel.buffers[uv_buffer_view.buffer];
+    build_infos[i].sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    build_infos[i].type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    build_infos[i].flags         = build_flags;
+    build_infos[i].mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    build_infos[i].geometryCount = (u32) blas_geometries[i].size();
+    build_infos[i].pGeometries   = &geometries[first_geometry];
 
-        auto old_uv_size = m_meshes.raw.uvs.size();
-        m_meshes.raw.uvs.resize(m_meshes.raw.uvs.size() + uv_accessor.count);
+    VkAccelerationStructureBuildSizesInfoKHR sizes_info{};
+    sizes_info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
 
-        auto         uv_offset = uv_accessor.byteOffset + uv_buffer_view.byteOffset;
-        const size_t uv_stride = uv_accessor.ByteStride(uv_buffer_view);
-        WASSERT(uv_stride != size_t(-1), "??");
+    vkGetAccelerationStructureBuildSizesKHR(
+        context.device(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &build_infos[i], &max_primitive_counts[first_geometry], &sizes_info
+    );
 
-        for (int i = 0; i < (int) uv_accessor.count; i += 1) {
-          m_meshes.raw.uvs[i + old_uv_size] = *(glm::vec2*) (&uv_buffer.data[uv_stride * i + uv_offset]);
-        }
-      } else {
-        m_meshes.raw.uvs.insert(m_meshes.raw.uvs.end(), pos_accessor.count, glm::vec2(0, 0));
-      }
+    m_meshes.blases[i] = create_acceleration_structure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizes_info.accelerationStructureSize);
+    build_infos[i].dstAccelerationStructure = m_meshes.blases[i].handle;
 
-      m_meshes.raw.primitive_infos.push_back(result_mesh);
-    }
+    scratch_sizes[i]   = align_up(sizes_info.buildScratchSize, scratch_align);
+    blas_sizes[i]      = sizes_info.accelerationStructureSize;
+    compacted_sizes[i] = sizes_info.accelerationStructureSize;
+    stats.blas_bytes += sizes_info.accelerationStructureSize;
   }
 
-  // proccess all nodes
+  // 2. split builds into batches, every batch has to fit into scratch budget (except single huge build)
+  struct batch_t {
+    usize        first        = 0;
+    usize        count        = 0;
+    VkDeviceSize scratch_size = 0;
+  };
 
-  for (auto node_idx : tscene.nodes) {
-    process_node(tmodel, node_idx, glm::scale(glm::mat4{1.f}, glm::vec3{-1.f, 1.f, 1.f}));
+  std::vector<batch_t> batches{};
+  for (usize i = 0; i < blas_count; i += 1) {
+    if (batches.empty() or batches.back().scratch_size + scratch_sizes[i] > blas_scratch_budget) {
+      batches.push_back(batch_t{ .first = i });
+    }
+    batches.back().count += 1;
+    batches.back().scratch_size += scratch_sizes[i];
   }
 
-  // LOAD ALL TEXTURES (load default one if nothing is found)
-  if (tmodel.textures.empty()) {
-    create_default_texture();
+  // 3. one scratch arena shared by all batches
+  for (auto const &batch : batches) {
+    stats.scratch_bytes = std::max(stats.scratch_bytes, batch.scratch_size);
   }
 
-  for (auto &texture : tmodel.textures) {
-    auto &image = tmodel.images[texture.source];
+  buffer_t scratch_arena = {};
+  if (stats.scratch_bytes > 0) {
+    VkBufferCreateInfo scratch_buffer_info{};
+    scratch_buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    scratch_buffer_info.usage       = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    scratch_buffer_info.size        = stats.scratch_bytes;
+    scratch_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    WASSERT(image.bits == 8, "TODO");
+    VmaAllocationCreateInfo scratch_buffer_alloc = {};
+    scratch_buffer_alloc.usage                   = VMA_MEMORY_USAGE_GPU_ONLY;
 
-    m_textures.push_back(create_texture(image.width, image.height, image.image, VK_FILTER_NEAREST, VK_FILTER_NEAREST));
+    check(
+        vmaCreateBufferWithAlignment(
+            context.vma_allocator(),                     //
+            &scratch_buffer_info, &scratch_buffer_alloc, //
+            scratch_align,                               //
+            &scratch_arena.handle, &scratch_arena.allocation, nullptr
+        ),
+        "creating scratch arena for blas builds"
+    );
+    context.set_debug_name(scratch_arena.handle, "blas scratch arena");
   }
-}
 
-void RayTracer::process_node(const tinygltf::Model &tmodel, int &node_idx, const glm::mat4 &parent_matrix) {
-  const auto &tnode = tmodel.nodes[node_idx];
+  // compacted sizes are queried right after every batch
+  handle<VkQueryPool> query_pool = VK_NULL_HANDLE;
+  if (compact and not batches.empty()) {
+    usize max_batch_count = 0;
+    for (auto const &batch : batches) {
+      max_batch_count = std::max(max_batch_count, batch.count);
+    }
 
-  glm::mat4 translation_matrix = 1;
-  glm::mat4 scale_matrix       = 1;
-  glm::mat4 rotation_matrix    = 1;
-  glm::mat4 node_matrix        = 1;
-  glm::quat rotation{};
+    VkQueryPoolCreateInfo query_pool_info{};
+    query_pool_info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+    query_pool_info.queryCount = (u32) max_batch_count;
 
-  if (not tnode.translation.empty())
-    translation_matrix = glm::translate(glm::mat4(1), glm::vec3(tnode.translation[0], tnode.translation[1], tnode.translation[2]));
-  if (not tnode.scale.empty()) {
-    scale_matrix = glm::scale(glm::mat4(1), glm::vec3(tnode.scale[0], tnode.scale[1], tnode.scale[2]));
-  }
-  if (not tnode.rotation.empty()) {
-    rotation        = glm::make_quat(tnode.rotation.data());
-    rotation_matrix = glm::mat4_cast(rotation);
-  }
-  if (!tnode.matrix.empty()) {
-    node_matrix = glm::make_mat4(tnode.matrix.data());
+    check(
+        vkCreateQueryPool(context.device(), &query_pool_info, nullptr, &query_pool), //
+        "creating query pool for blas compaction"
+    );
   }
 
-  glm::mat4 matrix       = translation_matrix * rotation_matrix * scale_matrix * node_matrix;
-  glm::mat4 world_matrix = parent_matrix * matrix;
+  // 4. record every batch with a single build command and a single submit,
+  //    batches share scratch arena, so each one waits on gpu for previous one, cpu waits only for compacted sizes
+  std::vector<VkAccelerationStructureBuildRangeInfoKHR const*> range_ptrs{};
+  std::vector<VkAccelerationStructureKHR>                      batch_handles{};
+  ticket_t                                                     previous = uploads;
+  for (auto const &batch : batches) {
+    VkDeviceAddress scratch_address = context.get_buffer_device_address(scratch_arena.handle);
+
+    range_ptrs.clear();
+    batch_handles.clear();
+    for (usize i = batch.first; i < batch.first + batch.count; i += 1) {
+      build_infos[i].scratchData.deviceAddress = scratch_address;
+      scratch_address += scratch_sizes[i];
+      range_ptrs.push_back(&ranges[first_geometries[i]]);
+      batch_handles.push_back(m_meshes.blases[i].handle);
+    }
 
-  if (tnode.mesh > -1) {
-    const auto &meshes = m_meshes.raw.mesh_to_primitives[tnode.mesh]; // A mesh could have many primitives
-    for (const auto &mesh : meshes) {
-      node node;
-      node.primitive_mesh = mesh;
-      node.world_matrix   = world_matrix;
-      m_meshes.raw.nodes.emplace_back(node);
+    auto record_build = [&](VkCommandBuffer cmd) {
+      u32 zone = m_profiler->begin_load_zone(cmd, "blas build");
+      vkCmdBuildAccelerationStructuresKHR(cmd, (u32) batch.count, &build_infos[batch.first], range_ptrs.data());
+      m_profiler->end_load_zone(cmd, zone);
+
+      if (compact) {
+        // compacted size is available only after the build is finished
+        VkMemoryBarrier barrier{};
+        barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+        barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+        vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, //
+            1, &barrier, 0, nullptr, 0, nullptr
+        );
+
+        vkCmdResetQueryPool(cmd, query_pool, 0, (u32) batch.count);
+        vkCmdWriteAccelerationStructuresPropertiesKHR(
+            cmd, (u32) batch.count, batch_handles.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, query_pool, 0
+        );
+      }
+    };
+    previous = submitter.submit(record_build, std::span{ &previous, 1 });
+    stats.submit_count += 1;
+
+    if (not compact) {
+      continue;
     }
-  }
+    submitter.wait(previous);
 
-  for (auto child : tnode.children) {
-    process_node(tmodel, child, world_matrix);
-  }
-}
+    // 5. copy every BLAS of the batch into tightly sized buffer and free the original one
+    check(
+        vkGetQueryPoolResults(
+            context.device(), query_pool, 0, (u32) batch.count,                                            //
+            batch.count * sizeof(VkDeviceSize), &compacted_sizes[batch.first], sizeof(VkDeviceSize), //
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+        ),
+        "getting compacted blas sizes"
+    );
 
-void RayTracer::load_gltf_device() {
-  Context &context = m_context_ref;
+    std::vector<acceleration_structure_t> compacted(batch.count);
+    for (usize j = 0; j < batch.count; j += 1) {
+      compacted[j] = create_acceleration_structure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compacted_sizes[batch.first + j]);
+    }
+
+    context.immediate_submit([&](VkCommandBuffer cmd) {
+      u32 zone = m_profiler->begin_load_zone(cmd, "blas compaction");
+      for (usize j = 0; j < batch.count; j += 1) {
+        VkCopyAccelerationStructureInfoKHR copy_info{};
+        copy_info.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+        copy_info.src   = m_meshes.blases[batch.first + j].handle;
+        copy_info.dst   = compacted[j].handle;
+        copy_info.mode  = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+        vkCmdCopyAccelerationStructureKHR(cmd, &copy_info);
+      }
+      m_profiler->end_load_zone(cmd, zone);
+    });
+    stats.submit_count += 1;
 
-  auto flags                      = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-  m_meshes.device.pos_buffer      = context.create_buffer(m_meshes.raw.positions, flags | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
-  m_meshes.device.index_buffer    = context.create_buffer(m_meshes.raw.indices, flags | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
-  m_meshes.device.normal_buffer   = context.create_buffer(m_meshes.raw.normals, flags);
-  m_meshes.device.uv_buffer       = context.create_buffer(m_meshes.raw.uvs, flags);
-  m_meshes.device.material_buffer = context.create_buffer(m_meshes.raw.materials, flags);
-
-  m_meshes.raw.prim_meshes.reserve(m_meshes.raw.primitive_infos.size());
-  for (auto &info : m_meshes.raw.primitive_infos) {
-    m_meshes.raw.prim_meshes.emplace_back(primitive_shader_info                           //
-                                          {
-                                              .index_offset   = info.index_offset,        //
-                                              .vertex_offset  = info.vertex_offset,       //
-                                              .material_index = (int) info.material_index //
-                                          });
+    for (usize j = 0; j < batch.count; j += 1) {
+      auto &blas = m_meshes.blases[batch.first + j];
+      vkDestroyAccelerationStructureKHR(context.device(), blas.handle, nullptr);
+      vmaDestroyBuffer(context.vma_allocator(), blas.buffer.handle, blas.buffer.allocation);
+      blas = std::move(compacted[j]);
+    }
   }
-  m_meshes.device.prim_infos = context.create_buffer(m_meshes.raw.prim_meshes, flags);
 
-  scene_description scene{};
-  scene.pos_address       = context.get_buffer_device_address(m_meshes.device.pos_buffer.handle);
-  scene.index_address     = context.get_buffer_device_address(m_meshes.device.index_buffer.handle);
-  scene.normal_address    = context.get_buffer_device_address(m_meshes.device.normal_buffer.handle);
-  scene.uv_address        = context.get_buffer_device_address(m_meshes.device.uv_buffer.handle);
-  scene.material_address  = context.get_buffer_device_address(m_meshes.device.material_buffer.handle);
-  scene.prim_info_address = context.get_buffer_device_address(m_meshes.device.prim_infos.handle);
+  submitter.wait(previous);
+  vkDestroyQueryPool(context.device(), query_pool, nullptr);
+  vmaDestroyBuffer(context.vma_allocator(), scratch_arena.handle, scratch_arena.allocation);
 
-  m_description.data.emplace_back(scene);
+  for (usize i = 0; i < blas_count; i += 1) {
+    stats.compacted_bytes += compacted_sizes[i];
+  }
 
-  m_description.buffer = context.create_buffer(m_description.data, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  // every instance after the first one of a blas would have needed its own copy without sharing
+  std::vector<bool> instanced(blas_count, false);
+  u64               built_triangles  = std::accumulate(blas_triangles.begin(), blas_triangles.end(), u64{ 0 });
+  u64               shared_triangles = 0;
+  for (auto const &plan : m_meshes.instances) {
+    if (instanced[plan.blas]) {
+      stats.shared_count += 1;
+      stats.shared_bytes += compacted_sizes[plan.blas];
+      shared_triangles += blas_triangles[plan.blas];
+    }
+    instanced[plan.blas] = true;
+  }
 
-  context.set_debug_name(m_meshes.device.pos_buffer.handle, "position");
-  context.set_debug_name(m_meshes.device.index_buffer.handle, "index");
-  context.set_debug_name(m_meshes.device.normal_buffer.handle, "normal");
-  context.set_debug_name(m_meshes.device.uv_buffer.handle, "uv");
-  context.set_debug_name(m_meshes.device.material_buffer.handle, "material");
-  context.set_debug_name(m_meshes.device.prim_infos.handle, "primitive infos");
-  context.set_debug_name(m_description.buffer.handle, "scene description");
-}
+  if (compact) {
+    // report is grouped by gltf meshes, sorted to keep it stable between runs. merged blas counts for mesh of its first geometry
+    std::vector<i32> primitive_meshes(primitive_infos.size(), -1);
+    std::vector<i32> mesh_indices{};
+    for (auto const &[mesh_idx, primitives] : m_meshes.raw.mesh_to_primitives) {
+      mesh_indices.push_back(mesh_idx);
+      for (u32 primitive : primitives) {
+        primitive_meshes[primitive] = mesh_idx;
+      }
+    }
+    std::sort(mesh_indices.begin(), mesh_indices.end());
+
+    for (i32 mesh_idx : mesh_indices) {
+      VkDeviceSize before = 0, after = 0;
+      for (usize i = 0; i < blas_count; i += 1) {
+        if (primitive_meshes[blas_geometries[i].front()] == mesh_idx) {
+          before += blas_sizes[i];
+          after += compacted_sizes[i];
+        }
+      }
+      WINFO("BLAS compaction, mesh #{}: {:.1f} KiB -> {:.1f} KiB", mesh_idx, (f64) before / 1024., (f64) after / 1024.);
+    }
 
-void RayTracer::load_primitive_to_blas(primitive_full_info &primitive, acceleration_structure_t &blas) {
-  Context const &context = m_context_ref;
+    WINFO(
+        "BLAS compaction, scene: {:.2f} MiB -> {:.2f} MiB ({:.1f}% saved)",                       //
+        (f64) stats.blas_bytes / (1024. * 1024.), (f64) stats.compacted_bytes / (1024. * 1024.), //
+        stats.blas_bytes > 0 ? 100. * (1. - (f64) stats.compacted_bytes / (f64) stats.blas_bytes) : 0.
+    );
+  }
 
-  VkDeviceAddress vertex_address      = context.get_buffer_device_address(m_meshes.device.pos_buffer.handle);
-  VkDeviceAddress index_address       = context.get_buffer_device_address(m_meshes.device.index_buffer.handle);
-  u32             max_primitive_count = primitive.index_count / 3;
-
-  // Describe buffer as array of VertexObj.
-  VkAccelerationStructureGeometryTrianglesDataKHR triangles{};
-  triangles.sType                    = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-  triangles.vertexFormat             = VK_FORMAT_R32G32B32_SFLOAT;
-  triangles.vertexData.deviceAddress = vertex_address;
-  triangles.vertexStride             = sizeof(glm::vec3);
-  triangles.indexType                = VK_INDEX_TYPE_UINT32;
-  triangles.indexData.deviceAddress  = index_address;
-  triangles.maxVertex                = primitive.vertex_count;
-
-  // The bottom level acceleration structure contains one set of triangles as the input geometry
-  VkAccelerationStructureGeometryKHR acceleration_structure_geometry{};
-  acceleration_structure_geometry.sType              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-  acceleration_structure_geometry.geometryType       = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-  acceleration_structure_geometry.flags              = VK_GEOMETRY_NO_DUPLICATE_ANY_HIT_INVOCATION_BIT_KHR;
-  acceleration_structure_geometry.geometry.triangles = triangles;
+  stats.build_ms       = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+  stats.saved_build_ms = built_triangles > 0 ? stats.build_ms * (f64) shared_triangles / (f64) built_triangles : 0.0;
 
-  // Get the size requirements for buffers involved in the acceleration structure build process
-  VkAccelerationStructureBuildGeometryInfoKHR acceleration_structure_build_geometry_info{};
-  acceleration_structure_build_geometry_info.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-  acceleration_structure_build_geometry_info.type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-  acceleration_structure_build_geometry_info.flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-  acceleration_structure_build_geometry_info.geometryCount = 1;
-  acceleration_structure_build_geometry_info.pGeometries   = &acceleration_structure_geometry;
+  m_meshes.blas_stats = stats;
+  WINFO(
+      "built {} BLAS ({} merged, {} geometries, {} instances) in {} submit(s) in {:.2f} ms, scratch arena: {:.2f} MiB, BLAS memory: {:.2f} MiB", //
+      stats.blas_count, stats.merged_count, stats.geometry_count, stats.instance_count, stats.submit_count, stats.build_ms,                     //
+      (f64) stats.scratch_bytes / (1024. * 1024.), (f64) stats.compacted_bytes / (1024. * 1024.)
+  );
+  if (stats.shared_count > 0) {
+    WINFO(
+        "BLAS sharing: {} instances reuse BLAS of identical geometry, saved {:.2f} MiB and ~{:.2f} ms of builds", //
+        stats.shared_count, (f64) stats.shared_bytes / (1024. * 1024.), stats.saved_build_ms
+    );
+  }
+}
 
-  VkAccelerationStructureBuildSizesInfoKHR acceleration_structure_build_sizes_info{};
-  acceleration_structure_build_sizes_info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+acceleration_structure_t RayTracer::create_acceleration_structure(VkAccelerationStructureTypeKHR type, VkDeviceSize size) {
+  Context &context = m_context_ref;
 
-  vkGetAccelerationStructureBuildSizesKHR(
-      context.device(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &acceleration_structure_build_geometry_info, &max_primitive_count,
-      &acceleration_structure_build_sizes_info
-  );
+  acceleration_structure_t result = {};
 
   VkBufferCreateInfo acc_buffer_info{};
   acc_buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   acc_buffer_info.usage       = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-  acc_buffer_info.size        = acceleration_structure_build_sizes_info.accelerationStructureSize;
+  acc_buffer_info.size        = size;
   acc_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
   VmaAllocationCreateInfo acc_buffer_alloc{};
@@ -659,136 +963,195 @@ void RayTracer::load_primitive_to_blas(primitive_full_info &primitive, accelerat
       vmaCreateBuffer(
           context.vma_allocator(),             //
           &acc_buffer_info, &acc_buffer_alloc, //
-          &blas.buffer.handle, &blas.buffer.allocation, nullptr
+          &result.buffer.handle, &result.buffer.allocation, nullptr
       ),
-      "creating buffer for blas"
+      "creating buffer for acceleration structure"
   );
-  context.set_debug_name(blas.buffer.handle, fmt::format("blas buffer for mesh"));
+  context.set_debug_name(result.buffer.handle, type == VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR ? "blas buffer" : "tlas buffer");
 
-  // Create the acceleration structure
   VkAccelerationStructureCreateInfoKHR acceleration_structure_create_info{};
   acceleration_structure_create_info.sType  = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-  acceleration_structure_create_info.buffer = blas.buffer.handle;
-  acceleration_structure_create_info.size   = acceleration_structure_build_sizes_info.accelerationStructureSize;
-  acceleration_structure_create_info.type   = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-
-  check(vkCreateAccelerationStructureKHR(context.device(), &acceleration_structure_create_info, nullptr, &blas.handle));
-
-  // The actual build process starts here
-
-  buffer_t           scratch_buffer = {};
-  VkBufferCreateInfo scratch_buffer_info{};
-  scratch_buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  scratch_buffer_info.usage       = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-  scratch_buffer_info.size        = acceleration_structure_build_sizes_info.buildScratchSize;
-  scratch_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-  VmaAllocationCreateInfo scratch_buffer_alloc = {};
-  scratch_buffer_alloc.usage                   = VMA_MEMORY_USAGE_CPU_TO_GPU;
+  acceleration_structure_create_info.buffer = result.buffer.handle;
+  acceleration_structure_create_info.size   = size;
+  acceleration_structure_create_info.type   = type;
 
   check(
-      vmaCreateBuffer(
-          context.vma_allocator(),                     //
-          &scratch_buffer_info, &scratch_buffer_alloc, //
-          &scratch_buffer.handle, &scratch_buffer.allocation, nullptr
-      ),
-      "creating scratch buffer for blas"
+      vkCreateAccelerationStructureKHR(context.device(), &acceleration_structure_create_info, nullptr, &result.handle), //
+      "creating acceleration structure"
   );
 
-  VkAccelerationStructureBuildGeometryInfoKHR acceleration_build_geometry_info{};
-  acceleration_build_geometry_info.sType                     = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-  acceleration_build_geometry_info.type                      = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-  acceleration_build_geometry_info.flags                     = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-  acceleration_build_geometry_info.mode                      = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-  acceleration_build_geometry_info.dstAccelerationStructure  = blas.handle;
-  acceleration_build_geometry_info.geometryCount             = 1;
-  acceleration_build_geometry_info.pGeometries               = &acceleration_structure_geometry;
-  acceleration_build_geometry_info.scratchData.deviceAddress = context.get_buffer_device_address(scratch_buffer.handle);
-
-  VkAccelerationStructureBuildRangeInfoKHR acceleration_structure_build_range_info;
-  acceleration_structure_build_range_info.firstVertex     = primitive.vertex_offset;
-  acceleration_structure_build_range_info.primitiveCount  = max_primitive_count;
-  acceleration_structure_build_range_info.primitiveOffset = primitive.index_offset * sizeof(uint32_t);
-  acceleration_structure_build_range_info.transformOffset = 0;
-
-  std::array<VkAccelerationStructureBuildRangeInfoKHR*, 1> acceleration_build_structure_range_infos = { &acceleration_structure_build_range_info };
-
-  context.immediate_submit([&](VkCommandBuffer cmd) {
-    vkCmdBuildAccelerationStructuresKHR(cmd, 1, &acceleration_build_geometry_info, acceleration_build_structure_range_infos.data());
-  });
-
-  vmaDestroyBuffer(context.vma_allocator(), scratch_buffer.handle, scratch_buffer.allocation);
+  return result;
 }
 
 void RayTracer::draw() {
+  WTRACE_FUNCTION();
   Context const &context = m_context_ref;
 
+  using clock     = std::chrono::steady_clock;
+  auto draw_start = clock::now();
+
   // ---------- IMGUI ----------------
   ImGui_ImplVulkan_NewFrame();
   ImGui_ImplGlfw_NewFrame();
   ImGui::NewFrame();
 
-  ImGui::ShowDemoWindow();
+  draw_accumulation_ui();
+  draw_pacing_ui();
+  m_profiler->draw_ui();
 
   ImGui::Render();
 
-  // --------- GETTING AN IMAGE -----------------
-  constexpr u64       no_timeout = std::numeric_limits<u64>::max();
-  render_frame_data_t frame      = m_frames[m_current_frame];
-  // wait until the gpu has finished rendering the last frame
-  check(
-      vkWaitForFences(context.device(), 1, &frame.fence, true, no_timeout), //
-      fmt::format("waiting for render fence #{}", m_current_frame)
-  );
+  // --------- WAITING FOR FRAME SLOT -----------------
+  constexpr u64        no_timeout = std::numeric_limits<u64>::max();
+  render_frame_data_t &frame      = m_frames[m_current_frame];
+  // wait until the gpu has finished frame submitted frames_in_flight draws ago, newer frames keep it busy meanwhile
+  auto fence_wait_start = clock::now();
+  {
+    WTRACE_ZONE("wait frame fence");
+    check(
+        vkWaitForFences(context.device(), 1, &frame.fence, true, no_timeout), //
+        fmt::format("waiting for render fence #{}", m_current_frame)
+    );
+  }
+  auto fence_wait_end = clock::now();
 
-  u32 image_index = 0;
-  check(
-      vkAcquireNextImageKHR(
-          context.device(),      //
-          context.swapchain(),   //
-          no_timeout,            //
-          frame.image_semaphore, //
-          nullptr,               //
-          &image_index
-      ),                         //
-      "acquiring next image index from swapchain"
-  );
+  m_profiler->begin_frame(m_current_frame);
+
+  // negative uniform and gpu times mean that nothing was traced
+  frame_pacing_stats_t timings{};
+  timings.fence_wait_ms  = std::chrono::duration<f64, std::milli>(fence_wait_end - fence_wait_start).count();
+  timings.trace_gpu_ms   = m_profiler->resolved_ms("trace");
+  timings.uniform_cpu_ms = -1.0;
+
+  // converged image is only presented again, frame costs one fullscreen blit
+  bool trace = update_accumulation(frame, m_current_frame);
 
-  // -------- BEFORE FRAME ------------------
-  check(vkResetCommandBuffer(frame.cmd, 0), "");
   VkCommandBufferBeginInfo begin_info = {};
   begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
   begin_info.pInheritanceInfo         = nullptr;
 
-  check(
-      vkBeginCommandBuffer(frame.cmd, &begin_info), //
-      fmt::format("beginning rendering frame#{}", m_current_frame)
-  );
+  // -------- TRACING ------------------
+  // tracing does not touch swapchain, so it is submitted before image is acquired and gpu starts on it while cpu waits in acquire
+  if (trace) {
+    check(vkResetCommandBuffer(frame.cmd, 0), "");
+    check(
+        vkBeginCommandBuffer(frame.cmd, &begin_info), //
+        fmt::format("beginning tracing frame#{}", m_current_frame)
+    );
 
-  context.transition_image(frame.cmd, context.swapchain_frames()[image_index].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-  context.transition_image(frame.cmd, context.swapchain_frames()[image_index].depth.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+    // noise counter of this frame is zeroed by host before submit
+    VkDeviceSize counter_offset                           = m_current_frame * sizeof(u32);
+    m_accumulation.noise_counters_mapped[m_current_frame] = 0;
+    check(
+        vmaFlushAllocation(context.vma_allocator(), m_accumulation.noise_counters.allocation, counter_offset, sizeof(u32)), //
+        "flushing noise counter"
+    );
+
+    u32 trace_zone = m_profiler->begin_zone(frame.cmd, "trace");
+
+    // moved instances refit tlas before anything traces it
+    record_tlas_update(frame.cmd, m_current_frame);
+
+    // --------------- UPDATING UBO
+    u32  uniforms_zone     = m_profiler->begin_zone(frame.cmd, "uniforms");
+    auto uniform_start     = clock::now();
+    u32  ubo_offset        = update_uniform_buffer(frame.cmd, m_current_frame);
+    timings.uniform_cpu_ms = std::chrono::duration<f64, std::milli>(clock::now() - uniform_start).count();
+    m_profiler->end_zone(frame.cmd, uniforms_zone);
+
+    // previous frame reads storage image in fragment shader and writes it with moments in raygen
+    VkMemoryBarrier accumulation_barrier = {};
+    accumulation_barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    accumulation_barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    accumulation_barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        frame.cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, //
+        1, &accumulation_barrier, 0, nullptr, 0, nullptr
+    );
 
-  // --------------- UPDATING UBO
-  update_uniform_buffer(frame.cmd);
+    // ------------ DRAWING IN THERE -----------------
+    vkCmdBindPipeline(frame.cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline);
+
+    std::array<VkDescriptorSet, 1> sets{ m_descriptor.shared.set };
+    vkCmdBindDescriptorSets(frame.cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline_layout, 0, (u32) sets.size(), sets.data(), 1, &ubo_offset);
+    push_constant_t pc{};
+    pc.mvp                  = glm::mat4{ 1.f };
+    pc.frame                = m_accumulation.samples;
+    pc.noise_threshold      = m_accumulation.samples + 1 >= min_noise_samples ? m_options.noise_threshold : 0.f;
+    pc.moments_address      = m_accumulation.moments_address;
+    pc.noisy_pixels_address = m_accumulation.noise_counters_address + counter_offset;
+
+    vkCmdPushConstants(
+        frame.cmd, m_pipeline_layout,
+        VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_CALLABLE_BIT_KHR, 0,
+        sizeof(push_constant_t), &pc
+    );
+
+    u32 trace_rays_zone = m_profiler->begin_zone(frame.cmd, "trace rays");
+    vkCmdTraceRaysKHR(frame.cmd, &m_gen_region, &m_miss_region, &m_hit_region, &m_call_region, m_storage_image.width, m_storage_image.height, 1);
+    m_profiler->end_zone(frame.cmd, trace_rays_zone);
+
+    // storage image is drawn by present submit right after, noise counter is read by host after fence wait
+    VkMemoryBarrier traced_barrier = {};
+    traced_barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    traced_barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    traced_barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(
+        frame.cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, //
+        1, &traced_barrier, 0, nullptr, 0, nullptr
+    );
 
-  // ------------ DRAWING IN THERE -----------------
-  vkCmdBindPipeline(frame.cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline);
+    m_profiler->end_zone(frame.cmd, trace_zone);
 
-  std::array<VkDescriptorSet, 1> sets{ m_descriptor.shared.set };
-  vkCmdBindDescriptorSets(frame.cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline_layout, 0, (u32) sets.size(), sets.data(), 0, nullptr);
-  push_constant_t pc{};
-  pc.mvp   = glm::mat4{ 1.f };
-  pc.frame = m_shader_frame;
+    check(vkEndCommandBuffer(frame.cmd), fmt::format("ending tracing frame#{}", m_current_frame));
+
+    frame.traced_sample = m_accumulation.samples;
+    m_accumulation.samples += 1;
+
+    // fence is signaled by present submit, it also covers this one as it is submitted earlier to the same queue
+    VkSubmitInfo trace_submit_info       = {};
+    trace_submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    trace_submit_info.commandBufferCount = 1;
+    trace_submit_info.pCommandBuffers    = &frame.cmd;
+
+    auto queue_lock = context.submitter().lock_queues();
+    check(
+        vkQueueSubmit(context.graphics_queue(), 1, &trace_submit_info, VK_NULL_HANDLE), //
+        fmt::format("submitting tracing to graphics queue on frame{}", m_current_frame)
+    );
+  }
 
-  vkCmdPushConstants(
-      frame.cmd, m_pipeline_layout,
-      VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_CALLABLE_BIT_KHR, 0,
-      sizeof(push_constant_t), &pc
+  // --------- GETTING AN IMAGE -----------------
+  auto acquire_start = clock::now();
+  u32  image_index   = 0;
+  {
+    WTRACE_ZONE("acquire swapchain image");
+    check(
+        vkAcquireNextImageKHR(
+            context.device(),      //
+            context.swapchain(),   //
+            no_timeout,            //
+            frame.image_semaphore, //
+            nullptr,               //
+            &image_index
+        ),                         //
+        "acquiring next image index from swapchain"
+    );
+  }
+  timings.acquire_wait_ms = std::chrono::duration<f64, std::milli>(clock::now() - acquire_start).count();
+
+  // -------- BEFORE FRAME ------------------
+  check(vkResetCommandBuffer(frame.present_cmd, 0), "");
+  check(
+      vkBeginCommandBuffer(frame.present_cmd, &begin_info), //
+      fmt::format("beginning rendering frame#{}", m_current_frame)
   );
 
-  VkExtent2D extent = context.swapchain_extent();
-  vkCmdTraceRaysKHR(frame.cmd, &m_gen_region, &m_miss_region, &m_hit_region, &m_call_region, extent.width, extent.height, 1);
+  context.transition_image(frame.present_cmd, context.swapchain_frames()[image_index].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  context.transition_image(
+      frame.present_cmd, context.swapchain_frames()[image_index].depth.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL
+  );
 
   // -------- RENDERING STORAGE IMAGE ---------------------
   VkRect2D render_area = {
@@ -815,13 +1178,15 @@ void RayTracer::draw() {
   render_info.pStencilAttachment   = nullptr;
   render_info.renderArea           = render_area;
 
-  vkCmdBeginRendering(frame.cmd, &render_info);
+  u32 blit_zone = m_profiler->begin_zone(frame.present_cmd, "blit");
+  vkCmdBeginRendering(frame.present_cmd, &render_info);
 
-  vkCmdBindPipeline(frame.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_offscreen.pipeline);
-  vkCmdBindDescriptorSets(frame.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_offscreen.pipeline_layout, 0, 1, &m_offscreen.desc_set, 0, nullptr);
-  vkCmdDraw(frame.cmd, 3, 1, 0, 0);
+  vkCmdBindPipeline(frame.present_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_offscreen.pipeline);
+  vkCmdBindDescriptorSets(frame.present_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_offscreen.pipeline_layout, 0, 1, &m_offscreen.desc_set, 0, nullptr);
+  vkCmdDraw(frame.present_cmd, 3, 1, 0, 0);
 
-  vkCmdEndRendering(frame.cmd);
+  vkCmdEndRendering(frame.present_cmd);
+  m_profiler->end_zone(frame.present_cmd, blit_zone);
 
   // --------------- IMGUI RENDERING-------------
   VkRenderingAttachmentInfo imgui_color_attachment = {};
@@ -840,14 +1205,16 @@ void RayTracer::draw() {
   imgui_render_info.pDepthAttachment     = nullptr;
   imgui_render_info.pStencilAttachment   = nullptr;
 
-  vkCmdBeginRendering(frame.cmd, &imgui_render_info);
-  ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.cmd);
-  vkCmdEndRendering(frame.cmd);
+  u32 imgui_zone = m_profiler->begin_zone(frame.present_cmd, "imgui");
+  vkCmdBeginRendering(frame.present_cmd, &imgui_render_info);
+  ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.present_cmd);
+  vkCmdEndRendering(frame.present_cmd);
+  m_profiler->end_zone(frame.present_cmd, imgui_zone);
 
   // ------------- AFTER FRAME ----------------
-  context.transition_image(frame.cmd, context.swapchain_frames()[image_index].image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  context.transition_image(frame.present_cmd, context.swapchain_frames()[image_index].image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
-  check(vkEndCommandBuffer(frame.cmd), fmt::format("ending rendering frame#{}", m_current_frame));
+  check(vkEndCommandBuffer(frame.present_cmd), fmt::format("ending rendering frame#{}", m_current_frame));
 
   // ---------- SUBMITTING -----------------
   VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -858,12 +1225,15 @@ void RayTracer::draw() {
   submit_info.pWaitSemaphores      = &frame.image_semaphore;
   submit_info.pWaitDstStageMask    = &wait_stage;
   submit_info.commandBufferCount   = 1;
-  submit_info.pCommandBuffers      = &frame.cmd;
+  submit_info.pCommandBuffers      = &frame.present_cmd;
   submit_info.signalSemaphoreCount = 1;
   submit_info.pSignalSemaphores    = &frame.render_semaphore;
 
   check(vkResetFences(context.device(), 1, &frame.fence), "reseting fence");
 
+  // loader threads may submit through Context at the same time
+  auto queue_lock = context.submitter().lock_queues();
+
   check(
       vkQueueSubmit(
           context.graphics_queue(), //
@@ -888,9 +1258,99 @@ void RayTracer::draw() {
       vkQueuePresentKHR(context.present_queue(), &present_info), //
       fmt::format("submitting {} image to present queue in frame{}", image_index, m_current_frame)
   );
+  queue_lock.unlock();
+
+  m_current_frame = (m_current_frame + 1) % (u32) m_frames.size();
+
+  f64 draw_ms   = std::chrono::duration<f64, std::milli>(clock::now() - draw_start).count();
+  timings.cpu_ms = draw_ms - timings.fence_wait_ms - timings.acquire_wait_ms;
+  record_pacing(draw_start, timings);
+}
+
+bool RayTracer::update_accumulation(render_frame_data_t &frame, u32 frame_index) {
+  Context const           &context = m_context_ref;
+  CameraManipulator const &cam     = m_camera_ref;
+
+  if (cam.view_matrix() != m_accumulation.view || cam.proj_matrix() != m_accumulation.proj) {
+    m_accumulation.view = cam.view_matrix();
+    m_accumulation.proj = cam.proj_matrix();
+    reset_frame();
+  }
+
+  // reset_frame() forgets samples in flight, so only counters of current accumulation get there
+  u32 traced_sample   = frame.traced_sample;
+  frame.traced_sample = no_sample;
+  if (m_accumulation.converged) {
+    return false;
+  }
+
+  if (traced_sample != no_sample && traced_sample + 1 >= min_noise_samples && m_options.noise_threshold > 0.f) {
+    check(
+        vmaInvalidateAllocation(context.vma_allocator(), m_accumulation.noise_counters.allocation, frame_index * sizeof(u32), sizeof(u32)), //
+        "invalidating noise counter"
+    );
+    m_accumulation.noisy_pixels = m_accumulation.noise_counters_mapped[frame_index];
+
+    u32 pixel_count = m_storage_image.width * m_storage_image.height;
+    if ((f32) m_accumulation.noisy_pixels <= (f32) pixel_count * max_noisy_pixel_ratio) {
+      finish_accumulation("noise threshold");
+      return false;
+    }
+  }
+
+  if (m_accumulation.samples >= m_options.target_samples) {
+    finish_accumulation("target samples");
+    return false;
+  }
+  return true;
+}
+
+void RayTracer::finish_accumulation(std::string_view reason) {
+  m_accumulation.converged = true;
+  m_accumulation.end       = std::chrono::steady_clock::now();
+
+  accumulation_stats_t stats = accumulation_stats();
+  WINFO(
+      "accumulation stopped by {}: {} samples in {:.2f} s ({:.1f} samples/s), {} noisy pixels", //
+      reason, stats.samples, stats.seconds, stats.samples_per_second, stats.noisy_pixels
+  );
+}
+
+RayTracer::accumulation_stats_t RayTracer::accumulation_stats() const {
+  auto                       end     = m_accumulation.converged ? m_accumulation.end : std::chrono::steady_clock::now();
+  std::chrono::duration<f64> elapsed = end - m_accumulation.start;
+
+  accumulation_stats_t stats{};
+  stats.samples            = m_accumulation.samples;
+  stats.noisy_pixels       = m_accumulation.noisy_pixels;
+  stats.converged          = m_accumulation.converged;
+  stats.seconds            = elapsed.count();
+  stats.samples_per_second = elapsed.count() > 0.0 ? m_accumulation.samples / elapsed.count() : 0.0;
+  return stats;
+}
+
+void RayTracer::draw_accumulation_ui() {
+  accumulation_stats_t stats = accumulation_stats();
+
+  ImGui::Begin("accumulation");
+  ImGui::Text("samples: %u / %u", stats.samples, m_options.target_samples);
+  ImGui::Text("%.1f samples/s", stats.samples_per_second);
+  ImGui::Text(stats.converged ? "converged in %.2f s" : "accumulating for %.2f s", stats.seconds);
+  ImGui::Text("noisy pixels: %u", stats.noisy_pixels);
 
-  m_current_frame = (m_current_frame + 1) / max_frames;
-  m_shader_frame  = std::max(m_shader_frame + 1, m_maxFrames);
+  // stop conditions do not change image, so accumulated samples are kept and accumulation goes on if needed
+  int target_samples = (int) m_options.target_samples;
+  if (ImGui::InputInt("target samples", &target_samples, 64, 1024)) {
+    m_options.target_samples = (u32) std::max(target_samples, 1);
+    m_accumulation.converged = false;
+  }
+  if (ImGui::SliderFloat("noise threshold", &m_options.noise_threshold, 0.f, 0.1f, "%.4f")) {
+    m_accumulation.converged = false;
+  }
+  if (ImGui::Button("restart")) {
+    reset_frame();
+  }
+  ImGui::End();
 }
 
 void RayTracer::create_storage_image() {
@@ -957,25 +1417,126 @@ void RayTracer::create_storage_image() {
   });
 }
 
-void RayTracer::create_uniform_buffer() {
+void RayTracer::record_pacing(std::chrono::steady_clock::time_point draw_start, frame_pacing_stats_t const &timings) {
+  bool first_draw          = m_pacing.last_draw_start == std::chrono::steady_clock::time_point{};
+  f64  frame_ms            = std::chrono::duration<f64, std::milli>(draw_start - m_pacing.last_draw_start).count();
+  m_pacing.last_draw_start = draw_start;
+  if (first_draw) {
+    return;
+  }
+
+  m_pacing.sums.frame_ms += frame_ms;
+  m_pacing.sums.cpu_ms += timings.cpu_ms;
+  m_pacing.sums.fence_wait_ms += timings.fence_wait_ms;
+  m_pacing.sums.acquire_wait_ms += timings.acquire_wait_ms;
+  m_pacing.frames += 1;
+  // idle frames of converged image neither update uniforms nor trace, gpu time comes from previous use of frame slot
+  if (timings.uniform_cpu_ms >= 0.0) {
+    m_pacing.sums.uniform_cpu_ms += timings.uniform_cpu_ms;
+    m_pacing.uniform_frames += 1;
+  }
+  if (timings.trace_gpu_ms >= 0.0) {
+    m_pacing.sums.trace_gpu_ms += timings.trace_gpu_ms;
+    m_pacing.gpu_frames += 1;
+  }
+  if (m_pacing.frames < pacing_window) {
+    return;
+  }
+
+  f64                  count = (f64) m_pacing.frames;
+  frame_pacing_stats_t stats{};
+  stats.frames_in_flight = (u32) m_frames.size();
+  stats.frame_ms         = m_pacing.sums.frame_ms / count;
+  stats.cpu_ms           = m_pacing.sums.cpu_ms / count;
+  stats.fence_wait_ms    = m_pacing.sums.fence_wait_ms / count;
+  stats.acquire_wait_ms  = m_pacing.sums.acquire_wait_ms / count;
+  stats.overlap          = stats.frame_ms > 0.0 ? 1.0 - stats.fence_wait_ms / stats.frame_ms : 0.0;
+  stats.uniform_cpu_ms   = m_pacing.sums.uniform_cpu_ms / (f64) std::max(m_pacing.uniform_frames, 1u);
+  stats.trace_gpu_ms     = m_pacing.sums.trace_gpu_ms / (f64) std::max(m_pacing.gpu_frames, 1u);
+
+  m_pacing.stats = stats;
+  reset_pacing();
+}
+
+void RayTracer::reset_pacing() {
+  m_pacing.sums           = {};
+  m_pacing.frames         = 0;
+  m_pacing.uniform_frames = 0;
+  m_pacing.gpu_frames     = 0;
+}
+
+void RayTracer::draw_pacing_ui() {
+  frame_pacing_stats_t const &stats = m_pacing.stats;
+
+  ImGui::Begin("frame pacing");
+  ImGui::Text("frames in flight: %u", (u32) m_frames.size());
+  ImGui::Text("frame: %.2f ms (%.1f fps)", stats.frame_ms, stats.frame_ms > 0.0 ? 1000.0 / stats.frame_ms : 0.0);
+  ImGui::Text("cpu: %.2f ms", stats.cpu_ms);
+  ImGui::Text("fence wait: %.2f ms", stats.fence_wait_ms);
+  ImGui::Text("acquire wait: %.2f ms", stats.acquire_wait_ms);
+  ImGui::Text("cpu/gpu overlap: %.0f%%", stats.overlap * 100.0);
+
+  ImGui::Separator();
+  ImGui::Text("uniform upload cpu: %.4f ms", stats.uniform_cpu_ms);
+  ImGui::Text("uniforms + trace gpu: %.3f ms", stats.trace_gpu_ms);
+  // transfer path is kept only to measure what mapped ring saves, averages restart on switch
+  int upload = (int) m_uniform_upload;
+  if (ImGui::RadioButton("mapped ring", &upload, (int) uniform_upload_t::mapped) ||
+      ImGui::RadioButton("vkCmdUpdateBuffer", &upload, (int) uniform_upload_t::cmd_update)) {
+    m_uniform_upload = (uniform_upload_t) upload;
+    reset_pacing();
+  }
+  ImGui::End();
+}
+
+void RayTracer::create_accumulation_buffers() {
   Context &context = m_context_ref;
 
-  VkBufferCreateInfo buffer_info{};
-  buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  buffer_info.usage       = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-  buffer_info.size        = sizeof(global_ubo);
-  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkBufferCreateInfo moments_info = {};
+  moments_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  moments_info.size               = (VkDeviceSize) m_storage_image.width * m_storage_image.height * sizeof(glm::vec2);
+  moments_info.usage              = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+  moments_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo moments_alloc = {};
+  moments_alloc.usage                   = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+  check(
+      vmaCreateBuffer(context.vma_allocator(), &moments_info, &moments_alloc, &m_accumulation.moments.handle, &m_accumulation.moments.allocation, nullptr),
+      "creating accumulation moments buffer"
+  );
+  m_accumulation.moments_address = context.get_buffer_device_address(m_accumulation.moments.handle);
+
+  VkBufferCreateInfo counters_info = {};
+  counters_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  counters_info.size               = m_frames.size() * sizeof(u32);
+  counters_info.usage              = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+  counters_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
 
-  VmaAllocationCreateInfo alloc_info = {};
-  alloc_info.usage                   = VMA_MEMORY_USAGE_AUTO;
-  alloc_info.flags                   = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-  alloc_info.preferredFlags          = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  VmaAllocationCreateInfo counters_alloc = {};
+  counters_alloc.usage                   = VMA_MEMORY_USAGE_AUTO;
+  counters_alloc.flags                   = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
+  VmaAllocationInfo counters_alloc_info = {};
   check(
-      vmaCreateBuffer(context.vma_allocator(), &buffer_info, &alloc_info, &m_ubo.handle, &m_ubo.allocation, nullptr), //
-      "allocating uniform buffer"
+      vmaCreateBuffer(
+          context.vma_allocator(), &counters_info, &counters_alloc, //
+          &m_accumulation.noise_counters.handle, &m_accumulation.noise_counters.allocation, &counters_alloc_info
+      ),
+      "creating noise counters buffer"
   );
-  context.set_debug_name(m_ubo.handle, "uniform buffer");
+  m_accumulation.noise_counters_address = context.get_buffer_device_address(m_accumulation.noise_counters.handle);
+  m_accumulation.noise_counters_mapped  = static_cast<u32*>(counters_alloc_info.pMappedData);
+
+  context.set_debug_name(m_accumulation.moments.handle, "accumulation moments");
+  context.set_debug_name(m_accumulation.noise_counters.handle, "noise counters");
+}
+
+void RayTracer::create_uniform_buffer() {
+  Context &context = m_context_ref;
+
+  // every frame in flight writes its own region, so recording of next frame never races with shaders of previous one
+  m_uniform_ring = std::make_unique<UniformRing>(context, (u32) m_frames.size());
 }
 
 void RayTracer::create_offscreen_renderer() {
@@ -1190,13 +1751,16 @@ void RayTracer::create_offscreen_renderer() {
 void RayTracer::create_frame_data() {
   Context const &context = m_context_ref.get();
 
+  u32 frame_count = std::clamp(m_options.frames_in_flight, 1u, max_frames_in_flight);
+
+  // tracing and presenting commands of every frame
   VkCommandBufferAllocateInfo cmd_buffers_create_info = {};
   cmd_buffers_create_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   cmd_buffers_create_info.commandPool                 = context.command_pool();
   cmd_buffers_create_info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  cmd_buffers_create_info.commandBufferCount          = max_frames;
+  cmd_buffers_create_info.commandBufferCount          = frame_count * 2;
 
-  std::vector<VkCommandBuffer> buffers{ (size_t) max_frames };
+  std::vector<VkCommandBuffer> buffers{ (size_t) frame_count * 2 };
   check(
       vkAllocateCommandBuffers(
           context.device(), &cmd_buffers_create_info,
@@ -1215,7 +1779,7 @@ void RayTracer::create_frame_data() {
   semaphore_create_info.pNext                 = nullptr;
   semaphore_create_info.flags                 = 0;
 
-  for (u32 i = 0; i < (u32) max_frames; i += 1) {
+  for (u32 i = 0; i < frame_count; i += 1) {
     render_frame_data_t data = {};
     check(
         vkCreateSemaphore(context.device(), &semaphore_create_info, nullptr, &data.image_semaphore), //
@@ -1229,15 +1793,19 @@ void RayTracer::create_frame_data() {
         vkCreateFence(context.device(), &fence_create_info, nullptr, &data.fence), //
         fmt::format("creating render fence#{}", i)
     );
-    data.cmd = buffers[i];
+    data.cmd         = buffers[i * 2];
+    data.present_cmd = buffers[i * 2 + 1];
 
     m_frames.push_back(data);
 
-    context.set_debug_name(data.cmd, fmt::format("render cmd buffer #{}", i));
+    context.set_debug_name(data.cmd, fmt::format("trace cmd buffer #{}", i));
+    context.set_debug_name(data.present_cmd, fmt::format("present cmd buffer #{}", i));
     context.set_debug_name(data.render_semaphore, fmt::format("render_semaphore #{}", i));
     context.set_debug_name(data.image_semaphore, fmt::format("image_semaphore #{}", i));
     context.set_debug_name(data.fence, fmt::format("in_flight_fence #{}", i));
   }
+
+  m_profiler = std::make_unique<GpuProfiler>(context, frame_count, m_options.profile_directory);
 }
 
 void RayTracer::init_imgui() {
@@ -1323,12 +1891,13 @@ void RayTracer::init_imgui() {
 }
 
 void RayTracer::init_descriptors() {
+  WTRACE_FUNCTION();
   Context &context = m_context_ref;
 
   std::array<VkDescriptorPoolSize, 5> shader_pool_sizes = {
     VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,                       1},
     VkDescriptorPoolSize{             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,                       1},
-    VkDescriptorPoolSize{            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                       1},
+    VkDescriptorPoolSize{    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,                       1},
     VkDescriptorPoolSize{            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,                       3},
     VkDescriptorPoolSize{    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (u32) m_textures.size()},
   };
@@ -1360,11 +1929,11 @@ void RayTracer::init_descriptors() {
   storage_image_binding.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
   storage_image_binding.stageFlags      = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
 
-  // UNIFORM BUFFER
+  // UNIFORM BUFFER, dynamic offset selects region of frame in uniform ring
   VkDescriptorSetLayoutBinding uniform_buffer_binding{};
   uniform_buffer_binding.binding         = SharedBindings::UniformBuffer;
   uniform_buffer_binding.descriptorCount = 1;
-  uniform_buffer_binding.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  uniform_buffer_binding.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   uniform_buffer_binding.stageFlags      = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
 
   // OBJECT DESCRIPTIONS
@@ -1453,16 +2022,16 @@ void RayTracer::init_descriptors() {
   image_write.pImageInfo      = &image_descriptor;
 
   VkDescriptorBufferInfo ubo_descriptor{};
-  ubo_descriptor.buffer = m_ubo.handle;
+  ubo_descriptor.buffer = m_uniform_ring->buffer();
   ubo_descriptor.offset = 0;
-  ubo_descriptor.range  = VK_WHOLE_SIZE;
+  ubo_descriptor.range  = sizeof(global_ubo);
 
   VkWriteDescriptorSet ubo_write{};
   ubo_write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
   ubo_write.dstSet          = m_descriptor.shared.set;
   ubo_write.dstBinding      = SharedBindings::UniformBuffer;
   ubo_write.descriptorCount = 1;
-  ubo_write.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  ubo_write.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   ubo_write.pBufferInfo     = &ubo_descriptor;
 
   VkDescriptorBufferInfo scene_descriptor{};
@@ -1533,6 +2102,7 @@ void RayTracer::init_descriptors() {
 }
 
 void RayTracer::create_pipeline() {
+  WTRACE_FUNCTION();
 
   Context &context = m_context_ref;
 
@@ -1914,33 +2484,51 @@ void RayTracer::create_pipeline() {
 // }
 
 void RayTracer::create_tlas() {
+  WTRACE_FUNCTION();
   Context &context = m_context_ref;
 
-  buffer_t instances =
-      context.create_buffer(m_blas_instances, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
-  VkDeviceAddress instance_address = context.get_buffer_device_address(instances.handle);
+  u32          primitive_count = static_cast<u32>(m_blas_instances.size());
+  u32          frame_count     = static_cast<u32>(m_frames.size());
+  VkDeviceSize region_size     = std::max(1u, primitive_count) * sizeof(VkAccelerationStructureInstanceKHR);
 
-  context.set_debug_name(instances.handle, "tlas instances buffer");
+  // host writes moved instances straight into their frame region, no staging copy per refit
+  VkBufferCreateInfo instances_info{};
+  instances_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  instances_info.usage       = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+  instances_info.size        = region_size * frame_count;
+  instances_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-  // The top level acceleration structure contains (bottom level) instance as the input geometry
-  VkAccelerationStructureGeometryKHR acceleration_structure_geometry{};
-  acceleration_structure_geometry.sType                                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-  acceleration_structure_geometry.geometryType                          = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-  acceleration_structure_geometry.flags                                 = VK_GEOMETRY_OPAQUE_BIT_KHR;
-  acceleration_structure_geometry.geometry.instances.sType              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-  acceleration_structure_geometry.geometry.instances.arrayOfPointers    = VK_FALSE;
-  acceleration_structure_geometry.geometry.instances.data.deviceAddress = instance_address;
+  VmaAllocationCreateInfo instances_alloc = {};
+  instances_alloc.usage                   = VMA_MEMORY_USAGE_AUTO;
+  instances_alloc.flags                   = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+  VmaAllocationInfo instances_alloc_info = {};
+  check(
+      vmaCreateBuffer(
+          context.vma_allocator(),           //
+          &instances_info, &instances_alloc, //
+          &m_tlas.instances.handle, &m_tlas.instances.allocation, &instances_alloc_info
+      ),
+      "creating tlas instances buffer"
+  );
+  context.set_debug_name(m_tlas.instances.handle, "tlas instances buffer");
+
+  m_tlas.instances_mapped = static_cast<VkAccelerationStructureInstanceKHR*>(instances_alloc_info.pMappedData);
+  for (u32 frame = 0; frame < frame_count; frame += 1) {
+    std::copy(m_blas_instances.begin(), m_blas_instances.end(), m_tlas.instances_mapped + (usize) frame * primitive_count);
+  }
+  check(vmaFlushAllocation(context.vma_allocator(), m_tlas.instances.allocation, 0, VK_WHOLE_SIZE), "flushing tlas instances");
+
+  VkAccelerationStructureGeometryKHR acceleration_structure_geometry = tlas_geometry(0);
 
   // Get the size requirements for buffers involved in the acceleration structure build process
   VkAccelerationStructureBuildGeometryInfoKHR acceleration_structure_build_geometry_info{};
   acceleration_structure_build_geometry_info.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
   acceleration_structure_build_geometry_info.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-  acceleration_structure_build_geometry_info.flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+  acceleration_structure_build_geometry_info.flags         = tlas_build_flags;
   acceleration_structure_build_geometry_info.geometryCount = 1;
   acceleration_structure_build_geometry_info.pGeometries   = &acceleration_structure_geometry;
 
-  const auto primitive_count = static_cast<u32>(m_blas_instances.size());
-
   VkAccelerationStructureBuildSizesInfoKHR acceleration_structure_build_sizes_info{};
   acceleration_structure_build_sizes_info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
   vkGetAccelerationStructureBuildSizesKHR(
@@ -1978,56 +2566,215 @@ void RayTracer::create_tlas() {
       "creating tlas"
   );
 
-  // The actual build process starts here
-
-  buffer_t           scratch_buffer = {};
+  // scratch lives as long as tlas, every refit and rebuild reuses it
   VkBufferCreateInfo scratch_buffer_info{};
-  scratch_buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  scratch_buffer_info.usage       = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-  scratch_buffer_info.size        = acceleration_structure_build_sizes_info.accelerationStructureSize;
+  scratch_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  scratch_buffer_info.usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  scratch_buffer_info.size =
+      std::max(acceleration_structure_build_sizes_info.buildScratchSize, acceleration_structure_build_sizes_info.updateScratchSize);
   scratch_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
   VmaAllocationCreateInfo scratch_buffer_alloc = {};
-  scratch_buffer_alloc.usage                   = VMA_MEMORY_USAGE_CPU_TO_GPU;
+  scratch_buffer_alloc.usage                   = VMA_MEMORY_USAGE_GPU_ONLY;
 
   check(
-      vmaCreateBuffer(
-          context.vma_allocator(),                     //
-          &scratch_buffer_info, &scratch_buffer_alloc, //
-          &scratch_buffer.handle, &scratch_buffer.allocation, nullptr
+      vmaCreateBufferWithAlignment(
+          context.vma_allocator(),                                  //
+          &scratch_buffer_info, &scratch_buffer_alloc,              //
+          m_as_prop.minAccelerationStructureScratchOffsetAlignment, //
+          &m_tlas.scratch.handle, &m_tlas.scratch.allocation, nullptr
       ),
       "creating scratch buffer for tlas"
   );
+  context.set_debug_name(m_tlas.scratch.handle, "tlas scratch buffer");
+
+  // Build the acceleration structure on the device via a one-time command buffer submission
+  context.immediate_submit([&](VkCommandBuffer cmd) {
+    u32 zone = m_profiler->begin_load_zone(cmd, "tlas build");
+    record_tlas_build(cmd, 0, VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
+    m_profiler->end_load_zone(cmd, zone);
+  });
+
+  // object space bounds of every blas from float positions of its geometries, shared geometry is walked once per blas
+  m_tlas.blas_bounds.assign(m_meshes.blas_geometries.size(), {});
+  m_thread_pool->parallel_for(m_meshes.blas_geometries.size(), [&](usize blas) {
+    for (u32 primitive : m_meshes.blas_geometries[blas]) {
+      auto const &info = m_meshes.raw.primitive_infos[primitive];
+      for (u32 i = info.vertex_offset; i < info.vertex_offset + info.vertex_count; i += 1) {
+        m_tlas.blas_bounds[blas].grow(m_meshes.raw.positions[i]);
+      }
+    }
+  });
+
+  m_tlas.dirty.clear();
+  m_tlas.dirty_frames.assign(primitive_count, 0);
+  m_tlas.build_bounds.resize(primitive_count);
+  m_tlas.swept_areas.resize(primitive_count);
+  reset_tlas_bounds();
+}
+
+VkAccelerationStructureGeometryKHR RayTracer::tlas_geometry(u32 frame_index) const {
+  Context const &context = m_context_ref;
+
+  VkDeviceAddress instance_address = context.get_buffer_device_address(m_tlas.instances.handle);
+  instance_address += (VkDeviceAddress) frame_index * m_blas_instances.size() * sizeof(VkAccelerationStructureInstanceKHR);
+
+  // The top level acceleration structure contains (bottom level) instance as the input geometry
+  VkAccelerationStructureGeometryKHR acceleration_structure_geometry{};
+  acceleration_structure_geometry.sType                                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+  acceleration_structure_geometry.geometryType                          = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  acceleration_structure_geometry.flags                                 = VK_GEOMETRY_OPAQUE_BIT_KHR;
+  acceleration_structure_geometry.geometry.instances.sType              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+  acceleration_structure_geometry.geometry.instances.arrayOfPointers    = VK_FALSE;
+  acceleration_structure_geometry.geometry.instances.data.deviceAddress = instance_address;
+  return acceleration_structure_geometry;
+}
 
+void RayTracer::record_tlas_build(VkCommandBuffer cmd, u32 frame_index, VkBuildAccelerationStructureModeKHR mode) {
+  Context const &context = m_context_ref;
+
+  VkAccelerationStructureGeometryKHR acceleration_structure_geometry = tlas_geometry(frame_index);
+
+  // update refits tlas in place, so source and destination are the same
   VkAccelerationStructureBuildGeometryInfoKHR acceleration_build_geometry_info{};
   acceleration_build_geometry_info.sType                     = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
   acceleration_build_geometry_info.type                      = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-  acceleration_build_geometry_info.flags                     = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-  acceleration_build_geometry_info.mode                      = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+  acceleration_build_geometry_info.flags                     = tlas_build_flags;
+  acceleration_build_geometry_info.mode                      = mode;
+  acceleration_build_geometry_info.srcAccelerationStructure  = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR ? static_cast<VkAccelerationStructureKHR>(m_tlas.handle) : VK_NULL_HANDLE;
   acceleration_build_geometry_info.dstAccelerationStructure  = m_tlas.handle;
   acceleration_build_geometry_info.geometryCount             = 1;
   acceleration_build_geometry_info.pGeometries               = &acceleration_structure_geometry;
-  acceleration_build_geometry_info.scratchData.deviceAddress = context.get_buffer_device_address(scratch_buffer.handle);
+  acceleration_build_geometry_info.scratchData.deviceAddress = context.get_buffer_device_address(m_tlas.scratch.handle);
 
   VkAccelerationStructureBuildRangeInfoKHR acceleration_structure_build_range_info{};
-  acceleration_structure_build_range_info.primitiveCount                                            = primitive_count;
+  acceleration_structure_build_range_info.primitiveCount                                            = static_cast<u32>(m_blas_instances.size());
   acceleration_structure_build_range_info.primitiveOffset                                           = 0;
   acceleration_structure_build_range_info.firstVertex                                               = 0;
   acceleration_structure_build_range_info.transformOffset                                           = 0;
   std::array<VkAccelerationStructureBuildRangeInfoKHR*, 1> acceleration_build_structure_range_infos = { &acceleration_structure_build_range_info };
 
-  // Build the acceleration structure on the device via a one-time command buffer submission
-  context.immediate_submit([&](VkCommandBuffer cmd) {
-    vkCmdBuildAccelerationStructuresKHR(cmd, 1, &acceleration_build_geometry_info, acceleration_build_structure_range_infos.data());
-  });
+  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &acceleration_build_geometry_info, acceleration_build_structure_range_infos.data());
+}
 
-  vmaDestroyBuffer(context.vma_allocator(), instances.handle, instances.allocation);
-  vmaDestroyBuffer(context.vma_allocator(), scratch_buffer.handle, scratch_buffer.allocation);
+void RayTracer::reset_tlas_bounds() {
+  m_tlas.build_area         = 0.0;
+  m_tlas.swept_area         = 0.0;
+  m_tlas.refits_since_build = 0;
+  for (usize i = 0; i < m_meshes.instances.size(); i += 1) {
+    auto const &plan       = m_meshes.instances[i];
+    m_tlas.build_bounds[i] = transform_bounds(m_tlas.blas_bounds[plan.blas], plan.world_matrix);
+    m_tlas.swept_areas[i]  = m_tlas.build_bounds[i].half_area();
+    m_tlas.build_area     += m_tlas.swept_areas[i];
+  }
+  m_tlas.swept_area = m_tlas.build_area;
+}
+
+void RayTracer::record_tlas_update(VkCommandBuffer cmd, u32 frame_index) {
+  if (not m_tlas.outdated) {
+    return;
+  }
+  WTRACE_FUNCTION();
+  Context const &context = m_context_ref;
+
+  // regions of other frames may still be read by their builds on gpu, they get moved instances when their frame comes
+  u32                                 instance_count = static_cast<u32>(m_blas_instances.size());
+  u8                                  frame_bit      = (u8) (1u << frame_index);
+  VkAccelerationStructureInstanceKHR* region         = m_tlas.instances_mapped + (usize) frame_index * instance_count;
+  u32                                 written        = 0;
+  for (u32 instance : m_tlas.dirty) {
+    if (m_tlas.dirty_frames[instance] & frame_bit) {
+      region[instance]               = m_blas_instances[instance];
+      m_tlas.dirty_frames[instance] &= (u8) ~frame_bit;
+      written                       += 1;
+    }
+  }
+  std::erase_if(m_tlas.dirty, [&](u32 instance) { return m_tlas.dirty_frames[instance] == 0; });
+
+  VkDeviceSize region_size = instance_count * sizeof(VkAccelerationStructureInstanceKHR);
+  check(
+      vmaFlushAllocation(context.vma_allocator(), m_tlas.instances.allocation, frame_index * region_size, region_size), //
+      "flushing tlas instances"
+  );
+
+  // refit keeps tree topology of last build, once moved instances stretch its nodes too much tracing gets slower than a rebuild
+  f32  growth   = m_tlas.build_area > 0.0 ? (f32) (m_tlas.swept_area / m_tlas.build_area) : 1.f;
+  bool periodic = m_options.tlas_rebuild_period > 0 and m_tlas.refits_since_build >= m_options.tlas_rebuild_period;
+  bool rebuild  = periodic or growth > m_options.tlas_refit_growth_limit;
+
+  u32 zone = m_profiler->begin_zone(cmd, "tlas update");
+
+  // traces of previous frames read tlas and their builds use the same scratch
+  VkMemoryBarrier build_barrier = {};
+  build_barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  build_barrier.srcAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  build_barrier.dstAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  vkCmdPipelineBarrier(
+      cmd,                                                                                                   //
+      VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, //
+      VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,                                                //
+      0, 1, &build_barrier, 0, nullptr, 0, nullptr
+  );
+
+  record_tlas_build(cmd, frame_index, rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR);
+
+  VkMemoryBarrier trace_barrier = {};
+  trace_barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  trace_barrier.srcAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  trace_barrier.dstAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+  vkCmdPipelineBarrier(
+      cmd,                                                                                                  //
+      VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, //
+      0, 1, &trace_barrier, 0, nullptr, 0, nullptr
+  );
+
+  m_profiler->end_zone(cmd, zone);
+
+  if (rebuild) {
+    reset_tlas_bounds();
+    m_tlas.stats.rebuilds += 1;
+  } else {
+    m_tlas.refits_since_build += 1;
+    m_tlas.stats.refits       += 1;
+  }
+  m_tlas.stats.dirty_instances = written;
+  m_tlas.stats.growth          = m_tlas.build_area > 0.0 ? (f32) (m_tlas.swept_area / m_tlas.build_area) : 1.f;
+  m_tlas.outdated              = false;
+}
+
+void RayTracer::set_node_transform(u32 node, glm::mat4 const &world_matrix) {
+  WASSERT(node < m_meshes.node_instances.size(), "node is out of scene");
+  u32   instance = m_meshes.node_instances[node];
+  auto &plan     = m_meshes.instances[instance];
+
+  // instance merged from other source nodes would move unrelated primitives
+  i32 source_node = m_meshes.raw.nodes[node].source_node;
+  if (plan.source_node != source_node) {
+    WERROR("node {} (source node {}) shares merged instance {}, mark it with set_dynamic_nodes before loading", node, source_node, instance);
+    return;
+  }
+  plan.world_matrix = world_matrix;
+
+  glm::mat3x4 rtxT = glm::transpose(world_matrix);
+  memcpy(&m_blas_instances[instance].transform, glm::value_ptr(rtxT), sizeof(VkTransformMatrixKHR));
+
+  // union with bounds at last build approximates how much refitted tlas nodes grow
+  bvh::bounds_t swept = m_tlas.build_bounds[instance];
+  swept.grow(transform_bounds(m_tlas.blas_bounds[plan.blas], world_matrix));
+  m_tlas.swept_area            += swept.half_area() - m_tlas.swept_areas[instance];
+  m_tlas.swept_areas[instance]  = swept.half_area();
+
+  if (m_tlas.dirty_frames[instance] == 0) {
+    m_tlas.dirty.push_back(instance);
+  }
+  m_tlas.dirty_frames[instance] = (u8) ((1u << m_frames.size()) - 1);
+  m_tlas.outdated               = true;
+  reset_frame();
 }
 
 texture_t RayTracer::create_texture(
-    u32 width, u32 height,            //
-    std::vector<unsigned char> &data, //
+    UploadBatch &batch, u32 width, u32 height, //
+    std::span<u8 const> data,                  //
     VkFilter mag_filter, VkFilter min_filter, VkFormat format
 ) {
   Context &context = m_context_ref;
@@ -2051,10 +2798,16 @@ texture_t RayTracer::create_texture(
   image_create_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
   image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-  auto* raw_data = data.data();
-  result.image   = context.create_image_on_gpu(image_create_info, raw_data, data.size());
+  VmaAllocationCreateInfo image_alloc{};
+  image_alloc.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  check(
+      vmaCreateImage(context.vma_allocator(), &image_create_info, &image_alloc, &result.image.handle, &result.image.allocation, nullptr), //
+      "creating texture image"
+  );
 
-  context.generate_mipmaps(result.image.handle, image_create_info);
+  WASSERT(data.size() == (usize) width * height * 4, "texture data size does not match its extent");
+  batch.upload(result.image.handle, image_create_info, data.data(), data.size());
 
   VkImageViewCreateInfo image_view_create_info{};
   image_view_create_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -2102,6 +2855,131 @@ texture_t RayTracer::create_texture(
   return result;
 }
 
-void RayTracer::reset_frame() { m_shader_frame = 0; }
+std::vector<f32> RayTracer::render_offline(u32 sample_count) {
+  Context &context = m_context_ref;
+  WASSERT(sample_count > 0, "at least one sample is needed");
+
+  VkExtent2D extent       = { m_storage_image.width, m_storage_image.height };
+  auto       render_start = std::chrono::steady_clock::now();
+
+  // storage image is read and written by every sample
+  VkMemoryBarrier accumulation_barrier = {};
+  accumulation_barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  accumulation_barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+  accumulation_barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+  // samples are split into several submits, so one submit never runs long enough to hit gpu watchdog
+  for (u32 first_sample = 0; first_sample < sample_count; first_sample += offline_samples_per_submit) {
+    u32 batch_size = std::min(offline_samples_per_submit, sample_count - first_sample);
+
+    // immediate_submit waits for gpu, so uniform ring region of first frame is free
+    context.immediate_submit([&](VkCommandBuffer cmd) {
+      if (first_sample == 0) {
+        record_tlas_update(cmd, 0);
+      }
+      u32 ubo_offset = update_uniform_buffer(cmd, 0);
+
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline);
+
+      std::array<VkDescriptorSet, 1> sets{ m_descriptor.shared.set };
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline_layout, 0, (u32) sets.size(), sets.data(), 1, &ubo_offset);
+
+      for (u32 i = 0; i < batch_size; i += 1) {
+        if (first_sample + i > 0) {
+          vkCmdPipelineBarrier(
+              cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, //
+              1, &accumulation_barrier, 0, nullptr, 0, nullptr
+          );
+        }
+
+        push_constant_t pc{};
+        pc.mvp   = glm::mat4{ 1.f };
+        pc.frame = (int) (first_sample + i);
+
+        vkCmdPushConstants(
+            cmd, m_pipeline_layout,
+            VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_CALLABLE_BIT_KHR, 0,
+            sizeof(push_constant_t), &pc
+        );
+
+        vkCmdTraceRaysKHR(cmd, &m_gen_region, &m_miss_region, &m_hit_region, &m_call_region, extent.width, extent.height, 1);
+      }
+    });
+  }
+
+  std::chrono::duration<f64> render_time = std::chrono::steady_clock::now() - render_start;
+
+  m_offline_stats.samples            = sample_count;
+  m_offline_stats.seconds            = render_time.count();
+  m_offline_stats.samples_per_second = sample_count / render_time.count();
+  m_offline_stats.mrays_per_second   = (f64) sample_count * extent.width * extent.height / render_time.count() / 1e6;
+  WINFO(
+      "rendered {} samples at {}x{} in {:.3f} s ({:.2f} samples/s, {:.2f} Mrays/s)", sample_count, extent.width, extent.height, //
+      m_offline_stats.seconds, m_offline_stats.samples_per_second, m_offline_stats.mrays_per_second
+  );
+
+  // ------------- READBACK ----------------
+  VkDeviceSize image_size = (VkDeviceSize) extent.width * extent.height * 4 * sizeof(f32);
+
+  VkBufferCreateInfo readback_info = {};
+  readback_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  readback_info.size               = image_size;
+  readback_info.usage              = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  readback_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo readback_alloc = {};
+  readback_alloc.usage                   = VMA_MEMORY_USAGE_AUTO;
+  readback_alloc.flags                   = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+  buffer_t          readback            = {};
+  VmaAllocationInfo readback_alloc_info = {};
+  check(
+      vmaCreateBuffer(context.vma_allocator(), &readback_info, &readback_alloc, &readback.handle, &readback.allocation, &readback_alloc_info), //
+      "creating readback buffer"
+  );
+
+  context.immediate_submit([&](VkCommandBuffer cmd) {
+    VkMemoryBarrier before_copy = {};
+    before_copy.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    before_copy.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    before_copy.dstAccessMask   = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &before_copy, 0, nullptr, 0, nullptr);
+
+    VkBufferImageCopy copy               = {};
+    copy.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy.imageSubresource.mipLevel       = 0;
+    copy.imageSubresource.baseArrayLayer = 0;
+    copy.imageSubresource.layerCount     = 1;
+    copy.imageExtent                     = { extent.width, extent.height, 1 };
+
+    // storage image always stays in GENERAL layout
+    vkCmdCopyImageToBuffer(cmd, m_storage_image.image, VK_IMAGE_LAYOUT_GENERAL, readback.handle, 1, &copy);
+
+    VkMemoryBarrier after_copy = {};
+    after_copy.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    after_copy.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    after_copy.dstAccessMask   = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &after_copy, 0, nullptr, 0, nullptr);
+  });
+
+  check(vmaInvalidateAllocation(context.vma_allocator(), readback.allocation, 0, VK_WHOLE_SIZE), "invalidating readback buffer");
+
+  std::vector<f32> result((usize) extent.width * extent.height * 4);
+  memcpy(result.data(), readback_alloc_info.pMappedData, image_size);
+
+  vmaDestroyBuffer(context.vma_allocator(), readback.handle, readback.allocation);
+  return result;
+}
+
+void RayTracer::reset_frame() {
+  m_accumulation.samples      = 0;
+  m_accumulation.noisy_pixels = 0;
+  m_accumulation.converged    = false;
+  m_accumulation.start        = std::chrono::steady_clock::now();
+  // frames in flight trace samples of previous accumulation, their noise estimates are stale
+  for (auto &frame : m_frames) {
+    frame.traced_sample = no_sample;
+  }
+}
 
 } // namespace whim::vk
\ No newline at end of file
@@ -1,40 +1,36 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 #include <optional>
 
+#include "bvh/bvh.hpp"
 #include "camera.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
 #include "vk/context.hpp"
+#include "vk/gpu_profiler.hpp"
+#include "vk/upload_batch.hpp"
+#include "vk/uniform_ring.hpp"
 #include "shader.h"
 
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #include "tiny_gltf.h"
 
+#include "utility/thread_pool.hpp"
 #include "vk/types.hpp"
 #include "whim.hpp"
 
 namespace whim::vk {
-struct primitive_full_info {
-  u32 index_count    = 0;
-  u32 index_offset   = 0;
-  u32 vertex_count   = 0;
-  u32 vertex_offset  = 0;
-  u32 material_index = 0;
-};
-
-struct node {
-  glm::mat4 world_matrix   = glm::mat4{ 1.f };
-  int       primitive_mesh = 0;
-};
 
-class RayTracer {
+class RayTracer final : public Renderer {
 
 public:
-  RayTracer(Context &context, CameraManipulator const &man);
-  ~RayTracer();
+  RayTracer(Context &context, CameraManipulator const &man, config_t const &config);
+  ~RayTracer() override;
 
   RayTracer(RayTracer &&) noexcept            = default;
   RayTracer &operator=(RayTracer &&) noexcept = default;
@@ -43,23 +39,176 @@ public:
 
   void draw();
 
-  void load_gltf_scene(std::string_view file_path);
+  void load_gltf_scene(std::string_view file_path) override;
+  void load_obj_scene(std::string_view file_path) override;
   // void load_spheres(std::vector<std::pair<sphere_t, u32>> &spheres, std::vector<material_options> &materials);
 
-  void reset_frame();
+  /*
+    restarts progressive accumulation, draw() calls it by itself when camera matrices change
+  */
+  void reset_frame() override;
+
+  /*
+    progressive accumulation state, samples_per_second and seconds are measured from last reset
+  */
+  struct accumulation_stats_t {
+    u32  samples            = 0;
+    u32  noisy_pixels       = 0; // by last noise estimate
+    bool converged          = false;
+    f64  samples_per_second = 0.0;
+    f64  seconds            = 0.0; // time to convergence once converged
+  };
+
+  [[nodiscard]] accumulation_stats_t accumulation_stats() const;
+
+  /*
+    draw() timings averaged over last pacing_window frames.
+    overlap is part of frame time cpu did not spend waiting for gpu to free frame slot, 1 - cpu never waits on gpu
+  */
+  struct frame_pacing_stats_t {
+    u32 frames_in_flight = 0;
+    f64 frame_ms         = 0.0; // between draw() calls
+    f64 cpu_ms           = 0.0; // draw() without waits
+    f64 fence_wait_ms    = 0.0;
+    f64 acquire_wait_ms  = 0.0;
+    f64 overlap          = 0.0;
+    // averaged over frames which traced rays
+    f64 uniform_cpu_ms = 0.0; // writing global_ubo or recording its upload
+    f64 trace_gpu_ms   = 0.0; // uniform upload and ray tracing, "trace" pass of profiler
+  };
+
+  [[nodiscard]] frame_pacing_stats_t frame_pacing_stats() const { return m_pacing.stats; }
+
+  /*
+    renders sample_count accumulated samples without presenting and reads storage image back,
+    result is linear RGBA, rows go from top to bottom
+  */
+  std::vector<f32> render_offline(u32 sample_count) override;
+
+  /*
+    device memory of scene vertices and indices, vertex_bytes counts every vertex buffer (blas build inputs too)
+  */
+  struct geometry_stats_t {
+    vertex_layout_t layout       = vertex_layout_t::separate;
+    u32             vertex_count = 0;
+    VkDeviceSize    vertex_bytes = 0;
+    VkDeviceSize    index_bytes  = 0;
+  };
+
+  [[nodiscard]] geometry_stats_t geometry_stats() const { return m_meshes.geometry_stats; }
+
+  /*
+    last render_offline() call, rays are primary rays
+  */
+  struct offline_stats_t {
+    u32 samples            = 0;
+    f64 seconds            = 0.0;
+    f64 samples_per_second = 0.0;
+    f64 mrays_per_second   = 0.0;
+  };
+
+  [[nodiscard]] offline_stats_t offline_stats() const { return m_offline_stats; }
+
+  /*
+    load time statistics of bottom level acceleration structures
+  */
+  struct blas_build_stats_t {
+    u32          blas_count     = 0;
+    u32          merged_count   = 0; // blases with several static primitives as geometries, see blas_merge_triangles
+    u32          geometry_count = 0;
+    u32          instance_count = 0;
+    u32          submit_count   = 0;
+    VkDeviceSize scratch_bytes  = 0;
+    VkDeviceSize blas_bytes     = 0;
+    // equals to blas_bytes if compaction is disabled
+    VkDeviceSize compacted_bytes = 0;
+    f64          build_ms        = 0.0; // cpu wall time of all builds and compactions
+    // instances reusing blas of identical geometry, compacted bytes and build time (by triangle share) their own blases would take
+    u32          shared_count   = 0;
+    VkDeviceSize shared_bytes   = 0;
+    f64          saved_build_ms = 0.0;
+  };
+
+  [[nodiscard]] blas_build_stats_t blas_stats() const { return m_meshes.blas_stats; }
+
+  /*
+    moves scene node (index into scene_data_t::nodes) to world_matrix and restarts accumulation.
+    only moved instances are written into persistently mapped instance buffer, next traced frame refits the tlas,
+    it is rebuilt every tlas_rebuild_period refits or when bounds swept by moved instances degrade it, see tlas_refit_growth_limit.
+    primitives of one gltf node merged into one blas (blas_merge_triangles) share one instance and move together,
+    nodes of instances merged across source nodes are rejected. mark animated nodes with set_dynamic_nodes to keep them unmerged
+  */
+  void set_node_transform(u32 node, glm::mat4 const &world_matrix);
+
+  /*
+    source nodes (gltf node indices, see node::source_node) moved later by set_node_transform, plan_blases never merges
+    their primitives. takes effect on next scene load
+  */
+  void set_dynamic_nodes(std::vector<i32> source_nodes) { m_meshes.dynamic_nodes = std::move(source_nodes); }
+
+  /*
+    tlas maintenance since scene load
+  */
+  struct tlas_update_stats_t {
+    u32 refits          = 0;
+    u32 rebuilds        = 0;
+    u32 dirty_instances = 0;   // written by last refit or rebuild
+    f32 growth          = 1.f; // swept instance bounds area relative to area at last build
+  };
+
+  [[nodiscard]] tlas_update_stats_t tlas_stats() const { return m_tlas.stats; }
 
 private:
-  constexpr static u32              max_frames           = 2;
-  constexpr static std::string_view default_texture_path = "../assets/texture/default.png";
+  constexpr static u32              max_frames_in_flight       = 4;
+  constexpr static std::string_view default_texture_path       = "../assets/texture/default.png";
+  constexpr static u32              offline_samples_per_submit = 16;
+
+  // noise estimate of first samples is too rough to stop on
+  constexpr static u32 min_noise_samples = 16;
+  // accumulation is converged when at most this part of pixels is still noisy
+  constexpr static f32 max_noisy_pixel_ratio = 0.001f;
+  constexpr static u32 no_sample             = ~0u;
+
+  constexpr static u32 pacing_window = 120;
+
+  // tlas is refitted in place when instances move
+  constexpr static VkBuildAccelerationStructureFlagsKHR tlas_build_flags =
+      VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+  // upper bound of scratch memory used by one batch of BLAS builds
+  constexpr static VkDeviceSize blas_scratch_budget = 256ull * 1024 * 1024;
 
   /*
-    store per frame data
+    store per frame data, frame is reused after its fence is signaled.
+    cmd traces rays and is submitted before swapchain image is acquired, present_cmd draws storage image into swapchain
   */
   struct render_frame_data_t {
     handle<VkCommandBuffer> cmd              = VK_NULL_HANDLE;
+    handle<VkCommandBuffer> present_cmd      = VK_NULL_HANDLE;
     handle<VkFence>         fence            = VK_NULL_HANDLE;
     handle<VkSemaphore>     image_semaphore  = VK_NULL_HANDLE;
     handle<VkSemaphore>     render_semaphore = VK_NULL_HANDLE;
+    // sample traced by last submit of this frame, its noisy pixel counter is read after fence wait
+    u32 traced_sample = no_sample;
+  };
+
+  /*
+    texture loading stages timings
+  */
+  struct texture_load_stats_t {
+    u32 decode_threads = 0;
+    f64 decode_ms      = 0.0; // zero if images come from scene cache
+  };
+
+  /*
+    tlas instance of one node, or of several nodes of one source node whose primitives are merged into one blas.
+    primitives of its geometries are geometry_primitives[first_geometry ..] in blas geometry order
+  */
+  struct instance_plan_t {
+    glm::mat4 world_matrix   = glm::mat4{ 1.f };
+    u32       blas           = 0;
+    u32       first_geometry = 0;
+    i32       source_node    = -1;
   };
 
 private:
@@ -70,28 +219,57 @@ private:
   void init_imgui();
   void create_storage_image();
   void create_uniform_buffer();
-  void create_default_texture();
+  void create_accumulation_buffers();
+  void create_default_texture(UploadBatch &batch);
   void create_offscreen_renderer();
 
   void load_gltf_raw(std::string_view file_path);
-  void process_node(const tinygltf::Model &tmodel, int &node_idx, const glm::mat4 &parent_matrix);
-  void load_gltf_device();
-  void load_primitive_to_blas(primitive_full_info &primitive, acceleration_structure_t &blas);
+  void load_obj_raw(std::string_view file_path);
+  // uploads m_meshes.raw of any source format, builds acceleration structures and pipeline
+  void upload_scene();
+  void create_textures(UploadBatch &batch);
+  void load_gltf_device(UploadBatch &batch);
+  // splits primitives of nodes into blases and tlas instances, small static ones are merged, see blas_merge_triangles
+  void plan_blases();
+  // builds wait on gpu for uploads of scene buffers
+  void build_blases(ticket_t uploads);
+
+  acceleration_structure_t create_acceleration_structure(VkAccelerationStructureTypeKHR type, VkDeviceSize size);
 
   void create_tlas();
+  [[nodiscard]] VkAccelerationStructureGeometryKHR tlas_geometry(u32 frame_index) const;
+  void record_tlas_build(VkCommandBuffer cmd, u32 frame_index, VkBuildAccelerationStructureModeKHR mode);
+  // bounds of every instance at its current transform become reference of refit quality
+  void reset_tlas_bounds();
+  // writes moved instances into frame region of instance buffer and records tlas refit or rebuild, nothing if nothing moved
+  void record_tlas_update(VkCommandBuffer cmd, u32 frame_index);
   void init_descriptors();
   void create_pipeline();
   void create_shader_binding_table();
 
-  void update_uniform_buffer(VkCommandBuffer cmd);
+  // writes global_ubo into uniform ring region of frame, returns its dynamic offset
+  u32 update_uniform_buffer(VkCommandBuffer cmd, u32 frame_index);
+
+  // restarts accumulation on camera change, reads noise estimate of finished frame, returns false if nothing is left to trace
+  bool update_accumulation(render_frame_data_t &frame, u32 frame_index);
+  void finish_accumulation(std::string_view reason);
+  void draw_accumulation_ui();
+
+  void record_pacing(std::chrono::steady_clock::time_point draw_start, frame_pacing_stats_t const &timings);
+  void reset_pacing();
+  void draw_pacing_ui();
 
+  // records upload into batch, texture is ready after batch.flush()
   texture_t create_texture(
-      u32 width, u32 height,            //
-      std::vector<unsigned char> &data, //
+      UploadBatch &batch, u32 width, u32 height, //
+      std::span<u8 const> data,                  //
       VkFilter mag_filter, VkFilter min_filter, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB
   );
 
 private:
+  config_t::options_t m_options     = {};
+  uptr<ThreadPool>    m_thread_pool = nullptr;
+
   // IMGUI DATA
   struct {
     handle<VkDescriptorPool> desc_pool;
@@ -101,37 +279,82 @@ private:
   std::vector<render_frame_data_t> m_frames;
   u32                              m_current_frame = 0;
 
-  u32 m_shader_frame = 0;
-  u32 m_maxFrames    = 100;
+  struct {
+    std::chrono::steady_clock::time_point last_draw_start = {};
+    u32                                   frames          = 0;
+    u32                                   uniform_frames  = 0;
+    u32                                   gpu_frames      = 0;
+    frame_pacing_stats_t                  sums            = {};
+    frame_pacing_stats_t                  stats           = {};
+  } m_pacing;
+
+  // gpu time of every pass of draw() and of scene loading
+  uptr<GpuProfiler> m_profiler = nullptr;
+
+  // UNIFORM DATA
+  /*
+    mapped - global_ubo is written straight into uniform ring,
+    cmd_update - old vkCmdUpdateBuffer upload with two barriers, kept to measure the difference
+  */
+  enum class uniform_upload_t : u8 {
+    mapped,
+    cmd_update,
+  };
+
+  uptr<UniformRing> m_uniform_ring   = nullptr;
+  uniform_upload_t  m_uniform_upload = uniform_upload_t::mapped;
 
-  // UNIFORM BUFFER DATA
-  buffer_t m_ubo = {};
+  // PROGRESSIVE ACCUMULATION DATA
+  struct {
+    u32                                   samples      = 0;
+    u32                                   noisy_pixels = 0;
+    bool                                  converged    = false;
+    std::chrono::steady_clock::time_point start        = {};
+    std::chrono::steady_clock::time_point end          = {};
+    // camera of accumulated samples
+    glm::mat4 view = {};
+    glm::mat4 proj = {};
+
+    // device local, pixel count of vec2
+    buffer_t        moments         = {};
+    VkDeviceAddress moments_address = {};
+    // host visible, one noisy pixel counter per frame in flight
+    buffer_t        noise_counters         = {};
+    VkDeviceAddress noise_counters_address = {};
+    u32*            noise_counters_mapped  = nullptr;
+  } m_accumulation;
+
+  offline_stats_t m_offline_stats = {};
 
   // MESHES DATA
   struct {
-    struct {
-      std::vector<glm::vec3>             positions{};
-      std::vector<u32>                   indices{};
-      std::vector<glm::vec3>             normals{};
-      std::vector<glm::vec2>             uvs{};
-      std::vector<material>              materials{};
-      std::vector<primitive_shader_info> prim_meshes{};
-      //
-      std::vector<primitive_full_info>          primitive_infos{};
-      std::vector<node>                         nodes{};
-      std::unordered_map<i32, std::vector<u32>> mesh_to_primitives{};
-    } raw;
+    scene_data_t                       raw{};
+    std::vector<primitive_shader_info> prim_meshes{};
 
+    // only buffers of chosen vertex layout exist, see scene_description
     struct {
       buffer_t pos_buffer      = {};
       buffer_t index_buffer    = {};
       buffer_t normal_buffer   = {};
       buffer_t uv_buffer       = {};
+      buffer_t vertex_buffer   = {};
       buffer_t material_buffer = {};
       buffer_t prim_infos      = {};
+      // quantized layout: dequantization VkTransformMatrixKHR of every primitive, applied by blas builds
+      buffer_t blas_transforms = {};
+      // scene_description::geometry_address
+      buffer_t geometry_primitives = {};
     } device;
 
+    // every blas is built from ranges of its primitives, one geometry per primitive. identical geometry is built once
+    std::vector<std::vector<u32>>         blas_geometries{};
+    std::vector<instance_plan_t>          instances{};
+    std::vector<u32>                      node_instances{};
+    std::vector<i32>                      dynamic_nodes{};
+    std::vector<u32>                      geometry_primitives{};
     std::vector<acceleration_structure_t> blases{};
+    blas_build_stats_t                    blas_stats{};
+    geometry_stats_t                      geometry_stats{};
   } m_meshes;
 
   struct {
@@ -166,6 +389,7 @@ private:
   // TEXTURES DATA
   std::vector<texture_t> m_textures{};
   texture_t              m_default_texture = {};
+  texture_load_stats_t   m_texture_stats   = {};
 
   // ACCELERATION STRUCTURE DATA
   std::vector<VkAccelerationStructureInstanceKHR> m_blas_instances{};
@@ -173,6 +397,23 @@ private:
   struct {
     buffer_t                           buffer = {};
     handle<VkAccelerationStructureKHR> handle = VK_NULL_HANDLE;
+    // m_blas_instances copy per frame in flight, gpu builds of recorded frames read their own region
+    buffer_t                            instances        = {};
+    VkAccelerationStructureInstanceKHR* instances_mapped = nullptr;
+    // sized for both build and update
+    buffer_t scratch = {};
+    // moved instances and bit mask of frame regions which still miss their transform
+    std::vector<u32> dirty{};
+    std::vector<u8>  dirty_frames{};
+    bool             outdated = false;
+    // quality estimate: half areas of instance bounds at last build and of their union with current bounds
+    std::vector<bvh::bounds_t> blas_bounds{};
+    std::vector<bvh::bounds_t> build_bounds{};
+    std::vector<f32>           swept_areas{};
+    f64                        build_area         = 0.0;
+    f64                        swept_area         = 0.0;
+    u32                        refits_since_build = 0;
+    tlas_update_stats_t        stats              = {};
   } m_tlas;
 
   // SHADER BINDING TABLE DATA
@@ -212,7 +453,8 @@ private:
   handle<VkPipelineLayout> m_pipeline_layout = VK_NULL_HANDLE;
 
   // RAYTRACING DATA
-  VkPhysicalDeviceRayTracingPipelinePropertiesKHR m_rt_prop = {};
+  VkPhysicalDeviceRayTracingPipelinePropertiesKHR    m_rt_prop = {};
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR m_as_prop = {};
 
   // OFFSCREEN RENDER DATA
   struct {
@@ -0,0 +1,385 @@
+#include "vk/staging_arena.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "utility/align.hpp"
+#include "vk/context.hpp"
+#include "vk/result.hpp"
+#include "vk/submitter.hpp"
+
+namespace whim::vk {
+
+StagingArena::StagingArena(Context const &context, VkDeviceSize size) :
+    m_device(context.device()),
+    m_vma(context.vma_allocator()),
+    m_submitter(&context.submitter()),
+    m_segment_size(align_down(size / segment_count, copy_offset_alignment)) {
+  WASSERT(m_segment_size > 0, "staging arena is too small");
+
+  m_transfer.queue  = context.transfer_queue();
+  m_transfer.family = context.transfer_family_index();
+  m_graphics.queue  = context.graphics_queue();
+  m_graphics.family = context.graphics_family_index();
+
+  for (queue_t* queue : { &m_transfer, &m_graphics }) {
+    if (queue == &m_graphics and not is_dedicated()) {
+      break;
+    }
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex        = queue->family;
+    pool_info.flags                   = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    check(
+        vkCreateCommandPool(m_device, &pool_info, nullptr, &queue->pool), //
+        "creating command pool for staging uploads"
+    );
+    context.set_debug_name(queue->pool, queue == &m_transfer ? "staging transfer command pool" : "staging acquire command pool");
+  }
+
+  for (auto &segment : m_segments) {
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool                 = m_transfer.pool;
+    cmd_info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount          = 1;
+
+    check(
+        vkAllocateCommandBuffers(m_device, &cmd_info, &segment.transfer_cmd), //
+        "allocating staging transfer command buffer"
+    );
+
+    if (is_dedicated()) {
+      cmd_info.commandPool = m_graphics.pool;
+      check(
+          vkAllocateCommandBuffers(m_device, &cmd_info, &segment.graphics_cmd), //
+          "allocating staging acquire command buffer"
+      );
+    }
+  }
+
+  VkSemaphoreTypeCreateInfo timeline_type = {};
+  timeline_type.sType                     = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timeline_type.semaphoreType             = VK_SEMAPHORE_TYPE_TIMELINE;
+  timeline_type.initialValue              = 0;
+
+  VkSemaphoreCreateInfo timeline_info = {};
+  timeline_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  timeline_info.pNext                 = &timeline_type;
+
+  check(
+      vkCreateSemaphore(m_device, &timeline_info, nullptr, &m_timeline), //
+      "creating staging timeline semaphore"
+  );
+  context.set_debug_name(m_timeline, "staging timeline");
+
+  u32 family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(context.physical_device(), &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(context.physical_device(), &family_count, families.data());
+
+  u32 valid_bits = families[m_transfer.family].timestampValidBits;
+  if (valid_bits > 0) {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(context.physical_device(), &properties);
+    m_period_ns = properties.limits.timestampPeriod;
+    m_tick_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo query_pool_info = {};
+    query_pool_info.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount            = segment_count * 2;
+
+    check(
+        vkCreateQueryPool(m_device, &query_pool_info, nullptr, &m_timestamps), //
+        "creating staging timestamp query pool"
+    );
+    context.set_debug_name(m_timestamps, "staging timestamps");
+  }
+
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size               = m_segment_size * segment_count;
+  buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo alloc_info = {};
+  alloc_info.usage                   = VMA_MEMORY_USAGE_AUTO;
+  alloc_info.flags                   = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  alloc_info.requiredFlags           = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  VmaAllocationInfo allocation_info = {};
+  check(
+      vmaCreateBuffer(m_vma, &buffer_info, &alloc_info, &m_buffer.handle, &m_buffer.allocation, &allocation_info), //
+      "creating staging arena"
+  );
+  m_mapped = static_cast<u8*>(allocation_info.pMappedData);
+
+  context.set_debug_name(m_buffer.handle, "staging arena");
+}
+
+StagingArena::~StagingArena() {
+  submit();
+  wait_idle();
+
+  vkDestroyQueryPool(m_device, m_timestamps, nullptr);
+  vkDestroySemaphore(m_device, m_timeline, nullptr);
+  vkDestroyCommandPool(m_device, m_transfer.pool, nullptr);
+  if (m_graphics.pool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(m_device, m_graphics.pool, nullptr);
+  }
+  vmaDestroyBuffer(m_vma, m_buffer.handle, m_buffer.allocation);
+}
+
+StagingArena::region_t StagingArena::allocate(VkDeviceSize size, VkDeviceSize min_size, content_t content) {
+  WASSERT(min_size > 0 and min_size <= size, "invalid staging request");
+  WASSERT(min_size <= m_segment_size, "staging request does not fit into arena segment");
+
+  if (m_segment_size - m_segment_offset < min_size) {
+    submit();
+  }
+
+  region_t region{};
+  region.cmd    = cmd();
+  region.offset = m_current_segment * m_segment_size + m_segment_offset;
+  region.size   = std::min(size, m_segment_size - m_segment_offset);
+  region.mapped = m_mapped + region.offset;
+
+  segment_t &segment = m_segments[m_current_segment];
+  (content == content_t::image ? segment.image_bytes : segment.buffer_bytes) += region.size;
+
+  m_segment_offset = std::min(align_up(m_segment_offset + region.size, copy_offset_alignment), m_segment_size);
+  return region;
+}
+
+VkCommandBuffer StagingArena::cmd() {
+  segment_t &segment = m_segments[m_current_segment];
+  begin_segment(segment);
+  return segment.transfer_cmd;
+}
+
+VkCommandBuffer StagingArena::graphics_cmd() {
+  segment_t &segment = m_segments[m_current_segment];
+  begin_segment(segment);
+  return is_dedicated() ? segment.graphics_cmd : segment.transfer_cmd;
+}
+
+void StagingArena::release(VkBuffer buffer) {
+  if (not is_dedicated()) {
+    return;
+  }
+
+  VkBufferMemoryBarrier2 barrier = {};
+  barrier.sType                  = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+  barrier.srcQueueFamilyIndex    = m_transfer.family;
+  barrier.dstQueueFamilyIndex    = m_graphics.family;
+  barrier.buffer                 = buffer;
+  barrier.offset                 = 0;
+  barrier.size                   = VK_WHOLE_SIZE;
+
+  VkDependencyInfo dependency         = {};
+  dependency.sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependency.bufferMemoryBarrierCount = 1;
+  dependency.pBufferMemoryBarriers    = &barrier;
+
+  // release: destination scope is ignored by transfer queue
+  barrier.srcStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier2(cmd(), &dependency);
+
+  // acquire: source scope is covered by timeline semaphore wait
+  barrier.srcStageMask  = VK_PIPELINE_STAGE_2_NONE;
+  barrier.srcAccessMask = VK_ACCESS_2_NONE;
+  barrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier2(graphics_cmd(), &dependency);
+}
+
+void StagingArena::release(VkImage image, VkImageSubresourceRange const &subresource) {
+  if (not is_dedicated()) {
+    return;
+  }
+
+  VkImageMemoryBarrier2 barrier = {};
+  barrier.sType                 = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.oldLayout             = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout             = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex   = m_transfer.family;
+  barrier.dstQueueFamilyIndex   = m_graphics.family;
+  barrier.image                 = image;
+  barrier.subresourceRange      = subresource;
+
+  VkDependencyInfo dependency        = {};
+  dependency.sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependency.imageMemoryBarrierCount = 1;
+  dependency.pImageMemoryBarriers    = &barrier;
+
+  barrier.srcStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier2(cmd(), &dependency);
+
+  // mips are blitted right after acquire
+  barrier.srcStageMask  = VK_PIPELINE_STAGE_2_NONE;
+  barrier.srcAccessMask = VK_ACCESS_2_NONE;
+  barrier.dstStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+  barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier2(graphics_cmd(), &dependency);
+}
+
+ticket_t StagingArena::submit() {
+  segment_t &segment = m_segments[m_current_segment];
+  if (segment.recording) {
+    submit_segment(segment);
+    m_current_segment = (m_current_segment + 1) % segment_count;
+    m_segment_offset  = 0;
+  }
+  return ticket_t{ m_timeline, m_timeline_value };
+}
+
+bool StagingArena::is_complete(u64 value) const {
+  u64 current = 0;
+  check(vkGetSemaphoreCounterValue(m_device, m_timeline, &current), "reading staging timeline");
+  return current >= value;
+}
+
+void StagingArena::wait(u64 value) {
+  WASSERT(value <= m_timeline_value, "waiting for timeline value that is never signaled");
+  if (not is_complete(value)) {
+    VkSemaphore timeline = m_timeline;
+
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType               = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount      = 1;
+    wait_info.pSemaphores         = &timeline;
+    wait_info.pValues             = &value;
+
+    auto wait_start = std::chrono::steady_clock::now();
+    check(vkWaitSemaphores(m_device, &wait_info, Submitter::wait_timeout_ns), "waiting for staging timeline");
+    m_stats.wait_ms += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+  }
+  read_timestamps(value);
+}
+
+void StagingArena::wait_idle() { wait(m_timeline_value); }
+
+void StagingArena::begin_segment(segment_t &segment) {
+  if (segment.recording) {
+    return;
+  }
+
+  // gpu may still read this part of the ring, its timestamps are read by wait() before byte counters are cleared
+  wait(segment.done_value);
+  segment.buffer_bytes = 0;
+  segment.image_bytes  = 0;
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  check(vkResetCommandBuffer(segment.transfer_cmd, 0), "reseting staging transfer command buffer");
+  check(vkBeginCommandBuffer(segment.transfer_cmd, &begin_info), "beginning staging transfer command buffer");
+  if (is_dedicated()) {
+    check(vkResetCommandBuffer(segment.graphics_cmd, 0), "reseting staging acquire command buffer");
+    check(vkBeginCommandBuffer(segment.graphics_cmd, &begin_info), "beginning staging acquire command buffer");
+  }
+  if (has_timestamps()) {
+    // previous timestamps of segment were read by wait() above
+    vkResetQueryPool(m_device, m_timestamps, m_current_segment * 2, 2);
+    vkCmdWriteTimestamp(segment.transfer_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamps, m_current_segment * 2);
+  }
+  segment.recording = true;
+}
+
+void StagingArena::submit_segment(segment_t &segment) {
+  if (not is_dedicated()) {
+    // buffer copies become visible to every later use: vertex input, acceleration structure builds, shaders
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+
+    vkCmdPipelineBarrier(segment.transfer_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+  if (has_timestamps()) {
+    vkCmdWriteTimestamp(segment.transfer_cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamps, m_current_segment * 2 + 1);
+    segment.timed = true;
+  }
+  check(vkEndCommandBuffer(segment.transfer_cmd), "ending staging transfer command buffer");
+
+  VkCommandBufferSubmitInfo transfer_cmd_info = {};
+  transfer_cmd_info.sType                     = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+  transfer_cmd_info.commandBuffer             = segment.transfer_cmd;
+
+  VkSemaphoreSubmitInfo transfer_done = {};
+  transfer_done.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  transfer_done.semaphore             = m_timeline;
+  transfer_done.value                 = m_timeline_value + 1;
+  transfer_done.stageMask             = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+  VkSubmitInfo2 transfer_submit            = {};
+  transfer_submit.sType                    = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+  transfer_submit.commandBufferInfoCount   = 1;
+  transfer_submit.pCommandBufferInfos      = &transfer_cmd_info;
+  transfer_submit.signalSemaphoreInfoCount = 1;
+  transfer_submit.pSignalSemaphoreInfos    = &transfer_done;
+
+  auto queue_lock = m_submitter->lock_queues();
+
+  check(vkQueueSubmit2(m_transfer.queue, 1, &transfer_submit, VK_NULL_HANDLE), "submiting staging uploads");
+  m_timeline_value += 1;
+
+  if (is_dedicated()) {
+    check(vkEndCommandBuffer(segment.graphics_cmd), "ending staging acquire command buffer");
+
+    VkCommandBufferSubmitInfo graphics_cmd_info = {};
+    graphics_cmd_info.sType                     = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    graphics_cmd_info.commandBuffer             = segment.graphics_cmd;
+
+    VkSemaphoreSubmitInfo acquired = transfer_done;
+    acquired.value                 = m_timeline_value + 1;
+
+    VkSubmitInfo2 graphics_submit            = {};
+    graphics_submit.sType                    = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    graphics_submit.waitSemaphoreInfoCount   = 1;
+    graphics_submit.pWaitSemaphoreInfos      = &transfer_done;
+    graphics_submit.commandBufferInfoCount   = 1;
+    graphics_submit.pCommandBufferInfos      = &graphics_cmd_info;
+    graphics_submit.signalSemaphoreInfoCount = 1;
+    graphics_submit.pSignalSemaphoreInfos    = &acquired;
+
+    check(vkQueueSubmit2(m_graphics.queue, 1, &graphics_submit, VK_NULL_HANDLE), "submiting staging acquires");
+    m_timeline_value += 1;
+  }
+
+  segment.recording  = false;
+  segment.done_value = m_timeline_value;
+  m_stats.submit_count += 1;
+}
+
+void StagingArena::read_timestamps(u64 value) {
+  for (u32 i = 0; i < segment_count; i += 1) {
+    segment_t &segment = m_segments[i];
+    if (not segment.timed or segment.done_value > value) {
+      continue;
+    }
+
+    std::array<u64, 2> ticks{};
+    check(
+        vkGetQueryPoolResults(
+            m_device, m_timestamps, i * 2, 2, //
+            sizeof(ticks), ticks.data(), sizeof(u64), VK_QUERY_RESULT_64_BIT
+        ),
+        "reading staging timestamps"
+    );
+    f64          gpu_ms = (f64) ((ticks[1] - ticks[0]) & m_tick_mask) * m_period_ns / 1e6;
+    VkDeviceSize bytes  = segment.buffer_bytes + segment.image_bytes;
+    m_stats.gpu_ms += gpu_ms;
+    m_stats.image_gpu_ms += bytes > 0 ? gpu_ms * (f64) segment.image_bytes / (f64) bytes : 0.0;
+    segment.timed = false;
+  }
+}
+
+} // namespace whim::vk
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <vulkan/vulkan_core.h>
+
+#include "vk/types.hpp"
+#include "whim.hpp"
+
+namespace whim::vk {
+
+class Context;
+class Submitter;
+
+/*
+  Persistently mapped staging ring shared by all uploads of a Context
+
+  ring is split into segments, every segment has its own command buffers:
+  while gpu copies from one segment cpu fills the next one. segment is reused only after its timeline value is reached,
+  so staging memory is allocated once per Context instead of once per uploaded resource.
+
+  copies run on transfer queue of Context. when it is a dedicated family, every resource is released by transfer queue
+  and acquired by graphics queue in a second command buffer of segment, which also generates mips (blits need graphics queue).
+  graphics side waits for transfer side on timeline semaphore, so cpu never blocks on upload
+  unless ring wraps onto segment that is still in flight or someone calls wait().
+  everything submitted is ordered before any later graphics queue submission.
+
+  arena keeps raw handles and submitter of Context only, Context owning it may be moved.
+  not thread safe, uploads are recorded through one UploadBatch at a time
+*/
+class StagingArena {
+
+public:
+  constexpr static u32          segment_count = 4;
+  constexpr static VkDeviceSize default_size  = 64ull * 1024 * 1024;
+  // satisfies texel size of every format and typical optimalBufferCopyOffsetAlignment
+  constexpr static VkDeviceSize copy_offset_alignment = 16;
+
+  // what region is copied into, gpu time of segments is split between the two by their bytes
+  enum class content_t : u32 { buffer = 0, image = 1 };
+
+  struct region_t {
+    VkCommandBuffer cmd    = VK_NULL_HANDLE; // transfer commands, copies out of region must be recorded here
+    u8*             mapped = nullptr;
+    VkDeviceSize    offset = 0; // inside buffer()
+    VkDeviceSize    size   = 0;
+  };
+
+  // lifetime counters, UploadBatch reports difference between its start and end
+  struct stats_t {
+    u32 submit_count = 0;
+    // cpu time spent waiting for segments to become free
+    f64 wait_ms = 0.0;
+    // transfer commands by timestamps, segment is counted once it is waited for. stays zero without has_timestamps()
+    f64 gpu_ms = 0.0;
+    // part of gpu_ms spent on image copies, rest went to buffers. segment holding both is split by their bytes
+    f64 image_gpu_ms = 0.0;
+  };
+
+  explicit StagingArena(Context const &context, VkDeviceSize size = default_size);
+  ~StagingArena();
+
+  StagingArena(StagingArena &&)                 = delete;
+  StagingArena &operator=(StagingArena &&)      = delete;
+  StagingArena(const StagingArena &)            = delete;
+  StagingArena &operator=(const StagingArena &) = delete;
+
+  /*
+    returns between min_size and size bytes of current segment,
+    submits it and moves to the next one when less than min_size bytes are left
+  */
+  region_t allocate(VkDeviceSize size, VkDeviceSize min_size, content_t content);
+
+  // transfer queue command buffer of current segment, begins segment if needed
+  VkCommandBuffer cmd();
+  // graphics queue command buffer of current segment, runs after its transfer commands, same as cmd() without dedicated transfer queue
+  VkCommandBuffer graphics_cmd();
+
+  /*
+    hands resource written by transfer commands of current segment over to graphics queue.
+    must be recorded after last copy into resource, image stays in TRANSFER_DST_OPTIMAL
+  */
+  void release(VkBuffer buffer);
+  void release(VkImage image, VkImageSubresourceRange const &subresource);
+
+  // submits current segment if anything is recorded, returned ticket is reached when all submitted uploads are done
+  ticket_t submit();
+
+  [[nodiscard]] bool is_complete(u64 value) const;
+  void               wait(u64 value);
+  // waits until gpu is done with every submitted segment
+  void wait_idle();
+
+  [[nodiscard]] VkBuffer       buffer() const { return m_buffer.handle; }
+  [[nodiscard]] VkDeviceSize   segment_size() const { return m_segment_size; }
+  [[nodiscard]] VkSemaphore    timeline() const { return m_timeline; }
+  [[nodiscard]] bool           is_dedicated() const { return m_transfer.family != m_graphics.family; }
+  [[nodiscard]] bool           has_timestamps() const { return m_timestamps != VK_NULL_HANDLE; }
+  [[nodiscard]] stats_t const &stats() const { return m_stats; }
+
+private:
+  struct queue_t {
+    VkQueue               queue  = VK_NULL_HANDLE;
+    u32                   family = 0;
+    handle<VkCommandPool> pool   = VK_NULL_HANDLE;
+  };
+
+  struct segment_t {
+    handle<VkCommandBuffer> transfer_cmd = VK_NULL_HANDLE;
+    handle<VkCommandBuffer> graphics_cmd = VK_NULL_HANDLE; // only with dedicated transfer queue
+    u64                     done_value   = 0;              // timeline value signaled when segment is free again
+    bool                    recording    = false;
+    bool                    timed        = false; // timestamps of submitted commands are not read yet
+    VkDeviceSize            buffer_bytes = 0;
+    VkDeviceSize            image_bytes  = 0;
+  };
+
+  void begin_segment(segment_t &segment);
+  void submit_segment(segment_t &segment);
+  // adds gpu time of every timed segment which is done at value
+  void read_timestamps(u64 value);
+
+private:
+  VkDevice     m_device    = VK_NULL_HANDLE;
+  VmaAllocator m_vma       = VK_NULL_HANDLE;
+  Submitter*   m_submitter = nullptr; // owns queue lock
+
+  queue_t m_transfer = {};
+  queue_t m_graphics = {};
+
+  handle<VkSemaphore> m_timeline       = VK_NULL_HANDLE;
+  u64                 m_timeline_value = 0; // last value signaled by submitted work
+
+  // start and end of transfer commands of every segment, only if transfer family supports timestamps
+  handle<VkQueryPool> m_timestamps = VK_NULL_HANDLE;
+  f64                 m_period_ns  = 1.0;
+  u64                 m_tick_mask  = ~0ull;
+
+  buffer_t m_buffer = {};
+  u8*      m_mapped = nullptr;
+
+  VkDeviceSize                         m_segment_size    = 0;
+  VkDeviceSize                         m_segment_offset  = 0;
+  u32                                  m_current_segment = 0;
+  std::array<segment_t, segment_count> m_segments        = {};
+
+  stats_t m_stats = {};
+};
+
+} // namespace whim::vk
@@ -0,0 +1,186 @@
+#include "vk/submitter.hpp"
+
+#include <limits>
+
+#include "vk/context.hpp"
+#include "vk/result.hpp"
+
+namespace whim::vk {
+
+namespace {
+// value of command buffer that is being recorded, it is never reached
+constexpr u64 recording = std::numeric_limits<u64>::max();
+} // namespace
+
+Submitter::Submitter(Context const &context) :
+    m_device(context.device()),
+    m_queue(context.graphics_queue()),
+    m_queue_family(context.graphics_family_index()) {
+  VkSemaphoreTypeCreateInfo timeline_type = {};
+  timeline_type.sType                     = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timeline_type.semaphoreType             = VK_SEMAPHORE_TYPE_TIMELINE;
+  timeline_type.initialValue              = 0;
+
+  VkSemaphoreCreateInfo timeline_info = {};
+  timeline_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  timeline_info.pNext                 = &timeline_type;
+
+  check(
+      vkCreateSemaphore(m_device, &timeline_info, nullptr, &m_timeline), //
+      "creating submission timeline semaphore"
+  );
+  context.set_debug_name(m_timeline, "submission timeline");
+}
+
+Submitter::~Submitter() {
+  wait_idle();
+
+  for (auto &[thread, pool] : m_pools) {
+    vkDestroyCommandPool(m_device, pool->pool, nullptr);
+  }
+  vkDestroySemaphore(m_device, m_timeline, nullptr);
+}
+
+ticket_t Submitter::submit(std::function<void(VkCommandBuffer cmd)> const &record, std::span<ticket_t const> dependencies) {
+  thread_pool_t  &pool  = thread_pool();
+  usize           index = acquire_command(pool);
+  VkCommandBuffer cmd   = pool.commands[index].cmd;
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  check(vkBeginCommandBuffer(cmd, &begin_info), "beginning submission command buffer");
+  record(cmd);
+  check(vkEndCommandBuffer(cmd), "ending submission command buffer");
+
+  std::vector<VkSemaphoreSubmitInfo> waits{};
+  waits.reserve(dependencies.size());
+  for (ticket_t const &dependency : dependencies) {
+    if (dependency.timeline == VK_NULL_HANDLE) {
+      continue;
+    }
+    VkSemaphoreSubmitInfo wait = {};
+    wait.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    wait.semaphore             = dependency.timeline;
+    wait.value                 = dependency.value;
+    wait.stageMask             = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    waits.push_back(wait);
+  }
+
+  VkCommandBufferSubmitInfo cmd_info = {};
+  cmd_info.sType                     = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+  cmd_info.commandBuffer             = cmd;
+
+  VkSemaphoreSubmitInfo signal = {};
+  signal.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  signal.semaphore             = m_timeline;
+  signal.stageMask             = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+  VkSubmitInfo2 submit            = {};
+  submit.sType                    = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+  submit.waitSemaphoreInfoCount   = (u32) waits.size();
+  submit.pWaitSemaphoreInfos      = waits.data();
+  submit.commandBufferInfoCount   = 1;
+  submit.pCommandBufferInfos      = &cmd_info;
+  submit.signalSemaphoreInfoCount = 1;
+  submit.pSignalSemaphoreInfos    = &signal;
+
+  {
+    // timeline values have to grow in submission order, so value is taken under the same lock as the queue
+    std::lock_guard lock{ m_queue_mutex };
+    signal.value = m_timeline_value + 1;
+    check(vkQueueSubmit2(m_queue, 1, &submit, VK_NULL_HANDLE), "submitting commands to graphics queue");
+    m_timeline_value = signal.value;
+  }
+
+  // record callback may submit on its own, so vector could grow since command was acquired
+  pool.commands[index].value = signal.value;
+  return ticket_t{ m_timeline, signal.value };
+}
+
+bool Submitter::is_complete(ticket_t ticket) const {
+  if (ticket.timeline == VK_NULL_HANDLE) {
+    return true;
+  }
+  u64 current = 0;
+  check(vkGetSemaphoreCounterValue(m_device, ticket.timeline, &current), "reading timeline semaphore");
+  return current >= ticket.value;
+}
+
+void Submitter::wait(ticket_t ticket) const {
+  if (ticket.timeline == VK_NULL_HANDLE) {
+    return;
+  }
+
+  VkSemaphoreWaitInfo wait_info = {};
+  wait_info.sType               = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount      = 1;
+  wait_info.pSemaphores         = &ticket.timeline;
+  wait_info.pValues             = &ticket.value;
+
+  check(vkWaitSemaphores(m_device, &wait_info, wait_timeout_ns), "waiting for timeline semaphore");
+}
+
+void Submitter::wait_idle() const {
+  u64 value = 0;
+  {
+    std::lock_guard lock{ m_queue_mutex };
+    value = m_timeline_value;
+  }
+  wait(ticket_t{ m_timeline, value });
+}
+
+std::unique_lock<std::mutex> Submitter::lock_queues() const { return std::unique_lock{ m_queue_mutex }; }
+
+Submitter::thread_pool_t &Submitter::thread_pool() {
+  std::lock_guard lock{ m_pools_mutex };
+
+  uptr<thread_pool_t> &pool = m_pools[std::this_thread::get_id()];
+  if (pool != nullptr) {
+    return *pool;
+  }
+
+  pool = std::make_unique<thread_pool_t>();
+
+  VkCommandPoolCreateInfo pool_info = {};
+  pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.queueFamilyIndex        = m_queue_family;
+  pool_info.flags                   = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  check(
+      vkCreateCommandPool(m_device, &pool_info, nullptr, &pool->pool), //
+      "creating submission command pool"
+  );
+  return *pool;
+}
+
+usize Submitter::acquire_command(thread_pool_t &pool) {
+  u64 reached = 0;
+  check(vkGetSemaphoreCounterValue(m_device, m_timeline, &reached), "reading submission timeline");
+
+  for (usize i = 0; i < pool.commands.size(); i += 1) {
+    command_t &command = pool.commands[i];
+    if (command.value <= reached) {
+      check(vkResetCommandBuffer(command.cmd, 0), "reseting submission command buffer");
+      command.value = recording;
+      return i;
+    }
+  }
+
+  VkCommandBufferAllocateInfo cmd_info = {};
+  cmd_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_info.commandPool                 = pool.pool;
+  cmd_info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_info.commandBufferCount          = 1;
+
+  command_t &command = pool.commands.emplace_back();
+  command.value      = recording;
+  check(
+      vkAllocateCommandBuffers(m_device, &cmd_info, &command.cmd), //
+      "allocating submission command buffer"
+  );
+  return pool.commands.size() - 1;
+}
+
+} // namespace whim::vk
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "vk/types.hpp"
+#include "whim.hpp"
+
+namespace whim::vk {
+
+class Context;
+
+/*
+  Asynchronous one-off submissions to graphics queue
+
+  every submission signals next value of one timeline semaphore and returns it as ticket_t,
+  tickets can be waited on by cpu or passed as dependencies of later submissions (gpu side wait, no cpu stall).
+  tickets of other timelines (StagingArena) are accepted as dependencies too.
+
+  commands are recorded on calling thread into command buffer from pool of that thread,
+  buffers are recycled once their ticket is reached, so any number of threads may submit at once.
+  VkQueue needs external synchronization: everyone else submitting or presenting holds lock_queues()
+*/
+class Submitter {
+
+public:
+  // gpu work which is not done after that is treated as lost device
+  constexpr static u64 wait_timeout_ns = 10ull * 1000 * 1000 * 1000;
+
+  explicit Submitter(Context const &context);
+  ~Submitter();
+
+  Submitter(Submitter &&)                 = delete;
+  Submitter &operator=(Submitter &&)      = delete;
+  Submitter(const Submitter &)            = delete;
+  Submitter &operator=(const Submitter &) = delete;
+
+  /*
+    returns as soon as commands are submitted, everything referenced by them must stay alive until ticket is complete.
+    commands start after all dependencies are reached
+  */
+  ticket_t submit(std::function<void(VkCommandBuffer cmd)> const &record, std::span<ticket_t const> dependencies = {});
+
+  [[nodiscard]] bool is_complete(ticket_t ticket) const;
+  void               wait(ticket_t ticket) const;
+  // waits for every submission made so far
+  void wait_idle() const;
+
+  [[nodiscard]] std::unique_lock<std::mutex> lock_queues() const;
+
+  [[nodiscard]] VkSemaphore timeline() const { return m_timeline; }
+
+private:
+  struct command_t {
+    handle<VkCommandBuffer> cmd   = VK_NULL_HANDLE;
+    u64                     value = 0; // ticket of last submission, buffer is free once it is reached
+  };
+
+  // touched only by its own thread after creation
+  struct thread_pool_t {
+    handle<VkCommandPool>  pool     = VK_NULL_HANDLE;
+    std::vector<command_t> commands = {};
+  };
+
+  thread_pool_t &thread_pool();
+  // index of free command buffer in pool, reset and ready for recording
+  usize acquire_command(thread_pool_t &pool);
+
+private:
+  VkDevice m_device       = VK_NULL_HANDLE;
+  VkQueue  m_queue        = VK_NULL_HANDLE;
+  u32      m_queue_family = 0;
+
+  handle<VkSemaphore> m_timeline       = VK_NULL_HANDLE;
+  u64                 m_timeline_value = 0; // last signaled value, guarded by m_queue_mutex
+
+  std::mutex                                               m_pools_mutex;
+  std::unordered_map<std::thread::id, uptr<thread_pool_t>> m_pools = {};
+
+  mutable std::mutex m_queue_mutex;
+};
+
+} // namespace whim::vk
@@ -20,6 +20,12 @@ struct image_t {
   ::whim::vk::handle<VmaAllocation> allocation = VK_NULL_HANDLE;
 };
 
+// point on timeline semaphore, work behind ticket is done when semaphore reaches value
+struct ticket_t {
+  VkSemaphore timeline = VK_NULL_HANDLE; // null ticket is always complete
+  u64         value    = 0;
+};
+
 struct acceleration_structure_t {
   handle<VkAccelerationStructureKHR> handle = VK_NULL_HANDLE;
   buffer_t                           buffer = {};
@@ -0,0 +1,80 @@
+#include "vk/uniform_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "utility/align.hpp"
+#include "vk/result.hpp"
+
+namespace whim::vk {
+
+UniformRing::UniformRing(Context &context, u32 frame_count, VkDeviceSize frame_size) :
+    m_context_ref(context),
+    m_frame_count(frame_count) {
+  WASSERT(frame_count > 0, "uniform ring needs at least one frame");
+
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(context.physical_device(), &properties);
+  m_alignment  = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 16);
+  m_frame_size = align_up(frame_size, m_alignment);
+
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size               = m_frame_size * frame_count;
+  buffer_info.usage              = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | //
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+  // host visible device local memory (BAR or unified) is preferred, shaders read it without any copy
+  VmaAllocationCreateInfo alloc_info = {};
+  alloc_info.usage                   = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+  alloc_info.flags                   = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  alloc_info.preferredFlags          = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  VmaAllocationInfo allocation_info = {};
+  check(
+      vmaCreateBuffer(context.vma_allocator(), &buffer_info, &alloc_info, &m_buffer.handle, &m_buffer.allocation, &allocation_info), //
+      "creating uniform ring"
+  );
+  m_mapped  = static_cast<u8*>(allocation_info.pMappedData);
+  m_address = context.get_buffer_device_address(m_buffer.handle);
+
+  context.set_debug_name(m_buffer.handle, "uniform ring");
+}
+
+UniformRing::~UniformRing() {
+  Context &context = m_context_ref;
+  vmaDestroyBuffer(context.vma_allocator(), m_buffer.handle, m_buffer.allocation);
+}
+
+void UniformRing::begin_frame(u32 frame_index) {
+  WASSERT(frame_index < m_frame_count, "frame index is out of uniform ring");
+  m_frame_offset = frame_index * m_frame_size;
+  m_cursor       = 0;
+}
+
+UniformRing::allocation_t UniformRing::allocate(VkDeviceSize size) {
+  VkDeviceSize offset = align_up(m_cursor, m_alignment);
+  if (offset + size > m_frame_size) {
+    WERROR("uniform ring frame region of {} bytes is exhausted, {} bytes requested", m_frame_size, size);
+    throw std::runtime_error("uniform ring overflow");
+  }
+  m_cursor = offset + size;
+
+  allocation_t allocation{};
+  allocation.mapped  = m_mapped + m_frame_offset + offset;
+  allocation.offset  = (u32) (m_frame_offset + offset);
+  allocation.address = m_address + m_frame_offset + offset;
+  return allocation;
+}
+
+void UniformRing::flush() {
+  Context &context = m_context_ref;
+  if (m_cursor == 0) {
+    return;
+  }
+  // no-op for coherent memory
+  check(vmaFlushAllocation(context.vma_allocator(), m_buffer.allocation, m_frame_offset, m_cursor), "flushing uniform ring");
+}
+
+} // namespace whim::vk
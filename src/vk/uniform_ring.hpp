@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstring>
+#include <vulkan/vulkan_core.h>
+
+#include "vk/context.hpp"
+#include "vk/types.hpp"
+#include "whim.hpp"
+
+namespace whim::vk {
+
+/*
+  Per frame data written by cpu straight into persistently mapped memory
+
+  buffer is split into one region per frame in flight, region of frame is reused after its fence is signaled.
+  data is addressed by offset inside buffer: as dynamic offset of UNIFORM_BUFFER_DYNAMIC descriptor
+  or through device address, so new per frame data needs neither transfer commands nor barriers.
+  host writes are made visible by vkQueueSubmit, flush() is only needed for non coherent memory.
+  buffer also accepts vkCmdUpdateBuffer, so transfer upload can be measured against mapped writes
+*/
+class UniformRing {
+
+public:
+  constexpr static VkDeviceSize default_frame_size = 64ull * 1024;
+
+  struct allocation_t {
+    void*           mapped  = nullptr;
+    u32             offset  = 0; // from start of buffer, dynamic offset of descriptor
+    VkDeviceAddress address = 0;
+  };
+
+  UniformRing(Context &context, u32 frame_count, VkDeviceSize frame_size = default_frame_size);
+  ~UniformRing();
+
+  UniformRing(UniformRing &&)                 = delete;
+  UniformRing &operator=(UniformRing &&)      = delete;
+  UniformRing(const UniformRing &)            = delete;
+  UniformRing &operator=(const UniformRing &) = delete;
+
+  // caller guarantees that gpu is done with previous use of frame region
+  void begin_frame(u32 frame_index);
+
+  // aligned to minUniformBufferOffsetAlignment, throws when frame region is exhausted
+  allocation_t allocate(VkDeviceSize size);
+
+  template<typename T>
+  allocation_t push(T const &data) {
+    allocation_t allocation = allocate(sizeof(T));
+    memcpy(allocation.mapped, &data, sizeof(T));
+    return allocation;
+  }
+
+  // flushes everything allocated in current frame region
+  void flush();
+
+  [[nodiscard]] VkBuffer     buffer() const { return m_buffer.handle; }
+  [[nodiscard]] VkDeviceSize frame_size() const { return m_frame_size; }
+
+private:
+  ref<Context> m_context_ref;
+
+  buffer_t        m_buffer  = {};
+  u8*             m_mapped  = nullptr;
+  VkDeviceAddress m_address = 0;
+
+  VkDeviceSize m_alignment    = 0;
+  VkDeviceSize m_frame_size   = 0;
+  u32          m_frame_count  = 0;
+  VkDeviceSize m_frame_offset = 0; // start of current frame region
+  VkDeviceSize m_cursor       = 0; // inside current frame region
+};
+
+} // namespace whim::vk
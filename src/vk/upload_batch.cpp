@@ -0,0 +1,154 @@
+#include "vk/upload_batch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "vk/result.hpp"
+
+namespace whim::vk {
+
+namespace {
+// smaller tail of segment is skipped, so large buffers are not split into many tiny copies
+constexpr VkDeviceSize min_buffer_chunk = 64ull * 1024;
+} // namespace
+
+UploadBatch::UploadBatch(Context &context) :
+    m_context_ref(context),
+    m_arena_start(context.staging_arena().stats()) {}
+
+UploadBatch::~UploadBatch() { submit(); }
+
+buffer_t UploadBatch::create_buffer(
+    VkDeviceSize size, void const* data, //
+    VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_props
+) {
+  Context &context = m_context_ref;
+  WASSERT(size != 0, "zero size not allowed");
+
+  buffer_t result = {};
+
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size               = size;
+  buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage;
+  buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo buffer_alloc = {};
+  buffer_alloc.usage                   = VMA_MEMORY_USAGE_GPU_ONLY;
+  buffer_alloc.requiredFlags           = mem_props;
+
+  check(
+      vmaCreateBuffer(context.vma_allocator(), &buffer_info, &buffer_alloc, &result.handle, &result.allocation, nullptr), //
+      "creating destination buffer for transferring"
+  );
+
+  upload(result.handle, 0, data, size);
+  m_stats.buffers.count += 1;
+  return result;
+}
+
+void UploadBatch::upload(VkBuffer buffer, VkDeviceSize offset, void const* data, VkDeviceSize size) {
+  Context      &context = m_context_ref;
+  StagingArena &arena   = context.staging_arena();
+
+  u8 const*    bytes = static_cast<u8 const*>(data);
+  VkDeviceSize done  = 0;
+  while (done < size) {
+    VkDeviceSize           remaining = size - done;
+    StagingArena::region_t region    = arena.allocate(remaining, std::min(remaining, min_buffer_chunk), StagingArena::content_t::buffer);
+
+    auto staging_start = std::chrono::steady_clock::now();
+    memcpy(region.mapped, bytes + done, region.size);
+    m_stats.buffers.staging_ms += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - staging_start).count();
+
+    VkBufferCopy copy = {};
+    copy.srcOffset    = region.offset;
+    copy.dstOffset    = offset + done;
+    copy.size         = region.size;
+
+    vkCmdCopyBuffer(region.cmd, arena.buffer(), buffer, 1, &copy);
+
+    m_stats.buffers.bytes += region.size;
+    done += region.size;
+  }
+  arena.release(buffer);
+}
+
+void UploadBatch::upload(VkImage image, VkImageCreateInfo const &image_info, u8 const* pixels, VkDeviceSize size) {
+  Context      &context = m_context_ref;
+  StagingArena &arena   = context.staging_arena();
+
+  u32 width  = image_info.extent.width;
+  u32 height = image_info.extent.height;
+  WASSERT(image_info.imageType == VK_IMAGE_TYPE_2D and height > 0 and size % height == 0, "image data size does not match its extent");
+
+  VkDeviceSize row_pitch = size / height;
+  WASSERT(row_pitch <= arena.segment_size(), "image row does not fit into staging segment");
+
+  VkImageSubresourceRange subresource_range{};
+  subresource_range.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresource_range.baseArrayLayer = 0;
+  subresource_range.baseMipLevel   = 0;
+  subresource_range.layerCount     = 1;
+  subresource_range.levelCount     = image_info.mipLevels;
+
+  context.transition_image(arena.cmd(), image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresource_range);
+
+  u32 rows_done = 0;
+  while (rows_done < height) {
+    StagingArena::region_t region = arena.allocate((height - rows_done) * row_pitch, row_pitch, StagingArena::content_t::image);
+
+    u32          rows      = (u32) (region.size / row_pitch);
+    VkDeviceSize band_size = rows * row_pitch;
+
+    auto staging_start = std::chrono::steady_clock::now();
+    memcpy(region.mapped, pixels + rows_done * row_pitch, band_size);
+    m_stats.images.staging_ms += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - staging_start).count();
+
+    VkBufferImageCopy copy               = {};
+    copy.bufferOffset                    = region.offset;
+    copy.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy.imageSubresource.mipLevel       = 0;
+    copy.imageSubresource.baseArrayLayer = 0;
+    copy.imageSubresource.layerCount     = 1;
+    copy.imageOffset                     = { 0, (i32) rows_done, 0 };
+    copy.imageExtent                     = { width, rows, 1 };
+
+    vkCmdCopyBufferToImage(region.cmd, arena.buffer(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+    m_stats.images.bytes += band_size;
+    rows_done += rows;
+  }
+
+  // blits are not supported by transfer queue, mips are generated after image is acquired by graphics queue
+  arena.release(image, subresource_range);
+  context.record_mipmaps(arena.graphics_cmd(), image, image_info);
+  m_stats.images.count += 1;
+}
+
+ticket_t UploadBatch::submit() {
+  Context &context = m_context_ref;
+  return context.staging_arena().submit();
+}
+
+void UploadBatch::flush() {
+  Context      &context = m_context_ref;
+  StagingArena &arena   = context.staging_arena();
+
+  arena.wait(arena.submit().value);
+}
+
+UploadBatch::stats_t UploadBatch::stats() const {
+  Context const &context = m_context_ref;
+
+  StagingArena::stats_t const &arena  = context.staging_arena().stats();
+  stats_t                      result = m_stats;
+  result.submit_count                 = arena.submit_count - m_arena_start.submit_count;
+  result.wait_ms                      = arena.wait_ms - m_arena_start.wait_ms;
+  result.images.gpu_ms                = arena.image_gpu_ms - m_arena_start.image_gpu_ms;
+  result.buffers.gpu_ms               = (arena.gpu_ms - m_arena_start.gpu_ms) - result.images.gpu_ms;
+  return result;
+}
+
+} // namespace whim::vk
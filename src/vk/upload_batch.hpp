@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "vk/context.hpp"
+#include "vk/staging_arena.hpp"
+#include "vk/types.hpp"
+#include "whim.hpp"
+
+namespace whim::vk {
+
+/*
+  Records buffer and image uploads through staging arena of Context
+
+  uploads of whole batch share staging submits: arena segment is submitted only when it is full or on submit(),
+  so loading a scene costs a few submits instead of one staging allocation and one blocking submit per resource.
+  after submit() resources may be used by any later graphics queue submission, cpu waits only in flush()
+*/
+class UploadBatch {
+
+public:
+  // uploads of one resource kind
+  struct part_stats_t {
+    u32          count = 0;
+    VkDeviceSize bytes = 0;
+    // cpu time spent copying data into arena
+    f64 staging_ms = 0.0;
+    // transfer commands on gpu, complete only once everything submitted by batch is waited for (see StagingArena::stats_t)
+    f64 gpu_ms = 0.0;
+  };
+
+  struct stats_t {
+    part_stats_t buffers      = {};
+    part_stats_t images       = {};
+    u32          submit_count = 0;
+    // cpu time spent waiting for arena segments to become free
+    f64 wait_ms = 0.0;
+  };
+
+  explicit UploadBatch(Context &context);
+  // submits everything that is still recorded
+  ~UploadBatch();
+
+  UploadBatch(UploadBatch &&)                 = delete;
+  UploadBatch &operator=(UploadBatch &&)      = delete;
+  UploadBatch(const UploadBatch &)            = delete;
+  UploadBatch &operator=(const UploadBatch &) = delete;
+
+  // TRANSFER_DST is added to usage
+  buffer_t create_buffer(
+      VkDeviceSize size, void const* data, //
+      VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  );
+
+  template<typename T>
+  buffer_t create_buffer(
+      std::vector<T> const &data, //
+      VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  ) {
+    WASSERT(not data.empty(), "data vector should be non empty!");
+    return create_buffer(sizeof(T) * data.size(), data.data(), usage, mem_props);
+  }
+
+  /*
+    buffers larger than arena segment are copied in several parts.
+    buffer must not be in use by gpu, with dedicated transfer queue ownership of whole buffer moves
+    between queue families, so its contents outside of uploaded range become undefined
+  */
+  void upload(VkBuffer buffer, VkDeviceSize offset, void const* data, VkDeviceSize size);
+
+  /*
+    image should be freshly created 2D color image with TRANSFER_DST usage (and TRANSFER_SRC if it has mips),
+    pixels are tightly packed level 0 of size bytes. images larger than a segment are copied by row bands.
+    for graphics queue work submitted after submit() image is in SHADER_READ_ONLY_OPTIMAL layout with all mips generated
+  */
+  void upload(VkImage image, VkImageCreateInfo const &image_info, u8 const* pixels, VkDeviceSize size);
+
+  // submits everything recorded so far, returned ticket can be waited on or passed as dependency to Submitter
+  ticket_t submit();
+  // submits and waits until gpu is done
+  void flush();
+
+  [[nodiscard]] stats_t stats() const;
+
+private:
+  ref<Context> m_context_ref;
+
+  StagingArena::stats_t m_arena_start = {};
+  stats_t               m_stats       = {};
+};
+
+} // namespace whim::vk
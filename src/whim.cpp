@@ -14,4 +14,7 @@
 #include "tiny_gltf.h"
 
 #define STB_IMAGE_IMPLEMENTATION
-#include "external/stb_image.h"
\ No newline at end of file
+#include "external/stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
@@ -4,6 +4,7 @@
 #include <utility>
 
 #include "GLFW/glfw3.h"
+#include "utility/trace.hpp"
 #include "vk/result.hpp"
 
 namespace whim {
@@ -43,9 +44,13 @@ Window::~Window() {
 // FIXME: should fun be passed as reference?...
 void Window::run(std::function<void(void)> fun) {
   while (!glfwWindowShouldClose(m_handle)) {
+    WTRACE_ZONE("frame");
 
     fun();
-    glfwPollEvents();
+    {
+      WTRACE_ZONE("poll events");
+      glfwPollEvents();
+    }
   }
 }
 
@@ -0,0 +1,144 @@
+/*
+  BVH test
+
+  closest hits of Bvh::traverse are compared with linear scan over all triangles, for serial and parallel builds
+  with several leaf sizes. both sides use the same triangle test, so distances must match exactly
+*/
+
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "bvh/bvh.hpp"
+#include "test_common.hpp"
+#include "utility/thread_pool.hpp"
+
+namespace {
+
+using namespace whim;
+
+struct triangle_soup_t {
+  std::vector<glm::vec3> positions{};
+  std::vector<u32>       indices{};
+};
+
+constexpr f32 miss = std::numeric_limits<f32>::infinity();
+
+triangle_soup_t random_triangles(u32 count, std::mt19937 &rng) {
+  std::uniform_real_distribution<f32> position{ 0.f, 1.f };
+  std::uniform_real_distribution<f32> offset{ -0.05f, 0.05f };
+
+  triangle_soup_t soup{};
+  for (u32 i = 0; i < count; i += 1) {
+    glm::vec3 center{ position(rng), position(rng), position(rng) };
+    for (u32 corner = 0; corner < 3; corner += 1) {
+      soup.indices.push_back((u32) soup.positions.size());
+      soup.positions.push_back(center + glm::vec3{ offset(rng), offset(rng), offset(rng) });
+    }
+  }
+  return soup;
+}
+
+/*
+  scalar Moller-Trumbore, same as ray_bench uses
+*/
+bool intersect_triangle(triangle_soup_t const &soup, u32 triangle, bvh::ray_t const &ray, f32 &t) {
+  glm::vec3 p0    = soup.positions[soup.indices[triangle * 3 + 0]];
+  glm::vec3 edge1 = soup.positions[soup.indices[triangle * 3 + 1]] - p0;
+  glm::vec3 edge2 = soup.positions[soup.indices[triangle * 3 + 2]] - p0;
+
+  glm::vec3 pvec = glm::cross(ray.direction, edge2);
+  f32       det  = glm::dot(edge1, pvec);
+  if (det == 0.f) {
+    return false;
+  }
+  f32 inverse_det = 1.f / det;
+
+  glm::vec3 tvec = ray.origin - p0;
+  f32       u    = glm::dot(tvec, pvec) * inverse_det;
+  glm::vec3 qvec = glm::cross(tvec, edge1);
+  f32       v    = glm::dot(ray.direction, qvec) * inverse_det;
+  if (u < 0.f || v < 0.f || u + v > 1.f) {
+    return false;
+  }
+
+  t = glm::dot(edge2, qvec) * inverse_det;
+  return t >= ray.t_min && t <= ray.t_max;
+}
+
+f32 closest_linear(triangle_soup_t const &soup, bvh::ray_t ray) {
+  f32 closest = miss;
+  for (u32 triangle = 0; triangle < soup.indices.size() / 3; triangle += 1) {
+    f32 t = 0.f;
+    if (intersect_triangle(soup, triangle, ray, t)) {
+      closest   = t;
+      ray.t_max = t;
+    }
+  }
+  return closest;
+}
+
+f32 closest_bvh(triangle_soup_t const &soup, bvh::Bvh const &tree, bvh::ray_t ray) {
+  bool hit = tree.traverse(ray, [&](u32 triangle, bvh::ray_t &r) {
+    f32 t = 0.f;
+    if (intersect_triangle(soup, triangle, r, t)) {
+      r.t_max = t;
+      return true;
+    }
+    return false;
+  });
+  return hit ? ray.t_max : miss;
+}
+
+/*
+  rays start around the soup and aim at random points inside it, some of them leave through empty space
+*/
+std::vector<bvh::ray_t> random_rays(u32 count, std::mt19937 &rng) {
+  std::uniform_real_distribution<f32> outside{ -1.f, 2.f };
+  std::uniform_real_distribution<f32> inside{ 0.f, 1.f };
+
+  std::vector<bvh::ray_t> rays{};
+  for (u32 i = 0; i < count; i += 1) {
+    glm::vec3 origin{ outside(rng), outside(rng), outside(rng) };
+    glm::vec3 target{ inside(rng), inside(rng), inside(rng) };
+    rays.push_back(bvh::ray_t{ .origin = origin, .direction = glm::normalize(target - origin), .t_min = 0.f, .t_max = 10.f });
+  }
+  return rays;
+}
+
+void check_build(triangle_soup_t const &soup, std::span<bvh::ray_t const> rays, ThreadPool* pool, bvh::build_options_t const &options) {
+  bvh::Bvh tree = bvh::Bvh::build_triangles(soup.positions, soup.indices, pool, options);
+  WCHECK(tree.primitive_indices().size() == soup.indices.size() / 3, "every triangle is referenced once");
+
+  u32 hits       = 0;
+  u32 mismatches = 0;
+  for (auto const &ray : rays) {
+    f32 expected = closest_linear(soup, ray);
+    hits += expected != miss ? 1 : 0;
+    mismatches += closest_bvh(soup, tree, ray) != expected ? 1 : 0;
+  }
+  WCHECK(mismatches == 0, fmt::format("{} of {} rays differ from linear scan (leaf size {})", mismatches, rays.size(), options.max_leaf_size));
+  WCHECK(hits > 0 and hits < rays.size(), "rays both hit and miss");
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng{ 42 };
+  ThreadPool   pool{ 4 };
+
+  triangle_soup_t         soup = random_triangles(2000, rng);
+  std::vector<bvh::ray_t> rays = random_rays(2000, rng);
+
+  for (u32 leaf_size : { 1u, 4u, 8u }) {
+    check_build(soup, rays, nullptr, { .max_leaf_size = leaf_size });
+    // low threshold so parallel binning and child tasks run on small soup
+    check_build(soup, rays, &pool, { .max_leaf_size = leaf_size, .parallel_threshold = 64 });
+  }
+
+  bvh::Bvh   empty = bvh::Bvh::build_triangles({}, {}, nullptr);
+  bvh::ray_t ray   = rays.front();
+  WCHECK(empty.empty() and not empty.traverse(ray, [](u32, bvh::ray_t &) { return true; }), "empty tree is never hit");
+
+  return test::finish("bvh_test");
+}
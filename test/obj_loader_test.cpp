@@ -0,0 +1,146 @@
+/*
+  OBJ loader test
+
+  small fixture with relative (negative) indices is checked triangle by triangle, then a generated scene big enough
+  to be split into several parse chunks is loaded with relative and with absolute indices, both must give the same arrays
+*/
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "obj_loader.hpp"
+#include "test_common.hpp"
+#include "utility/thread_pool.hpp"
+
+namespace {
+
+using namespace whim;
+
+using triangle_t = std::array<glm::vec3, 3>;
+
+std::vector<triangle_t> primitive_triangles(scene_data_t const &scene, primitive_full_info const &info) {
+  std::vector<triangle_t> triangles{};
+  for (u32 i = 0; i + 2 < info.index_count; i += 3) {
+    triangle_t triangle{};
+    for (u32 corner = 0; corner < 3; corner += 1) {
+      triangle[corner] = scene.positions[info.vertex_offset + scene.indices[info.index_offset + i + corner]];
+    }
+    triangles.push_back(triangle);
+  }
+  return triangles;
+}
+
+bool contains(std::vector<triangle_t> const &triangles, triangle_t const &triangle) {
+  return std::find(triangles.begin(), triangles.end(), triangle) != triangles.end();
+}
+
+primitive_full_info const* find_primitive(scene_data_t const &scene, glm::vec3 base_color) {
+  for (auto const &info : scene.primitive_infos) {
+    if (scene.materials[info.material_index].base_color_factor == base_color) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+void check_fixture(ThreadPool &pool) {
+  scene_data_t scene{};
+  load_obj(WHIM_TEST_DATA_DIR "/negative_indices.obj", scene, pool, { .use_scene_cache = false });
+
+  auto const* red  = find_primitive(scene, glm::vec3{ 1.f, 0.f, 0.f });
+  auto const* blue = find_primitive(scene, glm::vec3{ 0.f, 0.f, 1.f });
+  WCHECK(scene.primitive_infos.size() == 2 and red != nullptr and blue != nullptr, "one primitive per used material");
+  if (red == nullptr || blue == nullptr) {
+    return;
+  }
+
+  // quad is a fan of two triangles over four welded vertices
+  std::vector<triangle_t> quad = primitive_triangles(scene, *red);
+  WCHECK(red->vertex_count == 4 and quad.size() == 2, "quad has four vertices and two triangles");
+  WCHECK(contains(quad, { glm::vec3{ 0.f, 0.f, 0.f }, glm::vec3{ 1.f, 0.f, 0.f }, glm::vec3{ 1.f, 1.f, 0.f } }), "first quad triangle");
+  WCHECK(contains(quad, { glm::vec3{ 0.f, 0.f, 0.f }, glm::vec3{ 1.f, 1.f, 0.f }, glm::vec3{ 0.f, 1.f, 0.f } }), "second quad triangle");
+  for (u32 i = red->vertex_offset; i < red->vertex_offset + red->vertex_count; i += 1) {
+    // obj uv origin is bottom left, loader flips v
+    glm::vec3 position = scene.positions[i];
+    WCHECK(scene.uvs[i] == glm::vec2(position.x, 1.f - position.y), "quad uv comes from relative uv index");
+    WCHECK(scene.normals[i] == glm::vec3(0.f, 0.f, 1.f), "quad normal comes from relative normal index");
+  }
+
+  std::vector<triangle_t> triangles = primitive_triangles(scene, *blue);
+  WCHECK(blue->vertex_count == 3 and triangles.size() == 2, "triangles share three vertices");
+  WCHECK(contains(triangles, { glm::vec3{ 0.f, 0.f, 1.f }, glm::vec3{ 0.f, 2.f, 1.f }, glm::vec3{ 2.f, 0.f, 1.f } }), "relative triangle");
+  WCHECK(contains(triangles, { glm::vec3{ 0.f, 0.f, 1.f }, glm::vec3{ 2.f, 0.f, 1.f }, glm::vec3{ 0.f, 2.f, 1.f } }), "mixed triangle");
+  for (u32 i = blue->vertex_offset; i < blue->vertex_offset + blue->vertex_count; i += 1) {
+    WCHECK(scene.normals[i] == glm::vec3(0.f, 0.f, -1.f), "relative and absolute normal index resolve to the same normal");
+  }
+}
+
+/*
+  grid of quads, every quad writes its own four vertices followed by a face referencing them
+*/
+void write_grid(std::filesystem::path const &path, u32 size, bool relative) {
+  std::ofstream file{ path };
+  u32           first = 1;
+  for (u32 y = 0; y < size; y += 1) {
+    for (u32 x = 0; x < size; x += 1) {
+      file << fmt::format("v {} {} 0\nv {} {} 0\nv {} {} 0\nv {} {} 0\n", x, y, x + 1, y, x + 1, y + 1, x, y + 1);
+      file << fmt::format("vt {} {}\n", (f32) x / size, (f32) y / size);
+      if (relative) {
+        file << "f -4/-1 -3/-1 -2/-1 -1/-1\n";
+      } else {
+        file << fmt::format("f {0}/{4} {1}/{4} {2}/{4} {3}/{4}\n", first, first + 1, first + 2, first + 3, (first + 3) / 4);
+      }
+      first += 4;
+    }
+  }
+}
+
+void check_chunked(ThreadPool &pool) {
+  auto directory = std::filesystem::temp_directory_path() / "whim_test";
+  std::filesystem::create_directories(directory);
+  auto relative_path = directory / "grid_relative.obj";
+  auto absolute_path = directory / "grid_absolute.obj";
+  write_grid(relative_path, 128, true);
+  write_grid(absolute_path, 128, false);
+
+  scene_data_t     relative{};
+  scene_data_t     absolute{};
+  obj_load_stats_t stats = load_obj(relative_path.string(), relative, pool, { .use_scene_cache = false });
+  load_obj(absolute_path.string(), absolute, pool, { .use_scene_cache = false });
+
+  // relative indices of later chunks are resolved against attributes of earlier ones
+  WCHECK(stats.chunk_count > 1, fmt::format("grid of {} bytes is split into chunks", stats.file_bytes));
+  WCHECK(relative.positions.size() == 128 * 128 * 4 and relative.indices.size() == 128 * 128 * 6, "every quad has own vertices and two triangles");
+  WCHECK(relative.positions == absolute.positions, "relative and absolute indices give the same positions");
+  WCHECK(relative.uvs == absolute.uvs, "relative and absolute indices give the same uvs");
+  WCHECK(relative.indices == absolute.indices, "relative and absolute indices give the same triangles");
+
+  // reference before the first vertex
+  auto invalid_path = directory / "invalid_relative.obj";
+  std::ofstream{ invalid_path } << "v 0 0 0\nv 1 0 0\nv 0 1 0\nf -4 -3 -2\n";
+  bool thrown = false;
+  try {
+    scene_data_t invalid{};
+    load_obj(invalid_path.string(), invalid, pool, { .use_scene_cache = false });
+  } catch (std::runtime_error const &) {
+    thrown = true;
+  }
+  WCHECK(thrown, "relative index before first vertex is rejected");
+
+  std::filesystem::remove_all(directory);
+}
+
+} // namespace
+
+int main() {
+  ThreadPool pool{ 4 };
+
+  check_fixture(pool);
+  check_chunked(pool);
+
+  return test::finish("obj_loader_test");
+}
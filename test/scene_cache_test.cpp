@@ -0,0 +1,160 @@
+/*
+  scene cache test
+
+  writes a small scene into cache and reads it back, then breaks the cache file and its inputs in several ways.
+  every broken entry must be rejected and leave scene empty, nothing may be read past end of the file
+*/
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "scene.hpp"
+#include "scene_cache.hpp"
+#include "test_common.hpp"
+
+namespace {
+
+using namespace whim;
+
+constexpr std::string_view source_path     = "scene.obj";
+constexpr std::string_view dependency_path = "scene.mtl";
+
+// fixed part of cache header (magic, version and six u64 fields) is followed by section table, positions come first
+constexpr usize positions_section_offset = 56;
+
+void write_text(std::string_view path, std::string_view text) { std::ofstream{ std::filesystem::path(path) } << text; }
+
+std::vector<char> read_bytes(std::filesystem::path const &path) {
+  std::ifstream in{ path, std::ios::binary };
+  return std::vector<char>{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+}
+
+void write_bytes(std::filesystem::path const &path, std::span<char const> bytes) {
+  std::ofstream out{ path, std::ios::binary | std::ios::trunc };
+  out.write(bytes.data(), (std::streamsize) bytes.size());
+}
+
+std::filesystem::path cache_file() {
+  for (auto const &entry : std::filesystem::directory_iterator{ scene_cache_directory }) {
+    if (entry.path().extension() == ".wsc") {
+      return entry.path();
+    }
+  }
+  return {};
+}
+
+scene_data_t make_scene() {
+  scene_data_t scene{};
+  scene.positions = { { 0.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, { 1.f, 1.f, 0.f } };
+  scene.indices   = { 0, 1, 2, 2, 1, 3 };
+  scene.normals   = { { 0.f, 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f, 1.f } };
+  scene.uvs       = { { 0.f, 0.f }, { 1.f, 0.f }, { 0.f, 1.f }, { 1.f, 1.f } };
+
+  material m          = {};
+  m.base_color_factor = glm::vec3{ 0.5f, 0.25f, 1.f };
+  m.roughness_factor  = 0.75f;
+  m.n_texture         = 0;
+  scene.materials     = { m };
+
+  scene.primitive_infos = { primitive_full_info{ .index_count = 6, .vertex_count = 4 } };
+  scene.nodes           = { node{ .world_matrix = glm::mat4{ 2.f }, .primitive_mesh = 0, .source_node = 3 } };
+  scene.mesh_to_primitives[0] = { 0 };
+  scene.images.push_back(image_data_t{ .width = 2, .height = 1, .pixels = { 1, 2, 3, 4, 5, 6, 7, 8 } });
+  return scene;
+}
+
+void check_equal(scene_data_t const &read, scene_data_t const &written) {
+  WCHECK(read.positions == written.positions and read.indices == written.indices, "geometry round trip");
+  WCHECK(read.normals == written.normals and read.uvs == written.uvs, "attribute round trip");
+  WCHECK(
+      read.materials.size() == 1 and std::memcmp(read.materials.data(), written.materials.data(), sizeof(material)) == 0, //
+      "material round trip"
+  );
+  WCHECK(
+      read.primitive_infos.size() == 1 and read.primitive_infos[0].index_count == 6 and read.primitive_infos[0].vertex_count == 4, //
+      "primitive round trip"
+  );
+  WCHECK(
+      read.nodes.size() == 1 and read.nodes[0].world_matrix == written.nodes[0].world_matrix and read.nodes[0].source_node == 3, //
+      "node round trip"
+  );
+  WCHECK(read.mesh_to_primitives == written.mesh_to_primitives, "mesh map round trip");
+
+  bool same_pixels = read.images.size() == 1 and read.images[0].width == 2 and read.images[0].height == 1;
+  same_pixels      = same_pixels and std::ranges::equal(read.images[0].data(), written.images[0].data());
+  WCHECK(same_pixels, "image round trip");
+  WCHECK(read.images.size() == 1 and read.images[0].pixels.empty() and read.cache_mapping != nullptr, "pixels stay in mapping");
+}
+
+/*
+  writes fresh cache, lets damage change it and expects read to reject it with empty scene
+*/
+template<typename F>
+void check_rejected(scene_data_t const &scene, std::vector<std::string> const &dependencies, std::string_view what, F &&damage) {
+  write_scene_cache(source_path, 0, scene, dependencies);
+  damage(cache_file());
+
+  scene_data_t read{};
+  bool         accepted = read_scene_cache(source_path, 0, read);
+  WCHECK(not accepted, fmt::format("cache with {} is rejected", what));
+  WCHECK(read.positions.empty() and read.images.empty() and read.cache_mapping == nullptr, fmt::format("cache with {} leaves scene empty", what));
+}
+
+} // namespace
+
+int main() {
+  // cache directory is relative, so the whole test runs in its own directory
+  auto directory = std::filesystem::temp_directory_path() / "whim_scene_cache_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  std::filesystem::current_path(directory);
+
+  write_text(source_path, "o quad\n");
+  write_text(dependency_path, "newmtl quad\n");
+  std::vector<std::string> dependencies = { std::string(dependency_path) };
+  scene_data_t             scene        = make_scene();
+
+  {
+    scene_data_t missing{};
+    WCHECK(not read_scene_cache(source_path, 0, missing), "no cache before first write");
+
+    write_scene_cache(source_path, 0, scene, dependencies);
+    scene_data_t read{};
+    WCHECK(read_scene_cache(source_path, 0, read), "fresh cache is accepted");
+    check_equal(read, scene);
+
+    scene_data_t other_variant{};
+    WCHECK(not read_scene_cache(source_path, 1, other_variant), "variants have their own entries");
+  }
+
+  check_rejected(scene, dependencies, "truncated header", [](std::filesystem::path const &path) { //
+    std::filesystem::resize_file(path, 16);
+  });
+  check_rejected(scene, dependencies, "truncated sections", [](std::filesystem::path const &path) { //
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+  });
+  check_rejected(scene, dependencies, "wrong magic", [](std::filesystem::path const &path) {
+    std::vector<char> bytes = read_bytes(path);
+    bytes[0] ^= 0x5a;
+    write_bytes(path, bytes);
+  });
+  // offset close to u64 max wraps around when size is added to it
+  check_rejected(scene, dependencies, "overflowing section offset", [](std::filesystem::path const &path) {
+    std::vector<char> bytes  = read_bytes(path);
+    u64               offset = ~0ull - 7;
+    std::memcpy(bytes.data() + positions_section_offset, &offset, sizeof(offset));
+    write_bytes(path, bytes);
+  });
+  check_rejected(scene, dependencies, "changed dependency", [](std::filesystem::path const &) { //
+    write_text(dependency_path, "newmtl quad\nKd 1 0 0\n");
+  });
+  check_rejected(scene, dependencies, "changed source", [](std::filesystem::path const &) { //
+    write_text(source_path, "o quad\nv 0 0 0\n");
+  });
+
+  std::filesystem::current_path(std::filesystem::temp_directory_path());
+  std::filesystem::remove_all(directory);
+  return test::finish("scene_cache_test");
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdlib>
+#include <string_view>
+
+#include "utility/log.hpp"
+#include "utility/types.hpp"
+
+namespace whim::test {
+
+inline u32 failed_checks = 0;
+
+/*
+  prints result of the test program, its return value is exit code of main
+*/
+inline int finish(std::string_view name) {
+  log::flush();
+  if (failed_checks > 0) {
+    fmt::println(stderr, "{}: {} checks failed", name, failed_checks);
+    return EXIT_FAILURE;
+  }
+  fmt::println("{}: passed", name);
+  return EXIT_SUCCESS;
+}
+
+} // namespace whim::test
+
+// failed check is reported and counted, test goes on so one run shows every failure
+#define WCHECK(exp, msg)                                                                                                \
+  do {                                                                                                                  \
+    if (!(exp)) {                                                                                                       \
+      ::whim::log::flush();                                                                                             \
+      fmt::println(stderr, "[CHECK] {} \n    Expected: {} \n    Source: {}, line: {}", (msg), #exp, __FILE__, __LINE__); \
+      ::whim::test::failed_checks += 1;                                                                                 \
+    }                                                                                                                   \
+  } while (false)
@@ -0,0 +1,168 @@
+/*
+  vertex layout test
+
+  packs a small scene into every layout and decodes it the way hit shaders do, decoded attributes must stay
+  within quantization error of the source: interleaved is exact, octahedral snorm16 normals, half float uvs and
+  snorm16 positions (scaled by primitive extent) are checked against their step sizes
+*/
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "glm/packing.hpp"
+
+#include "scene.hpp"
+#include "test_common.hpp"
+#include "utility/thread_pool.hpp"
+#include "vertex_layout.hpp"
+
+namespace {
+
+using namespace whim;
+
+constexpr f32 snorm16_step = 1.f / 32767.f;
+// half float keeps 11 significant bits, one more is allowed for rounding
+constexpr f32 half_relative_error = 1.f / 1024.f;
+constexpr f32 half_min_normal     = 1.f / 16384.f;
+
+/*
+  same as octahedral_decode of ray_common.glsl
+*/
+glm::vec3 decode_normal(u32 encoded) {
+  glm::vec2 e = glm::unpackSnorm2x16(encoded);
+  glm::vec3 n{ e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y) };
+  f32       t = std::max(-n.z, 0.f);
+  n.x += n.x >= 0.f ? -t : t;
+  n.y += n.y >= 0.f ? -t : t;
+  return glm::normalize(n);
+}
+
+bool uv_within_error(glm::vec2 decoded, glm::vec2 uv) {
+  for (int axis = 0; axis < 2; axis += 1) {
+    if (std::abs(decoded[axis] - uv[axis]) > std::max(std::abs(uv[axis]), half_min_normal) * half_relative_error) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<typename T>
+T read_vertex(packed_vertices_t const &packed, u32 index) {
+  T value{};
+  std::memcpy(&value, packed.bytes.data() + (usize) index * sizeof(T), sizeof(T));
+  return value;
+}
+
+/*
+  primitive 0 is a random blob far from origin, primitive 1 is flat in z, primitive 2 reuses vertex range of primitive 0
+*/
+scene_data_t make_scene() {
+  std::mt19937                        rng{ 7 };
+  std::uniform_real_distribution<f32> unit{ -1.f, 1.f };
+  std::uniform_real_distribution<f32> uv{ -2.f, 4.f };
+
+  scene_data_t scene{};
+
+  auto add_primitive = [&](u32 vertex_count, glm::vec3 center, glm::vec3 extent) {
+    u32 offset = (u32) scene.positions.size();
+    for (u32 i = 0; i < vertex_count; i += 1) {
+      scene.positions.push_back(center + extent * glm::vec3{ unit(rng), unit(rng), unit(rng) });
+      glm::vec3 normal{ unit(rng), unit(rng), unit(rng) };
+      scene.normals.push_back(glm::length(normal) > 0.01f ? glm::normalize(normal) : glm::vec3{ 0.f, 0.f, -1.f });
+      scene.uvs.push_back(glm::vec2{ uv(rng), uv(rng) });
+    }
+    scene.primitive_infos.push_back(primitive_full_info{ .vertex_count = vertex_count, .vertex_offset = offset });
+  };
+
+  add_primitive(4096, glm::vec3{ 100.f, -50.f, 3.f }, glm::vec3{ 5.f, 0.5f, 20.f });
+  add_primitive(256, glm::vec3{ 0.f }, glm::vec3{ 1.f, 1.f, 0.f });
+
+  primitive_full_info shared = scene.primitive_infos[0];
+  shared.geometry_owner      = 0;
+  scene.primitive_infos.push_back(shared);
+  return scene;
+}
+
+void check_interleaved(scene_data_t const &scene, ThreadPool &pool) {
+  packed_vertices_t packed = pack_vertices(scene, vertex_layout_t::interleaved, pool);
+  WCHECK(packed.stride == sizeof(vertex) and packed.bytes.size() == scene.positions.size() * sizeof(vertex), "interleaved size");
+
+  u32 mismatches = 0;
+  for (u32 i = 0; i < scene.positions.size(); i += 1) {
+    auto v    = read_vertex<vertex>(packed, i);
+    bool same = v.pos == scene.positions[i] and v.normal == scene.normals[i] and v.texture == scene.uvs[i];
+    mismatches += same ? 0 : 1;
+  }
+  WCHECK(mismatches == 0, fmt::format("{} interleaved vertices differ", mismatches));
+}
+
+void check_compressed(scene_data_t const &scene, ThreadPool &pool) {
+  packed_vertices_t packed = pack_vertices(scene, vertex_layout_t::compressed, pool);
+  WCHECK(packed.stride == sizeof(compressed_vertex) and packed.bytes.size() == scene.positions.size() * sizeof(compressed_vertex), "compressed size");
+
+  f32 max_normal_error = 0.f;
+  u32 position_errors  = 0;
+  u32 uv_errors        = 0;
+  for (u32 i = 0; i < scene.positions.size(); i += 1) {
+    auto v           = read_vertex<compressed_vertex>(packed, i);
+    max_normal_error = std::max(max_normal_error, glm::length(decode_normal(v.normal) - scene.normals[i]));
+    position_errors += v.pos == scene.positions[i] ? 0 : 1;
+    uv_errors += uv_within_error(glm::unpackHalf2x16(v.uv), scene.uvs[i]) ? 0 : 1;
+  }
+  // octahedral fold stretches the square at most twice, so chord error stays within a few snorm steps
+  WCHECK(max_normal_error < 4.f * snorm16_step, fmt::format("normal error {} is above bound", max_normal_error));
+  WCHECK(position_errors == 0, "compressed layout keeps float positions");
+  WCHECK(uv_errors == 0, fmt::format("{} uvs are outside of half float error", uv_errors));
+}
+
+void check_quantized(scene_data_t const &scene, ThreadPool &pool) {
+  packed_vertices_t packed = pack_vertices(scene, vertex_layout_t::quantized, pool);
+  WCHECK(packed.stride == sizeof(quantized_vertex) and packed.bytes.size() == scene.positions.size() * sizeof(quantized_vertex), "quantized size");
+  WCHECK(packed.dequantize_scales.size() == scene.primitive_infos.size(), "one dequantization per primitive");
+
+  u32 position_errors = 0;
+  u32 normal_errors   = 0;
+  for (u32 primitive = 0; primitive < scene.primitive_infos.size(); primitive += 1) {
+    auto const &info   = scene.primitive_infos[primitive];
+    glm::vec3   scale  = packed.dequantize_scales[primitive];
+    glm::vec3   offset = packed.dequantize_offsets[primitive];
+    // half step of snorm rounding plus float error of the scale and offset arithmetic
+    glm::vec3 bound = scale * snorm16_step + glm::abs(offset) * 1e-6f;
+
+    for (u32 i = info.vertex_offset; i < info.vertex_offset + info.vertex_count; i += 1) {
+      auto      v        = read_vertex<quantized_vertex>(packed, i);
+      glm::vec2 xy       = glm::unpackSnorm2x16(v.pos_xy);
+      glm::vec2 zw       = glm::unpackSnorm2x16(v.pos_zw);
+      glm::vec3 position = glm::vec3{ xy.x, xy.y, zw.x } * scale + offset;
+      glm::vec3 error    = glm::abs(position - scene.positions[i]);
+      position_errors += error.x <= bound.x and error.y <= bound.y and error.z <= bound.z ? 0 : 1;
+      normal_errors += glm::length(decode_normal(v.normal) - scene.normals[i]) < 4.f * snorm16_step ? 0 : 1;
+    }
+  }
+  WCHECK(position_errors == 0, fmt::format("{} quantized positions are outside of snorm16 error", position_errors));
+  WCHECK(normal_errors == 0, fmt::format("{} quantized normals are outside of snorm16 error", normal_errors));
+  WCHECK(packed.dequantize_scales[1].z == 1.f, "flat axis keeps unit scale");
+  WCHECK(
+      packed.dequantize_scales[2] == packed.dequantize_scales[0] and packed.dequantize_offsets[2] == packed.dequantize_offsets[0], //
+      "shared geometry takes owner dequantization"
+  );
+}
+
+} // namespace
+
+int main() {
+  ThreadPool   pool{ 4 };
+  scene_data_t scene = make_scene();
+
+  check_interleaved(scene, pool);
+  check_compressed(scene, pool);
+  check_quantized(scene, pool);
+
+  for (vertex_layout_t layout : vertex_layouts) {
+    WCHECK(parse_vertex_layout(to_string(layout)) == layout, "layout names round trip");
+  }
+  WCHECK(not parse_vertex_layout("packed").has_value(), "unknown layout name is rejected");
+
+  return test::finish("vertex_layout_test");
+}